@@ -0,0 +1,93 @@
+/**
+ * \file            acquire.cpp
+ * \description     Measures the cost of acquiring and releasing a execution context of a shared
+ *                  program, which is paid each time a thread picks up a piece of work.
+ *
+ *                  A context that has been released is handed out again, which should only cost
+ *                  a lock and clearing the bindings, a few hundred nanoseconds at most. A context
+ *                  that isn't in the pool is built from scratch, which is measured separately by
+ *                  holding on to every context that is acquired.
+ */
+
+#include <vf_proto\vf.h>
+#include <vf_proto\intermediate.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+const char * pSource =
+    "in vec4 a;"
+    "in vec4 b;"
+    "uniform float r;"
+    "out vec4 c;"
+    "void main()"
+    "{"
+    "   vec4 t = a + b * r;"
+    "   c = normalize(t) * length(a);"
+    "}";
+
+static const size_t NumIterations   = 1000000;
+static const size_t NumHeld         = 64;
+
+/** Returns the number of nanoseconds since start */
+static double Elapsed(std::chrono::high_resolution_clock::time_point start)
+{
+    std::chrono::high_resolution_clock::time_point stop = std::chrono::high_resolution_clock::now();
+    return double(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count());
+}
+
+/**
+ * Acquires a context, binds the streams and releases it again NumIterations times, and returns
+ * the number of nanoseconds per acquire and release.
+ */
+static double Measure_Pooled(const vf::ByteCode_Program & program, std::shared_ptr<vf::ByteCode> bytecode)
+{
+    std::vector<float> a(4, 1.0f), b(4, 2.0f), c(4, 0.0f);
+    size_t ra = bytecode->StreamLocation("a"), rb = bytecode->StreamLocation("b"), rc = bytecode->StreamLocation("c");
+
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    for(size_t i = 0; i < NumIterations; ++i) {
+        std::shared_ptr<vf::ByteCode_Context> context = program.CreateContext();
+        context->SetRegisterPointer(ra, &a[0]);
+        context->SetRegisterPointer(rb, &b[0]);
+        context->SetRegisterPointer(rc, &c[0]);
+    }
+    return Elapsed(start) / double(NumIterations);
+}
+
+/**
+ * Acquires NumHeld contexts of a new program without releasing any of them, and returns the
+ * number of nanoseconds per context. All but the first are built from scratch.
+ */
+static double Measure_Miss(std::shared_ptr<vf::ByteCode> bytecode)
+{
+    vf::ByteCode_Program program(bytecode);
+    std::vector<std::shared_ptr<vf::ByteCode_Context> > held;
+    held.reserve(NumHeld);
+
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    for(size_t i = 0; i < NumHeld; ++i) {
+        held.push_back(program.CreateContext());
+    }
+    return Elapsed(start) / double(NumHeld);
+}
+
+int main()
+{
+    try {
+        std::shared_ptr<vf::Program> program = std::make_shared<vf::Program>(pSource);
+        std::shared_ptr<vf::ByteCode> bytecode = program->Compile();
+
+        vf::ByteCode_Program shared(bytecode);
+        cout << "elements per batch:      " << shared.GetBatchLimit() << endl;
+        cout << "acquire and release:     " << Measure_Pooled(shared, bytecode) << " ns (pooled context)" << endl;
+        cout << "acquire:                 " << Measure_Miss(bytecode) << " ns (new context)" << endl;
+    } catch (std::runtime_error& err) {
+        cerr << err.what() << endl;
+        return 1;
+    }
+    return 0;
+}
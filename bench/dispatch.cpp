@@ -0,0 +1,111 @@
+/**
+ * \file            dispatch.cpp
+ * \description     Measures the dispatch cost per instruction for short programs executed on
+ *                  small batches, where the cost of dispatching a instruction isn't hidden by the
+ *                  cost of executing it.
+ *
+ *                  The same AoS plan is measured with the steps dispatched through a switch, the
+ *                  dispatch before threading, and with threaded dispatch, which needs a compiler
+ *                  with computed goto. The difference between the two is the saving in dispatch.
+ *                  For reference the program is also measured on the SoA stream interpreter,
+ *                  which differs in layout, kernels and decoding as well, and compiled to native
+ *                  code.
+ */
+
+#include <vf_proto\vf.h>
+#include <vf_proto\intermediate.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+/** A short program, every operand is either a register or a uniform so no constants are inlined. */
+const char * pSource =
+    "in vec4 a;"
+    "in vec4 b;"
+    "uniform float r;"
+    "uniform vec4 o;"
+    "out vec4 c;"
+    "void main()"
+    "{"
+    "   vec4 t = a + b;"
+    "   t = t * r;"
+    "   t = t - o;"
+    "   t = max(t, a);"
+    "   t = min(t, b);"
+    "   c = t + o;"
+    "}";
+
+static const size_t NumElements     = 256;
+static const size_t NumIterations   = 100000;
+
+/**
+ * Executes the program NumIterations times and returns the number of nanoseconds per instruction
+ * and element, or a negative number if the dispatch isn't supported by the build.
+ */
+static double Measure(std::shared_ptr<vf::ByteCode> bytecode, vf::Layout_t layout, vf::Engine_t engine,
+    vf::Dispatch_t dispatch, std::vector<uint8_t> & scratch)
+{
+    std::vector<float> a(NumElements * 4, 1.0f), b(NumElements * 4, 2.0f), c(NumElements * 4, 0.0f);
+
+    vf::ByteCode_Execution exec(bytecode, &scratch[0], scratch.size(), layout, engine);
+    if (exec.SetDispatch(dispatch) != vf::Err_Success) {
+        return -1.0;
+    }
+    if (layout == vf::Layout_SoA) {
+        exec.SetComponentPointers(bytecode->StreamLocation("a"), &a[0], &a[NumElements], &a[2 * NumElements], &a[3 * NumElements]);
+        exec.SetComponentPointers(bytecode->StreamLocation("b"), &b[0], &b[NumElements], &b[2 * NumElements], &b[3 * NumElements]);
+        exec.SetComponentPointers(bytecode->StreamLocation("c"), &c[0], &c[NumElements], &c[2 * NumElements], &c[3 * NumElements]);
+    } else {
+        exec.SetRegisterPointer(bytecode->StreamLocation("a"), &a[0]);
+        exec.SetRegisterPointer(bytecode->StreamLocation("b"), &b[0]);
+        exec.SetRegisterPointer(bytecode->StreamLocation("c"), &c[0]);
+    }
+
+    size_t numInstructions = bytecode->GetMethods()[0]->GetCode().size();
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    for(size_t i = 0; i < NumIterations; ++i) {
+        if (exec.Execute(0, NumElements) != vf::Err_Success) {
+            throw std::runtime_error("Failed to execute the program.");
+        }
+    }
+    std::chrono::high_resolution_clock::time_point stop = std::chrono::high_resolution_clock::now();
+
+    double ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count());
+    return ns / (double(NumIterations) * double(numInstructions) * double(NumElements));
+}
+
+int main()
+{
+    std::vector<uint8_t> scratch(1024 * 100);
+
+    try {
+        std::shared_ptr<vf::Program> program = std::make_shared<vf::Program>(pSource);
+        program->SetUniform("r", 2.0);
+
+        std::shared_ptr<vf::ByteCode> bytecode = program->Compile();
+        cout << "instructions per method: " << bytecode->GetMethods()[0]->GetCode().size() << endl;
+        cout << "elements per batch:      " << NumElements << endl;
+
+        double before = Measure(bytecode, vf::Layout_AoS, vf::Engine_Interpreter, vf::Dispatch_Switch, scratch);
+        double after = Measure(bytecode, vf::Layout_AoS, vf::Engine_Interpreter, vf::Dispatch_Threaded, scratch);
+        cout << "plan, switch (AoS):      " << before << " ns/instruction/element" << endl;
+        if (after < 0.0) {
+            cout << "plan, threaded (AoS):    not supported by this build" << endl;
+        } else {
+            cout << "plan, threaded (AoS):    " << after << " ns/instruction/element" << endl;
+            cout << "dispatch saving:         " << (before - after) << " ns/instruction/element" << endl;
+        }
+
+        cout << "SoA stream interpreter:  " << Measure(bytecode, vf::Layout_SoA, vf::Engine_Interpreter,
+            vf::Dispatch_Switch, scratch) << " ns/instruction/element (other layout and kernels)" << endl;
+        cout << "native (AoS):            " << Measure(bytecode, vf::Layout_AoS, vf::Engine_JIT,
+            vf::Dispatch_Switch, scratch) << " ns/instruction/element" << endl;
+    } catch (std::runtime_error& err) {
+        cerr << err.what() << endl;
+        return 1;
+    }
+    return 0;
+}
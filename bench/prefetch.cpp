@@ -0,0 +1,194 @@
+/**
+ * \file            prefetch.cpp
+ * \description     Measures software prefetching across batches, for working sets that are far
+ *                  larger than the caches.
+ *
+ *                  The first program streams through a few large buffers, and is measured with a
+ *                  range of bytes prefetched ahead of each batch. The second program samples a
+ *                  large grid at random positions, with a sampler that prefetches the cells of the
+ *                  positions it's passed and with one that doesn't.
+ */
+
+#include <vf_proto\vf.h>
+#include <vf_proto\intermediate.hpp>
+
+#include <xmmintrin.h>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+/** Reads two streams and writes a third. */
+const char * pStreamSource =
+    "in vec4 a;"
+    "in vec4 b;"
+    "uniform float r;"
+    "out vec4 c;"
+    "void main()"
+    "{"
+    "   c = a * r + b;"
+    "}";
+
+/** Samples a grid at positions read from a stream. */
+const char * pSamplerSource =
+    "sampler s;"
+    "in vec3 p;"
+    "uniform float r;"
+    "out vec4 c;"
+    "void main()"
+    "{"
+    "   c = sample3D(s, p) * r;"
+    "}";
+
+static const size_t NumElements     = 4 * 1024 * 1024;    /**< 64 MB per stream */
+static const size_t NumIterations   = 10;
+static const size_t GridSize        = 256;                /**< 256 MB of cells */
+
+/**
+ * Nearest neighbour lookups in a grid of GridSize^3 cells, positions are in [0, 1).
+ */
+class GridSampler : public vf::ISampler
+{
+public:
+    GridSampler() : m_Cells(GridSize * GridSize * GridSize)
+    {
+        for(size_t i = 0; i < m_Cells.size(); ++i) {
+            m_Cells[i].x = m_Cells[i].y = m_Cells[i].z = m_Cells[i].w = float(i % 251);
+        }
+    }
+
+    bool sample1D(const vf::Vector *, vf::Vector *, size_t) const       { return false; }
+    bool sample1D(float, vf::Vector *, size_t) const                    { return false; }
+    bool sample2D(const vf::Vector *, vf::Vector *, size_t) const       { return false; }
+    bool sample2D(const vf::Vector2 &, vf::Vector *, size_t) const      { return false; }
+    bool sample3D(const vf::Vector3 &, vf::Vector *, size_t) const      { return false; }
+
+    bool sample3D(const vf::Vector * pos, vf::Vector * dst, size_t count) const
+    {
+        for(size_t i = 0; i < count; ++i) {
+            dst[i].u.v4 = *Cell(pos[i]);
+        }
+        return true;
+    }
+
+protected:
+    const vf::Vector4 * Cell(const vf::Vector & pos) const
+    {
+        size_t x = size_t(pos.u.v3.x * GridSize) % GridSize;
+        size_t y = size_t(pos.u.v3.y * GridSize) % GridSize;
+        size_t z = size_t(pos.u.v3.z * GridSize) % GridSize;
+        return &m_Cells[(z * GridSize + y) * GridSize + x];
+    }
+
+    std::vector<vf::Vector4> m_Cells;
+};
+
+/**
+ * The same lookups, with the cells of the upcoming positions prefetched.
+ */
+class PrefetchingGridSampler : public GridSampler, public vf::ISamplerPrefetch
+{
+public:
+    void prefetch(const vf::Vector * positions, size_t count, size_t) const
+    {
+        for(size_t i = 0; i < count; ++i) {
+            _mm_prefetch(reinterpret_cast<const char *>(Cell(positions[i])), _MM_HINT_T0);
+        }
+    }
+};
+
+/**
+ * Executes the stream program NumIterations times with a number of bytes prefetched ahead of
+ * each batch, and returns the number of nanoseconds per element.
+ */
+static double Measure_Streams(std::shared_ptr<vf::ByteCode> bytecode, size_t bytes, std::vector<uint8_t> & scratch)
+{
+    std::vector<vf::Vector4> a(NumElements), b(NumElements), c(NumElements);
+    for(size_t i = 0; i < NumElements; ++i) {
+        a[i].x = a[i].y = a[i].z = a[i].w = 1.0f;
+        b[i].x = b[i].y = b[i].z = b[i].w = 2.0f;
+    }
+
+    vf::ByteCode_Execution exec(bytecode, &scratch[0], scratch.size());
+    exec.SetRegisterPointer(bytecode->StreamLocation("a"), &a[0]);
+    exec.SetRegisterPointer(bytecode->StreamLocation("b"), &b[0]);
+    exec.SetRegisterPointer(bytecode->StreamLocation("c"), &c[0]);
+    exec.SetUniform(bytecode->UniformLocation("r"), 2.0f);
+    exec.SetPrefetch(bytes);
+
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    for(size_t i = 0; i < NumIterations; ++i) {
+        if (exec.Execute(0, NumElements) != vf::Err_Success) {
+            throw std::runtime_error("Failed to execute the program.");
+        }
+    }
+    std::chrono::high_resolution_clock::time_point stop = std::chrono::high_resolution_clock::now();
+
+    double ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count());
+    return ns / (double(NumIterations) * double(NumElements));
+}
+
+/**
+ * Executes the sampler program NumIterations times with random positions, and returns the number
+ * of nanoseconds per element.
+ */
+static double Measure_Sampler(std::shared_ptr<vf::ByteCode> bytecode, vf::ISampler * sampler, size_t bytes,
+    std::vector<uint8_t> & scratch)
+{
+    std::vector<vf::Vector4> p(NumElements), c(NumElements);
+    srand(1);
+    for(size_t i = 0; i < NumElements; ++i) {
+        p[i].x = float(rand()) / (float(RAND_MAX) + 1.0f);
+        p[i].y = float(rand()) / (float(RAND_MAX) + 1.0f);
+        p[i].z = float(rand()) / (float(RAND_MAX) + 1.0f);
+        p[i].w = 0.0f;
+    }
+
+    vf::ByteCode_Execution exec(bytecode, &scratch[0], scratch.size());
+    exec.SetRegisterPointer(bytecode->StreamLocation("p"), &p[0]);
+    exec.SetRegisterPointer(bytecode->StreamLocation("c"), &c[0]);
+    exec.SetUniform(bytecode->UniformLocation("r"), 2.0f);
+    exec.SetSampler(bytecode->SamplerLocation("s"), sampler);
+    exec.SetPrefetch(bytes);
+
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    for(size_t i = 0; i < NumIterations; ++i) {
+        if (exec.Execute(0, NumElements) != vf::Err_Success) {
+            throw std::runtime_error("Failed to execute the program.");
+        }
+    }
+    std::chrono::high_resolution_clock::time_point stop = std::chrono::high_resolution_clock::now();
+
+    double ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count());
+    return ns / (double(NumIterations) * double(NumElements));
+}
+
+int main()
+{
+    std::vector<uint8_t> scratch(1024 * 1024);
+    const size_t Bytes[] = { 0, 1024, 4096, 16384 };
+
+    try {
+        std::shared_ptr<vf::ByteCode> streams = std::make_shared<vf::Program>(pStreamSource)->Compile();
+        cout << "elements:                " << NumElements << endl;
+        for(size_t i = 0; i < sizeof(Bytes) / sizeof(Bytes[0]); ++i) {
+            cout << "streams, prefetch " << Bytes[i] << " bytes: " << Measure_Streams(streams, Bytes[i], scratch)
+                << " ns/element" << endl;
+        }
+
+        std::shared_ptr<vf::ByteCode> samples = std::make_shared<vf::Program>(pSamplerSource)->Compile();
+        GridSampler plain;
+        PrefetchingGridSampler prefetching;
+        cout << "sampler, no hook:        " << Measure_Sampler(samples, &plain, 0, scratch) << " ns/element" << endl;
+        for(size_t i = 0; i < sizeof(Bytes) / sizeof(Bytes[0]); ++i) {
+            cout << "sampler, hook, prefetch " << Bytes[i] << " bytes: "
+                << Measure_Sampler(samples, &prefetching, Bytes[i], scratch) << " ns/element" << endl;
+        }
+    } catch (std::runtime_error& err) {
+        cerr << err.what() << endl;
+        return 1;
+    }
+    return 0;
+}
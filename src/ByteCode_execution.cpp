@@ -1,8 +1,14 @@
 #include "vf.h"
 #include "vfvm.h"
 #include "vfutil.h"
+#include "vfpool.h"
+#include "vfprogram.h"
 
+#include <algorithm>
+#include <chrono>
 #include <memory>
+#include <mutex>
+#include <system_error>
 
 namespace vf
 {
@@ -12,30 +18,70 @@ namespace vf
     class ExecutionImpl
     {
     public:
-        ExecutionImpl(std::shared_ptr<vf::ByteCode>, void *, size_t);
+        ExecutionImpl(std::shared_ptr<vf::ByteCode>, void *, size_t, Layout_t, Engine_t, Precision_t);
 
         Status_t    Execute(size_t, size_t);
+        Status_t    Execute(size_t, size_t, size_t, void *, size_t) const;
+        size_t      GetScratchSize(size_t) const;
         Status_t    SetRegisterPointer(size_t, void *);
+        Status_t    SetRegisterPointer(size_t, void *, size_t, size_t);
+        Status_t    SetComponentPointers(size_t, float *, float *, float *, float *);
         Status_t    SetUniform(size_t, float);
         Status_t    SetUniform(size_t, const vf::Vector2 &);
         Status_t    SetUniform(size_t, const vf::Vector3 &);
         Status_t    SetUniform(size_t, const vf::Vector4 &);
         Status_t    SetSampler(size_t, vf::ISampler *);
+        Status_t    SetNonTemporal(size_t, bool);
+        Status_t    SetPrefetch(size_t);
+        Status_t    SetDispatch(Dispatch_t);
+        Status_t    SetThreads(size_t, size_t);
+        Status_t    SetScheduler(vf::IScheduler *, size_t);
+        Status_t    SetTiling(Tiling_t);
+        Status_t    Reserve_Workers(size_t);
+        Status_t    Reserve_Staging();
+        Status_t    Execute_Worker(size_t, size_t, size_t, size_t);
+        size_t      GetBatchLimit() const;
+        ExecutionStats GetStats() const;
 
     protected:
+        Status_t    Check_Method(size_t) const;
+        Status_t    Execute_Method(size_t, size_t);
+        Status_t    Evaluate_Uniforms(size_t);
+        Status_t    Update_Uniforms();
+
+        std::shared_ptr<const vf::CompiledProgram> m_pProgram;  /**< the verified methods and their plans */
         std::shared_ptr<vf::ByteCode>           m_pBytecode;
         std::shared_ptr<vf::VirtualMachine>     m_pVirtualMachine;
-        vfutil::Bitmap                          m_IoMap;
-        size_t                                  m_BatchLimit;
+        std::shared_ptr<vf::SoA_VirtualMachine> m_pSoAMachine;
+        size_t                                  m_BatchLimit;   /**< the number of elements executed at once */
+        size_t                                  m_Capacity;     /**< the number of elements that the temporary registers can hold */
+        Layout_t                                m_Layout;
+        std::shared_ptr<vf::ThreadPool>         m_pPool;        /**< the threads started by SetThreads */
+        vf::IScheduler *                        m_pScheduler;   /**< null when executing on the calling thread */
+        std::vector<std::shared_ptr<vf::VirtualMachine> > m_Workers;    /**< one machine per additional thread */
+        std::vector<std::vector<uint8_t> >      m_WorkerMemory; /**< temporary registers and predicate of each worker */
+        std::vector<std::vector<vf::Vector> >   m_Staging;      /**< packed elements of the strided streams of each machine */
+        size_t                                  m_GrainSize;
+        Tiling_t                                m_Tiling;
+        std::vector<size_t>                     m_Candidates;   /**< batch limits that are timed when autotuning */
+        std::vector<double>                     m_Timings;      /**< the best time per element of each candidate */
+        size_t                                  m_Trial;        /**< the number of timed executions */
+        uint8_t *                               m_pTemporaries; /**< the temporary registers of the calling thread */
+        mutable std::mutex                      m_RangeLock;
+        mutable std::vector<std::shared_ptr<vf::VirtualMachine> > m_RangeMachines; /**< idle machines of the ranged executions */
+    };
+
+    enum {
+        TILE_TRIALS         = 3     /**< the number of times each candidate is timed when autotuning */
     };
 
     /*************************************************************************/
     /*                              ByteCode_Execution                       */
     /*************************************************************************/
-    ByteCode_Execution::ByteCode_Execution(
-        std::shared_ptr<vf::ByteCode> pByteCode, void * ptrMem, size_t nMemSize)
+    ByteCode_Execution::ByteCode_Execution(std::shared_ptr<vf::ByteCode> pByteCode, void * ptrMem, size_t nMemSize,
+        Layout_t layout, Engine_t engine, Precision_t precision)
     {
-        m_pImpl = std::make_shared<ExecutionImpl>(pByteCode, ptrMem, nMemSize);
+        m_pImpl = std::make_shared<ExecutionImpl>(pByteCode, ptrMem, nMemSize, layout, engine, precision);
     }
 
     ByteCode_Execution::~ByteCode_Execution()
@@ -47,6 +93,16 @@ namespace vf
         return m_pImpl->SetRegisterPointer(index, ptrMemory);
     }
 
+    Status_t ByteCode_Execution::SetRegisterPointer(size_t index, void * ptrMemory, size_t stride, size_t numComponents)
+    {
+        return m_pImpl->SetRegisterPointer(index, ptrMemory, stride, numComponents);
+    }
+
+    Status_t ByteCode_Execution::SetComponentPointers(size_t index, float * x, float * y, float * z, float * w)
+    {
+        return m_pImpl->SetComponentPointers(index, x, y, z, w);
+    }
+
     Status_t ByteCode_Execution::SetUniform(size_t index, float value)
     {
         return m_pImpl->SetUniform(index, value);
@@ -72,74 +128,246 @@ namespace vf
         return m_pImpl->SetSampler(index, sampler);
     }
 
+    Status_t ByteCode_Execution::SetNonTemporal(size_t index, bool enable)
+    {
+        return m_pImpl->SetNonTemporal(index, enable);
+    }
+
+    Status_t ByteCode_Execution::SetPrefetch(size_t bytes)
+    {
+        return m_pImpl->SetPrefetch(bytes);
+    }
+
+    Status_t ByteCode_Execution::SetDispatch(Dispatch_t dispatch)
+    {
+        return m_pImpl->SetDispatch(dispatch);
+    }
+
+    Status_t ByteCode_Execution::SetThreads(size_t numThreads, size_t grainSize)
+    {
+        return m_pImpl->SetThreads(numThreads, grainSize);
+    }
+
+    Status_t ByteCode_Execution::SetTiling(Tiling_t tiling)
+    {
+        return m_pImpl->SetTiling(tiling);
+    }
+
+    Status_t ByteCode_Execution::SetScheduler(IScheduler * scheduler, size_t grainSize)
+    {
+        return m_pImpl->SetScheduler(scheduler, grainSize);
+    }
+
+    ExecutionStats ByteCode_Execution::GetStats() const
+    {
+        return m_pImpl->GetStats();
+    }
+
     Status_t ByteCode_Execution::Execute(size_t methodIndex, size_t batchSize)
     {
         return m_pImpl->Execute(methodIndex, batchSize);
     }
 
+    Status_t ByteCode_Execution::Execute(size_t methodIndex, size_t begin, size_t count, void * scratch,
+        size_t scratchSize) const
+    {
+        return m_pImpl->Execute(methodIndex, begin, count, scratch, scratchSize);
+    }
+
+    size_t ByteCode_Execution::GetScratchSize(size_t numElements) const
+    {
+        return m_pImpl->GetScratchSize(numElements);
+    }
+
+    Status_t ByteCode_Execution::Reserve_Workers(size_t numWorkers)
+    {
+        return m_pImpl->Reserve_Workers(numWorkers);
+    }
+
+    Status_t ByteCode_Execution::Execute_Worker(size_t methodIndex, size_t begin, size_t end, size_t worker)
+    {
+        return m_pImpl->Execute_Worker(methodIndex, begin, end, worker);
+    }
+
+    size_t ByteCode_Execution::GetBatchLimit() const
+    {
+        return m_pImpl->GetBatchLimit();
+    }
+
     /*************************************************************************/
     /*                              Execution_Impl                           */
     /*************************************************************************/
 
     /**
      * Constructor, performs the required initialization such as assigning memory to
-     * temporary registers.
+     * temporary registers. In the SoA layout each temporary register is divided into
+     * four component planes. The bytecode is verified and translated once by the compiled
+     * program, invalid methods are never executed.
      */
-    ExecutionImpl::ExecutionImpl(std::shared_ptr<vf::ByteCode> bytecode, void * ptrMem, size_t MemSize) 
-        : m_pBytecode(bytecode), m_IoMap(bytecode->GetNumRegisters())
+    ExecutionImpl::ExecutionImpl(std::shared_ptr<vf::ByteCode> bytecode, void * ptrMem, size_t MemSize, Layout_t layout,
+        Engine_t engine, Precision_t precision)
+        : m_pBytecode(bytecode), m_Layout(layout), m_pScheduler(nullptr), m_GrainSize(0),
+        m_Tiling(Tiling_Cache), m_Trial(0), m_pTemporaries((uint8_t *) ptrMem)
     {
-        // Mark each i/o register in the io map.
-        const std::map<std::string, vf::Variable> & ioStreams = bytecode->GetInputOutput();
-        for(std::map<std::string, vf::Variable>::const_iterator it = ioStreams.begin(); 
-            it != ioStreams.end(); 
-            it++)
-        {
-            m_IoMap.Set(it->second.m_Register);
-        }
-
-        m_pVirtualMachine = std::make_shared<vf::VirtualMachine>
-            (
-            m_IoMap,
-            bytecode->GetNumRegisters(),
-            bytecode->GetNumUniforms(),
-            bytecode->GetNumSamplers()
-            );
-
-        // Divide the memory to the temporary registers. The amount of memory set the upper limit
-        // on how large each batch size may be.
-        size_t NumTemps     = bytecode->GetNumRegisters() - ioStreams.size();
-        m_BatchLimit        = MemSize / ((16 * NumTemps) + 1);
-        if (m_BatchLimit == 0) {
+        // Divide the memory to the temporary registers and the predicate, which has one bit per
+        // element. The amount of memory set the upper limit on how large each batch size may be.
+        size_t NumTemps     = bytecode->GetNumRegisters() - bytecode->GetInputOutput().size();
+        m_Capacity          = MemSize ? (((MemSize - 1) * 8) / ((128 * NumTemps) + 1)) : 0;
+        m_BatchLimit        = m_Capacity;
+        if (m_Capacity == 0) {
             throw std::runtime_error("Not enough memory reserved.");
         }
+
+        m_pProgram = std::make_shared<vf::CompiledProgram>(bytecode, layout, engine, precision);
+        const vfutil::Bitmap & IoMap = m_pProgram->iomap;
+        if (m_Layout == Layout_SoA) {
+            m_pSoAMachine = std::make_shared<vf::SoA_VirtualMachine>
+                (
+                IoMap,
+                bytecode->GetNumRegisters(),
+                bytecode->GetNumUniforms(),
+                bytecode->GetNumSamplers(),
+                ISA_Auto,
+                precision
+                );
+        } else {
+            m_pVirtualMachine = std::make_shared<vf::VirtualMachine>
+                (
+                IoMap,
+                bytecode->GetNumRegisters(),
+                bytecode->GetNumUniforms(),
+                bytecode->GetNumSamplers(),
+                ISA_Auto,
+                precision
+                );
+        }
+
         /** Divide the memory to non i/o stream registers. */
         uint8_t * ptr = (uint8_t *) ptrMem;
-        if (NumTemps) {
+        if (m_Layout == Layout_SoA) {
             for(size_t i = 0, num = bytecode->GetNumRegisters(); i < num; ++i) {
-                if (!m_IoMap.Get(i)) {
-                    m_pVirtualMachine->SetRegisterPointer(i, ptr);
-                    ptr += (m_BatchLimit * 16);
+                if (!IoMap.Get(i)) {
+                    float * planes = (float *) ptr;
+                    m_pSoAMachine->SetRegisterPointer(i, planes, planes + m_Capacity,
+                        planes + (2 * m_Capacity), planes + (3 * m_Capacity));
+                    ptr += (m_Capacity * 16);
                 }
             }
+            /** Assign memory to the predicate. */
+            m_pSoAMachine->SetFlagPointer(ptr);
+        } else {
+            m_pProgram->AssignTemporaries(*m_pVirtualMachine, ptr, m_Capacity);
         }
-        /** Assign memory to the status register. */
-        m_pVirtualMachine->SetFlagPointer(ptr);
+
+        /** Execute batches that fits in the cache, rather than as large as the memory allows. */
+        SetTiling(Tiling_Cache);
+        Update_Uniforms();
     }
 
     /**
-     * Executes the method specified by the MethodIndex
+     * Returns the status of a method, and checks that the streams and samplers that it refers to
+     * are bound. The batches of a method that passes are executed without any checks.
+     */
+    Status_t ExecutionImpl::Check_Method(size_t MethodIndex) const
+    {
+        if (m_Layout == Layout_AoS) {
+            return m_pProgram->Check_Method(*m_pVirtualMachine, MethodIndex);
+        }
+        if (m_pProgram->status[MethodIndex] != Err_Success) {
+            return m_pProgram->status[MethodIndex];
+        }
+        return m_pSoAMachine->Check_Bindings(m_pProgram->bindings[MethodIndex]);
+    }
+
+    /**
+     * Executes the method specified by the MethodIndex. When autotuning, the first executions
+     * that are large enough to be divided into several batches are timed with each of the
+     * candidate batch limits, after which the fastest candidate is kept.
      */
     Status_t ExecutionImpl::Execute(size_t MethodIndex, size_t batchSize)
+    {
+        size_t numTrials = m_Candidates.size() * TILE_TRIALS;
+        if ((m_Trial >= numTrials) || (batchSize < 2 * m_Candidates.back())) {
+            return Execute_Method(MethodIndex, batchSize);
+        }
+
+        size_t candidate = m_Trial % m_Candidates.size();
+        m_BatchLimit = m_Candidates[candidate];
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        Status_t err = Execute_Method(MethodIndex, batchSize);
+        std::chrono::steady_clock::time_point stop = std::chrono::steady_clock::now();
+        if (err != Err_Success) {
+            return err;
+        }
+
+        double elapsed = std::chrono::duration<double>(stop - start).count() / double(batchSize);
+        if ((m_Timings[candidate] < 0.0) || (elapsed < m_Timings[candidate])) {
+            m_Timings[candidate] = elapsed;
+        }
+        if (++m_Trial == numTrials) {
+            size_t best = 0;
+            for(size_t i = 1; i < m_Candidates.size(); ++i) {
+                best = (m_Timings[i] < m_Timings[best]) ? i : best;
+            }
+            m_BatchLimit = m_Candidates[best];
+        }
+        return Err_Success;
+    }
+
+    /**
+     * Executes a method for batchSize elements. When several threads are used the elements
+     * are divided into ranges of at least m_GrainSize elements, each worker executes the ranges
+     * it claims with its own temporary registers.
+     */
+    Status_t ExecutionImpl::Execute_Method(size_t MethodIndex, size_t batchSize)
     {
         const std::vector<std::shared_ptr<ByteCode_Method> > & methods = m_pBytecode->GetMethods();
         if (MethodIndex >= methods.size()) {
             return Err_InvalidIndex;
         }
+        Status_t status = Check_Method(MethodIndex);
+        if (status != Err_Success) {
+            return status;
+        }
+
+        if (m_Layout == Layout_AoS) {
+            const vf::CompiledProgram & program = *m_pProgram;
+            if (!m_pScheduler || (batchSize < 2 * m_GrainSize)) {
+                return program.Execute_Range(*m_pVirtualMachine, MethodIndex, 0, batchSize, m_BatchLimit);
+            }
+
+            // A few ranges per thread, so that threads that are delayed doesn't hold up the others.
+            // The ranges are whole batches, so the elements are batched the same way as on one thread.
+            size_t numThreads   = m_pScheduler->NumWorkers();
+            size_t rangeSize    = (batchSize + (4 * numThreads) - 1) / (4 * numThreads);
+            if (rangeSize < m_GrainSize) {
+                rangeSize = m_GrainSize;
+            }
+            rangeSize = ((rangeSize + m_BatchLimit - 1) / m_BatchLimit) * m_BatchLimit;
+            size_t numRanges = (batchSize + rangeSize - 1) / rangeSize;
+            std::vector<Status_t> status(numThreads, Err_Success);
+            m_pScheduler->ParallelFor(numRanges, [&](size_t range, size_t worker) {
+                vf::VirtualMachine & vm = worker ? *m_Workers[worker - 1] : *m_pVirtualMachine;
+                size_t begin = range * rangeSize;
+                size_t end = ((begin + rangeSize) < batchSize) ? (begin + rangeSize) : batchSize;
+                Status_t err = program.Execute_Range(vm, MethodIndex, begin, end, m_BatchLimit);
+                if (err != Err_Success) {
+                    status[worker] = err;
+                }
+            });
+            for(size_t i = 0; i < numThreads; ++i) {
+                if (status[i] != Err_Success) {
+                    return status[i];
+                }
+            }
+            return Err_Success;
+        }
 
         for(size_t offset = 0; offset < batchSize; offset += m_BatchLimit) {
             size_t remaining = batchSize - offset;
             InstructionStream stream(methods[MethodIndex]->GetCode());
-            Status_t err = m_pVirtualMachine->Execute(stream, remaining > m_BatchLimit ? m_BatchLimit : remaining, offset);
+            size_t count = remaining > m_BatchLimit ? m_BatchLimit : remaining;
+            Status_t err = m_pSoAMachine->Execute(stream, count, offset);
             if (err != Err_Success) {
                 return err;
             }
@@ -147,51 +375,518 @@ namespace vf
         return Err_Success;
     }
 
+    /**
+     * Executes a method for the elements [begin, begin + count) on the calling thread, with the
+     * temporary registers and predicate placed in the scratch memory. Several threads may execute
+     * ranges at the same time as long as each has scratch memory of its own and the ranges doesn't
+     * overlap in the outputs. The streams, uniforms and samplers must not be changed meanwhile,
+     * and samplers must allow concurrent calls. Only the AoS layout is supported.
+     */
+    Status_t ExecutionImpl::Execute(size_t MethodIndex, size_t begin, size_t count, void * scratch,
+        size_t scratchSize) const
+    {
+        if (m_Layout != Layout_AoS) {
+            return Err_InvalidParameter;
+        }
+        if (MethodIndex >= m_pProgram->plans.size()) {
+            return Err_InvalidIndex;
+        }
+        Status_t err = Check_Method(MethodIndex);
+        if (err != Err_Success) {
+            return err;
+        }
+
+        // The largest number of elements whose temporaries and strided streams fits in the scratch memory.
+        size_t numStrided = m_pVirtualMachine->NumStrided();
+        size_t capacity = (scratchSize * 8) / ((128 * (m_pProgram->NumTemporaries() + numStrided)) + 1);
+        while(capacity && (GetScratchSize(capacity) > scratchSize)) {
+            --capacity;
+        }
+        if (!scratch || !capacity) {
+            return Err_InvalidParameter;
+        }
+        size_t batchLimit = (capacity < m_BatchLimit) ? capacity : m_BatchLimit;
+
+        // Borrow an idle machine, there are never more than the number of threads that execute
+        // ranges at once, and bring it up to date with the bindings. The hidden uniforms were
+        // evaluated when the uniforms were set. The strided streams are packed in front of the
+        // temporaries.
+        std::shared_ptr<vf::VirtualMachine> vm;
+        {
+            std::lock_guard<std::mutex> guard(m_RangeLock);
+            if (!m_RangeMachines.empty()) {
+                vm = m_RangeMachines.back();
+                m_RangeMachines.pop_back();
+            }
+        }
+        try {
+            if (vm) {
+                vm->Copy_Bindings(*m_pVirtualMachine);
+            } else {
+                vm = std::make_shared<vf::VirtualMachine>(*m_pVirtualMachine);
+            }
+        } catch(std::bad_alloc &) {
+            return Err_AllocationError;
+        }
+        uint8_t * temporaries = (uint8_t *) scratch + (capacity * 16 * numStrided);
+        vm->SetStagingPointer(scratch, capacity * numStrided);
+        m_pProgram->AssignTemporaries(*vm, temporaries, capacity);
+        err = m_pProgram->Execute_Range(*vm, MethodIndex, begin, begin + count, batchLimit);
+
+        try {
+            std::lock_guard<std::mutex> guard(m_RangeLock);
+            m_RangeMachines.push_back(vm);
+        } catch(std::bad_alloc &) {
+        }
+        return err;
+    }
+
+    /**
+     * Returns the number of bytes of scratch memory that executes numElements elements at once,
+     * the packed elements of the strided streams that are bound, the temporary registers and
+     * last the predicate.
+     */
+    size_t ExecutionImpl::GetScratchSize(size_t numElements) const
+    {
+        size_t numStrided = m_pVirtualMachine ? m_pVirtualMachine->NumStrided() : 0;
+        return (numElements * 16 * (m_pProgram->NumTemporaries() + numStrided)) + Predicate_Bytes(numElements);
+    }
+
+    /**
+     * Sets the number of threads that executes each method, zero uses one thread per hardware
+     * thread. Batches smaller than two grains are executed on the calling thread. Each additional
+     * thread gets its own temporary registers and predicate, so this is only supported in the AoS layout.
+     * Samplers must allow concurrent calls when more than one thread is used.
+     */
+    Status_t ExecutionImpl::SetThreads(size_t numThreads, size_t grainSize)
+    {
+        if (numThreads == 0) {
+            numThreads = std::thread::hardware_concurrency();
+            numThreads = numThreads ? numThreads : 1;
+        }
+        if (grainSize == 0) {
+            return Err_InvalidParameter;
+        }
+        Status_t err = Reserve_Workers(numThreads);
+        if (err != Err_Success) {
+            return err;
+        }
+
+        m_pPool.reset();
+        m_pScheduler = nullptr;
+        m_GrainSize = grainSize;
+        if (numThreads > 1) {
+            try {
+                m_pPool = std::make_shared<vf::ThreadPool>(numThreads);
+            } catch(std::system_error &) {
+                return Err_AllocationError;
+            }
+            m_pScheduler = m_pPool.get();
+        }
+        return Err_Success;
+    }
+
+    /**
+     * Executes each method on the workers of a scheduler that is provided by the application,
+     * null executes on the calling thread. The scheduler must outlive the execution, or be
+     * replaced before it's destroyed. Each worker gets its own temporary registers and predicate
+     * the same way as with SetThreads.
+     */
+    Status_t ExecutionImpl::SetScheduler(vf::IScheduler * scheduler, size_t grainSize)
+    {
+        if ((grainSize == 0) || (scheduler && !scheduler->NumWorkers())) {
+            return Err_InvalidParameter;
+        }
+        Status_t err = Reserve_Workers(scheduler ? scheduler->NumWorkers() : 1);
+        if (err != Err_Success) {
+            return err;
+        }
+        m_pPool.reset();
+        m_pScheduler = scheduler;
+        m_GrainSize = grainSize;
+        return Err_Success;
+    }
+
+    /**
+     * Makes sure that there is a machine for each of numWorkers workers, worker zero is the
+     * machine that executes on the calling thread. Each worker starts out as a copy of the
+     * machine, with the same streams, uniforms and samplers.
+     */
+    Status_t ExecutionImpl::Reserve_Workers(size_t numWorkers)
+    {
+        if ((m_Layout != Layout_AoS) && (numWorkers > 1)) {
+            return Err_InvalidParameter;
+        }
+        size_t NumTemps = m_pProgram->NumTemporaries();
+        try {
+            while((m_Workers.size() + 1) < numWorkers) {
+                std::vector<uint8_t> memory((m_Capacity * 16 * NumTemps) + Predicate_Bytes(m_Capacity));
+                std::shared_ptr<vf::VirtualMachine> vm = std::make_shared<vf::VirtualMachine>(*m_pVirtualMachine);
+                m_pProgram->AssignTemporaries(*vm, &memory[0], m_Capacity);
+                m_WorkerMemory.push_back(std::vector<uint8_t>());
+                m_WorkerMemory.back().swap(memory);
+                m_Workers.push_back(vm);
+            }
+        } catch(std::bad_alloc &) {
+            return Err_AllocationError;
+        }
+        return Reserve_Staging();
+    }
+
+    /**
+     * Makes sure that each machine has memory of its own for the packed elements of the strided
+     * streams that are bound, enough for the largest batch. The memory is reserved when the
+     * streams are bound, never while executing.
+     */
+    Status_t ExecutionImpl::Reserve_Staging()
+    {
+        size_t numElements = m_pVirtualMachine ? (m_pVirtualMachine->NumStrided() * m_Capacity) : 0;
+        if (!numElements) {
+            return Err_Success;
+        }
+        try {
+            m_Staging.resize(m_Workers.size() + 1);
+            for(size_t i = 0; i < m_Staging.size(); ++i) {
+                if (m_Staging[i].size() < numElements) {
+                    m_Staging[i].resize(numElements);
+                }
+                vf::VirtualMachine & vm = i ? *m_Workers[i - 1] : *m_pVirtualMachine;
+                vm.SetStagingPointer(&m_Staging[i][0], m_Staging[i].size());
+            }
+        } catch(std::bad_alloc &) {
+            return Err_AllocationError;
+        }
+        return Err_Success;
+    }
+
+    /**
+     * Executes a method for the elements [begin, end) with the machine of a worker. Different
+     * workers may execute concurrently, as long as the ranges doesn't overlap.
+     */
+    Status_t ExecutionImpl::Execute_Worker(size_t MethodIndex, size_t begin, size_t end, size_t worker)
+    {
+        if ((MethodIndex >= m_pProgram->plans.size()) || (m_Layout != Layout_AoS)) {
+            return (m_Layout != Layout_AoS) ? Err_InvalidParameter : Err_InvalidIndex;
+        }
+        if (worker > m_Workers.size()) {
+            return Err_InvalidParameter;
+        }
+        Status_t err = Check_Method(MethodIndex);
+        if (err != Err_Success) {
+            return err;
+        }
+        return m_pProgram->Execute_Range(worker ? *m_Workers[worker - 1] : *m_pVirtualMachine, MethodIndex, begin, end,
+            m_BatchLimit);
+    }
+
+    /**
+     * Executes the prologue of a method for a single element, and assigns the values it leaves
+     * in its registers to the hidden uniforms that the method reads, in every machine. The
+     * prologue uses the temporary registers of the calling thread, so it must not run while
+     * workers are executing.
+     */
+    Status_t ExecutionImpl::Evaluate_Uniforms(size_t MethodIndex)
+    {
+        const std::vector<int> & prologues = m_pProgram->prologues;
+        if ((MethodIndex >= prologues.size()) || (prologues[MethodIndex] < 0)) {
+            return (MethodIndex >= prologues.size()) ? Err_InvalidIndex : Err_Success;
+        }
+        size_t prologue = prologues[MethodIndex];
+        Status_t err = Check_Method(prologue);
+        if (err != Err_Success) {
+            return err;
+        }
+        if (m_Layout == Layout_AoS) {
+            err = m_pVirtualMachine->Execute_Unchecked(m_pProgram->plans[prologue], 1, 0);
+        } else {
+            InstructionStream stream(m_pBytecode->GetMethods()[prologue]->GetCode());
+            err = m_pSoAMachine->Execute(stream, 1, 0);
+        }
+        if (err != Err_Success) {
+            return err;
+        }
+
+        // In the SoA layout the components are located in separate planes.
+        size_t stride = (m_Layout == Layout_AoS) ? 1 : m_Capacity;
+        const std::vector<vf::Variable> & hoisted = m_pProgram->hoisted[MethodIndex];
+        for(size_t i = 0; (i < hoisted.size()) && (err == Err_Success); ++i) {
+            const float * ptr = m_pProgram->Temporary(m_pTemporaries, m_Capacity, hoisted[i].m_Register);
+            vf::Vector value;
+            for(size_t c = 0; c < 4; ++c) {
+                value[c] = ptr[c * stride];
+            }
+            if (m_Layout == Layout_SoA) {
+                err = Assign_Uniform(*m_pSoAMachine, hoisted[i], value);
+                continue;
+            }
+            for(size_t w = 0; w < m_Workers.size(); ++w) {
+                Assign_Uniform(*m_Workers[w], hoisted[i], value);
+            }
+            err = Assign_Uniform(*m_pVirtualMachine, hoisted[i], value);
+        }
+        return err;
+    }
+
+    /**
+     * Evaluates the hidden uniforms of every method, after the uniforms that they are computed
+     * from has been set. The methods, and the ranges executed concurrently, only read them.
+     */
+    Status_t ExecutionImpl::Update_Uniforms()
+    {
+        for(size_t i = 0; i < m_pProgram->prologues.size(); ++i) {
+            if (m_pProgram->status[i] != Err_Success) {
+                continue;
+            }
+            Status_t err = Evaluate_Uniforms(i);
+            if (err != Err_Success) {
+                return err;
+            }
+        }
+        return Err_Success;
+    }
+
+    /** Returns the largest number of elements that are executed at once */
+    size_t ExecutionImpl::GetBatchLimit() const
+    {
+        return m_BatchLimit;
+    }
+
+    /**
+     * Returns how the methods are executed. The prologues that evaluates the hidden uniforms
+     * aren't counted, nor the methods that failed verification.
+     */
+    ExecutionStats ExecutionImpl::GetStats() const
+    {
+        ExecutionStats stats = ExecutionStats();
+        stats.layout        = m_Layout;
+        stats.engine        = m_pProgram->engine;
+        stats.precision     = m_pProgram->precision;
+        stats.tiling        = m_Tiling;
+        stats.batchLimit    = m_BatchLimit;
+        stats.numThreads    = m_pScheduler ? m_pScheduler->NumWorkers() : 1;
+
+        const std::vector<std::shared_ptr<ByteCode_Method> > & methods = m_pBytecode->GetMethods();
+        for(size_t i = 0; i < methods.size(); ++i) {
+            if ((m_pProgram->status[i] != Err_Success) || (methods[i]->GetName().compare(0, 1, "$") == 0)) {
+                continue;
+            }
+            if (m_Layout != Layout_AoS) {
+                stats.numInterpreted++;
+            } else if (m_pProgram->plans[i].kernel) {
+                stats.numNative++;
+            } else if (m_pProgram->plans[i].native) {
+                stats.numCompiled++;
+            } else {
+                stats.numInterpreted++;
+            }
+        }
+        return stats;
+    }
+
+    /**
+     * Selects how the number of elements executed at once is chosen. The batch limit never
+     * exceeds the number of elements that the temporary register memory can hold.
+     */
+    Status_t ExecutionImpl::SetTiling(Tiling_t tiling)
+    {
+        m_Tiling = tiling;
+        m_Candidates.clear();
+        m_Timings.clear();
+        m_Trial = 0;
+
+        switch(tiling) {
+        case Tiling_Memory:
+            m_BatchLimit = m_Capacity;
+            break;
+        case Tiling_Cache:
+            m_BatchLimit = m_pProgram->Tile_FromCache(m_Capacity);
+            break;
+        case Tiling_Autotune:
+            {
+                // Candidates from a quarter to four times the cache based size, in increasing order.
+                m_BatchLimit = m_pProgram->Tile_FromCache(m_Capacity);
+                for(size_t scale = 1; scale <= 16; scale *= 2) {
+                    size_t candidate = (m_BatchLimit * scale) / 4;
+                    if ((candidate >= TILE_MIN_ELEMENTS) && (candidate <= m_Capacity)) {
+                        m_Candidates.push_back(candidate);
+                    }
+                }
+                if (m_Candidates.empty()) {
+                    m_Candidates.push_back(m_BatchLimit);
+                }
+                m_Timings.resize(m_Candidates.size(), -1.0);
+            }
+            break;
+        default:
+            return Err_InvalidParameter;
+        }
+        return Err_Success;
+    }
+
     Status_t ExecutionImpl::SetRegisterPointer(size_t index, void * ptrData)
     {
-        if ((index > m_pBytecode->GetNumRegisters()) || (!m_IoMap.Get(index))) {
+        if ((index >= m_pBytecode->GetNumRegisters()) || (!m_pProgram->iomap.Get(index))) {
             return Err_InvalidRegister;
         }
+        if (m_Layout != Layout_AoS) {
+            return Err_InvalidParameter;
+        }
+        for(size_t i = 0; i < m_Workers.size(); ++i) {
+            m_Workers[i]->SetRegisterPointer(index, ptrData);
+        }
         return m_pVirtualMachine->SetRegisterPointer(index, ptrData);
     }
 
+    /**
+     * Assigns a strided stream in the AoS layout. The machine checks the stride and the number
+     * of components before the workers are given the stream. Each machine gets room for the
+     * packed elements of the stream.
+     */
+    Status_t ExecutionImpl::SetRegisterPointer(size_t index, void * ptrData, size_t stride, size_t numComponents)
+    {
+        if ((index >= m_pBytecode->GetNumRegisters()) || (!m_pProgram->iomap.Get(index))) {
+            return Err_InvalidRegister;
+        }
+        if (m_Layout != Layout_AoS) {
+            return Err_InvalidParameter;
+        }
+        Status_t err = m_pVirtualMachine->SetRegisterPointer(index, ptrData, stride, numComponents);
+        if (err != Err_Success) {
+            return err;
+        }
+        for(size_t i = 0; i < m_Workers.size(); ++i) {
+            m_Workers[i]->SetRegisterPointer(index, ptrData, stride, numComponents);
+        }
+        return Reserve_Staging();
+    }
+
+    /**
+     * Assigns a stream in the SoA layout, one pointer per component. Components that
+     * the stream doesn't use may be null.
+     */
+    Status_t ExecutionImpl::SetComponentPointers(size_t index, float * x, float * y, float * z, float * w)
+    {
+        if ((index >= m_pBytecode->GetNumRegisters()) || (!m_pProgram->iomap.Get(index))) {
+            return Err_InvalidRegister;
+        }
+        if ((m_Layout != Layout_SoA) || !x) {
+            return Err_InvalidParameter;
+        }
+        return m_pSoAMachine->SetRegisterPointer(index, x, y, z, w);
+    }
+
     Status_t ExecutionImpl::SetUniform(size_t index, float value)
     {
-        if (index > m_pBytecode->GetNumUniforms()) {
+        if (index >= m_pBytecode->GetNumUniforms()) {
             return Err_InvalidRegister;
         }
-        return m_pVirtualMachine->SetUniform(index, value);
+        for(size_t i = 0; i < m_Workers.size(); ++i) {
+            m_Workers[i]->SetUniform(index, value);
+        }
+        Status_t err = (m_Layout == Layout_SoA) ? m_pSoAMachine->SetUniform(index, value) :
+            m_pVirtualMachine->SetUniform(index, value);
+        return (err == Err_Success) ? Update_Uniforms() : err;
     }
 
     Status_t ExecutionImpl::SetUniform(size_t index, const vf::Vector2 & value)
     {
-        if (index > m_pBytecode->GetNumUniforms()) {
+        if (index >= m_pBytecode->GetNumUniforms()) {
             return Err_InvalidRegister;
         }
-        return m_pVirtualMachine->SetUniform(index, value);
+        for(size_t i = 0; i < m_Workers.size(); ++i) {
+            m_Workers[i]->SetUniform(index, value);
+        }
+        Status_t err = (m_Layout == Layout_SoA) ? m_pSoAMachine->SetUniform(index, value) :
+            m_pVirtualMachine->SetUniform(index, value);
+        return (err == Err_Success) ? Update_Uniforms() : err;
     }
 
     Status_t ExecutionImpl::SetUniform(size_t index, const vf::Vector3 & value)
     {
-        if (index > m_pBytecode->GetNumUniforms()) {
+        if (index >= m_pBytecode->GetNumUniforms()) {
             return Err_InvalidRegister;
         }
-        return m_pVirtualMachine->SetUniform(index, value);
+        for(size_t i = 0; i < m_Workers.size(); ++i) {
+            m_Workers[i]->SetUniform(index, value);
+        }
+        Status_t err = (m_Layout == Layout_SoA) ? m_pSoAMachine->SetUniform(index, value) :
+            m_pVirtualMachine->SetUniform(index, value);
+        return (err == Err_Success) ? Update_Uniforms() : err;
     }
 
     Status_t ExecutionImpl::SetUniform(size_t index, const vf::Vector4 & value)
     {
-        if (index > m_pBytecode->GetNumUniforms()) {
+        if (index >= m_pBytecode->GetNumUniforms()) {
             return Err_InvalidRegister;
         }
-        return m_pVirtualMachine->SetUniform(index, value);
+        for(size_t i = 0; i < m_Workers.size(); ++i) {
+            m_Workers[i]->SetUniform(index, value);
+        }
+        Status_t err = (m_Layout == Layout_SoA) ? m_pSoAMachine->SetUniform(index, value) :
+            m_pVirtualMachine->SetUniform(index, value);
+        return (err == Err_Success) ? Update_Uniforms() : err;
     }
 
     Status_t ExecutionImpl::SetSampler(size_t index, vf::ISampler * sampler)
     {
-        if (index > m_pBytecode->GetNumSamplers()) {
+        if (index >= m_pBytecode->GetNumSamplers()) {
+            return Err_InvalidRegister;
+        }
+        for(size_t i = 0; i < m_Workers.size(); ++i) {
+            m_Workers[i]->SetSampler(index, sampler);
+        }
+        return (m_Layout == Layout_SoA) ? m_pSoAMachine->SetSampler(index, sampler) :
+            m_pVirtualMachine->SetSampler(index, sampler);
+    }
+
+    /**
+     * Selects if a stream that is only written is stored with non-temporal stores. The SoA layout
+     * always stores through the cache.
+     */
+    Status_t ExecutionImpl::SetNonTemporal(size_t index, bool enable)
+    {
+        if ((index >= m_pBytecode->GetNumRegisters()) || (!m_pProgram->iomap.Get(index))) {
             return Err_InvalidRegister;
         }
-        return m_pVirtualMachine->SetSampler(index, sampler);
+        if (m_Layout != Layout_AoS) {
+            return Err_Success;
+        }
+        for(size_t i = 0; i < m_Workers.size(); ++i) {
+            m_Workers[i]->SetNonTemporal(index, enable);
+        }
+        return m_pVirtualMachine->SetNonTemporal(index, enable);
+    }
+
+    /**
+     * Sets the number of bytes of each input stream that are prefetched ahead of a batch. The SoA
+     * layout decodes the bytecode as it's executed, and doesn't prefetch.
+     */
+    Status_t ExecutionImpl::SetPrefetch(size_t bytes)
+    {
+        if (m_Layout != Layout_AoS) {
+            return Err_Success;
+        }
+        for(size_t i = 0; i < m_Workers.size(); ++i) {
+            m_Workers[i]->SetPrefetch(bytes);
+        }
+        return m_pVirtualMachine->SetPrefetch(bytes);
+    }
+
+    /**
+     * Selects how the steps of the plans are dispatched, the SoA layout doesn't execute plans.
+     */
+    Status_t ExecutionImpl::SetDispatch(Dispatch_t dispatch)
+    {
+        if (m_Layout != Layout_AoS) {
+            return Err_Success;
+        }
+        Status_t err = m_pVirtualMachine->SetDispatch(dispatch);
+        if (err != Err_Success) {
+            return err;
+        }
+        for(size_t i = 0; i < m_Workers.size(); ++i) {
+            m_Workers[i]->SetDispatch(dispatch);
+        }
+        return Err_Success;
     }
 }
\ No newline at end of file
@@ -2,6 +2,8 @@
 #include "vm.hpp"
 #include "emit.hpp"
 #include "vfmath.hpp"
+#include "vfssa.h"
+#include "vfkernels.h"
 
 namespace vf
 {
@@ -29,6 +31,53 @@ namespace vf
         return static_cast<uint8_t>(pEnv->GetNumRegisters() + m_TmpRegisterOffset++);
     }
 
+    /**
+     * Returns the number of temporary registers that are dead once the instruction consuming the
+     * operands has been emitted.
+     *
+     * Temporaries are allocated as a stack while the expression tree is traversed, and each
+     * temporary is read by exactly one instruction (the one for the parent node). A operand
+     * temporary is therefore released as soon as it has been consumed, as long as it's located
+     * at the top of the stack and isn't reused as the destination.
+     *
+     * \param       base        The first temporary register.
+     * \param       top         The number of allocated temporary registers.
+     * \param       dst         The destination of the consuming instruction.
+     */
+    static size_t Num_DeadTemporaries(size_t base, size_t top, VM_Register_t dst, const ExpInfo & first,
+        const ExpInfo & second)
+    {
+        size_t numDead = 0;
+        if (top && second.isreusable && (second.reg != dst) && (second.reg == (base + top - 1))) {
+            ++numDead;
+            --top;
+        }
+        if (top && first.isreusable && (first.reg != dst) && (first.reg == (base + top - 1))) {
+            ++numDead;
+        }
+        return numDead;
+    }
+
+    static size_t Num_DeadTemporaries(size_t base, size_t top, VM_Register_t dst, const ExpInfo & first)
+    {
+        return Num_DeadTemporaries(base, top, dst, first, ExpInfo());
+    }
+
+    /**
+     * Emits the instruction of a comparison whose operands has been compiled.
+     */
+    static bool emit_comparison(IEmitSink * sink, const Node_Comparison & cond, ExpInfo & left, ExpInfo & right)
+    {
+        switch(cond.m_Type) {
+        case Node_Comparison::Op_Equal:         return emit_equal(sink, left, right);
+        case Node_Comparison::Op_Greater:       return emit_greater(sink, left, right);
+        case Node_Comparison::Op_Less:          return emit_less(sink, left, right);
+        case Node_Comparison::Op_GreaterEqual:  return emit_greater_equal(sink, left, right);
+        case Node_Comparison::Op_LessEqual:     return emit_less_equal(sink, left, right);
+        default:                                return false;
+        }
+    }
+
     /**
      * Resets the number of active temporary registers.
      */
@@ -108,6 +157,38 @@ namespace vf
             return false;
         }
 
+        /** Compile through the intermediate representation, unless the function uses
+            something that it can't represent */
+        IR_Function ir;
+        if (IR_Build(*pFunc, pEnv, m_Uniforms, ir)) {
+            IR_GetPassManager().Run(ir);
+
+            /** values that only depends on uniforms are computed once per execution by the
+                prologue, it runs on its own so its registers may overlap the temporaries */
+            uint8_t numTemporaries;
+            IR_PrologueSink * pPrologue = dynamic_cast<IR_PrologueSink *>(m_Sink);
+            IR_Function prologue;
+            if (pPrologue && IR_HoistUniforms(ir, prologue, pPrologue->FirstUniform(), pEnv->GetNumRegisters(),
+                pPrologue->hoisted))
+            {
+                uint8_t numHoisted = static_cast<uint8_t>(pPrologue->hoisted.size());
+                if (!IR_Lower(prologue, pPrologue->Prologue(), pEnv->GetNumRegisters() + numHoisted, numTemporaries)) {
+                    return false;
+                }
+                if ((numHoisted + numTemporaries) > m_MaxTempRegisters) {
+                    m_MaxTempRegisters = numHoisted + numTemporaries;
+                }
+            }
+
+            if (!IR_Lower(ir, *m_Sink, pEnv->GetNumRegisters(), numTemporaries)) {
+                return false;
+            }
+            if (numTemporaries > m_MaxTempRegisters) {
+                m_MaxTempRegisters = numTemporaries;
+            }
+            return true;
+        }
+
         for(vector<shared_ptr<Node_Statement> >::const_iterator it = pFunc->m_pStatements.begin(); 
             it != pFunc->m_pStatements.end();
             it++)
@@ -272,6 +353,7 @@ namespace vf
             }
             info.reg        = reg;
             info.regidx     = offset;
+            m_TmpRegisterOffset -= Num_DeadTemporaries(pEnv->GetNumRegisters(), m_TmpRegisterOffset, reg, left, right);
             return emit_add(m_Sink, reg, offset, left, right);
         }
         return true;
@@ -318,6 +400,7 @@ namespace vf
             }
             info.reg        = reg;
             info.regidx     = offset;
+            m_TmpRegisterOffset -= Num_DeadTemporaries(pEnv->GetNumRegisters(), m_TmpRegisterOffset, reg, left, right);
             return emit_sub(m_Sink, reg, offset, left, right);
         }
         return true;
@@ -364,6 +447,7 @@ namespace vf
             }
             info.reg        = reg;
             info.regidx     = offset;
+            m_TmpRegisterOffset -= Num_DeadTemporaries(pEnv->GetNumRegisters(), m_TmpRegisterOffset, reg, left, right);
             return emit_div(m_Sink, reg, offset, left, right);
         }
         return true;
@@ -408,6 +492,7 @@ namespace vf
             }
             info.reg        = reg;
             info.regidx     = offset;
+            m_TmpRegisterOffset -= Num_DeadTemporaries(pEnv->GetNumRegisters(), m_TmpRegisterOffset, reg, left, right);
             return emit_mul(m_Sink, reg, offset, left, right);
         }
         return true;
@@ -426,23 +511,41 @@ namespace vf
      */
     bool Codegen::Compile(const Node_Conditional & cond, Environment * pEnv, ExpInfo & info, VM_Register_t reg, int offset)
     {
-        // compile the compare expression
-        ExpInfo cmp, firstExp, secondExp;
+        ExpInfo left, right, firstExp, secondExp;
 
-        if (!Compile(cond.m_pComp.get(), pEnv, cmp)) {
+        if (cond.m_pComp->Type() != Node_Expression::EXP_COMPARE) {
             return false;
         }
+        const Node_Comparison & cmp = *(const Node_Comparison *) cond.m_pComp.get();
 
+        // The operands of the comparison are computed first, followed by the instructions of each
+        // alternative, which allows the virtual machine to compare before the alternatives and
+        // skip the one that isn't selected by any element. The comparison itself is emitted last,
+        // there is only a single predicate so a conditional expression within the alternatives
+        // would otherwise overwrite it.
+        if (!Compile(cmp.m_pLeft.get(), pEnv, left) || !Compile(cmp.m_pRight.get(), pEnv, right)) {
+            return false;
+        }
         if (!Compile(cond.m_pFirst.get(), pEnv, firstExp) || !Compile(cond.m_pSecond.get(), pEnv, secondExp)) {
             return false;
         }
+        if (!emit_comparison(m_Sink, cmp, left, right)) {
+            return false;
+        }
         if (reg == VM_ANY_REGISTER) {
-            reg = NextTemporary(pEnv);
+            reg = firstExp.isreusable ? firstExp.reg : (secondExp.isreusable ? secondExp.reg : NextTemporary(pEnv));
             info.isreusable = 1;
         }
+        info.type       = firstExp.type;
         info.reg        = reg;
         info.regidx     = offset;
-        return emit_cond_assign(m_Sink, reg, offset, firstExp, secondExp);
+        m_TmpRegisterOffset -= Num_DeadTemporaries(pEnv->GetNumRegisters(), m_TmpRegisterOffset, reg, firstExp, secondExp);
+        if (!emit_cond_assign(m_Sink, reg, offset, firstExp, secondExp)) {
+            return false;
+        }
+        /** the operands of the comparison are below the alternatives on the stack of temporaries */
+        m_TmpRegisterOffset -= Num_DeadTemporaries(pEnv->GetNumRegisters(), m_TmpRegisterOffset, reg, left, right);
+        return true;
     }
 
     /**
@@ -454,15 +557,9 @@ namespace vf
         if (!Compile(cond.m_pLeft.get(), pEnv, left) ||  !Compile(cond.m_pRight.get(), pEnv, right)) {
             return false;
         }
-
-        switch(cond.m_Type) {
-        case Node_Comparison::Op_Equal:         return emit_equal(m_Sink, left, right);
-        case Node_Comparison::Op_Greater:       return emit_greater(m_Sink, left, right);
-        case Node_Comparison::Op_Less:          return emit_less(m_Sink, left, right);
-        case Node_Comparison::Op_GreaterEqual:  return emit_greater_equal(m_Sink, left, right);
-        case Node_Comparison::Op_LessEqual:     return emit_less_equal(m_Sink, left, right);
-        default:                                return false;
-        }
+        /** the result is written to the flags, so the operands are dead after the comparison */
+        m_TmpRegisterOffset -= Num_DeadTemporaries(pEnv->GetNumRegisters(), m_TmpRegisterOffset, VM_ANY_REGISTER, left, right);
+        return emit_comparison(m_Sink, cond, left, right);
     }
 
     /**
@@ -577,6 +674,7 @@ namespace vf
         info.regidx = offset;
         info.type   = vf::Type_Float;
 
+        m_TmpRegisterOffset -= Num_DeadTemporaries(pEnv->GetNumRegisters(), m_TmpRegisterOffset, reg, first, second);
         return emit_dot(m_Sink, reg, offset, first, second);
     }
 
@@ -596,11 +694,13 @@ namespace vf
         }
         if (reg == VM_ANY_REGISTER) {
             reg = first.isreusable ? first.reg : (second.isreusable ? second.reg : NextTemporary(pEnv));
+            info.isreusable = 1;
         }
 
         info.reg    = reg;
         info.regidx = 0;
         info.type   = vf::Type_Vec3;
+        m_TmpRegisterOffset -= Num_DeadTemporaries(pEnv->GetNumRegisters(), m_TmpRegisterOffset, reg, first, second);
         return emit_cross(m_Sink, reg, offset, first, second);
     }
 
@@ -617,10 +717,12 @@ namespace vf
         }
         if (reg == VM_ANY_REGISTER) {
             reg = first.isreusable ? first.reg : NextTemporary(pEnv);
+            info.isreusable = 1;
         }
         info.reg    = reg;
         info.regidx = offset;
         info.type   = vf::Type_Float;
+        m_TmpRegisterOffset -= Num_DeadTemporaries(pEnv->GetNumRegisters(), m_TmpRegisterOffset, reg, first);
         return emit_length(m_Sink, reg, offset, first);
     }
 
@@ -638,7 +740,7 @@ namespace vf
         if (first.isconst) {
             info.type       = Type_Float;
             info.isconst    = 1;
-            info.value.u.f  = sinf(first.value.u.f);
+            info.value.u.f  = vf::Math_Sin(first.value.u.f);
             return true;
         }
         if (reg == VM_ANY_REGISTER) {
@@ -648,6 +750,7 @@ namespace vf
         info.reg    = reg;
         info.regidx = offset;
         info.type   = vf::Type_Float;
+        m_TmpRegisterOffset -= Num_DeadTemporaries(pEnv->GetNumRegisters(), m_TmpRegisterOffset, reg, first);
         return emit_sine(m_Sink, reg, offset, first);
     }
 
@@ -665,7 +768,7 @@ namespace vf
         if (first.isconst) {
             info.type       = Type_Float;
             info.isconst    = 1;
-            info.value.u.f  = cosf(first.value.u.f);
+            info.value.u.f  = vf::Math_Cos(first.value.u.f);
             return true;
         }
         if (reg == VM_ANY_REGISTER) {
@@ -675,6 +778,7 @@ namespace vf
         info.reg    = reg;
         info.regidx = offset;
         info.type   = vf::Type_Float;
+        m_TmpRegisterOffset -= Num_DeadTemporaries(pEnv->GetNumRegisters(), m_TmpRegisterOffset, reg, first);
         return emit_cosine(m_Sink, reg, offset, first);
     }
 
@@ -692,16 +796,18 @@ namespace vf
         if (first.isconst) {
             info.type       = Type_Float;
             info.isconst    = 1;
-            info.value.u.f  = tanf(first.value.u.f);
+            info.value.u.f  = vf::Math_Tan(first.value.u.f);
             return true;
         }
         if (reg == VM_ANY_REGISTER) {
             reg = first.isreusable ? first.reg : NextTemporary(pEnv);
+            info.isreusable = 1;
         }
         info.reg    = reg;
         info.regidx = offset;
         info.type   = vf::Type_Float;
 
+        m_TmpRegisterOffset -= Num_DeadTemporaries(pEnv->GetNumRegisters(), m_TmpRegisterOffset, reg, first);
         return emit_tangent(m_Sink, reg, offset, first);
     }
 
@@ -722,7 +828,7 @@ namespace vf
         if (first.isconst) {
             info.type       = Type_Float;
             info.isconst    = 1;
-            info.value.u.f  = acosf(first.value.u.f);
+            info.value.u.f  = vf::Math_ArcCos(first.value.u.f);
             return true;
         }
         if (reg == VM_ANY_REGISTER) {
@@ -733,6 +839,7 @@ namespace vf
         info.regidx = offset;
         info.type   = vf::Type_Float;
 
+        m_TmpRegisterOffset -= Num_DeadTemporaries(pEnv->GetNumRegisters(), m_TmpRegisterOffset, reg, first);
         return emit_arccosine(m_Sink, reg, offset, first);
     }
 
@@ -750,7 +857,7 @@ namespace vf
         if (first.isconst) {
             info.type       = Type_Float;
             info.isconst    = 1;
-            info.value.u.f  = asinf(first.value.u.f);
+            info.value.u.f  = vf::Math_ArcSin(first.value.u.f);
             return true;
         }
         if (reg == VM_ANY_REGISTER) {
@@ -760,6 +867,7 @@ namespace vf
         info.reg    = reg;
         info.regidx = offset;
         info.type   = vf::Type_Float;
+        m_TmpRegisterOffset -= Num_DeadTemporaries(pEnv->GetNumRegisters(), m_TmpRegisterOffset, reg, first);
         return emit_arcsine(m_Sink, reg, offset, first);
     }
 
@@ -777,7 +885,7 @@ namespace vf
         if (first.isconst) {
             info.type       = Type_Float;
             info.isconst    = 1;
-            info.value.u.f  = atanf(first.value.u.f);
+            info.value.u.f  = vf::Math_ArcTan(first.value.u.f);
             return true;
         }
         if (reg == VM_ANY_REGISTER) {
@@ -787,6 +895,7 @@ namespace vf
         info.reg    = reg;
         info.regidx = offset;
         info.type   = vf::Type_Float;
+        m_TmpRegisterOffset -= Num_DeadTemporaries(pEnv->GetNumRegisters(), m_TmpRegisterOffset, reg, first);
         return emit_arctangent(m_Sink, reg, offset, first);
     }
 
@@ -815,6 +924,7 @@ namespace vf
         info.reg    = reg;
         info.regidx = offset;
         info.type   = first.type;
+        m_TmpRegisterOffset -= Num_DeadTemporaries(pEnv->GetNumRegisters(), m_TmpRegisterOffset, reg, first);
         return emit_negate(m_Sink, reg, offset, first);
     }
 
@@ -842,6 +952,7 @@ namespace vf
         info.reg    = reg;
         info.regidx = offset;
         info.type   = vf::Type_Float;
+        m_TmpRegisterOffset -= Num_DeadTemporaries(pEnv->GetNumRegisters(), m_TmpRegisterOffset, reg, first);
         return emit_sqrt(m_Sink, reg, offset, first);
     }
 
@@ -869,6 +980,7 @@ namespace vf
         info.reg    = reg;
         info.regidx = offset;
         info.type   = vf::Type_Float;
+        m_TmpRegisterOffset -= Num_DeadTemporaries(pEnv->GetNumRegisters(), m_TmpRegisterOffset, reg, first);
         return emit_invsqrt(m_Sink, reg, offset, first);
     }
 
@@ -898,6 +1010,7 @@ namespace vf
         info.reg    = reg;
         info.regidx = offset;
         info.type   = first.type;
+        m_TmpRegisterOffset -= Num_DeadTemporaries(pEnv->GetNumRegisters(), m_TmpRegisterOffset, reg, first);
         return emit_normalize(m_Sink, reg, offset, first);
     }
 
@@ -935,13 +1048,14 @@ namespace vf
             return true;
         }
         if (reg == VM_ANY_REGISTER) {
-            reg = first.isreusable ? first.reg : NextTemporary(pEnv);
+            reg = first.isreusable ? first.reg : (second.isreusable ? second.reg : NextTemporary(pEnv));
             info.isreusable = 1;
         }
         info.reg    = reg;
         info.regidx = offset;
         info.type   = first.type;
 
+        m_TmpRegisterOffset -= Num_DeadTemporaries(pEnv->GetNumRegisters(), m_TmpRegisterOffset, reg, first, second);
         return minmax.m_IsMin ? emit_min(m_Sink, reg, offset, first, second) : 
             emit_max(m_Sink, reg, offset, first, second);
     }
@@ -969,6 +1083,7 @@ namespace vf
         info.reg    = reg;
         info.regidx = 0;
         info.type   = Type_Vec4;
+        m_TmpRegisterOffset -= Num_DeadTemporaries(pEnv->GetNumRegisters(), m_TmpRegisterOffset, reg, exp);
         return emit_sample(m_Sink, reg, offset, var.m_SampleId, exp);
     }
 
@@ -1015,6 +1130,7 @@ namespace vf
         }
         info.reg    = reg;
         info.regidx = offset;
+        m_TmpRegisterOffset -= Num_DeadTemporaries(pEnv->GetNumRegisters(), m_TmpRegisterOffset, reg, exp);
         return fc.m_IsFloor ? emit_floor(m_Sink, reg, offset, exp) :  emit_ceil(m_Sink, reg, offset, exp);
     }
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include <stdexcept>
 #include <algorithm>
 #include "codegen.hpp"
+#include "vfssa.h"
 
 using namespace std;
 
@@ -97,25 +98,45 @@ namespace vf
     /*************************************************************************/
 
     /**
-     * Compiles a program into the corresponding bytecode.
+     * Compiles a program into the corresponding bytecode. Values that only depends on uniforms
+     * are computed by a prologue method named "$" followed by the name of the method, which
+     * follows the methods of the program. The prologue leaves the values in the registers of
+     * the hidden uniforms "$<method>.<n>", from where they are copied to the uniform the method
+     * reads before the method is executed.
      */
     shared_ptr<vf::ByteCode> Program::Compile()
     {
         auto & symtab       = m_pTokenizer->SymbolTable();
         auto & functions    = m_pProgram->GetFunctions();
 
-        std::vector<shared_ptr<vf::ByteCode_Method> >   methods;
+        std::vector<shared_ptr<vf::ByteCode_Method> >   methods, prologues;
+        std::map<std::string, vf::Variable>             uniforms = m_Uniforms;
         for(auto it = functions.begin(); it != functions.end(); it++)
         {
-            shared_ptr<vf::ByteCode_Method> pMethod =  make_shared<vf::ByteCode_Method>( symtab.Retrive((*it)->m_Name) );
-            if (!m_CodeGenerator.SetSink( *pMethod ).Compile( *it, m_Parser.GetRoot() )) {
+            std::string name = symtab.Retrive((*it)->m_Name);
+            shared_ptr<vf::ByteCode_Method> pMethod     = make_shared<vf::ByteCode_Method>( name.c_str() );
+            shared_ptr<vf::ByteCode_Method> pPrologue   = make_shared<vf::ByteCode_Method>( ("$" + name).c_str() );
+            IR_PrologueSink sink(*pMethod, *pPrologue, static_cast<uint8_t>(uniforms.size()));
+            if (!m_CodeGenerator.SetSink( sink ).Compile( *it, m_Parser.GetRoot() )) {
                 return shared_ptr<vf::ByteCode>();
             }
             methods.push_back(pMethod);
+
+            for(size_t i = 0; i < sink.hoisted.size(); ++i) {
+                vf::Variable & var  = uniforms["$" + name + "." + std::to_string(i)];
+                var.m_Type          = sink.hoisted[i].type;
+                var.m_Attribute     = ATTRIBUTE_UNIFORM;
+                var.m_Register      = sink.hoisted[i].reg;
+                var.m_UniformIndex  = sink.hoisted[i].uniform;
+            }
+            if (!sink.hoisted.empty()) {
+                prologues.push_back(pPrologue);
+            }
         }
+        methods.insert(methods.end(), prologues.begin(), prologues.end());
 
         uint8_t numRegisters = m_NumRequiredRegisters + m_CodeGenerator.NumTemporaryRegisters();
-        shared_ptr<vf::ByteCode> bc = make_shared<vf::ByteCode> (numRegisters, m_InputOutput, m_Uniforms, m_Samplers, methods);
+        shared_ptr<vf::ByteCode> bc = make_shared<vf::ByteCode> (numRegisters, m_InputOutput, uniforms, m_Samplers, methods);
         return bc;
     }
 
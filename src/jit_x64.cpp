@@ -0,0 +1,833 @@
+/**
+ * \file            jit_x64.cpp
+ * \description     Compiles execution plans to native x86-64 code.
+ *
+ *                  The generated code loops over the elements of a batch and executes every
+ *                  step of the plan for one element before moving on to the next. Each virtual
+ *                  machine register that the plan references is kept in a xmm register for the
+ *                  whole method, so the i/o registers are loaded and stored once per element and
+ *                  the temporary registers are never written to memory.
+ *
+ *                  Plans with streams that are only written are compiled twice. The second
+ *                  function stores those streams with movntps, which doesn't read the
+ *                  destination into the cache, and is used when the streams are aligned.
+ *
+ *                  Only SSE instructions are used, plus SSE4.1 for floor() and ceil(). Plans
+ *                  that uses more registers than there are xmm registers available, or
+ *                  instructions that aren't supported (trigonometric functions and samplers),
+ *                  are left to the interpreter.
+ *
+ *                  Precision_Fastest replaces division, inverse square roots and normalization
+ *                  with the rcpps and rsqrtps estimates. Precision_Fast uses the exact
+ *                  instructions, which are within its error bound.
+ */
+
+#include "vfvm.h"
+
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#if defined(VF_JIT_X64)
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+namespace vf
+{
+#if defined(VF_JIT_X64)
+namespace
+{
+    /** General purpose registers */
+    enum {
+        RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7, R8 = 8
+    };
+
+    /** xmm registers used as scratch by the generated code. */
+    enum {
+        X0 = 0,         /**< the result of a step */
+        X1 = 1,
+        X2 = 2,         /**< the comparison flag of the element, all ones or all zeros */
+        X3 = 3,
+        FirstRegister = 4,
+        NumRegisters = 12
+    };
+
+    /** SSE opcodes, the second byte after 0F */
+    enum {
+        SSE_MOVUPS_LOAD     = 0x10,
+        SSE_MOVUPS_STORE    = 0x11,
+        SSE_MOVAPS          = 0x28,
+        SSE_MOVNTPS         = 0x2b,
+        SSE_SQRTPS          = 0x51,
+        SSE_RSQRTPS         = 0x52,
+        SSE_RCPPS           = 0x53,
+        SSE_ANDPS           = 0x54,
+        SSE_ANDNPS          = 0x55,
+        SSE_ORPS            = 0x56,
+        SSE_XORPS           = 0x57,
+        SSE_ADDPS           = 0x58,
+        SSE_MULPS           = 0x59,
+        SSE_SUBPS           = 0x5c,
+        SSE_MINPS           = 0x5d,
+        SSE_DIVPS           = 0x5e,
+        SSE_MAXPS           = 0x5f,
+        SSE_CMPPS           = 0xc2,
+        SSE_SHUFPS          = 0xc6
+    };
+
+    /** cmpps predicates */
+    enum {
+        CMP_EQ = 0,
+        CMP_LT = 1,
+        CMP_LE = 2
+    };
+
+    /**
+     * A minimal x86-64 assembler. Constants are placed in a pool in front of the code, and are
+     * addressed relative to the instruction pointer.
+     */
+    class Assembler
+    {
+    public:
+        Assembler()
+        {
+            // Lane masks for each of the 16 write masks, followed by the sign mask and ones.
+            for(unsigned mask = 0; mask < 16; ++mask) {
+                uint32_t lanes[4];
+                for(size_t c = 0; c < 4; ++c) {
+                    lanes[c] = (mask & (1 << c)) ? 0xffffffff : 0;
+                }
+                Constant(lanes);
+            }
+            uint32_t sign[4] = { 0x80000000, 0x80000000, 0x80000000, 0x80000000 };
+            m_SignMask = Constant(sign);
+            float ones[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+            m_Ones = Constant(ones);
+        }
+
+        /** Adds 16 bytes to the constant pool, and returns the offset of the constant. */
+        size_t Constant(const void * data)
+        {
+            size_t offset = m_Pool.size();
+            m_Pool.resize(offset + 16);
+            memcpy(&m_Pool[offset], data, 16);
+            return offset;
+        }
+
+        size_t LaneMask(unsigned mask) const    { return (mask & 0x0f) * 16; }
+        size_t SignMask() const                 { return m_SignMask; }
+        size_t Ones() const                     { return m_Ones; }
+        size_t Position() const                 { return m_Code.size(); }
+
+        void Byte(uint8_t b)
+        {
+            m_Code.push_back(b);
+        }
+
+        void Dword(uint32_t d)
+        {
+            for(size_t i = 0; i < 4; ++i) {
+                Byte(static_cast<uint8_t>(d >> (i * 8)));
+            }
+        }
+
+        void Patch(size_t position, uint32_t d)
+        {
+            for(size_t i = 0; i < 4; ++i) {
+                m_Code[position + i] = static_cast<uint8_t>(d >> (i * 8));
+            }
+        }
+
+        void Rex(bool w, int reg, int index, int base)
+        {
+            uint8_t rex = 0x40 | (w ? 0x08 : 0) | ((reg & 8) ? 0x04 : 0) | ((index & 8) ? 0x02 : 0) | ((base & 8) ? 0x01 : 0);
+            if (rex != 0x40) {
+                Byte(rex);
+            }
+        }
+
+        /*********************************************************************/
+        /*                              SSE                                  */
+        /*********************************************************************/
+
+        /** op xmm, xmm */
+        void Sse(uint8_t op, int dst, int src)
+        {
+            Rex(false, dst, 0, src);
+            Byte(0x0f);
+            Byte(op);
+            Byte(0xc0 | ((dst & 7) << 3) | (src & 7));
+        }
+
+        /** op xmm, xmm, imm8 */
+        void Sse(uint8_t op, int dst, int src, uint8_t imm)
+        {
+            Sse(op, dst, src);
+            Byte(imm);
+        }
+
+        /** op xmm, [rip + constant] */
+        void SseConstant(uint8_t op, int dst, size_t constant)
+        {
+            Rex(false, dst, 0, 0);
+            Byte(0x0f);
+            Byte(op);
+            Byte(0x05 | ((dst & 7) << 3));
+            m_Fixups.push_back(Fixup(Position(), constant));
+            Dword(0);
+        }
+
+        /** movups xmm, [rip + constant] */
+        void LoadConstant(int dst, size_t constant)
+        {
+            SseConstant(SSE_MOVUPS_LOAD, dst, constant);
+        }
+
+        /** op xmm, [base + disp32], or movups [base + disp32], xmm */
+        void MoveDisp(uint8_t op, int xmm, int base, int32_t disp)
+        {
+            Rex(false, xmm, 0, base);
+            Byte(0x0f);
+            Byte(op);
+            if ((base & 7) == RSP) {
+                Byte(0x84 | ((xmm & 7) << 3));
+                Byte(0x24);
+            } else {
+                Byte(0x80 | ((xmm & 7) << 3) | (base & 7));
+            }
+            Dword(static_cast<uint32_t>(disp));
+        }
+
+        /** movups xmm, [base + index] or movups [base + index], xmm */
+        void MoveIndexed(uint8_t op, int xmm, int base, int index)
+        {
+            Rex(false, xmm, index, base);
+            Byte(0x0f);
+            Byte(op);
+            Byte(0x04 | ((xmm & 7) << 3));
+            Byte(((index & 7) << 3) | (base & 7));
+        }
+
+        /** roundps xmm, xmm, imm8 (SSE4.1) */
+        void Roundps(int dst, int src, uint8_t imm)
+        {
+            Byte(0x66);
+            Rex(false, dst, 0, src);
+            Byte(0x0f);
+            Byte(0x3a);
+            Byte(0x08);
+            Byte(0xc0 | ((dst & 7) << 3) | (src & 7));
+            Byte(imm);
+        }
+
+        /*********************************************************************/
+        /*                          General purpose                          */
+        /*********************************************************************/
+
+        /** mov reg, [base + disp32] */
+        void LoadPointer(int reg, int base, int32_t disp)
+        {
+            Rex(true, reg, 0, base);
+            Byte(0x8b);
+            Byte(0x80 | ((reg & 7) << 3) | (base & 7));
+            Dword(static_cast<uint32_t>(disp));
+        }
+
+        /** mov dst, src */
+        void Move(int dst, int src)
+        {
+            Rex(true, src, 0, dst);
+            Byte(0x89);
+            Byte(0xc0 | ((src & 7) << 3) | (dst & 7));
+        }
+
+        /** sfence */
+        void Sfence()
+        {
+            Byte(0x0f);
+            Byte(0xae);
+            Byte(0xf8);
+        }
+
+        void Push(int reg)  { Rex(false, 0, 0, reg); Byte(0x50 | (reg & 7)); }
+        void Pop(int reg)   { Rex(false, 0, 0, reg); Byte(0x58 | (reg & 7)); }
+        void Ret()          { Byte(0xc3); }
+
+        /** add/sub reg, imm32 */
+        void AddImm(int reg, int32_t imm)
+        {
+            Rex(true, 0, 0, reg);
+            Byte(0x81);
+            Byte(((imm < 0) ? 0xe8 : 0xc0) | (reg & 7));
+            Dword(static_cast<uint32_t>((imm < 0) ? -imm : imm));
+        }
+
+        /** dec reg */
+        void Dec(int reg)
+        {
+            Rex(true, 0, 0, reg);
+            Byte(0xff);
+            Byte(0xc8 | (reg & 7));
+        }
+
+        /** test reg, reg */
+        void Test(int reg)
+        {
+            Rex(true, reg, 0, reg);
+            Byte(0x85);
+            Byte(0xc0 | ((reg & 7) << 3) | (reg & 7));
+        }
+
+        /** xor reg32, reg32 */
+        void Clear(int reg)
+        {
+            Rex(false, reg, 0, reg);
+            Byte(0x31);
+            Byte(0xc0 | ((reg & 7) << 3) | (reg & 7));
+        }
+
+        /** jcc rel32, returns the position of the displacement */
+        size_t Jump(uint8_t cc, size_t target = 0)
+        {
+            Byte(0x0f);
+            Byte(0x80 | cc);
+            size_t position = Position();
+            Dword(static_cast<uint32_t>(target - (position + 4)));
+            return position;
+        }
+
+        /**
+         * Places the constant pool in front of the code and resolves the constant references.
+         * Returns the image, and the offset of the first instruction.
+         */
+        size_t Link(std::vector<uint8_t> & image)
+        {
+            size_t entry = m_Pool.size();
+            image = m_Pool;
+            image.insert(image.end(), m_Code.begin(), m_Code.end());
+            for(size_t i = 0; i < m_Fixups.size(); ++i) {
+                size_t position = entry + m_Fixups[i].first;
+                uint32_t disp = static_cast<uint32_t>(int32_t(m_Fixups[i].second) - int32_t(position + 4));
+                for(size_t b = 0; b < 4; ++b) {
+                    image[position + b] = static_cast<uint8_t>(disp >> (b * 8));
+                }
+            }
+            return entry;
+        }
+
+    protected:
+        typedef std::pair<size_t, size_t> Fixup;
+
+        std::vector<uint8_t>    m_Code;
+        std::vector<uint8_t>    m_Pool;
+        std::vector<Fixup>      m_Fixups;
+        size_t                  m_SignMask;
+        size_t                  m_Ones;
+    };
+
+    /**
+     * Translates the steps of a execution plan into native code.
+     */
+    class JitCompiler
+    {
+    public:
+        JitCompiler(const ExecutionPlan & plan, const vfutil::Bitmap & IoMap, ISA_t isa, Precision_t precision)
+            : m_Plan(plan), m_IoMap(IoMap), m_SSE41(isa >= ISA_SSE41), m_Estimate(precision == Precision_Fastest),
+              m_Xmm(256, -1), m_Pointer(256, -1), m_Stream(256, false)
+        {
+            for(size_t i = 0; i < plan.streams.size(); ++i) {
+                m_Stream[plan.streams[i]] = true;
+            }
+        }
+
+        bool Compile(std::vector<uint8_t> & image, size_t & entry, size_t & streaming);
+
+    protected:
+        bool    AllocateRegisters();
+        bool    Function(bool streaming);
+        bool    Step(const PlanStep &);
+        void    Load(int xmm, const PlanOperand &);
+        int     Source(int xmm, const PlanOperand &);
+        void    Apply(uint8_t op, int dst, const PlanOperand &, int scratch);
+        void    Binary(uint8_t op, const PlanStep &);
+        void    Write(const PlanStep &);
+        void    StreamAddress(uint8_t reg, int & base);
+        void    HorizontalSum(size_t numComponents);
+        void    Prologue();
+        void    Epilogue();
+
+        const ExecutionPlan &       m_Plan;
+        const vfutil::Bitmap &      m_IoMap;
+        bool                        m_SSE41;
+        bool                        m_Estimate;     /**< use the reciprocal estimates */
+        std::vector<int>            m_Xmm;          /**< the xmm register of each vm register, -1 if unused */
+        std::vector<uint8_t>        m_Inputs;       /**< i/o registers that are loaded for each element */
+        std::vector<uint8_t>        m_Outputs;      /**< i/o registers that are stored for each element */
+        std::vector<int>            m_Pointer;      /**< the register holding the stream pointer of a i/o register, -1 if it's loaded when used */
+        std::vector<bool>           m_Stream;       /**< the i/o registers that the plan only writes */
+        Assembler                   m_Asm;
+    };
+
+    /**
+     * Assigns a xmm register to each virtual machine register that the plan references.
+     */
+    bool JitCompiler::AllocateRegisters()
+    {
+        int next = FirstRegister;
+        std::vector<bool> written(256, false);
+        for(size_t i = 0; i < m_Plan.steps.size(); ++i) {
+            const PlanStep & step = m_Plan.steps[i];
+            uint8_t regs[3];
+            size_t num = 0;
+            for(size_t s = 0; s < 2; ++s) {
+                if (step.src[s].isreg) {
+                    regs[num++] = step.src[s].reg;
+                }
+            }
+            if (step.family != Family_Compare) {
+                regs[num++] = step.dst;
+                written[step.dst] = true;
+            }
+            for(size_t r = 0; r < num; ++r) {
+                if (m_Xmm[regs[r]] < 0) {
+                    if (next >= FirstRegister + NumRegisters) {
+                        return false;
+                    }
+                    m_Xmm[regs[r]] = next++;
+                    if (m_IoMap.Get(regs[r])) {
+                        m_Inputs.push_back(regs[r]);
+                    }
+                }
+            }
+        }
+        for(size_t i = 0; i < m_Inputs.size(); ++i) {
+            if (written[m_Inputs[i]]) {
+                m_Outputs.push_back(m_Inputs[i]);
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Loads a operand into a scratch register, scalar operands are replicated to all four components.
+     */
+    void JitCompiler::Load(int xmm, const PlanOperand & op)
+    {
+        if (op.isreg) {
+            m_Asm.Sse(SSE_MOVAPS, xmm, m_Xmm[op.reg]);
+        } else if (op.isuniform) {
+            m_Asm.MoveDisp(SSE_MOVUPS_LOAD, xmm, RSI, int32_t(op.reg) * int32_t(sizeof(vf::Vector)));
+        } else {
+            m_Asm.LoadConstant(xmm, m_Asm.Constant(op.op.value));
+            return;
+        }
+        if (op.numComponents == 1) {
+            m_Asm.Sse(SSE_SHUFPS, xmm, xmm, static_cast<uint8_t>(op.op.member * 0x55));
+        }
+    }
+
+    /**
+     * Returns the xmm register that holds a operand. Vector registers are used directly, other
+     * operands are loaded into the scratch register.
+     */
+    int JitCompiler::Source(int xmm, const PlanOperand & op)
+    {
+        if (op.isreg && (op.numComponents > 1)) {
+            return m_Xmm[op.reg];
+        }
+        Load(xmm, op);
+        return xmm;
+    }
+
+    /**
+     * Applies a operation to dst with a operand as the second source. Constants and vector uniforms
+     * are used as memory operands.
+     */
+    void JitCompiler::Apply(uint8_t op, int dst, const PlanOperand & src, int scratch)
+    {
+        if (!src.isreg && !src.isuniform) {
+            m_Asm.SseConstant(op, dst, m_Asm.Constant(src.op.value));
+        } else if (src.isuniform && (src.numComponents > 1)) {
+            m_Asm.MoveDisp(op, dst, RSI, int32_t(src.reg) * int32_t(sizeof(vf::Vector)));
+        } else {
+            m_Asm.Sse(op, dst, Source(scratch, src));
+        }
+    }
+
+    /**
+     * Emits a component wise binary operation. When all components are written the result is
+     * computed directly in the destination register.
+     */
+    void JitCompiler::Binary(uint8_t op, const PlanStep & step)
+    {
+        const PlanOperand & rhs = step.src[1];
+        int dst = m_Xmm[step.dst];
+        int lhs = Source(X0, step.src[0]);
+        bool clobbers = rhs.isreg && (rhs.reg == step.dst) && (lhs != dst);
+        int result = (((step.mask & 0x0f) == 0x0f) && !clobbers) ? dst : X0;
+        if (result != lhs) {
+            m_Asm.Sse(SSE_MOVAPS, result, lhs);
+        }
+        Apply(op, result, rhs, X1);
+        if (result != dst) {
+            Write(step);
+        }
+    }
+
+    /**
+     * Writes the result in X0 to the destination components of the step.
+     */
+    void JitCompiler::Write(const PlanStep & step)
+    {
+        int dst = m_Xmm[step.dst];
+        if ((step.mask & 0x0f) == 0x0f) {
+            m_Asm.Sse(SSE_MOVAPS, dst, X0);
+        } else {
+            m_Asm.LoadConstant(X1, m_Asm.LaneMask(step.mask));
+            m_Asm.Sse(SSE_ANDPS, X0, X1);
+            m_Asm.Sse(SSE_ANDNPS, X1, dst);
+            m_Asm.Sse(SSE_ORPS, X1, X0);
+            m_Asm.Sse(SSE_MOVAPS, dst, X1);
+        }
+    }
+
+    /**
+     * Sums the first numComponents components of X0, the sum is stored in all four components.
+     * The order of the additions is the same as in the kernels.
+     */
+    void JitCompiler::HorizontalSum(size_t numComponents)
+    {
+        if (numComponents < 4) {
+            m_Asm.LoadConstant(X1, m_Asm.LaneMask((1 << numComponents) - 1));
+            m_Asm.Sse(SSE_ANDPS, X0, X1);
+        }
+        m_Asm.Sse(SSE_MOVAPS, X1, X0);
+        m_Asm.Sse(SSE_SHUFPS, X1, X1, 0xb1);
+        m_Asm.Sse(SSE_ADDPS, X0, X1);
+        m_Asm.Sse(SSE_MOVAPS, X1, X0);
+        m_Asm.Sse(SSE_SHUFPS, X1, X1, 0x4e);
+        m_Asm.Sse(SSE_ADDPS, X0, X1);
+    }
+
+    /**
+     * Emits the code for a single step, returns false if the step can't be compiled.
+     */
+    bool JitCompiler::Step(const PlanStep & step)
+    {
+        static const uint8_t binary[KERNEL_BINARY_MAX] = {
+            SSE_ADDPS, SSE_SUBPS, SSE_MULPS, SSE_DIVPS, SSE_MINPS, SSE_MAXPS
+        };
+
+        switch(step.family) {
+        case Family_Binary:
+            if (m_Estimate && (step.kernelIndex == KERNEL_DIV)) {
+                Load(X3, step.src[1]);
+                m_Asm.Sse(SSE_RCPPS, X3, X3);
+                Load(X0, step.src[0]);
+                m_Asm.Sse(SSE_MULPS, X0, X3);
+                break;
+            }
+            Binary(binary[step.kernelIndex], step);
+            return true;
+        case Family_Unary:
+            Load(X0, step.src[0]);
+            switch(step.kernelIndex) {
+            case KERNEL_COPY:
+                break;
+            case KERNEL_NEGATE:
+                m_Asm.LoadConstant(X1, m_Asm.SignMask());
+                m_Asm.Sse(SSE_XORPS, X0, X1);
+                break;
+            case KERNEL_FLOOR:
+            case KERNEL_CEIL:
+                if (!m_SSE41) {
+                    return false;
+                }
+                m_Asm.Roundps(X0, X0, (step.kernelIndex == KERNEL_FLOOR) ? 0x09 : 0x0a);
+                break;
+            case KERNEL_SQRT:
+                m_Asm.Sse(SSE_SQRTPS, X0, X0);
+                break;
+            case KERNEL_INVSQRT:
+                if (m_Estimate) {
+                    m_Asm.Sse(SSE_RSQRTPS, X0, X0);
+                    break;
+                }
+                m_Asm.Sse(SSE_SQRTPS, X0, X0);
+                m_Asm.LoadConstant(X1, m_Asm.Ones());
+                m_Asm.Sse(SSE_DIVPS, X1, X0);
+                m_Asm.Sse(SSE_MOVAPS, X0, X1);
+                break;
+            default:
+                return false;
+            }
+            break;
+        case Family_Dot:
+            Load(X0, step.src[0]);
+            Apply(SSE_MULPS, X0, step.src[1], X1);
+            HorizontalSum(step.src[0].numComponents);
+            break;
+        case Family_Length:
+            Load(X0, step.src[0]);
+            m_Asm.Sse(SSE_MULPS, X0, X0);
+            HorizontalSum(step.src[0].numComponents);
+            m_Asm.Sse(SSE_SQRTPS, X0, X0);
+            break;
+        case Family_Normalize:
+            Load(X3, step.src[0]);
+            m_Asm.Sse(SSE_MOVAPS, X0, X3);
+            m_Asm.Sse(SSE_MULPS, X0, X3);
+            HorizontalSum(step.src[0].numComponents);
+            if (m_Estimate) {
+                m_Asm.Sse(SSE_RSQRTPS, X0, X0);
+                m_Asm.Sse(SSE_MULPS, X0, X3);
+                break;
+            }
+            m_Asm.Sse(SSE_SQRTPS, X0, X0);
+            m_Asm.Sse(SSE_DIVPS, X3, X0);
+            m_Asm.Sse(SSE_MOVAPS, X0, X3);
+            break;
+        case Family_Cross:
+            // (a * b.yzx - a.yzx * b).yzx, which is the same products as the kernels.
+            Load(X0, step.src[0]);
+            Load(X1, step.src[1]);
+            m_Asm.Sse(SSE_MOVAPS, X3, X1);
+            m_Asm.Sse(SSE_SHUFPS, X3, X3, 0xc9);
+            m_Asm.Sse(SSE_MULPS, X3, X0);
+            m_Asm.Sse(SSE_SHUFPS, X0, X0, 0xc9);
+            m_Asm.Sse(SSE_MULPS, X0, X1);
+            m_Asm.Sse(SSE_SUBPS, X3, X0);
+            m_Asm.Sse(SSE_SHUFPS, X3, X3, 0xc9);
+            m_Asm.Sse(SSE_MOVAPS, X0, X3);
+            break;
+        case Family_Compare:
+            Load(X0, step.src[0]);
+            Load(X1, step.src[1]);
+            switch(step.kernelIndex) {
+            case KERNEL_CMP_GRT:    m_Asm.Sse(SSE_CMPPS, X1, X0, CMP_LT); m_Asm.Sse(SSE_MOVAPS, X2, X1); break;
+            case KERNEL_CMP_LE:     m_Asm.Sse(SSE_CMPPS, X0, X1, CMP_LT); m_Asm.Sse(SSE_MOVAPS, X2, X0); break;
+            case KERNEL_CMP_EQ:     m_Asm.Sse(SSE_CMPPS, X0, X1, CMP_EQ); m_Asm.Sse(SSE_MOVAPS, X2, X0); break;
+            case KERNEL_CMP_GEQ:    m_Asm.Sse(SSE_CMPPS, X1, X0, CMP_LE); m_Asm.Sse(SSE_MOVAPS, X2, X1); break;
+            case KERNEL_CMP_LEQ:    m_Asm.Sse(SSE_CMPPS, X0, X1, CMP_LE); m_Asm.Sse(SSE_MOVAPS, X2, X0); break;
+            default:
+                return false;
+            }
+            return true;
+        case Family_Select:
+            Load(X0, step.src[0]);
+            m_Asm.Sse(SSE_ANDPS, X0, X2);
+            m_Asm.Sse(SSE_MOVAPS, X3, X2);
+            Apply(SSE_ANDNPS, X3, step.src[1], X1);
+            m_Asm.Sse(SSE_ORPS, X0, X3);
+            break;
+        default:
+            return false;
+        }
+        Write(step);
+        return true;
+    }
+
+    /**
+     * Returns the general purpose register that holds the stream pointer of a i/o register.
+     */
+    void JitCompiler::StreamAddress(uint8_t reg, int & base)
+    {
+        base = m_Pointer[reg];
+        if (base < 0) {
+            m_Asm.LoadPointer(RAX, RDI, int32_t(reg) * int32_t(sizeof(float *)));
+            base = RAX;
+        }
+    }
+
+    /**
+     * Moves the arguments to rdi, rsi and rdx. On Windows rdi, rsi and xmm6-xmm15 are callee saved.
+     */
+    void JitCompiler::Prologue()
+    {
+#if defined(_WIN32)
+        m_Asm.Push(RDI);
+        m_Asm.Push(RSI);
+        m_Asm.AddImm(RSP, -168);
+        for(int i = 0; i < 10; ++i) {
+            m_Asm.MoveDisp(SSE_MOVUPS_STORE, 6 + i, RSP, i * 16);
+        }
+        m_Asm.Move(RDI, RCX);
+        m_Asm.Move(RSI, RDX);
+        m_Asm.Move(RDX, R8);
+#endif
+    }
+
+    void JitCompiler::Epilogue()
+    {
+#if defined(_WIN32)
+        for(int i = 0; i < 10; ++i) {
+            m_Asm.MoveDisp(SSE_MOVUPS_LOAD, 6 + i, RSP, i * 16);
+        }
+        m_Asm.AddImm(RSP, 168);
+        m_Asm.Pop(RSI);
+        m_Asm.Pop(RDI);
+#endif
+        m_Asm.Ret();
+    }
+
+    /**
+     * Compiles the plan, returns false if the plan can't be compiled. The streaming entry is the
+     * same as the first entry if the plan has no streams that are only written.
+     */
+    bool JitCompiler::Compile(std::vector<uint8_t> & image, size_t & entry, size_t & streaming)
+    {
+        if (!AllocateRegisters()) {
+            return false;
+        }
+        size_t first = m_Asm.Position(), second = first;
+        if (!Function(false)) {
+            return false;
+        }
+        if (!m_Plan.streams.empty()) {
+            second = m_Asm.Position();
+            if (!Function(true)) {
+                return false;
+            }
+        }
+        size_t code = m_Asm.Link(image);
+        entry       = code + first;
+        streaming   = code + second;
+        return true;
+    }
+
+    /**
+     * Emits a function that executes the plan. The streams that are only written are never
+     * loaded, and are stored with non-temporal stores by the streaming function.
+     *
+     *  rdi = register base pointers, rsi = uniforms, rdx = number of elements, rcx = element offset,
+     *  r8-r11 = stream pointers
+     */
+    bool JitCompiler::Function(bool streaming)
+    {
+        Prologue();
+        m_Asm.Test(RDX);
+        size_t done = m_Asm.Jump(0x04);     // jz
+        m_Asm.Clear(RCX);
+
+        // The stream pointers of the first i/o registers are kept in r8-r11 for the whole loop.
+        static const int pointers[] = { R8, R8 + 1, R8 + 2, R8 + 3 };
+        for(size_t i = 0; (i < m_Inputs.size()) && (i < 4); ++i) {
+            m_Pointer[m_Inputs[i]] = pointers[i];
+            m_Asm.LoadPointer(pointers[i], RDI, int32_t(m_Inputs[i]) * int32_t(sizeof(float *)));
+        }
+
+        size_t loop = m_Asm.Position();
+        for(size_t i = 0; i < m_Inputs.size(); ++i) {
+            if (m_Stream[m_Inputs[i]]) {
+                continue;
+            }
+            int base;
+            StreamAddress(m_Inputs[i], base);
+            m_Asm.MoveIndexed(SSE_MOVUPS_LOAD, m_Xmm[m_Inputs[i]], base, RCX);
+        }
+        m_Asm.Sse(SSE_XORPS, X2, X2);
+        for(size_t i = 0; i < m_Plan.steps.size(); ++i) {
+            if (!Step(m_Plan.steps[i])) {
+                return false;
+            }
+        }
+        for(size_t i = 0; i < m_Outputs.size(); ++i) {
+            int base;
+            StreamAddress(m_Outputs[i], base);
+            uint8_t op = (streaming && m_Stream[m_Outputs[i]]) ? SSE_MOVNTPS : SSE_MOVUPS_STORE;
+            m_Asm.MoveIndexed(op, m_Xmm[m_Outputs[i]], base, RCX);
+        }
+        m_Asm.AddImm(RCX, 16);
+        m_Asm.Dec(RDX);
+        m_Asm.Jump(0x05, loop);             // jnz
+
+        m_Asm.Patch(done, static_cast<uint32_t>(m_Asm.Position() - (done + 4)));
+        if (streaming) {
+            m_Asm.Sfence();
+        }
+        Epilogue();
+        return true;
+    }
+}
+
+    /*************************************************************************/
+    /*                                  JitCode                              */
+    /*************************************************************************/
+    JitCode::JitCode(const std::vector<uint8_t> & image, size_t entry, size_t streaming)
+        : m_Memory(nullptr), m_Size(image.size())
+    {
+#if defined(_WIN32)
+        m_Memory = VirtualAlloc(nullptr, m_Size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+        if (!m_Memory) {
+            throw std::bad_alloc();
+        }
+        memcpy(m_Memory, &image[0], m_Size);
+        DWORD old;
+        if (!VirtualProtect(m_Memory, m_Size, PAGE_EXECUTE_READ, &old)) {
+            VirtualFree(m_Memory, 0, MEM_RELEASE);
+            throw std::bad_alloc();
+        }
+        FlushInstructionCache(GetCurrentProcess(), m_Memory, m_Size);
+#else
+        m_Memory = mmap(nullptr, m_Size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (m_Memory == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        memcpy(m_Memory, &image[0], m_Size);
+        if (mprotect(m_Memory, m_Size, PROT_READ | PROT_EXEC) != 0) {
+            munmap(m_Memory, m_Size);
+            throw std::bad_alloc();
+        }
+#endif
+        m_Entry     = reinterpret_cast<JitFunction_t>(static_cast<uint8_t *>(m_Memory) + entry);
+        m_Streaming = reinterpret_cast<JitFunction_t>(static_cast<uint8_t *>(m_Memory) + streaming);
+    }
+
+    JitCode::~JitCode()
+    {
+#if defined(_WIN32)
+        VirtualFree(m_Memory, 0, MEM_RELEASE);
+#else
+        munmap(m_Memory, m_Size);
+#endif
+    }
+
+    std::shared_ptr<JitCode> Jit_Compile(const ExecutionPlan & plan, const vfutil::Bitmap & IoMap, ISA_t isa,
+        Precision_t precision)
+    {
+        std::vector<uint8_t> image;
+        size_t entry, streaming;
+        JitCompiler compiler(plan, IoMap, (isa == ISA_Auto) ? DetectISA() : isa, precision);
+        if (!compiler.Compile(image, entry, streaming)) {
+            return nullptr;
+        }
+        try {
+            return std::make_shared<JitCode>(image, entry, streaming);
+        } catch(std::bad_alloc &) {
+            return nullptr;
+        }
+    }
+
+#else
+
+    JitCode::JitCode(const std::vector<uint8_t> &, size_t, size_t) : m_Memory(nullptr), m_Size(0), m_Entry(nullptr),
+        m_Streaming(nullptr)
+    {
+        throw std::runtime_error("Native code isn't supported on this platform.");
+    }
+
+    JitCode::~JitCode()
+    {
+    }
+
+    std::shared_ptr<JitCode> Jit_Compile(const ExecutionPlan &, const vfutil::Bitmap &, ISA_t, Precision_t)
+    {
+        return nullptr;
+    }
+
+#endif
+}
@@ -0,0 +1,275 @@
+/**
+ * \file            kernels.cpp
+ * \description     Portable implementation of the virtual machine kernels, and selection of
+ *                  the kernels that are best suited for the processor.
+ */
+
+#include "vfkernels.h"
+#include "vfvm.h"
+
+#include <cmath>
+#include <vector>
+
+#if defined(VF_KERNELS_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <sys/sysctl.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace vf
+{
+namespace
+{
+    /**
+     * Plain C++ implementation, a register is a single vf::Vector.
+     */
+    struct Traits_Portable
+    {
+        struct V { float f[4]; };
+        typedef unsigned M;
+        typedef unsigned I;
+        enum { Width = 4 };
+
+        static V Load(const float * p)                  { V r = { { p[0], p[1], p[2], p[3] } }; return r; }
+        static void Store(float * p, V v)               { p[0] = v.f[0]; p[1] = v.f[1]; p[2] = v.f[2]; p[3] = v.f[3]; }
+        static void StoreMasked(float * p, M m, V v)    { for(size_t c = 0; c < 4; ++c) if (m & (1 << c)) p[c] = v.f[c]; }
+        static void StoreStream(float * p, V v)         { Store(p, v); }
+        static void Fence()                             { }
+        static void Prefetch(const void *)              { }
+        static V Broadcast4(const float * p)            { return Load(p); }
+        static I SplatIndex(unsigned member)            { return member; }
+        static V Splat(const float * p, I index)        { return Set1(p[index]); }
+        static V Zero()                                 { return Set1(0.0f); }
+        static V Set1(float x)                          { V r = { { x, x, x, x } }; return r; }
+
+        template<class F>
+        static V Apply(V a, V b, F fn)
+        {
+            V r;
+            for(size_t c = 0; c < 4; ++c) {
+                r.f[c] = fn(a.f[c], b.f[c]);
+            }
+            return r;
+        }
+
+        template<class F>
+        static V Apply(V a, F fn)
+        {
+            V r;
+            for(size_t c = 0; c < 4; ++c) {
+                r.f[c] = fn(a.f[c]);
+            }
+            return r;
+        }
+
+        template<class F>
+        static M Compare(V a, V b, F fn)
+        {
+            M r = 0;
+            for(size_t c = 0; c < 4; ++c) {
+                r |= fn(a.f[c], b.f[c]) ? (1 << c) : 0;
+            }
+            return r;
+        }
+
+        static float add(float a, float b)  { return a + b; }
+        static float sub(float a, float b)  { return a - b; }
+        static float mul(float a, float b)  { return a * b; }
+        static float div(float a, float b)  { return a / b; }
+        static float min(float a, float b)  { return (a < b) ? a : b; }
+        static float max(float a, float b)  { return (a > b) ? a : b; }
+        static float neg(float a)           { return -a; }
+        static float rcp(float a)           { return 1.0f / a; }
+        static float rsqrt(float a)         { return 1.0f / sqrtf(a); }
+        static bool gt(float a, float b)    { return a > b; }
+        static bool lt(float a, float b)    { return a < b; }
+        static bool eq(float a, float b)    { return a == b; }
+        static bool ge(float a, float b)    { return a >= b; }
+        static bool le(float a, float b)    { return a <= b; }
+
+        static V Add(V a, V b)              { return Apply(a, b, add); }
+        static V Sub(V a, V b)              { return Apply(a, b, sub); }
+        static V Mul(V a, V b)              { return Apply(a, b, mul); }
+        static V Div(V a, V b)              { return Apply(a, b, div); }
+        static V Min(V a, V b)              { return Apply(a, b, min); }
+        static V Max(V a, V b)              { return Apply(a, b, max); }
+        static V Negate(V a)                { return Apply(a, neg); }
+        static V Floor(V a)                 { return Apply(a, floorf); }
+        static V Ceil(V a)                  { return Apply(a, ceilf); }
+        static V Sqrt(V a)                  { return Apply(a, sqrtf); }
+        static V Rcp(V a)                   { return Apply(a, rcp); }
+        static V RSqrt(V a)                 { return Apply(a, rsqrt); }
+
+        template<int imm>
+        static V Permute(V a)
+        {
+            V r = { { a.f[imm & 3], a.f[(imm >> 2) & 3], a.f[(imm >> 4) & 3], a.f[(imm >> 6) & 3] } };
+            return r;
+        }
+
+        static M CmpGT(V a, V b)            { return Compare(a, b, gt); }
+        static M CmpLT(V a, V b)            { return Compare(a, b, lt); }
+        static M CmpEQ(V a, V b)            { return Compare(a, b, eq); }
+        static M CmpGE(V a, V b)            { return Compare(a, b, ge); }
+        static M CmpLE(V a, V b)            { return Compare(a, b, le); }
+
+        static V Select(M m, V a, V b)
+        {
+            V r;
+            for(size_t c = 0; c < 4; ++c) {
+                r.f[c] = (m & (1 << c)) ? a.f[c] : b.f[c];
+            }
+            return r;
+        }
+
+        static M LaneMask(unsigned mask)                { return mask & 0x0f; }
+        static M ElementMask(unsigned bits)             { return (0u - (bits & 1)) & 0x0f; }
+        static unsigned ElementBits(M m)                { return m & 1; }
+        static bool AnyLane(M m)                        { return m != 0; }
+    };
+}
+}
+
+#include "kernels_impl.h"
+
+namespace vf
+{
+    const KernelTable * GetKernelTable_Portable(Precision_t precision)
+    {
+        return SelectKernelTable<Traits_Portable>(ISA_Portable, "portable", precision);
+    }
+
+    float Math_Sin(float x)     { return Sin<Traits_Scalar>(x); }
+    float Math_Cos(float x)     { return Cos<Traits_Scalar>(x); }
+    float Math_Tan(float x)     { return Tan<Traits_Scalar>(x); }
+    float Math_ArcSin(float x)  { return ArcSin<Traits_Scalar>(x); }
+    float Math_ArcCos(float x)  { return ArcCos<Traits_Scalar>(x); }
+    float Math_ArcTan(float x)  { return ArcTan<Traits_Scalar>(x); }
+
+    /**
+     * Queries the processor for the supported instruction sets.
+     */
+    static ISA_t QueryISA()
+    {
+#if defined(VF_KERNELS_X86) && defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        int maxLeaf = info[0];
+
+        __cpuid(info, 1);
+        bool sse41      = (info[2] & (1 << 19)) != 0;
+        bool osxsave    = (info[2] & (1 << 27)) != 0;
+        bool avx        = (info[2] & (1 << 28)) != 0;
+
+        unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+        bool ymm = avx && ((xcr0 & 0x06) == 0x06);
+        bool zmm = ymm && ((xcr0 & 0xe0) == 0xe0);
+
+        bool avx2 = false, avx512 = false;
+        if (maxLeaf >= 7) {
+            __cpuidex(info, 7, 0);
+            avx2    = ymm && ((info[1] & (1 << 5)) != 0);
+            avx512  = zmm && ((info[1] & (1 << 16)) != 0);
+        }
+
+        if (avx512) return ISA_AVX512;
+        if (avx2)   return ISA_AVX2;
+        if (sse41)  return ISA_SSE41;
+#elif defined(VF_KERNELS_X86) && defined(__GNUC__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))  return ISA_AVX512;
+        if (__builtin_cpu_supports("avx2"))     return ISA_AVX2;
+        if (__builtin_cpu_supports("sse4.1"))   return ISA_SSE41;
+#endif
+        return ISA_Portable;
+    }
+
+    ISA_t DetectISA()
+    {
+        static const ISA_t isa = QueryISA();
+        return isa;
+    }
+
+    /**
+     * Queries the operating system for the size of the level 1 data cache and the level 2 cache.
+     */
+    static CacheSizes QueryCaches()
+    {
+        CacheSizes caches = { 0, 0 };
+#if defined(_WIN32)
+        DWORD size = 0;
+        GetLogicalProcessorInformation(nullptr, &size);
+        std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> info(size / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+        if (!info.empty() && GetLogicalProcessorInformation(&info[0], &size)) {
+            for(size_t i = 0; i < info.size(); ++i) {
+                if (info[i].Relationship != RelationCache) {
+                    continue;
+                }
+                const CACHE_DESCRIPTOR & cache = info[i].Cache;
+                if ((cache.Level == 1) && (cache.Type != CacheInstruction)) {
+                    caches.L1 = cache.Size;
+                } else if (cache.Level == 2) {
+                    caches.L2 = cache.Size;
+                }
+            }
+        }
+#elif defined(__APPLE__)
+        uint64_t value = 0;
+        size_t length = sizeof(value);
+        if (sysctlbyname("hw.l1dcachesize", &value, &length, nullptr, 0) == 0) {
+            caches.L1 = static_cast<size_t>(value);
+        }
+        length = sizeof(value);
+        if (sysctlbyname("hw.l2cachesize", &value, &length, nullptr, 0) == 0) {
+            caches.L2 = static_cast<size_t>(value);
+        }
+#elif defined(_SC_LEVEL1_DCACHE_SIZE) && defined(_SC_LEVEL2_CACHE_SIZE)
+        long l1 = sysconf(_SC_LEVEL1_DCACHE_SIZE), l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+        caches.L1 = (l1 > 0) ? static_cast<size_t>(l1) : 0;
+        caches.L2 = (l2 > 0) ? static_cast<size_t>(l2) : 0;
+#endif
+        if (caches.L1 == 0) {
+            caches.L1 = 32 * 1024;
+        }
+        if (caches.L2 < caches.L1) {
+            caches.L2 = (caches.L1 > 256 * 1024) ? caches.L1 : 256 * 1024;
+        }
+        return caches;
+    }
+
+    const CacheSizes & DetectCaches()
+    {
+        static const CacheSizes caches = QueryCaches();
+        return caches;
+    }
+
+    const KernelTable * GetKernelTable(ISA_t isa, Precision_t precision)
+    {
+        ISA_t supported = DetectISA();
+        if ((isa == ISA_Auto) || (isa > supported)) {
+            isa = supported;
+        }
+
+        const KernelTable * table = nullptr;
+        if (!table && (isa >= ISA_AVX512)) {
+            table = GetKernelTable_AVX512(precision);
+        }
+        if (!table && (isa >= ISA_AVX2)) {
+            table = GetKernelTable_AVX2(precision);
+        }
+        if (!table && (isa >= ISA_SSE41)) {
+            table = GetKernelTable_SSE41(precision);
+        }
+        return table ? table : GetKernelTable_Portable(precision);
+    }
+}
@@ -0,0 +1,118 @@
+/**
+ * \file            kernels_avx2.cpp
+ * \description     AVX2 implementation of the virtual machine kernels, a register is a
+ *                  pair of vf::Vector.
+ */
+
+#include "vfkernels.h"
+#include "vfvm.h"
+
+#include <cmath>
+
+#if defined(VF_KERNELS_X86)
+
+#include <immintrin.h>
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+namespace vf
+{
+namespace
+{
+    struct Traits_AVX2
+    {
+        typedef __m256 V;
+        typedef __m256 M;
+        typedef __m256i I;
+        enum { Width = 8 };
+
+        static V Load(const float * p)                  { return _mm256_loadu_ps(p); }
+        static void Store(float * p, V v)               { _mm256_storeu_ps(p, v); }
+        static void StoreMasked(float * p, M m, V v)    { _mm256_storeu_ps(p, _mm256_blendv_ps(_mm256_loadu_ps(p), v, m)); }
+        static void StoreStream(float * p, V v)         { _mm256_stream_ps(p, v); }
+        static void Fence()                             { _mm_sfence(); }
+        static void Prefetch(const void * p)            { _mm_prefetch(static_cast<const char *>(p), _MM_HINT_T0); }
+        static V Broadcast4(const float * p)            { return _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(p)); }
+        static I SplatIndex(unsigned member)            { return _mm256_set1_epi32(int(member)); }
+        static V Splat(const float * p, I index)        { return _mm256_permutevar_ps(_mm256_loadu_ps(p), index); }
+        static V Zero()                                 { return _mm256_setzero_ps(); }
+        static V Set1(float x)                          { return _mm256_set1_ps(x); }
+
+        static V Add(V a, V b)                          { return _mm256_add_ps(a, b); }
+        static V Sub(V a, V b)                          { return _mm256_sub_ps(a, b); }
+        static V Mul(V a, V b)                          { return _mm256_mul_ps(a, b); }
+        static V Div(V a, V b)                          { return _mm256_div_ps(a, b); }
+        static V Min(V a, V b)                          { return _mm256_min_ps(a, b); }
+        static V Max(V a, V b)                          { return _mm256_max_ps(a, b); }
+        static V Negate(V a)                            { return _mm256_xor_ps(a, _mm256_set1_ps(-0.0f)); }
+        static V Floor(V a)                             { return _mm256_floor_ps(a); }
+        static V Ceil(V a)                              { return _mm256_ceil_ps(a); }
+        static V Sqrt(V a)                              { return _mm256_sqrt_ps(a); }
+        static V Rcp(V a)                               { return _mm256_rcp_ps(a); }
+        static V RSqrt(V a)                             { return _mm256_rsqrt_ps(a); }
+
+        template<int imm>
+        static V Permute(V a)                           { return _mm256_permute_ps(a, imm); }
+
+        static M CmpGT(V a, V b)                        { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+        static M CmpLT(V a, V b)                        { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+        static M CmpEQ(V a, V b)                        { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+        static M CmpGE(V a, V b)                        { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+        static M CmpLE(V a, V b)                        { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+        static V Select(M m, V a, V b)                  { return _mm256_blendv_ps(b, a, m); }
+
+        static M LaneMask(unsigned mask)
+        {
+            __m128i m = _mm_setr_epi32(-int(mask & 1), -int((mask >> 1) & 1), -int((mask >> 2) & 1), -int((mask >> 3) & 1));
+            return _mm256_castsi256_ps(_mm256_broadcastsi128_si256(m));
+        }
+
+        static M ElementMask(unsigned bits)
+        {
+            const __m256i select = _mm256_setr_epi32(1, 1, 1, 1, 2, 2, 2, 2);
+            return _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(int(bits)), select), select));
+        }
+
+        static unsigned ElementBits(M m)
+        {
+            unsigned bits = unsigned(_mm256_movemask_ps(m));
+            return (bits & 0x01) | ((bits >> 3) & 0x02);
+        }
+
+        static bool AnyLane(M m)                        { return _mm256_movemask_ps(m) != 0; }
+    };
+}
+}
+
+#include "kernels_impl.h"
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+namespace vf
+{
+    const KernelTable * GetKernelTable_AVX2(Precision_t precision)
+    {
+        return SelectKernelTable<Traits_AVX2>(ISA_AVX2, "avx2", precision);
+    }
+}
+
+#else
+
+namespace vf
+{
+    const KernelTable * GetKernelTable_AVX2(Precision_t)
+    {
+        return nullptr;
+    }
+}
+
+#endif
@@ -0,0 +1,123 @@
+/**
+ * \file            kernels_avx512.cpp
+ * \description     AVX-512 implementation of the virtual machine kernels, a register is a
+ *                  group of four vf::Vector.
+ */
+
+#include "vfkernels.h"
+#include "vfvm.h"
+
+#include <cmath>
+
+#if defined(VF_KERNELS_X86)
+
+#include <immintrin.h>
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx512f"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+// AVX-512F includes FMA, products are rounded as on the other instruction sets.
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+namespace vf
+{
+namespace
+{
+    struct Traits_AVX512
+    {
+        typedef __m512 V;
+        typedef __mmask16 M;
+        typedef __m512i I;
+        enum { Width = 16 };
+
+        static V Load(const float * p)                  { return _mm512_loadu_ps(p); }
+        static void Store(float * p, V v)               { _mm512_storeu_ps(p, v); }
+        static void StoreMasked(float * p, M m, V v)    { _mm512_mask_storeu_ps(p, m, v); }
+        static void StoreStream(float * p, V v)         { _mm512_stream_ps(p, v); }
+        static void Fence()                             { _mm_sfence(); }
+        static void Prefetch(const void * p)            { _mm_prefetch(static_cast<const char *>(p), _MM_HINT_T0); }
+        static V Broadcast4(const float * p)            { return _mm512_broadcast_f32x4(_mm_loadu_ps(p)); }
+        static I SplatIndex(unsigned member)            { return _mm512_set1_epi32(int(member)); }
+        static V Splat(const float * p, I index)        { return _mm512_permutevar_ps(_mm512_loadu_ps(p), index); }
+        static V Zero()                                 { return _mm512_setzero_ps(); }
+        static V Set1(float x)                          { return _mm512_set1_ps(x); }
+
+        static V Add(V a, V b)                          { return _mm512_add_ps(a, b); }
+        static V Sub(V a, V b)                          { return _mm512_sub_ps(a, b); }
+        static V Mul(V a, V b)                          { return _mm512_mul_ps(a, b); }
+        static V Div(V a, V b)                          { return _mm512_div_ps(a, b); }
+        static V Min(V a, V b)                          { return _mm512_min_ps(a, b); }
+        static V Max(V a, V b)                          { return _mm512_max_ps(a, b); }
+        static V Sqrt(V a)                              { return _mm512_sqrt_ps(a); }
+        static V Rcp(V a)                               { return _mm512_rcp14_ps(a); }
+        static V RSqrt(V a)                             { return _mm512_rsqrt14_ps(a); }
+
+        static V Negate(V a)
+        {
+            return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a), _mm512_set1_epi32(int(0x80000000))));
+        }
+
+        static V Floor(V a)                             { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+        static V Ceil(V a)                              { return _mm512_roundscale_ps(a, _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC); }
+
+        template<int imm>
+        static V Permute(V a)                           { return _mm512_permute_ps(a, imm); }
+
+        static M CmpGT(V a, V b)                        { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+        static M CmpLT(V a, V b)                        { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+        static M CmpEQ(V a, V b)                        { return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ); }
+        static M CmpGE(V a, V b)                        { return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+        static M CmpLE(V a, V b)                        { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+        static V Select(M m, V a, V b)                  { return _mm512_mask_blend_ps(m, b, a); }
+
+        static M LaneMask(unsigned mask)
+        {
+            mask &= 0x0f;
+            return M(mask | (mask << 4) | (mask << 8) | (mask << 12));
+        }
+
+        static M ElementMask(unsigned bits)
+        {
+            return M(((bits & 1) * 0x000f) | ((bits & 2) * 0x0078) | ((bits & 4) * 0x03c0) | ((bits & 8) * 0x1e00));
+        }
+
+        static unsigned ElementBits(M m)
+        {
+            return (m & 0x0001) | ((m >> 3) & 0x0002) | ((m >> 6) & 0x0004) | ((m >> 9) & 0x0008);
+        }
+
+        static bool AnyLane(M m)                        { return m != 0; }
+    };
+}
+}
+
+#include "kernels_impl.h"
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+namespace vf
+{
+    const KernelTable * GetKernelTable_AVX512(Precision_t precision)
+    {
+        return SelectKernelTable<Traits_AVX512>(ISA_AVX512, "avx512", precision);
+    }
+}
+
+#else
+
+namespace vf
+{
+    const KernelTable * GetKernelTable_AVX512(Precision_t)
+    {
+        return nullptr;
+    }
+}
+
+#endif
@@ -0,0 +1,1100 @@
+/**
+ * \file            kernels_impl.h
+ * \description     Generic implementation of the virtual machine kernels. This file is included
+ *                  once by each of the kernels_*.cpp files, after the instruction set traits
+ *                  has been declared, and must only be included by those files.
+ *
+ *                  The traits of a instruction set declares the following:
+ *
+ *                  V       - a register holding 'Width' floats, where Width is a multiple of four.
+ *                  M       - a lane mask.
+ *                  I       - the index used by Splat().
+ *
+ *                  Load, Store, StoreMasked, StoreStream, Fence, Prefetch, Broadcast4, Splat, SplatIndex, Zero, Set1, Add, Sub,
+ *                  Mul, Div, Min, Max, Negate, Floor, Ceil, Sqrt, Rcp, RSqrt, Permute<imm>, CmpGT,
+ *                  CmpLT, CmpEQ, CmpGE, CmpLE, Select, LaneMask, ElementMask, ElementBits and
+ *                  AnyLane.
+ *
+ *                  ElementBits returns one bit per element of a comparison, ElementMask expands
+ *                  the lowest Width / 4 bits of a predicate to the lanes of their elements.
+ *                  AnyLane returns true if any lane of a mask is set. Rcp and RSqrt are the
+ *                  reciprocal estimates of the instruction set. StoreStream is a non-temporal
+ *                  store to a address aligned to a full register, Fence orders the non-temporal
+ *                  stores before the stores that follows. Prefetch loads a cache line into
+ *                  the first level cache, without waiting for it.
+ *
+ *                  Permute and the horizontal operations works on groups of four floats, which
+ *                  means that each group is a single vf::Vector.
+ */
+
+namespace vf
+{
+namespace
+{
+    /*************************************************************************/
+    /*                              Operands                                 */
+    /*************************************************************************/
+
+    /** A operand with one packed vf::Vector per element */
+    template<class ISA>
+    struct Source_Vector
+    {
+        const float * p;
+
+        explicit Source_Vector(const KernelOperand & op) : p(op.ptr) {}
+        typename ISA::V Get(size_t i) const { return ISA::Load(p + i); }
+        float Scalar(size_t j) const { return p[j]; }
+    };
+
+    /** A scalar operand, the member is replicated to all four components */
+    template<class ISA>
+    struct Source_Splat
+    {
+        const float *       p;
+        typename ISA::I     index;
+        unsigned            member;
+
+        explicit Source_Splat(const KernelOperand & op) : p(op.ptr), index(ISA::SplatIndex(op.member)), member(op.member) {}
+        typename ISA::V Get(size_t i) const { return ISA::Splat(p + i, index); }
+        float Scalar(size_t j) const { return p[(j & ~size_t(3)) + member]; }
+    };
+
+    /** A constant or uniform operand */
+    template<class ISA>
+    struct Source_Const
+    {
+        const float *       p;
+        typename ISA::V     v;
+
+        explicit Source_Const(const KernelOperand & op) : p(op.value), v(ISA::Broadcast4(op.value)) {}
+        typename ISA::V Get(size_t) const { return v; }
+        float Scalar(size_t j) const { return p[j & 3]; }
+    };
+
+    /**
+     * Invokes K::Run() with the operand types resolved, which keeps the operand kind out of the
+     * inner loops.
+     */
+    template<class ISA, class K, class L, class... A>
+    static void Dispatch_Rhs(const L & lhs, const KernelOperand & rhs, A... args)
+    {
+        switch(rhs.kind) {
+        case Operand_Vector:    K::Run(lhs, Source_Vector<ISA>(rhs), args...); break;
+        case Operand_Splat:     K::Run(lhs, Source_Splat<ISA>(rhs), args...); break;
+        default:                K::Run(lhs, Source_Const<ISA>(rhs), args...); break;
+        }
+    }
+
+    template<class ISA, class K, class... A>
+    static void Dispatch(const KernelOperand & lhs, const KernelOperand & rhs, A... args)
+    {
+        switch(lhs.kind) {
+        case Operand_Vector:    Dispatch_Rhs<ISA, K>(Source_Vector<ISA>(lhs), rhs, args...); break;
+        case Operand_Splat:     Dispatch_Rhs<ISA, K>(Source_Splat<ISA>(lhs), rhs, args...); break;
+        default:                Dispatch_Rhs<ISA, K>(Source_Const<ISA>(lhs), rhs, args...); break;
+        }
+    }
+
+    template<class ISA, class K, class... A>
+    static void Dispatch(const KernelOperand & src, A... args)
+    {
+        switch(src.kind) {
+        case Operand_Vector:    K::Run(Source_Vector<ISA>(src), args...); break;
+        case Operand_Splat:     K::Run(Source_Splat<ISA>(src), args...); break;
+        default:                K::Run(Source_Const<ISA>(src), args...); break;
+        }
+    }
+
+    /**
+     * Resolves the last operand of a kernel with three operands.
+     */
+    template<class ISA, class K>
+    struct Dispatch_Last
+    {
+        template<class A, class B, class... Args>
+        static void Run(const A & a, const B & b, const KernelOperand & c, Args... args)
+        {
+            switch(c.kind) {
+            case Operand_Vector:    K::Run(a, b, Source_Vector<ISA>(c), args...); break;
+            case Operand_Splat:     K::Run(a, b, Source_Splat<ISA>(c), args...); break;
+            default:                K::Run(a, b, Source_Const<ISA>(c), args...); break;
+            }
+        }
+    };
+
+    template<class ISA, class K, class... A>
+    static void Dispatch3(const KernelOperand & a, const KernelOperand & b, const KernelOperand & c, A... args)
+    {
+        Dispatch<ISA, Dispatch_Last<ISA, K> >(a, b, c, args...);
+    }
+
+    /**
+     * Writes the components of a register that are selected by the mask.
+     */
+    template<class ISA>
+    static inline void Write(float * dst, typename ISA::M mask, bool full, typename ISA::V v)
+    {
+        if (full) {
+            ISA::Store(dst, v);
+        } else {
+            ISA::StoreMasked(dst, mask, v);
+        }
+    }
+
+    /**
+     * Sums the components of each vf::Vector, the sum is stored in all four components.
+     */
+    template<class ISA>
+    static inline typename ISA::V HorizontalSum(typename ISA::V v)
+    {
+        v = ISA::Add(v, ISA::template Permute<0xb1>(v));
+        return ISA::Add(v, ISA::template Permute<0x4e>(v));
+    }
+
+    /**
+     * Applies a scalar function to each float of a register.
+     */
+    template<class ISA>
+    static inline typename ISA::V Map(typename ISA::V v, float (*fn)(float))
+    {
+        float tmp[ISA::Width];
+        ISA::Store(tmp, v);
+        for(size_t i = 0; i < ISA::Width; ++i) {
+            tmp[i] = fn(tmp[i]);
+        }
+        return ISA::Load(tmp);
+    }
+
+    /*************************************************************************/
+    /*                              Math                                     */
+    /*************************************************************************/
+
+    /**
+     * A single float, used for the elements after the last full register and by the scalar math
+     * functions. Evaluating them with the same polynomials as the registers makes the result of
+     * a element independent of its position in the batch and of the instruction set.
+     */
+    struct Traits_Scalar
+    {
+        typedef float V;
+        typedef bool M;
+        enum { Width = 1 };
+
+        static V Load(const float * p)      { return *p; }
+        static void Store(float * p, V v)   { *p = v; }
+        static V Set1(float x)              { return x; }
+        static V Add(V a, V b)              { return a + b; }
+        static V Sub(V a, V b)              { return a - b; }
+        static V Mul(V a, V b)              { return a * b; }
+        static V Div(V a, V b)              { return a / b; }
+        static V Max(V a, V b)              { return (a > b) ? a : b; }
+        static V Negate(V a)                { return -a; }
+        static V Floor(V a)                 { return floorf(a); }
+        static V Sqrt(V a)                  { return sqrtf(a); }
+        static V Rcp(V a)                   { return 1.0f / a; }
+        static V RSqrt(V a)                 { return 1.0f / sqrtf(a); }
+        static M CmpGT(V a, V b)            { return a > b; }
+        static M CmpLT(V a, V b)            { return a < b; }
+        static M CmpEQ(V a, V b)            { return a == b; }
+        static V Select(M m, V a, V b)      { return m ? a : b; }
+        static bool AnyLane(M m)            { return m; }
+    };
+
+    /**
+     * The largest argument of sin(), cos() and tan() that is reduced by the polynomials. The
+     * multiples of pi / 2 are subtracted in four parts, where the first three parts has enough
+     * trailing zeros to be multiplied exactly by any quadrant below the limit. Larger arguments
+     * are evaluated by the C library instead, except by Precision_Fastest.
+     */
+    static const float Math_TrigonometricLimit = 8192.0f;
+
+    template<class ISA>
+    static inline typename ISA::V Abs(typename ISA::V x)
+    {
+        return ISA::Max(x, ISA::Negate(x));
+    }
+
+    /** Returns x - 2 * floor(x / 2), which is 1 for the odd integers and 0 for the even */
+    template<class ISA>
+    static inline typename ISA::V Odd(typename ISA::V x)
+    {
+        return ISA::Sub(x, ISA::Mul(ISA::Set1(2.0f), ISA::Floor(ISA::Mul(x, ISA::Set1(0.5f)))));
+    }
+
+    /**
+     * 1 / x. The estimate of the instruction set has a relative error of at most 1.5 * 2^-12, a
+     * Newton-Raphson step reduces it to about 2^-22. The step isn't defined for zero and infinity,
+     * where the estimate is kept.
+     */
+    template<class ISA, Precision_t P>
+    static inline typename ISA::V Reciprocal(typename ISA::V x)
+    {
+        typedef typename ISA::V V;
+        if (P == Precision_Precise) {
+            return ISA::Div(ISA::Set1(1.0f), x);
+        }
+        V y = ISA::Rcp(x);
+        if (P == Precision_Fastest) {
+            return y;
+        }
+        V r = ISA::Mul(y, ISA::Sub(ISA::Set1(2.0f), ISA::Mul(x, y)));
+        return ISA::Select(ISA::CmpEQ(r, r), r, y);
+    }
+
+    /** 1 / sqrt(x), refined the same way as Reciprocal() */
+    template<class ISA, Precision_t P>
+    static inline typename ISA::V InvSqrt(typename ISA::V x)
+    {
+        typedef typename ISA::V V;
+        if (P == Precision_Precise) {
+            return ISA::Div(ISA::Set1(1.0f), ISA::Sqrt(x));
+        }
+        V y = ISA::RSqrt(x);
+        if (P == Precision_Fastest) {
+            return y;
+        }
+        V r = ISA::Mul(y, ISA::Sub(ISA::Set1(1.5f), ISA::Mul(ISA::Mul(ISA::Set1(0.5f), x), ISA::Mul(y, y))));
+        return ISA::Select(ISA::CmpEQ(r, r), r, y);
+    }
+
+    /** v / sqrt(sum), as a multiplication by the inverse square root for the approximate precisions */
+    template<class ISA, Precision_t P>
+    static inline typename ISA::V Normalize(typename ISA::V v, typename ISA::V sum)
+    {
+        if (P == Precision_Precise) {
+            return ISA::Div(v, ISA::Sqrt(sum));
+        }
+        return ISA::Mul(v, InvSqrt<ISA, P>(sum));
+    }
+
+    /** a / b, as a multiplication by the reciprocal for the approximate precisions */
+    template<class ISA, Precision_t P>
+    static inline typename ISA::V Divide(typename ISA::V a, typename ISA::V b)
+    {
+        if (P == Precision_Precise) {
+            return ISA::Div(a, b);
+        }
+        return ISA::Mul(a, Reciprocal<ISA, P>(b));
+    }
+
+    /**
+     * Reduces x to r in [-pi / 4, pi / 4], and returns the quadrant j = round(x * 2 / pi) such that
+     * x = r + j * pi / 2. Precision_Fastest subtracts pi / 2 in two parts, which is accurate for
+     * arguments of a moderate size.
+     */
+    template<class ISA, Precision_t P>
+    static inline typename ISA::V Reduce_Quadrant(typename ISA::V x, typename ISA::V & r)
+    {
+        typename ISA::V j = ISA::Floor(ISA::Add(ISA::Mul(x, ISA::Set1(0.63661977236758134f)), ISA::Set1(0.5f)));
+        r = ISA::Sub(x, ISA::Mul(j, ISA::Set1(1.5703125f)));
+        if (P == Precision_Fastest) {
+            r = ISA::Sub(r, ISA::Mul(j, ISA::Set1(4.838267948966e-4f)));
+            return j;
+        }
+        r = ISA::Sub(r, ISA::Mul(j, ISA::Set1(4.8351287841796875e-4f)));
+        r = ISA::Sub(r, ISA::Mul(j, ISA::Set1(3.13855707645416259765625e-7f)));
+        r = ISA::Sub(r, ISA::Mul(j, ISA::Set1(6.077100628276710381e-11f)));
+        return j;
+    }
+
+    /** sin(r) for r in [-pi / 4, pi / 4], where z = r * r */
+    template<class ISA, Precision_t P>
+    static inline typename ISA::V Sine_Polynomial(typename ISA::V r, typename ISA::V z)
+    {
+        typename ISA::V s;
+        if (P == Precision_Fastest) {
+            s = ISA::Add(ISA::Mul(ISA::Set1(8.1632638e-3f), z), ISA::Set1(-1.6663390e-1f));
+        } else {
+            s = ISA::Add(ISA::Mul(ISA::Set1(-1.9515295891e-4f), z), ISA::Set1(8.3321608736e-3f));
+            s = ISA::Add(ISA::Mul(s, z), ISA::Set1(-1.6666654611e-1f));
+        }
+        return ISA::Add(ISA::Mul(ISA::Mul(s, z), r), r);
+    }
+
+    /** cos(r) for r in [-pi / 4, pi / 4], where z = r * r */
+    template<class ISA, Precision_t P>
+    static inline typename ISA::V Cosine_Polynomial(typename ISA::V z)
+    {
+        typename ISA::V c;
+        if (P == Precision_Fastest) {
+            c = ISA::Add(ISA::Mul(ISA::Set1(4.0458324e-2f), z), ISA::Set1(-4.9976051e-1f));
+            return ISA::Add(ISA::Mul(c, z), ISA::Set1(1.0f));
+        }
+        c = ISA::Add(ISA::Mul(ISA::Set1(2.443315711809948e-5f), z), ISA::Set1(-1.388731625493765e-3f));
+        c = ISA::Add(ISA::Mul(c, z), ISA::Set1(4.166664568298827e-2f));
+        c = ISA::Sub(ISA::Mul(ISA::Mul(c, z), z), ISA::Mul(ISA::Set1(0.5f), z));
+        return ISA::Add(c, ISA::Set1(1.0f));
+    }
+
+    /**
+     * sin(x + offset * pi / 2). The sine or the cosine polynomial is evaluated depending on the
+     * quadrant, which also selects the sign.
+     */
+    template<class ISA, Precision_t P>
+    static inline typename ISA::V SinCos(typename ISA::V x, float offset)
+    {
+        typedef typename ISA::V V;
+        V r, j = ISA::Add(Reduce_Quadrant<ISA, P>(x, r), ISA::Set1(offset));
+        V z = ISA::Mul(r, r);
+        V s = Sine_Polynomial<ISA, P>(r, z);
+        V c = Cosine_Polynomial<ISA, P>(z);
+        V v = ISA::Select(ISA::CmpGT(Odd<ISA>(j), ISA::Set1(0.5f)), c, s);
+        V half = Odd<ISA>(ISA::Floor(ISA::Mul(j, ISA::Set1(0.5f))));
+        return ISA::Select(ISA::CmpGT(half, ISA::Set1(0.5f)), ISA::Negate(v), v);
+    }
+
+    /**
+     * Replaces the lanes of v whose argument is above Math_TrigonometricLimit with the result of
+     * the C library.
+     */
+    template<class ISA, Precision_t P>
+    static inline typename ISA::V Trigonometric_Range(typename ISA::V x, typename ISA::V v, float (*fn)(float))
+    {
+        if (P == Precision_Fastest) {
+            return v;
+        }
+        typename ISA::M large = ISA::CmpGT(Abs<ISA>(x), ISA::Set1(Math_TrigonometricLimit));
+        return ISA::AnyLane(large) ? ISA::Select(large, Map<ISA>(x, fn), v) : v;
+    }
+
+    template<class ISA, Precision_t P = Precision_Precise>
+    static inline typename ISA::V Sin(typename ISA::V x)
+    {
+        return Trigonometric_Range<ISA, P>(x, SinCos<ISA, P>(x, 0.0f), sinf);
+    }
+
+    template<class ISA, Precision_t P = Precision_Precise>
+    static inline typename ISA::V Cos(typename ISA::V x)
+    {
+        return Trigonometric_Range<ISA, P>(x, SinCos<ISA, P>(x, 1.0f), cosf);
+    }
+
+    /**
+     * tan(x), which is tan(r) in the even quadrants and -1 / tan(r) in the odd. Precision_Fastest
+     * divides the low order sine and cosine polynomials instead.
+     */
+    template<class ISA, Precision_t P = Precision_Precise>
+    static inline typename ISA::V Tan(typename ISA::V x)
+    {
+        typedef typename ISA::V V;
+        V r, j = Reduce_Quadrant<ISA, P>(x, r);
+        V z = ISA::Mul(r, r);
+        typename ISA::M odd = ISA::CmpGT(Odd<ISA>(j), ISA::Set1(0.5f));
+        if (P == Precision_Fastest) {
+            V s = Sine_Polynomial<ISA, P>(r, z), c = Cosine_Polynomial<ISA, P>(z);
+            return Divide<ISA, P>(ISA::Select(odd, ISA::Negate(c), s), ISA::Select(odd, s, c));
+        }
+        V t = ISA::Add(ISA::Mul(ISA::Set1(9.38540185543e-3f), z), ISA::Set1(3.11992232697e-3f));
+        t = ISA::Add(ISA::Mul(t, z), ISA::Set1(2.44301354525e-2f));
+        t = ISA::Add(ISA::Mul(t, z), ISA::Set1(5.34112807005e-2f));
+        t = ISA::Add(ISA::Mul(t, z), ISA::Set1(1.33387994085e-1f));
+        t = ISA::Add(ISA::Mul(t, z), ISA::Set1(3.33331568548e-1f));
+        t = ISA::Add(ISA::Mul(ISA::Mul(t, z), r), r);
+        t = ISA::Select(odd, ISA::Negate(Reciprocal<ISA, P>(t)), t);
+        return Trigonometric_Range<ISA, P>(x, t, tanf);
+    }
+
+    /**
+     * The arcsine polynomial, asin(s) for |s| <= 0.5 where z = s * s.
+     */
+    template<class ISA, Precision_t P>
+    static inline typename ISA::V ArcSine_Polynomial(typename ISA::V s, typename ISA::V z)
+    {
+        typename ISA::V p;
+        if (P == Precision_Fastest) {
+            p = ISA::Add(ISA::Mul(ISA::Set1(9.4301227e-2f), z), ISA::Set1(1.6505737e-1f));
+        } else {
+            p = ISA::Add(ISA::Mul(ISA::Set1(4.2163199048e-2f), z), ISA::Set1(2.4181311049e-2f));
+            p = ISA::Add(ISA::Mul(p, z), ISA::Set1(4.5470025998e-2f));
+            p = ISA::Add(ISA::Mul(p, z), ISA::Set1(7.4953002686e-2f));
+            p = ISA::Add(ISA::Mul(p, z), ISA::Set1(1.6666752422e-1f));
+        }
+        return ISA::Add(ISA::Mul(ISA::Mul(p, z), s), s);
+    }
+
+    /**
+     * asin(x) for |x| <= 0.5, and pi / 2 - 2 * asin(sqrt((1 - |x|) / 2)) with the sign of x
+     * above. Arguments outside [-1, 1] takes the square root of a negative number, which is NaN.
+     */
+    template<class ISA, Precision_t P = Precision_Precise>
+    static inline typename ISA::V ArcSin(typename ISA::V x)
+    {
+        typedef typename ISA::V V;
+        V a = Abs<ISA>(x);
+        typename ISA::M large = ISA::CmpGT(a, ISA::Set1(0.5f));
+        V z = ISA::Select(large, ISA::Mul(ISA::Set1(0.5f), ISA::Sub(ISA::Set1(1.0f), a)), ISA::Mul(x, x));
+        V s = ISA::Select(large, ISA::Sqrt(z), x);
+        V p = ArcSine_Polynomial<ISA, P>(s, z);
+        V q = ISA::Sub(ISA::Set1(1.5707963267948966f), ISA::Add(p, p));
+        return ISA::Select(large, ISA::Select(ISA::CmpLT(x, ISA::Set1(0.0f)), ISA::Negate(q), q), p);
+    }
+
+    /**
+     * pi / 2 - asin(x) for |x| <= 0.5, 2 * asin(sqrt((1 - x) / 2)) above and
+     * pi - 2 * asin(sqrt((1 + x) / 2)) below.
+     */
+    template<class ISA, Precision_t P = Precision_Precise>
+    static inline typename ISA::V ArcCos(typename ISA::V x)
+    {
+        typedef typename ISA::V V;
+        V a = Abs<ISA>(x);
+        typename ISA::M large = ISA::CmpGT(a, ISA::Set1(0.5f));
+        typename ISA::M negative = ISA::CmpLT(x, ISA::Set1(0.0f));
+        V z = ISA::Select(large, ISA::Mul(ISA::Set1(0.5f), ISA::Sub(ISA::Set1(1.0f), a)), ISA::Mul(x, x));
+        V s = ISA::Select(large, ISA::Sqrt(z), x);
+        V p = ArcSine_Polynomial<ISA, P>(s, z);
+        V twice = ISA::Add(p, p);
+        V q = ISA::Select(negative, ISA::Sub(ISA::Set1(3.14159265358979f), twice), twice);
+        return ISA::Select(large, q, ISA::Sub(ISA::Set1(1.5707963267948966f), p));
+    }
+
+    /**
+     * atan(x), where |x| is reduced to [-tan(pi / 8), tan(pi / 8)] with atan(a) = pi / 2 + atan(-1 / a)
+     * above tan(3 * pi / 8), and atan(a) = pi / 4 + atan((a - 1) / (a + 1)) above tan(pi / 8).
+     */
+    template<class ISA, Precision_t P = Precision_Precise>
+    static inline typename ISA::V ArcTan(typename ISA::V x)
+    {
+        typedef typename ISA::V V;
+        V a = Abs<ISA>(x);
+        typename ISA::M large = ISA::CmpGT(a, ISA::Set1(2.414213562373095f));
+        typename ISA::M medium = ISA::CmpGT(a, ISA::Set1(0.4142135623730950f));
+        V t = ISA::Select(medium, Divide<ISA, P>(ISA::Sub(a, ISA::Set1(1.0f)), ISA::Add(a, ISA::Set1(1.0f))), a);
+        t = ISA::Select(large, ISA::Negate(Reciprocal<ISA, P>(a)), t);
+        V y = ISA::Select(large, ISA::Set1(1.5707963267948966f), ISA::Select(medium, ISA::Set1(0.7853981633974483f), ISA::Set1(0.0f)));
+        V z = ISA::Mul(t, t);
+        V p;
+        if (P == Precision_Fastest) {
+            p = ISA::Add(ISA::Mul(ISA::Set1(1.7033899e-1f), z), ISA::Set1(-3.3183348e-1f));
+        } else {
+            p = ISA::Add(ISA::Mul(ISA::Set1(8.05374449538e-2f), z), ISA::Set1(-1.38776856032e-1f));
+            p = ISA::Add(ISA::Mul(p, z), ISA::Set1(1.99777106478e-1f));
+            p = ISA::Add(ISA::Mul(p, z), ISA::Set1(-3.33329491539e-1f));
+        }
+        y = ISA::Add(y, ISA::Add(ISA::Mul(ISA::Mul(p, z), t), t));
+        return ISA::Select(ISA::CmpLT(x, ISA::Set1(0.0f)), ISA::Negate(y), y);
+    }
+
+    /*************************************************************************/
+    /*                              Operations                               */
+    /*************************************************************************/
+#define VF_BINARY_OP(NAME, VECTOR, SCALAR)                                          \
+    struct NAME {                                                                   \
+        template<class ISA>                                                         \
+        static typename ISA::V Apply(typename ISA::V a, typename ISA::V b)          \
+        { return VECTOR; }                                                          \
+        static float Apply(float a, float b) { return SCALAR; }                     \
+    };
+
+#define VF_UNARY_OP(NAME, VECTOR, SCALAR)                                           \
+    struct NAME {                                                                   \
+        template<class ISA>                                                         \
+        static typename ISA::V Apply(typename ISA::V a)                             \
+        { return VECTOR; }                                                          \
+        static float Apply(float a) { return SCALAR; }                              \
+    };
+
+#define VF_COMPARE_OP(NAME, VECTOR, SCALAR)                                         \
+    struct NAME {                                                                   \
+        template<class ISA>                                                         \
+        static typename ISA::M Apply(typename ISA::V a, typename ISA::V b)          \
+        { return VECTOR; }                                                          \
+        static bool Apply(float a, float b) { return SCALAR; }                      \
+    };
+
+    VF_BINARY_OP(Op_Add,        ISA::Add(a, b),     a + b)
+    VF_BINARY_OP(Op_Sub,        ISA::Sub(a, b),     a - b)
+    VF_BINARY_OP(Op_Mul,        ISA::Mul(a, b),     a * b)
+    VF_BINARY_OP(Op_Min,        ISA::Min(a, b),     (a < b) ? a : b)
+    VF_BINARY_OP(Op_Max,        ISA::Max(a, b),     (a > b) ? a : b)
+
+    VF_UNARY_OP(Op_Copy,        a,                                      a)
+    VF_UNARY_OP(Op_Negate,      ISA::Negate(a),                         -a)
+    VF_UNARY_OP(Op_Floor,       ISA::Floor(a),                          floorf(a))
+    VF_UNARY_OP(Op_Ceil,        ISA::Ceil(a),                           ceilf(a))
+    VF_UNARY_OP(Op_Sqrt,        ISA::Sqrt(a),                           sqrtf(a))
+
+    /**
+     * The operations that depends on the precision. The elements after the last full register
+     * are evaluated with Traits_Scalar, whose reciprocals are exact.
+     */
+    template<Precision_t P>
+    struct Op_Div
+    {
+        template<class ISA>
+        static typename ISA::V Apply(typename ISA::V a, typename ISA::V b) { return Divide<ISA, P>(a, b); }
+        static float Apply(float a, float b) { return Divide<Traits_Scalar, P>(a, b); }
+    };
+
+#define VF_PRECISION_OP(NAME, FUNCTION)                                             \
+    template<Precision_t P>                                                         \
+    struct NAME {                                                                   \
+        template<class ISA>                                                         \
+        static typename ISA::V Apply(typename ISA::V a)                             \
+        { return FUNCTION<ISA, P>(a); }                                             \
+        static float Apply(float a) { return FUNCTION<Traits_Scalar, P>(a); }       \
+    };
+
+    VF_PRECISION_OP(Op_InvSqrt,     InvSqrt)
+    VF_PRECISION_OP(Op_Sine,        Sin)
+    VF_PRECISION_OP(Op_Cosine,      Cos)
+    VF_PRECISION_OP(Op_Tangent,     Tan)
+    VF_PRECISION_OP(Op_ArcSine,     ArcSin)
+    VF_PRECISION_OP(Op_ArcCosine,   ArcCos)
+    VF_PRECISION_OP(Op_ArcTangent,  ArcTan)
+
+    VF_COMPARE_OP(Op_Greater,       ISA::CmpGT(a, b),   a > b)
+    VF_COMPARE_OP(Op_Less,          ISA::CmpLT(a, b),   a < b)
+    VF_COMPARE_OP(Op_Equal,         ISA::CmpEQ(a, b),   a == b)
+    VF_COMPARE_OP(Op_GreaterEqual,  ISA::CmpGE(a, b),   a >= b)
+    VF_COMPARE_OP(Op_LessEqual,     ISA::CmpLE(a, b),   a <= b)
+
+#define VF_TERNARY_OP(NAME, VECTOR, SCALAR)                                         \
+    struct NAME {                                                                   \
+        template<class ISA>                                                         \
+        static typename ISA::V Apply(typename ISA::V a, typename ISA::V b, typename ISA::V c) \
+        { return VECTOR; }                                                          \
+        static float Apply(float a, float b, float c) { return SCALAR; }            \
+    };
+
+    VF_TERNARY_OP(Op_MulAdd,    ISA::Add(ISA::Mul(a, b), c),    a * b + c)
+    VF_TERNARY_OP(Op_MulSub,    ISA::Sub(ISA::Mul(a, b), c),    a * b - c)
+    VF_TERNARY_OP(Op_SubMul,    ISA::Sub(c, ISA::Mul(a, b)),    c - a * b)
+
+#undef VF_BINARY_OP
+#undef VF_UNARY_OP
+#undef VF_COMPARE_OP
+#undef VF_TERNARY_OP
+#undef VF_PRECISION_OP
+
+    /*************************************************************************/
+    /*                              Kernels                                  */
+    /*************************************************************************/
+
+    /**
+     * Component wise binary operation.
+     */
+    template<class ISA, class Op>
+    struct Kernel_Binary
+    {
+        template<class L, class R>
+        static void Run(const L & lhs, const R & rhs, float * dst, size_t count, unsigned mask)
+        {
+            const typename ISA::M m = ISA::LaneMask(mask);
+            const bool full = ((mask & 0x0f) == 0x0f);
+            size_t i = 0;
+            for(; (i + ISA::Width) <= count; i += ISA::Width) {
+                Write<ISA>(dst + i, m, full, Op::template Apply<ISA>(lhs.Get(i), rhs.Get(i)));
+            }
+            for(; i < count; ++i) {
+                if (mask & (1 << (i & 3))) {
+                    dst[i] = Op::Apply(lhs.Scalar(i), rhs.Scalar(i));
+                }
+            }
+        }
+
+        static void Exec(float * dst, const KernelOperand & lhs, const KernelOperand & rhs, size_t count, unsigned mask)
+        {
+            Dispatch<ISA, Kernel_Binary>(lhs, rhs, dst, count, mask);
+        }
+    };
+
+    /**
+     * Component wise unary operation.
+     */
+    template<class ISA, class Op>
+    struct Kernel_Unary
+    {
+        template<class S>
+        static void Run(const S & src, float * dst, size_t count, unsigned mask)
+        {
+            const typename ISA::M m = ISA::LaneMask(mask);
+            const bool full = ((mask & 0x0f) == 0x0f);
+            size_t i = 0;
+            for(; (i + ISA::Width) <= count; i += ISA::Width) {
+                Write<ISA>(dst + i, m, full, Op::template Apply<ISA>(src.Get(i)));
+            }
+            for(; i < count; ++i) {
+                if (mask & (1 << (i & 3))) {
+                    dst[i] = Op::Apply(src.Scalar(i));
+                }
+            }
+        }
+
+        static void Exec(float * dst, const KernelOperand & src, size_t count, unsigned mask)
+        {
+            Dispatch<ISA, Kernel_Unary>(src, dst, count, mask);
+        }
+    };
+
+    /**
+     * Component wise operation with three operands.
+     */
+    template<class ISA, class Op>
+    struct Kernel_Ternary
+    {
+        template<class A, class B, class C>
+        static void Run(const A & a, const B & b, const C & c, float * dst, size_t count, unsigned mask)
+        {
+            const typename ISA::M m = ISA::LaneMask(mask);
+            const bool full = ((mask & 0x0f) == 0x0f);
+            size_t i = 0;
+            for(; (i + ISA::Width) <= count; i += ISA::Width) {
+                Write<ISA>(dst + i, m, full, Op::template Apply<ISA>(a.Get(i), b.Get(i), c.Get(i)));
+            }
+            for(; i < count; ++i) {
+                if (mask & (1 << (i & 3))) {
+                    dst[i] = Op::Apply(a.Scalar(i), b.Scalar(i), c.Scalar(i));
+                }
+            }
+        }
+
+        static void Exec(float * dst, const KernelOperand & a, const KernelOperand & b, const KernelOperand & c,
+            size_t count, unsigned mask)
+        {
+            Dispatch3<ISA, Kernel_Ternary>(a, b, c, dst, count, mask);
+        }
+    };
+
+    /**
+     * Dot-product of the first N components, the result is written to the components selected
+     * by the mask after Post has been applied to it.
+     */
+    template<class ISA, size_t N, class Post = Op_Copy>
+    struct Kernel_Dot
+    {
+        template<class L, class R>
+        static void Run(const L & lhs, const R & rhs, float * dst, size_t count, unsigned mask)
+        {
+            const typename ISA::M m = ISA::LaneMask(mask), components = ISA::LaneMask((1 << N) - 1);
+            size_t i = 0;
+            for(; (i + ISA::Width) <= count; i += ISA::Width) {
+                typename ISA::V p = ISA::Mul(lhs.Get(i), rhs.Get(i));
+                if (N < 4) {
+                    p = ISA::Select(components, p, ISA::Zero());
+                }
+                ISA::StoreMasked(dst + i, m, Post::template Apply<ISA>(HorizontalSum<ISA>(p)));
+            }
+            for(; i < count; i += 4) {
+                float sum = 0.0f;
+                for(size_t c = 0; c < N; ++c) {
+                    sum += lhs.Scalar(i + c) * rhs.Scalar(i + c);
+                }
+                sum = Post::Apply(sum);
+                for(size_t c = 0; c < 4; ++c) {
+                    if (mask & (1 << c)) {
+                        dst[i + c] = sum;
+                    }
+                }
+            }
+        }
+
+        static void Exec(float * dst, const KernelOperand & lhs, const KernelOperand & rhs, size_t count, unsigned mask)
+        {
+            Dispatch<ISA, Kernel_Dot>(lhs, rhs, dst, count, mask);
+        }
+    };
+
+    /**
+     * Length of the first N components, the result is written to the components selected by the mask.
+     */
+    template<class ISA, size_t N>
+    struct Kernel_Length
+    {
+        template<class S>
+        static void Run(const S & src, float * dst, size_t count, unsigned mask)
+        {
+            const typename ISA::M m = ISA::LaneMask(mask), components = ISA::LaneMask((1 << N) - 1);
+            size_t i = 0;
+            for(; (i + ISA::Width) <= count; i += ISA::Width) {
+                typename ISA::V v = src.Get(i);
+                typename ISA::V p = ISA::Mul(v, v);
+                if (N < 4) {
+                    p = ISA::Select(components, p, ISA::Zero());
+                }
+                ISA::StoreMasked(dst + i, m, ISA::Sqrt(HorizontalSum<ISA>(p)));
+            }
+            for(; i < count; i += 4) {
+                float sum = 0.0f;
+                for(size_t c = 0; c < N; ++c) {
+                    sum += src.Scalar(i + c) * src.Scalar(i + c);
+                }
+                sum = sqrtf(sum);
+                for(size_t c = 0; c < 4; ++c) {
+                    if (mask & (1 << c)) {
+                        dst[i + c] = sum;
+                    }
+                }
+            }
+        }
+
+        static void Exec(float * dst, const KernelOperand & src, size_t count, unsigned mask)
+        {
+            Dispatch<ISA, Kernel_Length>(src, dst, count, mask);
+        }
+    };
+
+    /**
+     * Normalizes the first N components.
+     */
+    template<class ISA, size_t N, Precision_t P>
+    struct Kernel_Normalize
+    {
+        template<class S>
+        static void Run(const S & src, float * dst, size_t count, unsigned mask)
+        {
+            const typename ISA::M m = ISA::LaneMask(mask), components = ISA::LaneMask((1 << N) - 1);
+            const bool full = ((mask & 0x0f) == 0x0f);
+            size_t i = 0;
+            for(; (i + ISA::Width) <= count; i += ISA::Width) {
+                typename ISA::V v = src.Get(i);
+                typename ISA::V p = ISA::Mul(v, v);
+                if (N < 4) {
+                    p = ISA::Select(components, p, ISA::Zero());
+                }
+                Write<ISA>(dst + i, m, full, Normalize<ISA, P>(v, HorizontalSum<ISA>(p)));
+            }
+            for(; i < count; i += 4) {
+                float v[4], sum = 0.0f;
+                for(size_t c = 0; c < 4; ++c) {
+                    v[c] = src.Scalar(i + c);
+                }
+                for(size_t c = 0; c < N; ++c) {
+                    sum += v[c] * v[c];
+                }
+                sum = sqrtf(sum);
+                for(size_t c = 0; c < 4; ++c) {
+                    if (mask & (1 << c)) {
+                        dst[i + c] = v[c] / sum;
+                    }
+                }
+            }
+        }
+
+        static void Exec(float * dst, const KernelOperand & src, size_t count, unsigned mask)
+        {
+            Dispatch<ISA, Kernel_Normalize>(src, dst, count, mask);
+        }
+    };
+
+    /**
+     * Cross-product of two vf::Vector3.
+     */
+    template<class ISA>
+    struct Kernel_Cross
+    {
+        template<class L, class R>
+        static void Run(const L & lhs, const R & rhs, float * dst, size_t count, unsigned mask)
+        {
+            const typename ISA::M m = ISA::LaneMask(mask);
+            size_t i = 0;
+            for(; (i + ISA::Width) <= count; i += ISA::Width) {
+                typename ISA::V a = lhs.Get(i), b = rhs.Get(i);
+                typename ISA::V a_yzx = ISA::template Permute<0xc9>(a), a_zxy = ISA::template Permute<0xd2>(a);
+                typename ISA::V b_yzx = ISA::template Permute<0xc9>(b), b_zxy = ISA::template Permute<0xd2>(b);
+                ISA::StoreMasked(dst + i, m, ISA::Sub(ISA::Mul(a_yzx, b_zxy), ISA::Mul(a_zxy, b_yzx)));
+            }
+            for(; i < count; i += 4) {
+                float a[3], b[3], r[3];
+                for(size_t c = 0; c < 3; ++c) {
+                    a[c] = lhs.Scalar(i + c);
+                    b[c] = rhs.Scalar(i + c);
+                }
+                r[0] = a[1] * b[2] - a[2] * b[1];
+                r[1] = a[2] * b[0] - a[0] * b[2];
+                r[2] = a[0] * b[1] - a[1] * b[0];
+                for(size_t c = 0; c < 3; ++c) {
+                    if (mask & (1 << c)) {
+                        dst[i + c] = r[c];
+                    }
+                }
+            }
+        }
+
+        static void Exec(float * dst, const KernelOperand & lhs, const KernelOperand & rhs, size_t count, unsigned mask)
+        {
+            Dispatch<ISA, Kernel_Cross>(lhs, rhs, dst, count, mask);
+        }
+    };
+
+    /**
+     * Normalizes the first N components of the lhs and scales them by the rhs.
+     */
+    template<class ISA, size_t N, Precision_t P>
+    struct Kernel_NormalizeScale
+    {
+        template<class L, class R>
+        static void Run(const L & lhs, const R & rhs, float * dst, size_t count, unsigned mask)
+        {
+            const typename ISA::M m = ISA::LaneMask(mask), components = ISA::LaneMask((1 << N) - 1);
+            const bool full = ((mask & 0x0f) == 0x0f);
+            size_t i = 0;
+            for(; (i + ISA::Width) <= count; i += ISA::Width) {
+                typename ISA::V v = lhs.Get(i);
+                typename ISA::V p = ISA::Mul(v, v);
+                if (N < 4) {
+                    p = ISA::Select(components, p, ISA::Zero());
+                }
+                v = Normalize<ISA, P>(v, HorizontalSum<ISA>(p));
+                Write<ISA>(dst + i, m, full, ISA::Mul(v, rhs.Get(i)));
+            }
+            for(; i < count; i += 4) {
+                float v[4], s[4], sum = 0.0f;
+                for(size_t c = 0; c < 4; ++c) {
+                    v[c] = lhs.Scalar(i + c);
+                    s[c] = rhs.Scalar(i + c);
+                }
+                for(size_t c = 0; c < N; ++c) {
+                    sum += v[c] * v[c];
+                }
+                sum = sqrtf(sum);
+                for(size_t c = 0; c < 4; ++c) {
+                    if (mask & (1 << c)) {
+                        dst[i + c] = (v[c] / sum) * s[c];
+                    }
+                }
+            }
+        }
+
+        static void Exec(float * dst, const KernelOperand & lhs, const KernelOperand & rhs, size_t count, unsigned mask)
+        {
+            Dispatch<ISA, Kernel_NormalizeScale>(lhs, rhs, dst, count, mask);
+        }
+    };
+
+    /**
+     * Length of the difference between the first N components of two operands, the result is
+     * written to the components selected by the mask.
+     */
+    template<class ISA, size_t N>
+    struct Kernel_LengthOfDifference
+    {
+        template<class L, class R>
+        static void Run(const L & lhs, const R & rhs, float * dst, size_t count, unsigned mask)
+        {
+            const typename ISA::M m = ISA::LaneMask(mask), components = ISA::LaneMask((1 << N) - 1);
+            size_t i = 0;
+            for(; (i + ISA::Width) <= count; i += ISA::Width) {
+                typename ISA::V v = ISA::Sub(lhs.Get(i), rhs.Get(i));
+                typename ISA::V p = ISA::Mul(v, v);
+                if (N < 4) {
+                    p = ISA::Select(components, p, ISA::Zero());
+                }
+                ISA::StoreMasked(dst + i, m, ISA::Sqrt(HorizontalSum<ISA>(p)));
+            }
+            for(; i < count; i += 4) {
+                float sum = 0.0f;
+                for(size_t c = 0; c < N; ++c) {
+                    float d = lhs.Scalar(i + c) - rhs.Scalar(i + c);
+                    sum += d * d;
+                }
+                sum = sqrtf(sum);
+                for(size_t c = 0; c < 4; ++c) {
+                    if (mask & (1 << c)) {
+                        dst[i + c] = sum;
+                    }
+                }
+            }
+        }
+
+        static void Exec(float * dst, const KernelOperand & lhs, const KernelOperand & rhs, size_t count, unsigned mask)
+        {
+            Dispatch<ISA, Kernel_LengthOfDifference>(lhs, rhs, dst, count, mask);
+        }
+    };
+
+    /**
+     * Compares two scalar operands, one predicate bit is written per element. The comparisons of
+     * eight elements are gathered into each byte, the unused bits of the last byte are cleared.
+     */
+    template<class ISA, class Op>
+    struct Kernel_Compare
+    {
+        template<class L, class R>
+        static void Run(const L & lhs, const R & rhs, uint8_t * predicate, size_t count)
+        {
+            const size_t elements = ISA::Width / 4;
+            size_t i = 0;
+            for(; (i + 8) <= count; i += 8) {
+                unsigned bits = 0;
+                for(size_t k = 0; k < 8; k += elements) {
+                    bits |= ISA::ElementBits(Op::template Apply<ISA>(lhs.Get((i + k) * 4), rhs.Get((i + k) * 4))) << k;
+                }
+                predicate[i / 8] = static_cast<uint8_t>(bits);
+            }
+            if (i < count) {
+                unsigned bits = 0;
+                for(size_t k = 0; (i + k) < count; ++k) {
+                    bits |= unsigned(Op::Apply(lhs.Scalar((i + k) * 4), rhs.Scalar((i + k) * 4))) << k;
+                }
+                predicate[i / 8] = static_cast<uint8_t>(bits);
+            }
+        }
+
+        static void Exec(uint8_t * predicate, const KernelOperand & lhs, const KernelOperand & rhs, size_t count)
+        {
+            Dispatch<ISA, Kernel_Compare>(lhs, rhs, predicate, count);
+        }
+    };
+
+    /**
+     * Blends the lhs operand into the elements whose predicate bit is set, and the rhs operand
+     * into the others.
+     */
+    template<class ISA>
+    struct Kernel_Select
+    {
+        template<class L, class R>
+        static void Run(const L & lhs, const R & rhs, float * dst, const uint8_t * predicate, size_t count, unsigned mask)
+        {
+            const typename ISA::M m = ISA::LaneMask(mask);
+            const bool full = ((mask & 0x0f) == 0x0f);
+            size_t i = 0;
+            for(; (i + ISA::Width) <= count; i += ISA::Width) {
+                size_t e = i / 4;
+                typename ISA::M selected = ISA::ElementMask(predicate[e / 8] >> (e % 8));
+                Write<ISA>(dst + i, m, full, ISA::Select(selected, lhs.Get(i), rhs.Get(i)));
+            }
+            for(; i < count; ++i) {
+                if (mask & (1 << (i & 3))) {
+                    dst[i] = ((predicate[i / 32] >> ((i / 4) % 8)) & 1) ? lhs.Scalar(i) : rhs.Scalar(i);
+                }
+            }
+        }
+
+        static void Exec(float * dst, const uint8_t * predicate, const KernelOperand & lhs, const KernelOperand & rhs,
+            size_t count, unsigned mask)
+        {
+            Dispatch<ISA, Kernel_Select>(lhs, rhs, dst, predicate, count, mask);
+        }
+    };
+
+    /**
+     * Copies floats with non-temporal stores. The floats in front of the first address that is
+     * aligned to a full register, and the floats after the last full register, are copied with
+     * ordinary stores.
+     */
+    template<class ISA>
+    struct Kernel_Stream
+    {
+        static void Exec(float * dst, const float * src, size_t count)
+        {
+            const uintptr_t alignment = ISA::Width * sizeof(float);
+            size_t i = 0;
+            for(; (i < count) && ((reinterpret_cast<uintptr_t>(dst + i) % alignment) != 0); ++i) {
+                dst[i] = src[i];
+            }
+            for(; (i + ISA::Width) <= count; i += ISA::Width) {
+                ISA::StoreStream(dst + i, ISA::Load(src + i));
+            }
+            for(; i < count; ++i) {
+                dst[i] = src[i];
+            }
+            ISA::Fence();
+        }
+    };
+
+    /**
+     * Prefetches the cache lines of a range of memory.
+     */
+    template<class ISA>
+    struct Kernel_Prefetch
+    {
+        static void Exec(const void * ptr, size_t bytes)
+        {
+            const uint8_t * p = static_cast<const uint8_t *>(ptr);
+            for(size_t i = 0; i < bytes; i += CACHE_LINE_SIZE) {
+                ISA::Prefetch(p + i);
+            }
+        }
+    };
+
+    /*************************************************************************/
+    /*                              Kernel table                             */
+    /*************************************************************************/
+    template<class ISA, Precision_t P>
+    static KernelTable MakeKernelTable(ISA_t isa, const char * name)
+    {
+        KernelTable table;
+        table.isa       = isa;
+        table.precision = P;
+        table.name      = name;
+
+        table.Binary[KERNEL_ADD]            = &Kernel_Binary<ISA, Op_Add>::Exec;
+        table.Binary[KERNEL_SUB]            = &Kernel_Binary<ISA, Op_Sub>::Exec;
+        table.Binary[KERNEL_MUL]            = &Kernel_Binary<ISA, Op_Mul>::Exec;
+        table.Binary[KERNEL_DIV]            = &Kernel_Binary<ISA, Op_Div<P> >::Exec;
+        table.Binary[KERNEL_MIN]            = &Kernel_Binary<ISA, Op_Min>::Exec;
+        table.Binary[KERNEL_MAX]            = &Kernel_Binary<ISA, Op_Max>::Exec;
+
+        table.Unary[KERNEL_COPY]            = &Kernel_Unary<ISA, Op_Copy>::Exec;
+        table.Unary[KERNEL_NEGATE]          = &Kernel_Unary<ISA, Op_Negate>::Exec;
+        table.Unary[KERNEL_FLOOR]           = &Kernel_Unary<ISA, Op_Floor>::Exec;
+        table.Unary[KERNEL_CEIL]            = &Kernel_Unary<ISA, Op_Ceil>::Exec;
+        table.Unary[KERNEL_SQRT]            = &Kernel_Unary<ISA, Op_Sqrt>::Exec;
+        table.Unary[KERNEL_INVSQRT]         = &Kernel_Unary<ISA, Op_InvSqrt<P> >::Exec;
+        table.Unary[KERNEL_SINE]            = &Kernel_Unary<ISA, Op_Sine<P> >::Exec;
+        table.Unary[KERNEL_COSINE]          = &Kernel_Unary<ISA, Op_Cosine<P> >::Exec;
+        table.Unary[KERNEL_TANGENT]         = &Kernel_Unary<ISA, Op_Tangent<P> >::Exec;
+        table.Unary[KERNEL_ARCSINE]         = &Kernel_Unary<ISA, Op_ArcSine<P> >::Exec;
+        table.Unary[KERNEL_ARCCOSINE]       = &Kernel_Unary<ISA, Op_ArcCosine<P> >::Exec;
+        table.Unary[KERNEL_ARCTANGENT]      = &Kernel_Unary<ISA, Op_ArcTangent<P> >::Exec;
+
+        table.Compare[KERNEL_CMP_GRT]       = &Kernel_Compare<ISA, Op_Greater>::Exec;
+        table.Compare[KERNEL_CMP_LE]        = &Kernel_Compare<ISA, Op_Less>::Exec;
+        table.Compare[KERNEL_CMP_EQ]        = &Kernel_Compare<ISA, Op_Equal>::Exec;
+        table.Compare[KERNEL_CMP_GEQ]       = &Kernel_Compare<ISA, Op_GreaterEqual>::Exec;
+        table.Compare[KERNEL_CMP_LEQ]       = &Kernel_Compare<ISA, Op_LessEqual>::Exec;
+        table.Select                        = &Kernel_Select<ISA>::Exec;
+        table.Stream                        = &Kernel_Stream<ISA>::Exec;
+        table.Prefetch                      = &Kernel_Prefetch<ISA>::Exec;
+
+        table.Dot[0]                        = &Kernel_Dot<ISA, 2>::Exec;
+        table.Dot[1]                        = &Kernel_Dot<ISA, 3>::Exec;
+        table.Dot[2]                        = &Kernel_Dot<ISA, 4>::Exec;
+        table.Length[0]                     = &Kernel_Length<ISA, 2>::Exec;
+        table.Length[1]                     = &Kernel_Length<ISA, 3>::Exec;
+        table.Length[2]                     = &Kernel_Length<ISA, 4>::Exec;
+        table.Normalize[0]                  = &Kernel_Normalize<ISA, 2, P>::Exec;
+        table.Normalize[1]                  = &Kernel_Normalize<ISA, 3, P>::Exec;
+        table.Normalize[2]                  = &Kernel_Normalize<ISA, 4, P>::Exec;
+        table.Cross                         = &Kernel_Cross<ISA>::Exec;
+
+        table.Ternary[KERNEL_MULADD]        = &Kernel_Ternary<ISA, Op_MulAdd>::Exec;
+        table.Ternary[KERNEL_MULSUB]        = &Kernel_Ternary<ISA, Op_MulSub>::Exec;
+        table.Ternary[KERNEL_SUBMUL]        = &Kernel_Ternary<ISA, Op_SubMul>::Exec;
+        table.NormalizeScale[0]             = &Kernel_NormalizeScale<ISA, 2, P>::Exec;
+        table.NormalizeScale[1]             = &Kernel_NormalizeScale<ISA, 3, P>::Exec;
+        table.NormalizeScale[2]             = &Kernel_NormalizeScale<ISA, 4, P>::Exec;
+        table.LengthOfDifference[0]         = &Kernel_LengthOfDifference<ISA, 2>::Exec;
+        table.LengthOfDifference[1]         = &Kernel_LengthOfDifference<ISA, 3>::Exec;
+        table.LengthOfDifference[2]         = &Kernel_LengthOfDifference<ISA, 4>::Exec;
+        table.DotSqrt[0]                    = &Kernel_Dot<ISA, 2, Op_Sqrt>::Exec;
+        table.DotSqrt[1]                    = &Kernel_Dot<ISA, 3, Op_Sqrt>::Exec;
+        table.DotSqrt[2]                    = &Kernel_Dot<ISA, 4, Op_Sqrt>::Exec;
+        return table;
+    }
+
+    /**
+     * Returns the table of a precision, each table is created the first time it's requested.
+     */
+    template<class ISA>
+    static const KernelTable * SelectKernelTable(ISA_t isa, const char * name, Precision_t precision)
+    {
+        switch(precision) {
+        case Precision_Fast: {
+                static const KernelTable table = MakeKernelTable<ISA, Precision_Fast>(isa, name);
+                return &table;
+            }
+        case Precision_Fastest: {
+                static const KernelTable table = MakeKernelTable<ISA, Precision_Fastest>(isa, name);
+                return &table;
+            }
+        default: {
+                static const KernelTable table = MakeKernelTable<ISA, Precision_Precise>(isa, name);
+                return &table;
+            }
+        }
+    }
+}
+}
@@ -0,0 +1,116 @@
+/**
+ * \file            kernels_sse41.cpp
+ * \description     SSE4.1 implementation of the virtual machine kernels, a register is a
+ *                  single vf::Vector.
+ */
+
+#include "vfkernels.h"
+#include "vfvm.h"
+
+#include <cmath>
+
+#if defined(VF_KERNELS_X86)
+
+#include <immintrin.h>
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("sse4.1"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+#endif
+
+namespace vf
+{
+namespace
+{
+    struct Traits_SSE41
+    {
+        typedef __m128 V;
+        typedef __m128 M;
+        typedef unsigned I;
+        enum { Width = 4 };
+
+        static V Load(const float * p)                  { return _mm_loadu_ps(p); }
+        static void Store(float * p, V v)               { _mm_storeu_ps(p, v); }
+        static void StoreMasked(float * p, M m, V v)    { _mm_storeu_ps(p, _mm_blendv_ps(_mm_loadu_ps(p), v, m)); }
+        static void StoreStream(float * p, V v)         { _mm_stream_ps(p, v); }
+        static void Fence()                             { _mm_sfence(); }
+        static void Prefetch(const void * p)            { _mm_prefetch(static_cast<const char *>(p), _MM_HINT_T0); }
+        static V Broadcast4(const float * p)            { return _mm_loadu_ps(p); }
+        static I SplatIndex(unsigned member)            { return member; }
+        static V Splat(const float * p, I index)        { return _mm_load1_ps(p + index); }
+        static V Zero()                                 { return _mm_setzero_ps(); }
+        static V Set1(float x)                          { return _mm_set1_ps(x); }
+
+        static V Add(V a, V b)                          { return _mm_add_ps(a, b); }
+        static V Sub(V a, V b)                          { return _mm_sub_ps(a, b); }
+        static V Mul(V a, V b)                          { return _mm_mul_ps(a, b); }
+        static V Div(V a, V b)                          { return _mm_div_ps(a, b); }
+        static V Min(V a, V b)                          { return _mm_min_ps(a, b); }
+        static V Max(V a, V b)                          { return _mm_max_ps(a, b); }
+        static V Negate(V a)                            { return _mm_xor_ps(a, _mm_set1_ps(-0.0f)); }
+        static V Floor(V a)                             { return _mm_floor_ps(a); }
+        static V Ceil(V a)                              { return _mm_ceil_ps(a); }
+        static V Sqrt(V a)                              { return _mm_sqrt_ps(a); }
+        static V Rcp(V a)                               { return _mm_rcp_ps(a); }
+        static V RSqrt(V a)                             { return _mm_rsqrt_ps(a); }
+
+        template<int imm>
+        static V Permute(V a)                           { return _mm_shuffle_ps(a, a, imm); }
+
+        static M CmpGT(V a, V b)                        { return _mm_cmpgt_ps(a, b); }
+        static M CmpLT(V a, V b)                        { return _mm_cmplt_ps(a, b); }
+        static M CmpEQ(V a, V b)                        { return _mm_cmpeq_ps(a, b); }
+        static M CmpGE(V a, V b)                        { return _mm_cmpge_ps(a, b); }
+        static M CmpLE(V a, V b)                        { return _mm_cmple_ps(a, b); }
+        static V Select(M m, V a, V b)                  { return _mm_blendv_ps(b, a, m); }
+
+        static M LaneMask(unsigned mask)
+        {
+            return _mm_castsi128_ps(_mm_setr_epi32(-int(mask & 1), -int((mask >> 1) & 1), -int((mask >> 2) & 1),
+                -int((mask >> 3) & 1)));
+        }
+
+        static M ElementMask(unsigned bits)
+        {
+            return _mm_castsi128_ps(_mm_set1_epi32(-int(bits & 1)));
+        }
+
+        static unsigned ElementBits(M m)
+        {
+            return _mm_movemask_ps(m) & 1;
+        }
+
+        static bool AnyLane(M m)                        { return _mm_movemask_ps(m) != 0; }
+    };
+}
+}
+
+#include "kernels_impl.h"
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+namespace vf
+{
+    const KernelTable * GetKernelTable_SSE41(Precision_t precision)
+    {
+        return SelectKernelTable<Traits_SSE41>(ISA_SSE41, "sse4.1", precision);
+    }
+}
+
+#else
+
+namespace vf
+{
+    const KernelTable * GetKernelTable_SSE41(Precision_t)
+    {
+        return nullptr;
+    }
+}
+
+#endif
@@ -0,0 +1,450 @@
+/**
+ * \file            native.cpp
+ * \description     Ahead-of-time compilation of bytecode to C++ source, and the registry of the
+ *                  native kernels that are linked into the application.
+ *
+ *                  The generated source has one function per method. Like the JIT, each function
+ *                  loops over the elements of a batch and executes every step of the method for
+ *                  one element before moving on to the next. The registers are local arrays,
+ *                  constants are inlined as literals and only the written components of each
+ *                  step are computed, which leaves the C++ compiler free to optimize the whole
+ *                  method as a single loop.
+ *                  The trigonometric functions calls the vf::Math_ functions, which gives the same
+ *                  results as the kernels of the interpreter.
+ */
+
+#include "vf.h"
+#include "vfvm.h"
+#include "vfutil.h"
+
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+
+namespace vf
+{
+namespace
+{
+    /** The number of floats between two uniforms */
+    const size_t UniformStride = sizeof(vf::Vector) / sizeof(float);
+
+    /**
+     * Translates the steps of a execution plan into C++.
+     */
+    class NativeEmitter
+    {
+    public:
+        NativeEmitter(const ExecutionPlan & plan, const vfutil::Bitmap & IoMap, size_t numRegisters)
+            : m_Plan(plan), m_IoMap(IoMap), m_Written(numRegisters, 0), m_Uniforms(256, false)
+        {
+        }
+
+        bool Emit(const std::string & function, std::ostream & os);
+
+    protected:
+        bool        Step(const PlanStep &, std::ostream & os);
+        std::string Operand(const PlanOperand &, size_t component) const;
+        std::string Sum(const PlanOperand &, const PlanOperand &) const;
+
+        const ExecutionPlan &       m_Plan;
+        const vfutil::Bitmap &      m_IoMap;
+        std::vector<unsigned>       m_Written;      /**< the components that are written, per register */
+        std::vector<bool>           m_Uniforms;     /**< the uniforms that the plan reads */
+    };
+
+    /**
+     * Formats a float as a C++ literal that is converted back to the same value.
+     */
+    std::string Literal(float value)
+    {
+        if (value != value) {
+            return "std::numeric_limits<float>::quiet_NaN()";
+        }
+        if ((value == HUGE_VALF) || (value == -HUGE_VALF)) {
+            return (value < 0.0f) ? "-std::numeric_limits<float>::infinity()" : "std::numeric_limits<float>::infinity()";
+        }
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%.9g", value);
+        std::string literal(buffer);
+        if (literal.find_first_of(".e") == std::string::npos) {
+            literal += ".0";
+        }
+        return literal + "f";
+    }
+
+    /**
+     * Returns a C++ expression for a component of a operand, scalar operands are replicated to
+     * all components.
+     */
+    std::string NativeEmitter::Operand(const PlanOperand & op, size_t component) const
+    {
+        std::ostringstream os;
+        size_t c = (op.numComponents == 1) ? op.op.member : component;
+        if (op.isreg) {
+            os << "r" << unsigned(op.reg) << "[" << c << "]";
+        } else if (op.isuniform && ((op.numComponents == 1) || (component < op.numComponents))) {
+            os << "u" << unsigned(op.reg) << "[" << c << "]";
+        } else {
+            return Literal(op.op.value[component]);
+        }
+        return os.str();
+    }
+
+    /**
+     * Returns a C++ expression for the sum of the products of the components of two operands,
+     * the order of the additions is the same as in the kernels.
+     */
+    std::string NativeEmitter::Sum(const PlanOperand & lhs, const PlanOperand & rhs) const
+    {
+        std::string p[4];
+        for(size_t c = 0; c < lhs.numComponents; ++c) {
+            p[c] = Operand(lhs, c) + " * " + Operand(rhs, c);
+        }
+        switch(lhs.numComponents) {
+        case 2:     return p[0] + " + " + p[1];
+        case 3:     return "(" + p[0] + " + " + p[1] + ") + " + p[2];
+        default:    return "(" + p[0] + " + " + p[1] + ") + (" + p[2] + " + " + p[3] + ")";
+        }
+    }
+
+    /**
+     * Emits a single step, returns false if the step can't be compiled. The result is computed
+     * into temporaries first, since the destination may also be a source of the step.
+     */
+    bool NativeEmitter::Step(const PlanStep & step, std::ostream & os)
+    {
+        static const char * const binary[KERNEL_BINARY_MAX] = { "+", "-", "*", "/", "<", ">" };
+        static const char * const unary[KERNEL_UNARY_MAX] = {
+            "", "-", "std::floor", "std::ceil", "std::sqrt", "1.0f / std::sqrt",
+            "vf::Math_Sin", "vf::Math_Cos", "vf::Math_Tan", "vf::Math_ArcSin", "vf::Math_ArcCos", "vf::Math_ArcTan"
+        };
+        static const char * const compare[KERNEL_CMP_MAX] = { ">", "<", "==", ">=", "<=" };
+
+        const PlanOperand & lhs = step.src[0];
+        const PlanOperand & rhs = step.src[1];
+        std::string t[4];
+
+        switch(step.family) {
+        case Family_Binary:
+            for(size_t c = 0; c < 4; ++c) {
+                std::string a = Operand(lhs, c), b = Operand(rhs, c);
+                if (step.kernelIndex >= KERNEL_MIN) {
+                    t[c] = "(" + a + " " + binary[step.kernelIndex] + " " + b + ") ? " + a + " : " + b;
+                } else {
+                    t[c] = a + " " + binary[step.kernelIndex] + " " + b;
+                }
+            }
+            break;
+        case Family_Unary:
+            for(size_t c = 0; c < 4; ++c) {
+                if (step.kernelIndex == KERNEL_COPY) {
+                    t[c] = Operand(lhs, c);
+                } else if (step.kernelIndex == KERNEL_NEGATE) {
+                    t[c] = "-(" + Operand(lhs, c) + ")";
+                } else {
+                    t[c] = std::string(unary[step.kernelIndex]) + "(" + Operand(lhs, c) + ")";
+                }
+            }
+            break;
+        case Family_Dot:
+            t[0] = t[1] = t[2] = t[3] = Sum(lhs, rhs);
+            break;
+        case Family_Length:
+            t[0] = t[1] = t[2] = t[3] = "std::sqrt(" + Sum(lhs, lhs) + ")";
+            break;
+        case Family_Normalize:
+            os << "            {" << std::endl;
+            os << "                const float length = std::sqrt(" << Sum(lhs, lhs) << ");" << std::endl;
+            for(size_t c = 0; c < 4; ++c) {
+                if (step.mask & (1 << c)) {
+                    os << "                r" << unsigned(step.dst) << "[" << c << "] = " << Operand(lhs, c) << " / length;" << std::endl;
+                }
+            }
+            os << "            }" << std::endl;
+            m_Written[step.dst] |= step.mask;
+            return true;
+        case Family_Cross:
+            for(size_t c = 0; c < 3; ++c) {
+                size_t i = (c + 1) % 3, j = (c + 2) % 3;
+                t[c] = Operand(lhs, i) + " * " + Operand(rhs, j) + " - " + Operand(lhs, j) + " * " + Operand(rhs, i);
+            }
+            t[3] = "0.0f";
+            break;
+        case Family_Compare:
+            os << "            flag = " << Operand(lhs, 0) << " " << compare[step.kernelIndex] << " " << Operand(rhs, 0) << ";" << std::endl;
+            return true;
+        case Family_Select:
+            for(size_t c = 0; c < 4; ++c) {
+                t[c] = "flag ? " + Operand(lhs, c) + " : " + Operand(rhs, c);
+            }
+            break;
+        default:
+            return false;
+        }
+
+        os << "            {" << std::endl;
+        for(size_t c = 0; c < 4; ++c) {
+            if (step.mask & (1 << c)) {
+                os << "                const float t" << c << " = " << t[c] << ";" << std::endl;
+            }
+        }
+        for(size_t c = 0; c < 4; ++c) {
+            if (step.mask & (1 << c)) {
+                os << "                r" << unsigned(step.dst) << "[" << c << "] = t" << c << ";" << std::endl;
+            }
+        }
+        os << "            }" << std::endl;
+        m_Written[step.dst] |= step.mask;
+        return true;
+    }
+
+    /**
+     * Emits the function of the plan, returns false if the plan can't be compiled.
+     */
+    bool NativeEmitter::Emit(const std::string & function, std::ostream & os)
+    {
+        std::ostringstream body;
+        for(size_t i = 0; i < m_Plan.steps.size(); ++i) {
+            const PlanStep & step = m_Plan.steps[i];
+            for(size_t s = 0; s < 2; ++s) {
+                if (step.src[s].isuniform) {
+                    m_Uniforms[step.src[s].reg] = true;
+                }
+            }
+            if (!Step(step, body)) {
+                return false;
+            }
+        }
+
+        os << "    void " << function << "(float * const * registers, const float * uniforms, size_t count)" << std::endl;
+        os << "    {" << std::endl;
+        bool uniforms = false;
+        for(size_t u = 0; u < m_Uniforms.size(); ++u) {
+            if (m_Uniforms[u]) {
+                size_t base = u * UniformStride;
+                os << "        const float u" << u << "[4] = { uniforms[" << base << "], uniforms[" << (base + 1)
+                    << "], uniforms[" << (base + 2) << "], uniforms[" << (base + 3) << "] };" << std::endl;
+                uniforms = true;
+            }
+        }
+        if (!uniforms) {
+            os << "        (void) uniforms;" << std::endl;
+        }
+        for(size_t r = 0; r < m_Plan.registers.size(); ++r) {
+            unsigned reg = m_Plan.registers[r];
+            if (m_IoMap.Get(reg)) {
+                os << "        float * const s" << reg << " = registers[" << reg << "];" << std::endl;
+            }
+        }
+        os << "        for(size_t i = 0; i < count; ++i) {" << std::endl;
+        for(size_t r = 0; r < m_Plan.registers.size(); ++r) {
+            unsigned reg = m_Plan.registers[r];
+            if (m_IoMap.Get(reg)) {
+                os << "            float r" << reg << "[4] = { s" << reg << "[i * 4], s" << reg << "[i * 4 + 1], s"
+                    << reg << "[i * 4 + 2], s" << reg << "[i * 4 + 3] };" << std::endl;
+            } else {
+                os << "            float r" << reg << "[4] = { 0.0f, 0.0f, 0.0f, 0.0f };" << std::endl;
+            }
+        }
+        for(size_t i = 0; i < m_Plan.steps.size(); ++i) {
+            if (m_Plan.steps[i].family == Family_Compare) {
+                os << "            bool flag = false;" << std::endl;
+                break;
+            }
+        }
+        os << body.str();
+        for(size_t r = 0; r < m_Plan.registers.size(); ++r) {
+            unsigned reg = m_Plan.registers[r];
+            if (m_IoMap.Get(reg)) {
+                for(size_t c = 0; c < 4; ++c) {
+                    if (m_Written[reg] & (1 << c)) {
+                        os << "            s" << reg << "[i * 4 + " << c << "] = r" << reg << "[" << c << "];" << std::endl;
+                    }
+                }
+            }
+        }
+        os << "        }" << std::endl;
+        os << "    }" << std::endl;
+        return true;
+    }
+
+    /**
+     * Returns true if the name can be used as a C++ identifier.
+     */
+    bool IsIdentifier(const char * name)
+    {
+        if (!name || !*name || ((*name >= '0') && (*name <= '9'))) {
+            return false;
+        }
+        for(; *name; ++name) {
+            char c = *name;
+            if (!(((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) || ((c >= '0') && (c <= '9')) || (c == '_'))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * The registered native kernels, keyed by the bytecode hash and the method index.
+     */
+    struct NativeRegistry
+    {
+        std::mutex                                                  lock;
+        std::map<std::pair<uint64_t, size_t>, NativeKernel_t>       kernels;
+    };
+
+    NativeRegistry & Registry()
+    {
+        static NativeRegistry registry;
+        return registry;
+    }
+
+    /** FNV-1a */
+    void Hash(uint64_t & hash, uint32_t value)
+    {
+        for(size_t i = 0; i < 4; ++i) {
+            hash ^= (value >> (i * 8)) & 0xff;
+            hash *= 0x100000001b3ULL;
+        }
+    }
+}
+
+    /*************************************************************************/
+    /*                                  Native                               */
+    /*************************************************************************/
+
+    uint64_t Native_Hash(const vf::ByteCode & bytecode)
+    {
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        Hash(hash, bytecode.GetNumRegisters());
+        Hash(hash, bytecode.GetNumUniforms());
+        Hash(hash, bytecode.GetNumSamplers());
+
+        const std::map<std::string, vf::Variable> & ioStreams = bytecode.GetInputOutput();
+        for(std::map<std::string, vf::Variable>::const_iterator it = ioStreams.begin(); it != ioStreams.end(); it++) {
+            Hash(hash, it->second.m_Register);
+        }
+
+        const std::vector<std::shared_ptr<ByteCode_Method> > & methods = bytecode.GetMethods();
+        Hash(hash, static_cast<uint32_t>(methods.size()));
+        for(size_t i = 0; i < methods.size(); ++i) {
+            const std::vector<uint32_t> & code = methods[i]->GetCode();
+            Hash(hash, static_cast<uint32_t>(code.size()));
+            for(size_t j = 0; j < code.size(); ++j) {
+                Hash(hash, code[j]);
+            }
+        }
+        return hash;
+    }
+
+    Status_t Native_Emit(const vf::ByteCode & bytecode, const char * name, std::ostream & os)
+    {
+        if (!IsIdentifier(name)) {
+            return Err_InvalidParameter;
+        }
+
+        vfutil::Bitmap IoMap(bytecode.GetNumRegisters());
+        const std::map<std::string, vf::Variable> & ioStreams = bytecode.GetInputOutput();
+        for(std::map<std::string, vf::Variable>::const_iterator it = ioStreams.begin(); it != ioStreams.end(); it++) {
+            IoMap.Set(it->second.m_Register);
+        }
+        VirtualMachine vm(IoMap, bytecode.GetNumRegisters(), bytecode.GetNumUniforms(), bytecode.GetNumSamplers(),
+            ISA_Portable);
+
+        // Translate every method before anything is written, so a failure doesn't leave a partial file.
+        const std::vector<std::shared_ptr<ByteCode_Method> > & methods = bytecode.GetMethods();
+        std::ostringstream functions;
+        std::vector<size_t> emitted;
+        for(size_t i = 0; i < methods.size(); ++i) {
+            // A prologue leaves its results in temporaries, which the kernels keep in local arrays.
+            if (methods[i]->GetName().compare(0, 1, "$") == 0) {
+                continue;
+            }
+            ExecutionPlan plan;
+            InstructionStream stream(methods[i]->GetCode());
+            Status_t err = vm.Compile(stream, plan);
+            if (err != Err_Success) {
+                return err;
+            }
+            std::ostringstream function;
+            function << name << "_" << i;
+            std::ostringstream code;
+            NativeEmitter emitter(plan, IoMap, bytecode.GetNumRegisters());
+            if (emitter.Emit(function.str(), code)) {
+                functions << "    /** " << methods[i]->GetName() << " */" << std::endl << code.str() << std::endl;
+                emitted.push_back(i);
+            }
+        }
+
+        char hash[32];
+        snprintf(hash, sizeof(hash), "0x%016llxULL", static_cast<unsigned long long>(Native_Hash(bytecode)));
+
+        os << "/**" << std::endl;
+        os << " * \\file            " << name << ".cpp" << std::endl;
+        os << " * \\description     Native kernels generated from bytecode with the hash " << hash << "." << std::endl;
+        os << " *                  Generated by vf::Native_Emit, regenerate the file when the program changes." << std::endl;
+        os << " */" << std::endl;
+        os << std::endl;
+        os << "#include <cmath>" << std::endl;
+        os << "#include <cstddef>" << std::endl;
+        os << "#include <cstdint>" << std::endl;
+        os << "#include <limits>" << std::endl;
+        os << std::endl;
+        os << "namespace vf" << std::endl;
+        os << "{" << std::endl;
+        os << "    typedef void (*NativeKernel_t)(float * const * registers, const float * uniforms, size_t count);" << std::endl;
+        os << "    bool Native_Register(uint64_t hash, size_t method, NativeKernel_t kernel);" << std::endl;
+        os << "    float Math_Sin(float);" << std::endl;
+        os << "    float Math_Cos(float);" << std::endl;
+        os << "    float Math_Tan(float);" << std::endl;
+        os << "    float Math_ArcSin(float);" << std::endl;
+        os << "    float Math_ArcCos(float);" << std::endl;
+        os << "    float Math_ArcTan(float);" << std::endl;
+        os << "}" << std::endl;
+        os << std::endl;
+        os << "namespace" << std::endl;
+        os << "{" << std::endl;
+        os << functions.str();
+        os << "}" << std::endl;
+        os << std::endl;
+        os << "/**" << std::endl;
+        os << " * Registers the kernels, called automatically unless the file is linked from a static library" << std::endl;
+        os << " * where nothing else references it." << std::endl;
+        os << " */" << std::endl;
+        os << "void " << name << "_Register()" << std::endl;
+        os << "{" << std::endl;
+        for(size_t i = 0; i < emitted.size(); ++i) {
+            os << "    vf::Native_Register(" << hash << ", " << emitted[i] << ", &" << name << "_" << emitted[i] << ");" << std::endl;
+        }
+        os << "}" << std::endl;
+        os << std::endl;
+        os << "namespace" << std::endl;
+        os << "{" << std::endl;
+        os << "    struct Registration" << std::endl;
+        os << "    {" << std::endl;
+        os << "        Registration() { " << name << "_Register(); }" << std::endl;
+        os << "    } registration;" << std::endl;
+        os << "}" << std::endl;
+        return os.good() ? Err_Success : Err_InvalidParameter;
+    }
+
+    bool Native_Register(uint64_t hash, size_t method, NativeKernel_t kernel)
+    {
+        NativeRegistry & registry = Registry();
+        std::lock_guard<std::mutex> guard(registry.lock);
+        return registry.kernels.insert(std::make_pair(std::make_pair(hash, method), kernel)).second;
+    }
+
+    NativeKernel_t Native_Find(uint64_t hash, size_t method)
+    {
+        NativeRegistry & registry = Registry();
+        std::lock_guard<std::mutex> guard(registry.lock);
+        std::map<std::pair<uint64_t, size_t>, NativeKernel_t>::const_iterator it =
+            registry.kernels.find(std::make_pair(hash, method));
+        return (it == registry.kernels.end()) ? nullptr : it->second;
+    }
+}
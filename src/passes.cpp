@@ -0,0 +1,663 @@
+/**
+ * \file            passes.cpp
+ * \description     Optimization passes over the intermediate representation, the pass
+ *                  manager that runs them, and the hoisting of uniform invariant values.
+ */
+
+#include "vfssa.h"
+#include "vfkernels.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <ostream>
+#include <unordered_map>
+
+namespace vf
+{
+    /*************************************************************************/
+    /*                              Constant folding                         */
+    /*************************************************************************/
+namespace
+{
+    static size_t NumComponents(vf::DataType type)
+    {
+        switch(type) {
+        case vf::Type_Float:    return 1;
+        case vf::Type_Vec2:     return 2;
+        case vf::Type_Vec3:     return 3;
+        case vf::Type_Vec4:     return 4;
+        default:                return 0;
+        }
+    }
+
+    /**
+     * Evaluates operations whose operands are all constants, and simplifies members of
+     * constants, uniforms and other members.
+     */
+    class ConstantFolding : public IR_Pass
+    {
+    public:
+        const char * Name() const { return "fold"; }
+
+        bool Run(IR_Function & func)
+        {
+            bool changed = false;
+            for(size_t i = 0; i < func.code.size(); ++i) {
+                changed |= Fold(func, static_cast<int>(i));
+            }
+            if (changed) {
+                IR_Compact(func);
+            }
+            return changed;
+        }
+
+    protected:
+        static bool IsConst(const IR_Function & func, int value)
+        {
+            return func.code[value].op == IR_Const;
+        }
+
+        /** Horizontal sum in the same order as the kernels */
+        static float Sum(const float * p, size_t n)
+        {
+            switch(n) {
+            case 2:     return p[0] + p[1];
+            case 3:     return (p[0] + p[1]) + p[2];
+            case 4:     return (p[0] + p[1]) + (p[2] + p[3]);
+            default:    return p[0];
+            }
+        }
+
+        static bool Evaluate(const IR_Function & func, const IR_Instruction & ins, vf::Vector & result);
+        static bool Fold(IR_Function & func, int index);
+    };
+
+    bool ConstantFolding::Evaluate(const IR_Function & func, const IR_Instruction & ins, vf::Vector & result)
+    {
+        float x[4] = { 0, 0, 0, 0 }, y[4] = { 0, 0, 0, 0 }, r[4] = { 0, 0, 0, 0 }, p[4];
+        size_t n = NumComponents(func.code[ins.args[0]].type);
+        for(size_t c = 0; c < 4; ++c) {
+            x[c] = func.code[ins.args[0]].value[c];
+            if (IR_NumArgs(ins.op) > 1) {
+                y[c] = func.code[ins.args[1]].value[c];
+            }
+        }
+
+        switch(ins.op) {
+        case IR_Add:    for(size_t c = 0; c < n; ++c) r[c] = x[c] + y[c]; break;
+        case IR_Sub:    for(size_t c = 0; c < n; ++c) r[c] = x[c] - y[c]; break;
+        case IR_Mul:    for(size_t c = 0; c < n; ++c) r[c] = x[c] * y[0]; break;
+        case IR_Div:    for(size_t c = 0; c < n; ++c) r[c] = x[c] / y[0]; break;
+        case IR_Min:    for(size_t c = 0; c < n; ++c) r[c] = std::min(x[c], y[c]); break;
+        case IR_Max:    for(size_t c = 0; c < n; ++c) r[c] = std::max(x[c], y[c]); break;
+        case IR_Negate: for(size_t c = 0; c < n; ++c) r[c] = -x[c]; break;
+        case IR_Floor:  for(size_t c = 0; c < n; ++c) r[c] = floorf(x[c]); break;
+        case IR_Ceil:   for(size_t c = 0; c < n; ++c) r[c] = ceilf(x[c]); break;
+        case IR_Sqrt:   r[0] = sqrtf(x[0]); break;
+        case IR_InvSqrt:r[0] = 1.0f / sqrtf(x[0]); break;
+        case IR_Sin:    r[0] = Math_Sin(x[0]); break;
+        case IR_Cos:    r[0] = Math_Cos(x[0]); break;
+        case IR_Tan:    r[0] = Math_Tan(x[0]); break;
+        case IR_ArcSin: r[0] = Math_ArcSin(x[0]); break;
+        case IR_ArcCos: r[0] = Math_ArcCos(x[0]); break;
+        case IR_ArcTan: r[0] = Math_ArcTan(x[0]); break;
+        case IR_Dot:
+            for(size_t c = 0; c < n; ++c) p[c] = x[c] * y[c];
+            r[0] = Sum(p, n);
+            break;
+        case IR_Length:
+            for(size_t c = 0; c < n; ++c) p[c] = x[c] * x[c];
+            r[0] = sqrtf(Sum(p, n));
+            break;
+        case IR_Normalize: {
+            for(size_t c = 0; c < n; ++c) p[c] = x[c] * x[c];
+            float length = sqrtf(Sum(p, n));
+            for(size_t c = 0; c < n; ++c) r[c] = x[c] / length;
+            break;
+        }
+        case IR_Cross:
+            r[0] = x[1] * y[2] - x[2] * y[1];
+            r[1] = x[2] * y[0] - x[0] * y[2];
+            r[2] = x[0] * y[1] - x[1] * y[0];
+            break;
+        default:
+            return false;
+        }
+        for(size_t c = 0; c < 4; ++c) {
+            result[c] = r[c];
+        }
+        return true;
+    }
+
+    bool ConstantFolding::Fold(IR_Function & func, int index)
+    {
+        IR_Instruction & ins = func.code[index];
+
+        if (ins.op == IR_Member) {
+            const IR_Instruction source = func.code[ins.args[0]];
+            if ((ins.member == 0) && (ins.type == source.type)) {
+                /** the whole value */
+                IR_Replace(func, index, ins.args[0]);
+                func.code[index].op = IR_Nop;
+                return true;
+            }
+            switch(source.op) {
+            case IR_Const:
+                ins.op = IR_Const;
+                for(size_t c = 0; c < 4; ++c) {
+                    ins.value[c] = ((ins.member + c) < 4) ? source.value[ins.member + c] : 0.0f;
+                }
+                ins.member = 0;
+                return true;
+            case IR_Uniform:
+                ins.op      = IR_Uniform;
+                ins.reg     = source.reg;
+                ins.member  = source.member + ins.member;
+                return true;
+            case IR_Member:
+                ins.args[0] = source.args[0];
+                ins.member  = source.member + ins.member;
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        if (ins.op == IR_Select) {
+            const IR_Instruction & cmp = func.code[ins.args[0]];
+            if (!IsConst(func, cmp.args[0]) || !IsConst(func, cmp.args[1])) {
+                return false;
+            }
+            float l = func.code[cmp.args[0]].value[0], r = func.code[cmp.args[1]].value[0];
+            bool result;
+            switch(cmp.reg) {
+            case IR_CmpEqual:           result = (l == r); break;
+            case IR_CmpGreater:         result = (l > r); break;
+            case IR_CmpLess:            result = (l < r); break;
+            case IR_CmpGreaterEqual:    result = (l >= r); break;
+            case IR_CmpLessEqual:       result = (l <= r); break;
+            default:                    return false;
+            }
+            IR_Replace(func, index, ins.args[result ? 1 : 2]);
+            func.code[index].op = IR_Nop;
+            return true;
+        }
+
+        if (!IR_IsEmitted(ins.op) || (ins.op == IR_Sample) || (ins.op == IR_Store)) {
+            return false;
+        }
+        for(size_t a = 0; a < IR_NumArgs(ins.op); ++a) {
+            if (!IsConst(func, ins.args[a])) {
+                return false;
+            }
+        }
+        vf::Vector result;
+        if (!Evaluate(func, ins, result)) {
+            return false;
+        }
+        ins.op      = IR_Const;
+        ins.value   = result;
+        ins.args[0] = ins.args[1] = ins.args[2] = -1;
+        return true;
+    }
+
+    /*************************************************************************/
+    /*                            Dead code elimination                      */
+    /*************************************************************************/
+
+    class DeadCodeElimination : public IR_Pass
+    {
+    public:
+        const char * Name() const { return "dce"; }
+
+        bool Run(IR_Function & func)
+        {
+            std::vector<size_t> uses = IR_CountUses(func);
+            bool changed = false;
+            for(size_t i = func.code.size(); i-- > 0;) {
+                IR_Instruction & ins = func.code[i];
+                if ((ins.op == IR_Nop) || (ins.op == IR_Store) || uses[i]) {
+                    continue;
+                }
+                for(size_t a = 0; a < IR_NumArgs(ins.op); ++a) {
+                    uses[ins.args[a]]--;
+                }
+                ins.op  = IR_Nop;
+                changed = true;
+            }
+            if (changed) {
+                IR_Compact(func);
+            }
+            return changed;
+        }
+    };
+
+    /*************************************************************************/
+    /*                      Common subexpression elimination                 */
+    /*************************************************************************/
+
+    /**
+     * Identifies the value that a instruction computes, equal for instructions that computes the
+     * same value. Loads also hold the number of stores to the register before them, constants
+     * their components.
+     */
+    struct ValueKey
+    {
+        enum { NUM_WORDS = 11 };
+
+        bool operator==(const ValueKey & other) const
+        {
+            return memcmp(words, other.words, sizeof(words)) == 0;
+        }
+
+        uint32_t    words[NUM_WORDS];
+    };
+
+    struct ValueHash
+    {
+        size_t operator()(const ValueKey & key) const
+        {
+            /** FNV-1a over the words */
+            uint64_t hash = 14695981039346656037ULL;
+            for(size_t i = 0; i < ValueKey::NUM_WORDS; ++i) {
+                hash = (hash ^ key.words[i]) * 1099511628211ULL;
+            }
+            return static_cast<size_t>(hash);
+        }
+    };
+
+    /**
+     * Replaces instructions that computes the same value as a earlier instruction. Every
+     * instruction except stores is free of side effects, loads are only equal as long as
+     * the register hasn't been stored to in between.
+     *
+     * The instructions are visited once in program order. The operands of each instruction
+     * are rewritten to the values that replaced them before it's looked up, so the values
+     * of the table are always the first instruction of their kind.
+     */
+    class CommonSubexpressionElimination : public IR_Pass
+    {
+    public:
+        CommonSubexpressionElimination(size_t maxTemporaries) : m_MaxTemporaries(maxTemporaries)
+        {
+        }
+
+        const char * Name() const { return "cse"; }
+
+        bool Run(IR_Function & func)
+        {
+            typedef std::unordered_map<ValueKey, int, ValueHash> ValueMap;
+            ValueMap values;
+            std::vector<uint32_t> generation(256, 0);   /**< the number of stores to each register */
+            std::vector<int> replaced(func.code.size());
+            for(size_t i = 0; i < replaced.size(); ++i) {
+                replaced[i] = static_cast<int>(i);
+            }
+
+            // The number of temporaries that are live at each position, which is kept up to date
+            // as the values are reused.
+            std::vector<int> lastUse;
+            std::vector<bool> temporary;
+            IR_LiveRanges(func, lastUse, temporary);
+            std::vector<int> live(func.code.size() + 1, 0);
+            for(size_t i = 0; i < func.code.size(); ++i) {
+                if (IR_IsEmitted(func.code[i].op) && (func.code[i].op != IR_Store) && temporary[i]) {
+                    live[i]++;
+                    live[lastUse[i]]--;
+                }
+            }
+            int limit = 0;
+            for(size_t i = 0; i < func.code.size(); ++i) {
+                live[i] += i ? live[i - 1] : 0;
+                limit = std::max(limit, live[i]);
+            }
+            limit = std::max(limit, static_cast<int>(m_MaxTemporaries));
+            bool changed = false;
+
+            for(size_t i = 0; i < func.code.size(); ++i) {
+                IR_Instruction & ins = func.code[i];
+                for(size_t a = 0; a < IR_NumArgs(ins.op); ++a) {
+                    ins.args[a] = replaced[ins.args[a]];
+                }
+                if (ins.op == IR_Store) {
+                    generation[ins.reg]++;
+                    continue;
+                }
+                if (ins.op == IR_Nop) {
+                    continue;
+                }
+
+                std::pair<ValueMap::iterator, bool> entry = values.insert(std::make_pair(Key(ins, generation),
+                    static_cast<int>(i)));
+                if (entry.second) {
+                    continue;
+                }
+                int value = entry.first->second;
+                if (IR_IsEmitted(ins.op) && !Reuse(value, static_cast<int>(i), limit, lastUse, temporary, live)) {
+                    continue;
+                }
+                replaced[i] = value;
+                ins.op = IR_Nop;
+                changed = true;
+            }
+            if (changed) {
+                IR_Compact(func);
+            }
+            return changed;
+        }
+
+    protected:
+        /**
+         * Extends the live range of a earlier value over the uses of a later value that computes
+         * the same, unless more than limit temporaries would be live at some position. Only the
+         * positions between the two ranges are affected, the later value no longer needs a
+         * register of its own.
+         */
+        static bool Reuse(int value, int later, int limit, std::vector<int> & lastUse, std::vector<bool> & temporary,
+            std::vector<int> & live)
+        {
+            bool isTemporary = temporary[value] || temporary[later];
+            int begin = temporary[value] ? lastUse[value] : value;
+            int end = std::max(lastUse[value], lastUse[later]);
+            if (isTemporary) {
+                for(int p = begin; p < end; ++p) {
+                    if (live[p] + Change(p, value, later, lastUse, temporary) > limit) {
+                        return false;
+                    }
+                }
+                for(int p = begin; p < end; ++p) {
+                    live[p] += Change(p, value, later, lastUse, temporary);
+                }
+            }
+            lastUse[value] = end;
+            temporary[value] = isTemporary;
+            return true;
+        }
+
+        /** Returns the change in live temporaries at a position, when value takes over the uses of later */
+        static int Change(int p, int value, int later, const std::vector<int> & lastUse,
+            const std::vector<bool> & temporary)
+        {
+            int change = 1;
+            change -= (temporary[value] && (p < lastUse[value])) ? 1 : 0;
+            change -= (temporary[later] && (p >= later) && (p < lastUse[later])) ? 1 : 0;
+            return change;
+        }
+
+        /**
+         * Returns a key that is equal for instructions that computes the same value. The operands
+         * of additions and dot products are ordered, since the result doesn't depend on the order.
+         */
+        static ValueKey Key(const IR_Instruction & ins, const std::vector<uint32_t> & generation)
+        {
+            ValueKey key;
+            memset(key.words, 0, sizeof(key.words));
+            int first = ins.args[0], second = ins.args[1];
+            if (((ins.op == IR_Add) || (ins.op == IR_Dot)) && (second < first)) {
+                std::swap(first, second);
+            }
+            key.words[0] = ins.op;
+            key.words[1] = ins.type;
+            key.words[2] = static_cast<uint32_t>(first);
+            key.words[3] = static_cast<uint32_t>(second);
+            key.words[4] = static_cast<uint32_t>(ins.args[2]);
+            key.words[5] = ins.reg;
+            key.words[6] = ins.member;
+            if (ins.op == IR_Load) {
+                key.words[7] = generation[ins.reg];
+            } else if (ins.op == IR_Const) {
+                for(size_t c = 0; c < NumComponents(ins.type); ++c) {
+                    memcpy(&key.words[7 + c], &ins.value[c], sizeof(uint32_t));
+                }
+            }
+            return key;
+        }
+
+        size_t m_MaxTemporaries;
+    };
+}
+
+    std::shared_ptr<IR_Pass> IR_ConstantFolding()
+    {
+        return std::make_shared<ConstantFolding>();
+    }
+
+    std::shared_ptr<IR_Pass> IR_DeadCodeElimination()
+    {
+        return std::make_shared<DeadCodeElimination>();
+    }
+
+    std::shared_ptr<IR_Pass> IR_CommonSubexpressionElimination(size_t maxTemporaries)
+    {
+        return std::make_shared<CommonSubexpressionElimination>(maxTemporaries);
+    }
+
+    /*************************************************************************/
+    /*                                  Hoisting                             */
+    /*************************************************************************/
+namespace
+{
+    /** Returns true if code has to be generated to compute a value */
+    static bool Generates(const IR_Function & func, int value)
+    {
+        const IR_Instruction & ins = func.code[value];
+        if (ins.op == IR_Member) {
+            return Generates(func, ins.args[0]);
+        }
+        return IR_IsEmitted(ins.op) || (ins.op == IR_Compare);
+    }
+
+    /** Returns true if a value is computed by a single instruction */
+    static bool IsSingleOperation(const IR_Function & func, int value)
+    {
+        const IR_Instruction & ins = func.code[value];
+        for(size_t a = 0; a < IR_NumArgs(ins.op); ++a) {
+            if (Generates(func, ins.args[a])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Records that a invariant value is read by a instruction that depends on a stream. Members
+     * and comparisons are generated where they are used, so their operands are read instead.
+     * Moving a value saves instructions unless a store is the only reader and the value is
+     * computed by a single instruction.
+     */
+    static void Read(const IR_Function & func, const std::vector<bool> & invariant, int value,
+        bool isStore, std::vector<bool> & read, std::vector<bool> & saves)
+    {
+        const IR_Instruction & ins = func.code[value];
+        if (!invariant[value] || (ins.op == IR_Const) || (ins.op == IR_Uniform)) {
+            return;
+        }
+        if ((ins.op == IR_Member) || (ins.op == IR_Compare)) {
+            for(size_t a = 0; a < IR_NumArgs(ins.op); ++a) {
+                Read(func, invariant, ins.args[a], false, read, saves);
+            }
+            return;
+        }
+        read[value] = true;
+        if (!isStore || !IsSingleOperation(func, value)) {
+            saves[value] = true;
+        }
+    }
+}
+
+    bool IR_HoistUniforms(IR_Function & func, IR_Function & prologue, uint8_t firstUniform,
+        uint8_t firstRegister, std::vector<IR_Hoisted> & hoisted)
+    {
+        size_t size = func.code.size();
+
+        /** the values that are the same for every element */
+        std::vector<bool> invariant(size, false);
+        for(size_t i = 0; i < size; ++i) {
+            const IR_Instruction & ins = func.code[i];
+            switch(ins.op) {
+            case IR_Nop:
+            case IR_Load:
+            case IR_Sample:
+            case IR_Store:
+                break;
+            default:
+                invariant[i] = true;
+                for(size_t a = 0; a < IR_NumArgs(ins.op); ++a) {
+                    invariant[i] = invariant[i] && invariant[ins.args[a]];
+                }
+                break;
+            }
+        }
+
+        std::vector<bool> read(size, false), saves(size, false);
+        for(size_t i = 0; i < size; ++i) {
+            const IR_Instruction & ins = func.code[i];
+            if (!invariant[i]) {
+                for(size_t a = 0; a < IR_NumArgs(ins.op); ++a) {
+                    Read(func, invariant, ins.args[a], ins.op == IR_Store, read, saves);
+                }
+            }
+        }
+
+        /** each moved value takes a hidden uniform, and a register while the prologue executes */
+        std::vector<int> moved;
+        for(size_t i = 0; i < size; ++i) {
+            size_t n = moved.size();
+            if (read[i] && saves[i] && ((firstUniform + n) < IR_MAX_UNIFORMS) && (n < IR_MAX_TEMPORARIES) &&
+                ((firstRegister + n) < 64))
+            {
+                moved.push_back(static_cast<int>(i));
+            }
+        }
+        if (moved.empty()) {
+            return false;
+        }
+
+        prologue.name = func.name;
+        prologue.code.clear();
+        for(size_t i = 0; i < size; ++i) {
+            prologue.code.push_back(invariant[i] ? func.code[i] : IR_Instruction());
+        }
+        for(size_t n = 0; n < moved.size(); ++n) {
+            IR_Hoisted value;
+            value.uniform   = static_cast<uint8_t>(firstUniform + n);
+            value.reg       = static_cast<uint8_t>(firstRegister + n);
+            value.type      = func.code[moved[n]].type;
+            hoisted.push_back(value);
+
+            IR_Instruction store(IR_Store, value.type);
+            store.reg       = value.reg;
+            store.args[0]   = moved[n];
+            prologue.Append(store);
+
+            IR_Instruction uniform(IR_Uniform, value.type);
+            uniform.reg     = value.uniform;
+            func.code[moved[n]] = uniform;
+        }
+        IR_Compact(prologue);
+        IR_DeadCodeElimination()->Run(prologue);
+        IR_DeadCodeElimination()->Run(func);
+        return true;
+    }
+
+    /*************************************************************************/
+    /*                                Pass manager                           */
+    /*************************************************************************/
+
+    IR_PassManager::IR_PassManager() : m_Dump(nullptr)
+    {
+    }
+
+    void IR_PassManager::Add(std::shared_ptr<IR_Pass> pass)
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        IR_PassTiming timing;
+        timing.name     = pass->Name();
+        timing.runs     = 0;
+        timing.changes  = 0;
+        timing.seconds  = 0.0;
+        m_Passes.push_back(pass);
+        m_Timings.push_back(timing);
+    }
+
+    void IR_PassManager::Clear()
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_Passes.clear();
+        m_Timings.clear();
+    }
+
+    /**
+     * Sets the stream that the functions are dumped to, or nullptr to disable dumping.
+     */
+    void IR_PassManager::SetDump(std::ostream * os)
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_Dump = os;
+    }
+
+    void IR_PassManager::Run(IR_Function & func)
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        if (m_Dump) {
+            *m_Dump << "*** before optimization ***" << std::endl;
+            IR_Dump(func, *m_Dump);
+        }
+        for(size_t i = 0; i < m_Passes.size(); ++i) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            bool changed = m_Passes[i]->Run(func);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+            m_Timings[i].runs++;
+            m_Timings[i].changes += changed ? 1 : 0;
+            m_Timings[i].seconds += elapsed.count();
+            if (changed && m_Dump) {
+                *m_Dump << "*** after " << m_Passes[i]->Name() << " ***" << std::endl;
+                IR_Dump(func, *m_Dump);
+            }
+        }
+    }
+
+    std::vector<IR_PassTiming> IR_PassManager::GetTimings() const
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        return m_Timings;
+    }
+
+    void IR_PassManager::PrintTimings(std::ostream & os) const
+    {
+        std::vector<IR_PassTiming> timings = GetTimings();
+        os << std::left << std::setw(16) << "pass" << std::right << std::setw(10) << "runs"
+            << std::setw(10) << "changed" << std::setw(14) << "time (ms)" << std::endl;
+        for(size_t i = 0; i < timings.size(); ++i) {
+            os << std::left << std::setw(16) << timings[i].name << std::right << std::setw(10) << timings[i].runs
+                << std::setw(10) << timings[i].changes << std::setw(14) << std::fixed << std::setprecision(3)
+                << timings[i].seconds * 1000.0 << std::endl;
+        }
+    }
+
+    void IR_PassManager::ResetTimings()
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        for(size_t i = 0; i < m_Timings.size(); ++i) {
+            m_Timings[i].runs       = 0;
+            m_Timings[i].changes    = 0;
+            m_Timings[i].seconds    = 0.0;
+        }
+    }
+
+    IR_PassManager & IR_GetPassManager()
+    {
+        static IR_PassManager manager;
+        static std::once_flag once;
+        std::call_once(once, [] {
+            manager.Add(IR_ConstantFolding());
+            manager.Add(IR_CommonSubexpressionElimination());
+            manager.Add(IR_DeadCodeElimination());
+        });
+        return manager;
+    }
+}
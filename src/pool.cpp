@@ -0,0 +1,124 @@
+/**
+ * \file            pool.cpp
+ * \description     Thread pool used to execute a method on several threads.
+ */
+
+#include "vfpool.h"
+
+namespace vf
+{
+    /**
+     * Starts numThreads - 1 worker threads, the caller of Run is the remaining thread.
+     */
+    ThreadPool::ThreadPool(size_t numThreads)
+        : m_Task(nullptr), m_NumTasks(0), m_Next(0), m_Active(0), m_Generation(0), m_Stop(false)
+    {
+        try {
+            for(size_t i = 1; i < numThreads; ++i) {
+                m_Threads.push_back(std::thread(&ThreadPool::Worker, this, i));
+            }
+        } catch(...) {
+            Stop();
+            throw;
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        Stop();
+    }
+
+    /**
+     * Stops and joins the worker threads.
+     */
+    void ThreadPool::Stop()
+    {
+        {
+            std::lock_guard<std::mutex> guard(m_Lock);
+            m_Stop = true;
+        }
+        m_Start.notify_all();
+        for(size_t i = 0; i < m_Threads.size(); ++i) {
+            m_Threads[i].join();
+        }
+        m_Threads.clear();
+    }
+
+    size_t ThreadPool::NumThreads() const
+    {
+        return m_Threads.size() + 1;
+    }
+
+    size_t ThreadPool::NumWorkers() const
+    {
+        return NumThreads();
+    }
+
+    void ThreadPool::ParallelFor(size_t numTasks, const Task_t & task)
+    {
+        Run(numTasks, task);
+    }
+
+    /**
+     * Executes numTasks tasks and returns when every task has finished. The tasks are claimed
+     * one at a time, so a worker that finishes early takes over the remaining tasks.
+     */
+    void ThreadPool::Run(size_t numTasks, const Task_t & task)
+    {
+        if (m_Threads.empty() || (numTasks < 2)) {
+            for(size_t i = 0; i < numTasks; ++i) {
+                task(i, 0);
+            }
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(m_Lock);
+            m_Task      = &task;
+            m_NumTasks  = numTasks;
+            m_Next      = 0;
+            m_Active    = m_Threads.size();
+            ++m_Generation;
+        }
+        m_Start.notify_all();
+
+        Execute(0);
+
+        std::unique_lock<std::mutex> lock(m_Lock);
+        while(m_Active) {
+            m_Done.wait(lock);
+        }
+        m_Task = nullptr;
+    }
+
+    void ThreadPool::Execute(size_t worker)
+    {
+        for(size_t i = m_Next++; i < m_NumTasks; i = m_Next++) {
+            (*m_Task)(i, worker);
+        }
+    }
+
+    void ThreadPool::Worker(size_t index)
+    {
+        uint64_t generation = 0;
+        for(;;) {
+            {
+                std::unique_lock<std::mutex> lock(m_Lock);
+                while(!m_Stop && (generation == m_Generation)) {
+                    m_Start.wait(lock);
+                }
+                if (m_Stop) {
+                    return;
+                }
+                generation = m_Generation;
+            }
+
+            Execute(index);
+
+            std::lock_guard<std::mutex> guard(m_Lock);
+            if (--m_Active == 0) {
+                m_Done.notify_one();
+            }
+        }
+    }
+}
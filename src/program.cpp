@@ -0,0 +1,558 @@
+/**
+ * \file            program.cpp
+ * \description     Compiled programs that are shared by several threads, and the execution
+ *                  contexts that they are executed through.
+ *
+ *                  A program verifies and translates the bytecode once, and is never modified
+ *                  afterwards. Everything that changes during a execution, the streams,
+ *                  uniforms, samplers, temporary registers and predicate, belongs to a context,
+ *                  which is a machine that only executes the plans of the program. Such a
+ *                  machine never builds the call table that translation requires, so a context
+ *                  is only a few allocations. Released contexts are kept by the program and
+ *                  handed out again, which leaves a lock and the clearing of the bindings.
+ */
+
+#include "vf.h"
+#include "vfprogram.h"
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <mutex>
+
+namespace vf
+{
+    /*************************************************************************/
+    /*                              CompiledProgram                          */
+    /*************************************************************************/
+
+    /**
+     * Verifies the bytecode and translates each method into a execution plan, the bytecode is
+     * never decoded again. Methods with a registered ahead-of-time kernel are executed by the
+     * kernel regardless of the engine, with the JIT engine the other methods are also compiled
+     * to native code. Only verification is done for the SoA layout, which decodes the bytecode
+     * as it's executed.
+     */
+    CompiledProgram::CompiledProgram(std::shared_ptr<vf::ByteCode> pByteCode, Layout_t layout_, Engine_t engine_,
+        Precision_t precision_)
+        : bytecode(pByteCode), iomap(pByteCode->GetNumRegisters()), layout(layout_), engine(engine_),
+        precision(precision_)
+    {
+        // Mark each i/o register in the io map.
+        const std::map<std::string, vf::Variable> & ioStreams = bytecode->GetInputOutput();
+        for(std::map<std::string, vf::Variable>::const_iterator it = ioStreams.begin();
+            it != ioStreams.end();
+            it++)
+        {
+            iomap.Set(it->second.m_Register);
+        }
+
+        // The plans that the methods are compiled into while verifying them are the ones that
+        // are executed. The SoA layout decodes the bytecode as it's executed, and drops them.
+        const std::vector<std::shared_ptr<ByteCode_Method> > & methods = bytecode->GetMethods();
+        vf::VirtualMachine compiler(iomap, bytecode->GetNumRegisters(), bytecode->GetNumUniforms(),
+            bytecode->GetNumSamplers(), ISA_Auto, precision);
+        Verify_ByteCode(*bytecode, compiler, plans, status, bindings);
+        if (layout != Layout_AoS) {
+            plans.clear();
+        } else {
+            uint64_t hash = Native_Hash(*bytecode);
+            for(size_t i = 0; i < methods.size(); ++i) {
+                // Native code, generated or JIT compiled, keeps the temporaries in local arrays or
+                // xmm registers and only writes the streams back. A prologue leaves its results in
+                // temporaries that are read afterwards, so prologues are always interpreted.
+                bool prologue = (methods[i]->GetName().compare(0, 1, "$") == 0);
+                if ((status[i] == Err_Success) && !prologue) {
+                    plans[i].kernel = Native_Find(hash, i);
+                }
+                if ((engine == Engine_JIT) && (status[i] == Err_Success) && !plans[i].kernel && !prologue) {
+                    plans[i].native = Jit_Compile(plans[i], iomap, ISA_Auto, precision);
+                }
+            }
+        }
+
+        /** The prologue of each method, and the hidden uniforms that it computes. */
+        const std::map<std::string, vf::Variable> & uniforms = bytecode->GetUniforms();
+        prologues.resize(methods.size(), -1);
+        hoisted.resize(methods.size());
+        for(size_t i = 0; i < methods.size(); ++i) {
+            const std::string prefix = "$" + methods[i]->GetName() + ".";
+            for(size_t k = 0; k < methods.size(); ++k) {
+                if (methods[k]->GetName() == ("$" + methods[i]->GetName())) {
+                    prologues[i] = static_cast<int>(k);
+                }
+            }
+            for(std::map<std::string, vf::Variable>::const_iterator it = uniforms.begin(); it != uniforms.end(); ++it) {
+                if (it->first.compare(0, prefix.size(), prefix) == 0) {
+                    hoisted[i].push_back(it->second);
+                }
+            }
+        }
+        // A method can't be executed without the hidden uniforms of its prologue.
+        for(size_t i = 0; i < methods.size(); ++i) {
+            if ((prologues[i] >= 0) && (status[i] == Err_Success)) {
+                status[i] = status[prologues[i]];
+            }
+        }
+
+        /**
+         * Fuse the steps of the interpreted plans, pass the positions of the samplers on ahead
+         * of the lookups, mark the alternatives of the conditional assignments so that they can
+         * be skipped, and the streams that are only written. A prologue leaves its results in registers that
+         * are read afterwards, so they are kept as they are.
+         */
+        for(size_t i = 0; i < plans.size(); ++i) {
+            if ((status[i] == Err_Success) && !plans[i].kernel && !plans[i].native &&
+                (methods[i]->GetName().compare(0, 1, "$") != 0))
+            {
+                compiler.Fuse(plans[i]);
+                compiler.Mark_Prefetches(plans[i]);
+                compiler.Mark_Branches(plans[i]);
+                compiler.Mark_Streams(plans[i]);
+            }
+        }
+    }
+
+    /**
+     * Assigns capacity elements of memory to each temporary register of a machine in the AoS
+     * layout, followed by the predicate.
+     */
+    void CompiledProgram::AssignTemporaries(vf::VirtualMachine & vm, uint8_t * ptr, size_t capacity) const
+    {
+        for(size_t i = 0, num = bytecode->GetNumRegisters(); i < num; ++i) {
+            if (!iomap.Get(i)) {
+                vm.SetRegisterPointer(i, ptr);
+                ptr += (capacity * 16);
+            }
+        }
+        vm.SetFlagPointer(ptr);
+    }
+
+    /** Returns the number of registers that aren't i/o streams */
+    size_t CompiledProgram::NumTemporaries() const
+    {
+        return bytecode->GetNumRegisters() - bytecode->GetInputOutput().size();
+    }
+
+    /**
+     * Returns the status of a method, and checks that the streams and samplers that it refers to
+     * are bound to a machine. The batches of a method that passes are executed without any checks.
+     */
+    Status_t CompiledProgram::Check_Method(const vf::VirtualMachine & vm, size_t method) const
+    {
+        if (status[method] != Err_Success) {
+            return status[method];
+        }
+        return vm.Check_Bindings(bindings[method]);
+    }
+
+    /**
+     * Executes the plan of a method for the elements [begin, end) in batches of at most batchLimit
+     * elements. The start of each batch is prefetched before the batch in front of it is executed.
+     * The method must have been checked with Check_Method.
+     */
+    Status_t CompiledProgram::Execute_Range(vf::VirtualMachine & vm, size_t method, size_t begin, size_t end,
+        size_t batchLimit) const
+    {
+        const ExecutionPlan & plan = plans[method];
+        for(size_t offset = begin; offset < end; offset += batchLimit) {
+            size_t remaining = end - offset;
+            size_t count = remaining > batchLimit ? batchLimit : remaining;
+            if (remaining > count) {
+                vm.Prefetch_Batch(plan, std::min(remaining - count, batchLimit), offset + count);
+            }
+            Status_t err = vm.Execute_Unchecked(plan, count, offset);
+            if (err != Err_Success) {
+                return err;
+            }
+        }
+        return Err_Success;
+    }
+
+    /**
+     * Executes the prologue of a method for a single element on a machine in the AoS layout, and
+     * assigns the values it leaves in the temporary registers to the hidden uniforms of the machine.
+     */
+    Status_t CompiledProgram::Evaluate_Uniforms(vf::VirtualMachine & vm, size_t method, const uint8_t * temporaries,
+        size_t capacity) const
+    {
+        if (prologues[method] < 0) {
+            return Err_Success;
+        }
+        size_t prologue = prologues[method];
+        Status_t err = Check_Method(vm, prologue);
+        if (err == Err_Success) {
+            err = vm.Execute_Unchecked(plans[prologue], 1, 0);
+        }
+        const std::vector<vf::Variable> & values = hoisted[method];
+        for(size_t i = 0; (i < values.size()) && (err == Err_Success); ++i) {
+            const float * ptr = Temporary(temporaries, capacity, values[i].m_Register);
+            vf::Vector value;
+            for(size_t c = 0; c < 4; ++c) {
+                value[c] = ptr[c];
+            }
+            err = Assign_Uniform(vm, values[i], value);
+        }
+        return err;
+    }
+
+    /**
+     * Returns the first element of a temporary register. The temporaries are laid out in
+     * register order, capacity elements each.
+     */
+    const float * CompiledProgram::Temporary(const uint8_t * temporaries, size_t capacity, size_t reg) const
+    {
+        size_t index = 0;
+        for(size_t i = 0; i < reg; ++i) {
+            index += iomap.Get(i) ? 0 : 1;
+        }
+        return (const float *) (temporaries + (index * capacity * 16));
+    }
+
+    /**
+     * Returns the batch limit that keeps the registers referenced by the methods in the level 2
+     * cache, with room to spare for the streams that are read ahead and the kernel tables. In
+     * the AoS layout only the registers referenced by the plans are counted. The limit never
+     * exceeds capacity.
+     */
+    size_t CompiledProgram::Tile_FromCache(size_t capacity) const
+    {
+        size_t numRegisters = bytecode->GetNumRegisters();
+        if (layout == Layout_AoS) {
+            std::vector<bool> used(numRegisters, false);
+            for(size_t i = 0; i < plans.size(); ++i) {
+                for(size_t r = 0; r < plans[i].registers.size(); ++r) {
+                    used[plans[i].registers[r]] = true;
+                }
+            }
+            numRegisters = std::count(used.begin(), used.end(), true);
+        }
+
+        size_t bitsPerElement = (128 * numRegisters) + 1;
+        size_t tile = ((DetectCaches().L2 / 2) * 8) / bitsPerElement;
+        tile = (tile < TILE_MIN_ELEMENTS) ? TILE_MIN_ELEMENTS : (tile & ~size_t(15));
+        return (tile < capacity) ? tile : capacity;
+    }
+
+    /*************************************************************************/
+    /*                              Context_Impl                             */
+    /*************************************************************************/
+
+    /**
+     * The machine and temporary registers of a execution context.
+     */
+    class ContextImpl
+    {
+    public:
+        ContextImpl(const CompiledProgram &, size_t capacity);
+
+        Status_t    Execute(size_t, size_t, size_t);
+        Status_t    SetRegisterPointer(size_t, void *);
+        Status_t    SetRegisterPointer(size_t, void *, size_t, size_t);
+        Status_t    SetUniform(size_t, float);
+        Status_t    SetUniform(size_t, const vf::Vector2 &);
+        Status_t    SetUniform(size_t, const vf::Vector3 &);
+        Status_t    SetUniform(size_t, const vf::Vector4 &);
+        Status_t    SetSampler(size_t, vf::ISampler *);
+        Status_t    SetNonTemporal(size_t, bool);
+        Status_t    SetPrefetch(size_t);
+        void        Clear();
+
+    protected:
+        const CompiledProgram &     m_Program;
+        vf::VirtualMachine          m_Machine;
+        std::unique_ptr<uint8_t[]>  m_Temporaries;  /**< the temporary registers and the predicate */
+        std::vector<vf::Vector>     m_Staging;      /**< packed elements of the strided streams */
+        size_t                      m_Capacity;     /**< the number of elements executed at once */
+    };
+
+    ContextImpl::ContextImpl(const CompiledProgram & program, size_t capacity)
+        : m_Program(program),
+        m_Machine(program.iomap, program.bytecode->GetNumRegisters(), program.bytecode->GetNumUniforms(),
+            program.bytecode->GetNumSamplers(), ISA_Auto, program.precision),
+        m_Capacity(capacity)
+    {
+        // The temporaries and the predicate are always written before they are read, so they
+        // are left uninitialized rather than cleared, a batch of them fills half the cache.
+        m_Temporaries.reset(new uint8_t[(capacity * 16 * program.NumTemporaries()) + Predicate_Bytes(capacity)]);
+        m_Program.AssignTemporaries(m_Machine, m_Temporaries.get(), m_Capacity);
+    }
+
+    /**
+     * Executes a method for count elements starting at begin. The hidden uniforms are evaluated
+     * into this context only.
+     */
+    Status_t ContextImpl::Execute(size_t MethodIndex, size_t begin, size_t count)
+    {
+        if (MethodIndex >= m_Program.plans.size()) {
+            return Err_InvalidIndex;
+        }
+        Status_t err = m_Program.Check_Method(m_Machine, MethodIndex);
+        if (err == Err_Success) {
+            err = m_Program.Evaluate_Uniforms(m_Machine, MethodIndex, m_Temporaries.get(), m_Capacity);
+        }
+        if (err != Err_Success) {
+            return err;
+        }
+        return m_Program.Execute_Range(m_Machine, MethodIndex, begin, begin + count, m_Capacity);
+    }
+
+    Status_t ContextImpl::SetRegisterPointer(size_t index, void * ptrData)
+    {
+        if ((index >= m_Program.bytecode->GetNumRegisters()) || (!m_Program.iomap.Get(index))) {
+            return Err_InvalidRegister;
+        }
+        return m_Machine.SetRegisterPointer(index, ptrData);
+    }
+
+    Status_t ContextImpl::SetRegisterPointer(size_t index, void * ptrData, size_t stride, size_t numComponents)
+    {
+        if ((index >= m_Program.bytecode->GetNumRegisters()) || (!m_Program.iomap.Get(index))) {
+            return Err_InvalidRegister;
+        }
+        Status_t err = m_Machine.SetRegisterPointer(index, ptrData, stride, numComponents);
+        if (err != Err_Success) {
+            return err;
+        }
+
+        // Room for the packed elements of the strided streams, reserved here rather than while executing.
+        size_t numElements = m_Machine.NumStrided() * m_Capacity;
+        if (m_Staging.size() < numElements) {
+            try {
+                m_Staging.resize(numElements);
+            } catch(std::bad_alloc &) {
+                return Err_AllocationError;
+            }
+            m_Machine.SetStagingPointer(&m_Staging[0], m_Staging.size());
+        }
+        return Err_Success;
+    }
+
+    Status_t ContextImpl::SetUniform(size_t index, float value)
+    {
+        if (index >= m_Program.bytecode->GetNumUniforms()) {
+            return Err_InvalidRegister;
+        }
+        return m_Machine.SetUniform(index, value);
+    }
+
+    Status_t ContextImpl::SetUniform(size_t index, const vf::Vector2 & value)
+    {
+        if (index >= m_Program.bytecode->GetNumUniforms()) {
+            return Err_InvalidRegister;
+        }
+        return m_Machine.SetUniform(index, value);
+    }
+
+    Status_t ContextImpl::SetUniform(size_t index, const vf::Vector3 & value)
+    {
+        if (index >= m_Program.bytecode->GetNumUniforms()) {
+            return Err_InvalidRegister;
+        }
+        return m_Machine.SetUniform(index, value);
+    }
+
+    Status_t ContextImpl::SetUniform(size_t index, const vf::Vector4 & value)
+    {
+        if (index >= m_Program.bytecode->GetNumUniforms()) {
+            return Err_InvalidRegister;
+        }
+        return m_Machine.SetUniform(index, value);
+    }
+
+    Status_t ContextImpl::SetSampler(size_t index, vf::ISampler * sampler)
+    {
+        if (index >= m_Program.bytecode->GetNumSamplers()) {
+            return Err_InvalidRegister;
+        }
+        return m_Machine.SetSampler(index, sampler);
+    }
+
+    Status_t ContextImpl::SetNonTemporal(size_t index, bool enable)
+    {
+        if ((index >= m_Program.bytecode->GetNumRegisters()) || (!m_Program.iomap.Get(index))) {
+            return Err_InvalidRegister;
+        }
+        return m_Machine.SetNonTemporal(index, enable);
+    }
+
+    Status_t ContextImpl::SetPrefetch(size_t bytes)
+    {
+        return m_Machine.SetPrefetch(bytes);
+    }
+
+    /**
+     * Clears the streams, uniforms and samplers, before the context is handed out again. The
+     * streams are stored with non-temporal stores again, and prefetched by the default amount.
+     */
+    void ContextImpl::Clear()
+    {
+        m_Machine.Clear_Bindings();
+    }
+
+    /*************************************************************************/
+    /*                              Program_Impl                             */
+    /*************************************************************************/
+
+    /**
+     * The compiled program and the contexts that have been released.
+     */
+    class ProgramImpl
+    {
+    public:
+        ProgramImpl(std::shared_ptr<vf::ByteCode>, Engine_t, Precision_t);
+        ~ProgramImpl();
+
+        ByteCode_Context *  Acquire();
+        void                Release(ByteCode_Context *);
+        size_t              GetBatchLimit() const;
+
+    protected:
+        CompiledProgram                 m_Program;
+        size_t                          m_BatchLimit;
+        std::mutex                      m_Lock;
+        std::vector<ByteCode_Context *> m_Free;     /**< released contexts, with their bindings cleared */
+    };
+
+    /**
+     * The batch limit of the contexts is the one that keeps the registers of a batch in the cache,
+     * each context has temporary registers for that many elements. The pool starts out with one
+     * context, so that the first acquire doesn't have to build one.
+     */
+    ProgramImpl::ProgramImpl(std::shared_ptr<vf::ByteCode> bytecode, Engine_t engine, Precision_t precision)
+        : m_Program(bytecode, Layout_AoS, engine, precision)
+    {
+        m_BatchLimit = m_Program.Tile_FromCache(std::numeric_limits<size_t>::max());
+        std::unique_ptr<ByteCode_Context> context(new ByteCode_Context(std::make_shared<ContextImpl>(m_Program, m_BatchLimit)));
+        m_Free.push_back(context.get());
+        context.release();
+    }
+
+    ProgramImpl::~ProgramImpl()
+    {
+        for(size_t i = 0; i < m_Free.size(); ++i) {
+            delete m_Free[i];
+        }
+    }
+
+    /** Returns a released context, or creates a new one if there is none */
+    ByteCode_Context * ProgramImpl::Acquire()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_Lock);
+            if (!m_Free.empty()) {
+                ByteCode_Context * context = m_Free.back();
+                m_Free.pop_back();
+                return context;
+            }
+        }
+        return new ByteCode_Context(std::make_shared<ContextImpl>(m_Program, m_BatchLimit));
+    }
+
+    /** Clears the bindings of a context and keeps it for the next Acquire */
+    void ProgramImpl::Release(ByteCode_Context * context)
+    {
+        context->m_pImpl->Clear();
+        try {
+            std::lock_guard<std::mutex> lock(m_Lock);
+            m_Free.push_back(context);
+        } catch(std::bad_alloc &) {
+            delete context;
+        }
+    }
+
+    size_t ProgramImpl::GetBatchLimit() const
+    {
+        return m_BatchLimit;
+    }
+
+    /*************************************************************************/
+    /*                              ByteCode_Program                         */
+    /*************************************************************************/
+    ByteCode_Program::ByteCode_Program(std::shared_ptr<vf::ByteCode> pByteCode, Engine_t engine, Precision_t precision)
+    {
+        m_pImpl = std::make_shared<ProgramImpl>(pByteCode, engine, precision);
+    }
+
+    ByteCode_Program::~ByteCode_Program()
+    {
+    }
+
+    /**
+     * Returns a context with nothing bound. The context is returned to the program when the last
+     * reference to it is released, which keeps the program alive until then.
+     */
+    std::shared_ptr<ByteCode_Context> ByteCode_Program::CreateContext() const
+    {
+        std::shared_ptr<ProgramImpl> program = m_pImpl;
+        return std::shared_ptr<ByteCode_Context>(program->Acquire(), [program](ByteCode_Context * context) {
+            program->Release(context);
+        });
+    }
+
+    size_t ByteCode_Program::GetBatchLimit() const
+    {
+        return m_pImpl->GetBatchLimit();
+    }
+
+    /*************************************************************************/
+    /*                              ByteCode_Context                         */
+    /*************************************************************************/
+    ByteCode_Context::ByteCode_Context(std::shared_ptr<ContextImpl> pImpl) : m_pImpl(pImpl)
+    {
+    }
+
+    ByteCode_Context::~ByteCode_Context()
+    {
+    }
+
+    Status_t ByteCode_Context::Execute(size_t methodIndex, size_t begin, size_t count)
+    {
+        return m_pImpl->Execute(methodIndex, begin, count);
+    }
+
+    Status_t ByteCode_Context::SetRegisterPointer(size_t index, void * ptrMemory)
+    {
+        return m_pImpl->SetRegisterPointer(index, ptrMemory);
+    }
+
+    Status_t ByteCode_Context::SetRegisterPointer(size_t index, void * ptrMemory, size_t stride, size_t numComponents)
+    {
+        return m_pImpl->SetRegisterPointer(index, ptrMemory, stride, numComponents);
+    }
+
+    Status_t ByteCode_Context::SetUniform(size_t index, float value)
+    {
+        return m_pImpl->SetUniform(index, value);
+    }
+
+    Status_t ByteCode_Context::SetUniform(size_t index, const vf::Vector2 & value)
+    {
+        return m_pImpl->SetUniform(index, value);
+    }
+
+    Status_t ByteCode_Context::SetUniform(size_t index, const vf::Vector3 & value)
+    {
+        return m_pImpl->SetUniform(index, value);
+    }
+
+    Status_t ByteCode_Context::SetUniform(size_t index, const vf::Vector4 & value)
+    {
+        return m_pImpl->SetUniform(index, value);
+    }
+
+    Status_t ByteCode_Context::SetSampler(size_t index, vf::ISampler * sampler)
+    {
+        return m_pImpl->SetSampler(index, sampler);
+    }
+
+    Status_t ByteCode_Context::SetNonTemporal(size_t index, bool enable)
+    {
+        return m_pImpl->SetNonTemporal(index, enable);
+    }
+
+    Status_t ByteCode_Context::SetPrefetch(size_t bytes)
+    {
+        return m_pImpl->SetPrefetch(bytes);
+    }
+}
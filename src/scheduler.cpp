@@ -0,0 +1,245 @@
+/**
+ * \file            scheduler.cpp
+ * \description     Work stealing scheduler for executing many jobs on a thread pool.
+ *
+ *                  Each thread owns a queue of ranges. The jobs are dealt out to the queues
+ *                  before the threads are started. A thread takes ranges from the back of its
+ *                  own queue, and splits a range in half for as long as it's larger than the
+ *                  grain size, pushing the second half back onto its queue. A thread with an
+ *                  empty queue steals from the front of the other queues, which is where the
+ *                  largest ranges are. The queues have a lock each, there is no lock that is
+ *                  shared by all threads.
+ *
+ *                  The threads are the workers of a IScheduler, which is a thread pool owned
+ *                  by the scheduler unless the application provides one of its own.
+ */
+
+#include "vf.h"
+#include "vfpool.h"
+
+#include <algorithm>
+#include <deque>
+#include <stdexcept>
+
+namespace vf
+{
+    /**
+     * The implementation of the scheduler.
+     */
+    class SchedulerImpl
+    {
+    public:
+        SchedulerImpl(std::shared_ptr<vf::IScheduler> pool, vf::IScheduler * scheduler, size_t grainSize);
+
+        size_t      NumThreads() const;
+        Status_t    Run(std::vector<Job> & jobs);
+
+    protected:
+        /** A part of a job */
+        struct Range
+        {
+            size_t  job;
+            size_t  begin;
+            size_t  end;
+        };
+
+        struct Queue
+        {
+            std::mutex          lock;
+            std::deque<Range>   ranges;
+        };
+
+        void        Worker(size_t worker);
+        void        Push(size_t worker, const Range &);
+        bool        Pop(size_t worker, Range &);
+        bool        Steal(size_t worker, Range &);
+        void        Execute(size_t worker, Range);
+
+        std::shared_ptr<vf::IScheduler> m_pPool;    /**< the threads owned by the scheduler, if any */
+        vf::IScheduler &            m_Workers;
+        size_t                      m_GrainSize;
+        std::vector<Queue>          m_Queues;
+        std::vector<Job> *          m_Jobs;
+        std::vector<size_t>         m_Grain;        /**< the split granularity of each job */
+        std::atomic<size_t>         m_Remaining;    /**< the number of elements that hasn't been executed */
+        std::mutex                  m_ErrorLock;
+    };
+
+    SchedulerImpl::SchedulerImpl(std::shared_ptr<vf::IScheduler> pool, vf::IScheduler * scheduler, size_t grainSize)
+        : m_pPool(pool), m_Workers(*scheduler), m_GrainSize(grainSize), m_Queues(scheduler->NumWorkers()),
+        m_Jobs(nullptr), m_Remaining(0)
+    {
+    }
+
+    size_t SchedulerImpl::NumThreads() const
+    {
+        return m_Workers.NumWorkers();
+    }
+
+    void SchedulerImpl::Push(size_t worker, const Range & range)
+    {
+        std::lock_guard<std::mutex> guard(m_Queues[worker].lock);
+        m_Queues[worker].ranges.push_back(range);
+    }
+
+    bool SchedulerImpl::Pop(size_t worker, Range & range)
+    {
+        std::lock_guard<std::mutex> guard(m_Queues[worker].lock);
+        if (m_Queues[worker].ranges.empty()) {
+            return false;
+        }
+        range = m_Queues[worker].ranges.back();
+        m_Queues[worker].ranges.pop_back();
+        return true;
+    }
+
+    /**
+     * Steals a range from the front of another queue, the queues are visited starting with the
+     * next one to spread the thieves out.
+     */
+    bool SchedulerImpl::Steal(size_t worker, Range & range)
+    {
+        for(size_t i = 1, num = m_Queues.size(); i < num; ++i) {
+            Queue & victim = m_Queues[(worker + i) % num];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.ranges.empty()) {
+                range = victim.ranges.front();
+                victim.ranges.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Executes a range, splitting off the second half for other threads to steal for as long as
+     * the range is larger than the grain of the job. The split points are whole batches of the
+     * execution, so the elements are batched the same way as when executing on a single thread.
+     */
+    void SchedulerImpl::Execute(size_t worker, Range range)
+    {
+        Job & job = (*m_Jobs)[range.job];
+        size_t grain = m_Grain[range.job];
+        while((range.end - range.begin) > grain) {
+            size_t half = (range.end - range.begin) / 2;
+            size_t batch = job.execution->GetBatchLimit();
+            half = ((half + batch - 1) / batch) * batch;
+            Range second = { range.job, range.begin + half, range.end };
+            range.end = second.begin;
+            Push(worker, second);
+        }
+
+        Status_t err = job.execution->Execute_Worker(job.method, range.begin, range.end, worker);
+        if (err != Err_Success) {
+            std::lock_guard<std::mutex> guard(m_ErrorLock);
+            if (job.status == Err_Success) {
+                job.status = err;
+            }
+        }
+        m_Remaining -= (range.end - range.begin);
+    }
+
+    void SchedulerImpl::Worker(size_t worker)
+    {
+        Range range;
+        while(m_Remaining) {
+            if (Pop(worker, range) || Steal(worker, range)) {
+                Execute(worker, range);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    /**
+     * Executes the jobs and returns when all of them has finished. Returns the status of the
+     * first job that failed, the status of each job is also stored in the job.
+     */
+    Status_t SchedulerImpl::Run(std::vector<Job> & jobs)
+    {
+        size_t numThreads = m_Queues.size();
+        size_t total = 0;
+        m_Grain.resize(jobs.size());
+        for(size_t i = 0; i < jobs.size(); ++i) {
+            Job & job = jobs[i];
+            job.status = job.execution ? job.execution->Reserve_Workers(numThreads) : Err_InvalidParameter;
+            if (job.status == Err_Success) {
+                size_t batch = job.execution->GetBatchLimit();
+                m_Grain[i] = (m_GrainSize > batch) ? m_GrainSize : batch;
+            }
+        }
+
+        // Deal out the jobs, the largest first so that they're spread over the threads.
+        std::vector<std::pair<size_t, size_t> > order;
+        for(size_t i = 0; i < jobs.size(); ++i) {
+            if ((jobs[i].status == Err_Success) && jobs[i].count) {
+                order.push_back(std::make_pair(jobs[i].count, i));
+                total += jobs[i].count;
+            }
+        }
+        std::sort(order.rbegin(), order.rend());
+        for(size_t i = 0; i < order.size(); ++i) {
+            const Job & job = jobs[order[i].second];
+            Range range = { order[i].second, job.begin, job.begin + job.count };
+            m_Queues[i % numThreads].ranges.push_back(range);
+        }
+
+        m_Jobs = &jobs;
+        m_Remaining = total;
+        m_Workers.ParallelFor(numThreads, [this](size_t, size_t worker) {
+            Worker(worker);
+        });
+        m_Jobs = nullptr;
+
+        for(size_t i = 0; i < jobs.size(); ++i) {
+            if (jobs[i].status != Err_Success) {
+                return jobs[i].status;
+            }
+        }
+        return Err_Success;
+    }
+
+    /*************************************************************************/
+    /*                                  Scheduler                            */
+    /*************************************************************************/
+
+    /**
+     * Starts the threads of the scheduler, zero uses one thread per hardware thread. Jobs are
+     * split into ranges of at least grainSize elements.
+     */
+    Scheduler::Scheduler(size_t numThreads, size_t grainSize)
+    {
+        if (numThreads == 0) {
+            numThreads = std::thread::hardware_concurrency();
+            numThreads = numThreads ? numThreads : 1;
+        }
+        std::shared_ptr<vf::ThreadPool> pool = std::make_shared<vf::ThreadPool>(numThreads);
+        m_pImpl = std::make_shared<SchedulerImpl>(pool, pool.get(), grainSize ? grainSize : 1);
+    }
+
+    /**
+     * Executes the jobs on the workers of a scheduler that is provided by the application, it
+     * must outlive the scheduler.
+     */
+    Scheduler::Scheduler(IScheduler * scheduler, size_t grainSize)
+    {
+        if (!scheduler || !scheduler->NumWorkers()) {
+            throw std::runtime_error("The scheduler must have at least one worker.");
+        }
+        m_pImpl = std::make_shared<SchedulerImpl>(nullptr, scheduler, grainSize ? grainSize : 1);
+    }
+
+    Scheduler::~Scheduler()
+    {
+    }
+
+    size_t Scheduler::NumThreads() const
+    {
+        return m_pImpl->NumThreads();
+    }
+
+    Status_t Scheduler::Run(std::vector<Job> & jobs)
+    {
+        return m_pImpl->Run(jobs);
+    }
+}
@@ -0,0 +1,1097 @@
+/**
+ * \file            ssa.cpp
+ * \description     The intermediate representation that sits between the syntax tree and the
+ *                  bytecode. Functions are translated from the syntax tree into instructions
+ *                  in static single assignment form, optimized by the passes in passes.cpp
+ *                  and then lowered to bytecode through the emitters in emit.cpp.
+ */
+
+#include "vfssa.h"
+#include "emit.hpp"
+#include "vm.hpp"
+
+#include <algorithm>
+#include <ostream>
+
+namespace vf
+{
+    /*************************************************************************/
+    /*                                  Utility                              */
+    /*************************************************************************/
+
+    /**
+     * Constructor, the instruction has no operands.
+     */
+    IR_Instruction::IR_Instruction(IR_Opcode_t op, vf::DataType type) : op(op), type(type), reg(0), member(0)
+    {
+        args[0] = args[1] = args[2] = -1;
+        for(size_t c = 0; c < 4; ++c) {
+            value[c] = 0.0f;
+        }
+    }
+
+    /**
+     * Returns the number of components of a type, or zero if it isn't a scalar or vector.
+     */
+    static size_t NumComponents(vf::DataType type)
+    {
+        switch(type) {
+        case vf::Type_Float:    return 1;
+        case vf::Type_Vec2:     return 2;
+        case vf::Type_Vec3:     return 3;
+        case vf::Type_Vec4:     return 4;
+        default:                return 0;
+        }
+    }
+
+    size_t IR_NumArgs(IR_Opcode_t op)
+    {
+        switch(op) {
+        case IR_Nop:
+        case IR_Const:
+        case IR_Uniform:
+        case IR_Load:       return 0;
+        case IR_Member:
+        case IR_Negate:
+        case IR_Length:
+        case IR_Normalize:
+        case IR_Sqrt:
+        case IR_InvSqrt:
+        case IR_Sin:
+        case IR_Cos:
+        case IR_Tan:
+        case IR_ArcSin:
+        case IR_ArcCos:
+        case IR_ArcTan:
+        case IR_Floor:
+        case IR_Ceil:
+        case IR_Sample:
+        case IR_Store:      return 1;
+        case IR_Select:     return 3;
+        default:            return 2;
+        }
+    }
+
+    bool IR_IsEmitted(IR_Opcode_t op)
+    {
+        switch(op) {
+        case IR_Nop:
+        case IR_Const:
+        case IR_Uniform:
+        case IR_Load:
+        case IR_Member:
+        case IR_Compare:    return false;
+        default:            return true;
+        }
+    }
+
+    std::vector<size_t> IR_CountUses(const IR_Function & func)
+    {
+        std::vector<size_t> uses(func.code.size(), 0);
+        for(size_t i = 0; i < func.code.size(); ++i) {
+            const IR_Instruction & ins = func.code[i];
+            for(size_t a = 0; a < IR_NumArgs(ins.op); ++a) {
+                uses[ins.args[a]]++;
+            }
+        }
+        return uses;
+    }
+
+    void IR_LiveRanges(const IR_Function & func, std::vector<int> & lastUse, std::vector<bool> & temporary)
+    {
+        size_t size = func.code.size();
+        lastUse.assign(size, -1);
+        temporary.assign(size, false);
+
+        /** members and comparisons are generated where they are used */
+        for(size_t i = size; i-- > 0;) {
+            const IR_Instruction & ins = func.code[i];
+            bool deferred = (ins.op == IR_Member) || (ins.op == IR_Compare);
+            int position = (deferred && (lastUse[i] >= 0)) ? lastUse[i] : static_cast<int>(i);
+            for(size_t a = 0; a < IR_NumArgs(ins.op); ++a) {
+                lastUse[ins.args[a]] = std::max(lastUse[ins.args[a]], position);
+                if (ins.op != IR_Store) {
+                    temporary[ins.args[a]] = true;
+                }
+            }
+        }
+    }
+
+    size_t IR_Pressure(const IR_Function & func)
+    {
+        size_t size = func.code.size();
+        std::vector<int> lastUse;
+        std::vector<bool> temporary;
+        IR_LiveRanges(func, lastUse, temporary);
+
+        std::vector<int> delta(size + 1, 0);
+        for(size_t i = 0; i < size; ++i) {
+            if (IR_IsEmitted(func.code[i].op) && (func.code[i].op != IR_Store) && temporary[i]) {
+                delta[i]++;
+                delta[lastUse[i]]--;
+            }
+        }
+        size_t pressure = 0;
+        int live = 0;
+        for(size_t i = 0; i < size; ++i) {
+            live += delta[i];
+            pressure = std::max(pressure, static_cast<size_t>(live));
+        }
+        return pressure;
+    }
+
+    void IR_Replace(IR_Function & func, int from, int to)
+    {
+        for(size_t i = 0; i < func.code.size(); ++i) {
+            IR_Instruction & ins = func.code[i];
+            for(size_t a = 0; a < IR_NumArgs(ins.op); ++a) {
+                if (ins.args[a] == from) {
+                    ins.args[a] = to;
+                }
+            }
+        }
+    }
+
+    void IR_Compact(IR_Function & func)
+    {
+        std::vector<int> remap(func.code.size(), -1);
+        std::vector<IR_Instruction> code;
+        code.reserve(func.code.size());
+
+        for(size_t i = 0; i < func.code.size(); ++i) {
+            IR_Instruction ins = func.code[i];
+            if (ins.op == IR_Nop) {
+                continue;
+            }
+            for(size_t a = 0; a < IR_NumArgs(ins.op); ++a) {
+                ins.args[a] = remap[ins.args[a]];
+            }
+            remap[i] = static_cast<int>(code.size());
+            code.push_back(ins);
+        }
+        func.code.swap(code);
+    }
+
+    /*************************************************************************/
+    /*                                  Dump                                 */
+    /*************************************************************************/
+
+    static const char * OpcodeName(IR_Opcode_t op)
+    {
+        switch(op) {
+        case IR_Nop:        return "nop";
+        case IR_Const:      return "const";
+        case IR_Uniform:    return "uniform";
+        case IR_Load:       return "load";
+        case IR_Member:     return "member";
+        case IR_Add:        return "add";
+        case IR_Sub:        return "sub";
+        case IR_Mul:        return "mul";
+        case IR_Div:        return "div";
+        case IR_Min:        return "min";
+        case IR_Max:        return "max";
+        case IR_Dot:        return "dot";
+        case IR_Cross:      return "cross";
+        case IR_Negate:     return "neg";
+        case IR_Length:     return "length";
+        case IR_Normalize:  return "normalize";
+        case IR_Sqrt:       return "sqrt";
+        case IR_InvSqrt:    return "invsqrt";
+        case IR_Sin:        return "sin";
+        case IR_Cos:        return "cos";
+        case IR_Tan:        return "tan";
+        case IR_ArcSin:     return "asin";
+        case IR_ArcCos:     return "acos";
+        case IR_ArcTan:     return "atan";
+        case IR_Floor:      return "floor";
+        case IR_Ceil:       return "ceil";
+        case IR_Sample:     return "sample";
+        case IR_Compare:    return "cmp";
+        case IR_Select:     return "select";
+        case IR_Store:      return "store";
+        default:            return "?";
+        }
+    }
+
+    static const char * TypeName(vf::DataType type)
+    {
+        switch(type) {
+        case vf::Type_Float:    return "float";
+        case vf::Type_Vec2:     return "vec2";
+        case vf::Type_Vec3:     return "vec3";
+        case vf::Type_Vec4:     return "vec4";
+        default:                return "-";
+        }
+    }
+
+    static const char * CompareName(uint8_t cmp)
+    {
+        switch(cmp) {
+        case IR_CmpEqual:           return "eq";
+        case IR_CmpGreater:         return "gt";
+        case IR_CmpLess:            return "lt";
+        case IR_CmpGreaterEqual:    return "ge";
+        case IR_CmpLessEqual:       return "le";
+        default:                    return "?";
+        }
+    }
+
+    /** Writes the components that are accessed, for example ".yz" */
+    static void DumpMembers(std::ostream & os, uint8_t member, vf::DataType type)
+    {
+        os << '.';
+        for(size_t c = 0; c < NumComponents(type); ++c) {
+            os << "xyzw"[(member + c) & 3];
+        }
+    }
+
+    void IR_Dump(const IR_Function & func, std::ostream & os)
+    {
+        os << "function " << func.name << std::endl;
+        for(size_t i = 0; i < func.code.size(); ++i) {
+            const IR_Instruction & ins = func.code[i];
+            os << "    ";
+            if (ins.op != IR_Store) {
+                os << '%' << i << " = ";
+            }
+            os << OpcodeName(ins.op);
+            if (ins.op == IR_Compare) {
+                os << '.' << CompareName(ins.reg);
+            } else {
+                os << ' ' << TypeName(ins.type);
+            }
+
+            switch(ins.op) {
+            case IR_Const:
+                os << ' ';
+                if (NumComponents(ins.type) > 1) os << '{';
+                for(size_t c = 0; c < NumComponents(ins.type); ++c) {
+                    os << (c ? ", " : "") << ins.value[c];
+                }
+                if (NumComponents(ins.type) > 1) os << '}';
+                break;
+            case IR_Uniform:
+                os << " u" << unsigned(ins.reg);
+                DumpMembers(os, ins.member, ins.type);
+                break;
+            case IR_Load:
+                os << " r" << unsigned(ins.reg);
+                DumpMembers(os, ins.member, ins.type);
+                break;
+            case IR_Member:
+                os << " %" << ins.args[0];
+                DumpMembers(os, ins.member, ins.type);
+                break;
+            case IR_Store:
+                os << " r" << unsigned(ins.reg);
+                DumpMembers(os, ins.member, ins.type);
+                os << ", %" << ins.args[0];
+                break;
+            case IR_Sample:
+                os << " s" << unsigned(ins.reg) << ", %" << ins.args[0];
+                break;
+            default:
+                for(size_t a = 0; a < IR_NumArgs(ins.op); ++a) {
+                    os << (a ? ", %" : " %") << ins.args[a];
+                }
+                break;
+            }
+            os << std::endl;
+        }
+    }
+
+    /*************************************************************************/
+    /*                      Translation from the syntax tree                 */
+    /*************************************************************************/
+namespace
+{
+    /**
+     * Translates the statements of a function into instructions. Keeps track of the value that
+     * was last stored to each register component, so variables that are read after they have
+     * been assigned refers to the stored value instead of being loaded again.
+     */
+    class Builder
+    {
+    public:
+        Builder(vf::Environment * pEnv, const std::map<vf::SymbolTable::SymIndex, vf::Vector> & uniforms,
+            IR_Function & func) : m_Env(pEnv), m_Uniforms(uniforms), m_Func(func), m_Stored(256 * 4)
+        {
+        }
+
+        bool Statement(const vf::Node_Assignment & stmt);
+        bool Expression(const vf::Node_Expression * exp, int & value);
+
+    protected:
+        /** A register component, the component index of a stored value */
+        struct Component
+        {
+            Component() : value(-1), index(0) {}
+
+            int     value;
+            uint8_t index;
+        };
+
+        vf::DataType Type(int value) const
+        {
+            return m_Func.code[value].type;
+        }
+
+        int     Const(vf::DataType type, const vf::Vector & value, uint8_t member = 0);
+        int     Load(uint8_t reg, uint8_t member, vf::DataType type);
+        int     Member(int value, uint8_t member, vf::DataType type);
+        void    Store(uint8_t reg, uint8_t member, int value);
+        int     Instruction(IR_Opcode_t op, vf::DataType type, int first, int second = -1, int third = -1);
+        bool    Variable(vf::SymbolTable::SymIndex symIndex, uint8_t member, vf::DataType type, bool wholeVariable,
+            int & value);
+        bool    Unary(IR_Opcode_t op, const vf::Node_Expression * exp, bool isFloat, int & value);
+        bool    Binary(const vf::Node_Binary & binary, int & value);
+        bool    Comparison(const vf::Node_Comparison & cmp, int & value);
+
+        vf::Environment *                                           m_Env;
+        const std::map<vf::SymbolTable::SymIndex, vf::Vector> &     m_Uniforms;
+        IR_Function &                                               m_Func;
+        std::vector<Component>                                      m_Stored;   /**< four per register */
+    };
+
+    int Builder::Const(vf::DataType type, const vf::Vector & value, uint8_t member)
+    {
+        IR_Instruction ins(IR_Const, type);
+        for(size_t c = 0; (c < NumComponents(type)) && ((member + c) < 4); ++c) {
+            ins.value[c] = value[member + c];
+        }
+        return m_Func.Append(ins);
+    }
+
+    /**
+     * Reads a register, the stored value is used if the components were assigned earlier.
+     */
+    int Builder::Load(uint8_t reg, uint8_t member, vf::DataType type)
+    {
+        size_t numComponents = NumComponents(type);
+        const Component * stored = &m_Stored[reg * 4];
+        const Component & first = stored[member];
+
+        bool forward = (first.value >= 0) && ((member + numComponents) <= 4);
+        for(size_t c = 1; forward && (c < numComponents); ++c) {
+            forward = (stored[member + c].value == first.value) && (stored[member + c].index == (first.index + c));
+        }
+        if (forward) {
+            return Member(first.value, first.index, type);
+        }
+
+        IR_Instruction ins(IR_Load, type);
+        ins.reg     = reg;
+        ins.member  = member;
+        return m_Func.Append(ins);
+    }
+
+    /**
+     * Returns the components of a value starting at member.
+     */
+    int Builder::Member(int value, uint8_t member, vf::DataType type)
+    {
+        if ((member == 0) && (type == Type(value))) {
+            return value;
+        }
+        const IR_Instruction source = m_Func.code[value];
+        switch(source.op) {
+        case IR_Const:
+            return Const(type, source.value, member);
+        case IR_Uniform: {
+            IR_Instruction ins(IR_Uniform, type);
+            ins.reg     = source.reg;
+            ins.member  = source.member + member;
+            return m_Func.Append(ins);
+        }
+        case IR_Member: {
+            IR_Instruction ins(IR_Member, type);
+            ins.args[0] = source.args[0];
+            ins.member  = source.member + member;
+            return m_Func.Append(ins);
+        }
+        default: {
+            IR_Instruction ins(IR_Member, type);
+            ins.args[0] = value;
+            ins.member  = member;
+            return m_Func.Append(ins);
+        }
+        }
+    }
+
+    void Builder::Store(uint8_t reg, uint8_t member, int value)
+    {
+        IR_Instruction ins(IR_Store, Type(value));
+        ins.args[0] = value;
+        ins.reg     = reg;
+        ins.member  = member;
+        m_Func.Append(ins);
+
+        for(size_t c = 0; (c < NumComponents(ins.type)) && ((member + c) < 4); ++c) {
+            Component & stored = m_Stored[reg * 4 + member + c];
+            stored.value = value;
+            stored.index = static_cast<uint8_t>(c);
+        }
+    }
+
+    int Builder::Instruction(IR_Opcode_t op, vf::DataType type, int first, int second, int third)
+    {
+        IR_Instruction ins(op, type);
+        ins.args[0] = first;
+        ins.args[1] = second;
+        ins.args[2] = third;
+        return m_Func.Append(ins);
+    }
+
+    /**
+     * Translates a assignment. Assignments to accumulated variables adds the value to the
+     * present value of the variable.
+     */
+    bool Builder::Statement(const vf::Node_Assignment & stmt)
+    {
+        vf::Variable var;
+        uint8_t member      = 0;
+        bool accumulated    = false;
+
+        if (!stmt.m_pIdentifier) { // local variable
+            if (!m_Env->Lookup(stmt.m_Name, var)) {
+                return false;
+            }
+        } else {
+            const vf::Node_Expression * target = stmt.m_pIdentifier.get();
+            if (target->Type() == vf::Node_Expression::EXP_IDENTIFIER) {
+                if (!m_Env->Lookup(((const vf::Node_Identifier *) target)->m_SymIndex, var)) {
+                    return false;
+                }
+                accumulated = var.m_Accumulated ? true : false;
+            } else if (target->Type() == vf::Node_Expression::EXP_MEMBER_REFERENCE) {
+                const vf::Node_MemberReference * ref = (const vf::Node_MemberReference *) target;
+                if (!m_Env->Lookup(ref->m_SymIndex, var)) {
+                    return false;
+                }
+                member = ref->m_MemberOffset;
+            } else {
+                return false;
+            }
+            if ((var.m_Attribute == ATTRIBUTE_UNIFORM) || (var.m_Attribute == ATTRIBUTE_CONST)) {
+                return false;
+            }
+        }
+
+        int value;
+        if (!Expression(stmt.m_pExpression.get(), value)) {
+            return false;
+        }
+        if (accumulated) {
+            int present = Load(var.m_Register, member, Type(value));
+            value = Instruction(IR_Add, Type(value), present, value);
+        }
+        Store(var.m_Register, member, value);
+        return true;
+    }
+
+    /**
+     * Translates a reference to a variable, or to some of its members.
+     */
+    bool Builder::Variable(vf::SymbolTable::SymIndex symIndex, uint8_t member, vf::DataType type, bool wholeVariable,
+        int & value)
+    {
+        vf::Variable var;
+        if (!m_Env->Lookup(symIndex, var)) {
+            return false;
+        }
+        if (wholeVariable) {
+            type = var.m_Type;
+        }
+
+        if (var.m_Attribute == ATTRIBUTE_UNIFORM) {
+            std::map<vf::SymbolTable::SymIndex, vf::Vector>::const_iterator it = m_Uniforms.find(symIndex);
+            if (it != m_Uniforms.end()) {
+                /** the value is known at compile time */
+                value = Const(type, it->second, member);
+            } else {
+                IR_Instruction ins(IR_Uniform, type);
+                ins.reg     = var.m_UniformIndex;
+                ins.member  = member;
+                value = m_Func.Append(ins);
+            }
+        } else if (var.m_Attribute == ATTRIBUTE_CONST) {
+            value = Const(type, var.m_Value, member);
+        } else if (NumComponents(type)) {
+            value = Load(var.m_Register, member, type);
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    bool Builder::Unary(IR_Opcode_t op, const vf::Node_Expression * exp, bool isFloat, int & value)
+    {
+        int first;
+        if (!Expression(exp, first)) {
+            return false;
+        }
+        value = Instruction(op, isFloat ? vf::Type_Float : Type(first), first);
+        return true;
+    }
+
+    bool Builder::Binary(const vf::Node_Binary & binary, int & value)
+    {
+        int left, right;
+        if (!Expression(binary.m_pLeft.get(), left) || !Expression(binary.m_pRight.get(), right)) {
+            return false;
+        }
+
+        IR_Opcode_t op;
+        switch(binary.m_Type) {
+        case vf::Node_Binary::Op_Add:   op = IR_Add; break;
+        case vf::Node_Binary::Op_Sub:   op = IR_Sub; break;
+        case vf::Node_Binary::Op_Mul:   op = IR_Mul; break;
+        case vf::Node_Binary::Op_Div:   op = IR_Div; break;
+        default:                        return false;
+        }
+        if ((op == IR_Add) || (op == IR_Sub)) {
+            if (Type(left) != Type(right)) {
+                return false;
+            }
+        } else if (Type(right) != vf::Type_Float) { /** the right hand side expression is always a float */
+            return false;
+        }
+        value = Instruction(op, Type(left), left, right);
+        return true;
+    }
+
+    bool Builder::Comparison(const vf::Node_Comparison & cmp, int & value)
+    {
+        int left, right;
+        if (!Expression(cmp.m_pLeft.get(), left) || !Expression(cmp.m_pRight.get(), right)) {
+            return false;
+        }
+
+        IR_Instruction ins(IR_Compare, vf::Type_Invalid);
+        switch(cmp.m_Type) {
+        case vf::Node_Comparison::Op_Equal:         ins.reg = IR_CmpEqual; break;
+        case vf::Node_Comparison::Op_Greater:       ins.reg = IR_CmpGreater; break;
+        case vf::Node_Comparison::Op_Less:          ins.reg = IR_CmpLess; break;
+        case vf::Node_Comparison::Op_GreaterEqual:  ins.reg = IR_CmpGreaterEqual; break;
+        case vf::Node_Comparison::Op_LessEqual:     ins.reg = IR_CmpLessEqual; break;
+        default:                                    return false;
+        }
+        ins.args[0] = left;
+        ins.args[1] = right;
+        value = m_Func.Append(ins);
+        return true;
+    }
+
+    bool Builder::Expression(const vf::Node_Expression * exp, int & value)
+    {
+        switch(exp->Type())
+        {
+        case vf::Node_Expression::EXP_CONSTANT: {
+            const vf::Node_Constant * constant = (const vf::Node_Constant *) exp;
+            value = Const(constant->m_expType, constant->m_Value);
+            return true;
+        }
+        case vf::Node_Expression::EXP_IDENTIFIER:
+            return Variable(((const vf::Node_Identifier *) exp)->m_SymIndex, 0, vf::Type_Invalid, true, value);
+        case vf::Node_Expression::EXP_MEMBER_REFERENCE: {
+            const vf::Node_MemberReference * ref = (const vf::Node_MemberReference *) exp;
+            return Variable(ref->m_SymIndex, ref->m_MemberOffset, ref->m_MemberType, false, value);
+        }
+        case vf::Node_Expression::EXP_BINARY:
+            return Binary(*(const vf::Node_Binary *) exp, value);
+        case vf::Node_Expression::EXP_CONDITIONAL: {
+            const vf::Node_Conditional * cond = (const vf::Node_Conditional *) exp;
+            int cmp, first, second;
+            if (cond->m_pComp->Type() != vf::Node_Expression::EXP_COMPARE) {
+                return false;
+            }
+            if (!Comparison(*(const vf::Node_Comparison *) cond->m_pComp.get(), cmp) ||
+                !Expression(cond->m_pFirst.get(), first) || !Expression(cond->m_pSecond.get(), second))
+            {
+                return false;
+            }
+            value = Instruction(IR_Select, Type(first), cmp, first, second);
+            return true;
+        }
+        case vf::Node_Expression::EXP_DOT: {
+            const vf::Node_DotProduct * dot = (const vf::Node_DotProduct *) exp;
+            int first, second;
+            if (!Expression(dot->m_exp1.get(), first) || !Expression(dot->m_exp2.get(), second)) {
+                return false;
+            }
+            if (Type(first) != Type(second)) {
+                return false;
+            }
+            value = Instruction(IR_Dot, vf::Type_Float, first, second);
+            return true;
+        }
+        case vf::Node_Expression::EXP_CROSS: {
+            const vf::Node_CrossProduct * cross = (const vf::Node_CrossProduct *) exp;
+            int first, second;
+            if (!Expression(cross->m_exp1.get(), first) || !Expression(cross->m_exp2.get(), second)) {
+                return false;
+            }
+            if ((Type(first) != vf::Type_Vec3) || (Type(second) != vf::Type_Vec3)) {
+                return false;
+            }
+            value = Instruction(IR_Cross, vf::Type_Vec3, first, second);
+            return true;
+        }
+        case vf::Node_Expression::EXP_MIN_MAX: {
+            const vf::Node_MinMax * minmax = (const vf::Node_MinMax *) exp;
+            int first, second;
+            if (!Expression(minmax->m_pExp1.get(), first) || !Expression(minmax->m_pExp2.get(), second)) {
+                return false;
+            }
+            value = Instruction(minmax->m_IsMin ? IR_Min : IR_Max, Type(first), first, second);
+            return true;
+        }
+        case vf::Node_Expression::EXP_SAMPLER: {
+            const vf::Node_Sampler * sampler = (const vf::Node_Sampler *) exp;
+            vf::Variable var;
+            int position;
+            if (!Expression(sampler->m_pExp.get(), position)) {
+                return false;
+            }
+            if (!m_Env->Lookup(sampler->m_pIdent->m_SymIndex, var) || (var.m_Type != vf::Type_Sampler)) {
+                return false;
+            }
+            IR_Instruction ins(IR_Sample, vf::Type_Vec4);
+            ins.args[0] = position;
+            ins.reg     = var.m_SampleId;
+            value = m_Func.Append(ins);
+            return true;
+        }
+        case vf::Node_Expression::EXP_LENGTH:
+            return Unary(IR_Length, ((const vf::Node_Length *) exp)->m_exp.get(), true, value);
+        case vf::Node_Expression::EXP_SIN:
+            return Unary(IR_Sin, ((const vf::Node_Sine *) exp)->m_pExp.get(), true, value);
+        case vf::Node_Expression::EXP_COS:
+            return Unary(IR_Cos, ((const vf::Node_Cosine *) exp)->m_pExp.get(), true, value);
+        case vf::Node_Expression::EXP_TAN:
+            return Unary(IR_Tan, ((const vf::Node_Tangent *) exp)->m_pExp.get(), true, value);
+        case vf::Node_Expression::EXP_ASIN:
+            return Unary(IR_ArcSin, ((const vf::Node_ArcSine *) exp)->m_pExp.get(), true, value);
+        case vf::Node_Expression::EXP_ACOS:
+            return Unary(IR_ArcCos, ((const vf::Node_ArcCosine *) exp)->m_pExp.get(), true, value);
+        case vf::Node_Expression::EXP_ATAN:
+            return Unary(IR_ArcTan, ((const vf::Node_ArcTangent *) exp)->m_pExp.get(), true, value);
+        case vf::Node_Expression::EXP_NEGATE:
+            return Unary(IR_Negate, ((const vf::Node_Negate *) exp)->m_pExp.get(), false, value);
+        case vf::Node_Expression::EXP_SQRT:
+            return Unary(IR_Sqrt, ((const vf::Node_Sqrt *) exp)->m_pExp.get(), true, value);
+        case vf::Node_Expression::EXP_INVSQRT:
+            return Unary(IR_InvSqrt, ((const vf::Node_InvSqrt *) exp)->m_pExp.get(), true, value);
+        case vf::Node_Expression::EXP_NORMALIZE:
+            return Unary(IR_Normalize, ((const vf::Node_Normalize *) exp)->m_pExp.get(), false, value);
+        case vf::Node_Expression::EXP_FLOOR_CEIL: {
+            const vf::Node_FloorCeil * fc = (const vf::Node_FloorCeil *) exp;
+            return Unary(fc->m_IsFloor ? IR_Floor : IR_Ceil, fc->m_pExp.get(), false, value);
+        }
+        default:
+            return false;
+        }
+    }
+}
+
+    bool IR_Build(const vf::Node_Function & func, vf::Environment * pEnv,
+        const std::map<vf::SymbolTable::SymIndex, vf::Vector> & uniforms, IR_Function & ir)
+    {
+        ir.name = func.m_Name;
+        ir.code.clear();
+
+        Builder builder(pEnv, uniforms, ir);
+        for(std::vector<std::shared_ptr<vf::Node_Statement> >::const_iterator it = func.m_pStatements.begin();
+            it != func.m_pStatements.end();
+            it++)
+        {
+            if (!builder.Statement(*reinterpret_cast<const vf::Node_Assignment *>(it->get()))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /*************************************************************************/
+    /*                                  Lowering                             */
+    /*************************************************************************/
+namespace
+{
+    /**
+     * Generates the bytecode of a function.
+     *
+     * Every emitted value is given a location before the instruction that defines it is
+     * generated. A value that is stored is computed directly into the stored register, also when
+     * other instructions are generated between the definition and the store, as long as the
+     * register isn't read or written in between and isn't overwritten while the value is still
+     * in use. Other values are placed in temporary registers, which are returned to the free list
+     * once the last instruction that reads them has been generated.
+     */
+    class Lowering
+    {
+    public:
+        Lowering(const IR_Function & func, vf::IEmitSink & sink, uint8_t firstTemporary)
+            : m_Func(func), m_Sink(sink), m_First(firstTemporary), m_NumTemporaries(0),
+            m_LastUse(func.code.size(), -1), m_Reg(func.code.size(), 0), m_Member(func.code.size(), 0),
+            m_Owned(func.code.size(), false), m_IsHome(func.code.size(), false), m_Homed(func.code.size(), false),
+            m_Copied(func.code.size(), false), m_Moved(func.code.size(), false), m_MovedAt(func.code.size(), -1)
+        {
+        }
+
+        bool    Run();
+        uint8_t NumTemporaries() const { return m_NumTemporaries; }
+
+    protected:
+        void    Use(int value, int position);
+        int     Definition(int store) const;
+        int     WritePosition(int store) const;
+        int     Clobber(uint8_t reg, int from, int to) const;
+        void    Analyze();
+        uint8_t Allocate();
+        void    Release(int value);
+        vf::ExpInfo Operand(int value) const;
+        bool    Emit(int index);
+
+        const IR_Function &     m_Func;
+        vf::IEmitSink &         m_Sink;
+        uint8_t                 m_First;
+        uint8_t                 m_NumTemporaries;
+        std::vector<bool>       m_Free;         /**< temporary registers that are free */
+        std::vector<int>        m_LastUse;      /**< the position of the last instruction that reads the value */
+        std::vector<uint8_t>    m_Reg;          /**< the location of each value */
+        std::vector<uint8_t>    m_Member;
+        std::vector<bool>       m_Owned;        /**< the value is located in a temporary register */
+        std::vector<bool>       m_IsHome;       /**< the value is computed into the register it's stored to */
+        std::vector<bool>       m_Homed;        /**< store whose value is computed into the stored register */
+        std::vector<bool>       m_Copied;       /**< load that is copied, the register is written while in use */
+        std::vector<bool>       m_Moved;        /**< load that is read from where it was stored */
+        std::vector<int>        m_MovedAt;      /**< the store after which the load is read from the stored register */
+    };
+
+    /**
+     * Records a use of a value. Members and comparisons are generated where they are used,
+     * so they extend the lifetime of their own operands.
+     */
+    void Lowering::Use(int value, int position)
+    {
+        const IR_Instruction & ins = m_Func.code[value];
+        m_LastUse[value] = std::max(m_LastUse[value], position);
+        if ((ins.op == IR_Member) || (ins.op == IR_Compare)) {
+            for(size_t a = 0; a < IR_NumArgs(ins.op); ++a) {
+                Use(ins.args[a], position);
+            }
+        }
+    }
+
+    /**
+     * Returns the instruction that defines the value of a store, if it may be computed directly
+     * into the stored register. The register must not be read after the definition, except by
+     * the definition itself, and must not be stored to between the definition and the store.
+     * This also writes the final result of a statement directly to a output stream when the
+     * value has been computed by a earlier statement.
+     */
+    int Lowering::Definition(int store) const
+    {
+        const IR_Instruction & st = m_Func.code[store];
+        int def = st.args[0];
+        if (!IR_IsEmitted(m_Func.code[def].op)) {
+            return -1;
+        }
+        for(int k = 0; k < store; ++k) {
+            const IR_Instruction & ins = m_Func.code[k];
+            if ((ins.op == IR_Load) && (ins.reg == st.reg) && ((k > def) || (m_LastUse[k] > def))) {
+                return -1;
+            }
+            if ((ins.op == IR_Store) && (ins.reg == st.reg) && (k > def)) {
+                return -1;
+            }
+        }
+        return def;
+    }
+
+    /**
+     * Returns the position where a store writes the register, which is the definition of the
+     * value if it's computed directly into the register.
+     */
+    int Lowering::WritePosition(int store) const
+    {
+        int def = Definition(store);
+        return (def >= 0) ? def : store;
+    }
+
+    void Lowering::Analyze()
+    {
+        const std::vector<IR_Instruction> & code = m_Func.code;
+        int size = static_cast<int>(code.size());
+
+        for(int i = 0; i < size; ++i) {
+            for(size_t a = 0; a < IR_NumArgs(code[i].op); ++a) {
+                Use(code[i].args[a], i);
+            }
+        }
+
+        /** values that are computed directly into the register they are stored to */
+        for(int i = 0; i < size; ++i) {
+            int def = (code[i].op == IR_Store) ? Definition(i) : -1;
+            if ((def < 0) || m_IsHome[def]) {
+                continue;
+            }
+            bool overwritten = false;
+            for(int k = i + 1; (k < size) && !overwritten; ++k) {
+                overwritten = (code[k].op == IR_Store) && (code[k].reg == code[i].reg) &&
+                    (WritePosition(k) < m_LastUse[def]);
+            }
+            if (!overwritten) {
+                m_Homed[i]      = true;
+                m_IsHome[def]   = true;
+                m_Reg[def]      = code[i].reg;
+                m_Member[def]   = code[i].member;
+            }
+        }
+
+        /** loads whose register is written while they are still in use, they are read from where
+            they were stored if possible, otherwise copied to a temporary register */
+        for(int i = 0; i < size; ++i) {
+            if (code[i].op != IR_Load) {
+                continue;
+            }
+            int write = Clobber(code[i].reg, i, m_LastUse[i]);
+            if (write < 0) {
+                continue;
+            }
+            for(int k = i + 1; (k < write) && (m_MovedAt[i] < 0); ++k) {
+                if ((code[k].op == IR_Store) && (code[k].args[0] == i) && (code[k].reg != code[i].reg) &&
+                    (Clobber(code[k].reg, k, m_LastUse[i]) < 0))
+                {
+                    m_MovedAt[i] = k;
+                }
+            }
+            m_Copied[i] = (m_MovedAt[i] < 0);
+        }
+    }
+
+    /**
+     * Returns the first position after from and before to where a register is written, or -1.
+     */
+    int Lowering::Clobber(uint8_t reg, int from, int to) const
+    {
+        for(int k = from + 1; k < to; ++k) {
+            const IR_Instruction & ins = m_Func.code[k];
+            if ((ins.op == IR_Store) && (ins.reg == reg) && !m_Homed[k]) {
+                return k;
+            }
+            if (IR_IsEmitted(ins.op) && m_IsHome[k] && (m_Reg[k] == reg)) {
+                return k;
+            }
+        }
+        return -1;
+    }
+
+    uint8_t Lowering::Allocate()
+    {
+        size_t index = 0;
+        while((index < m_Free.size()) && !m_Free[index]) {
+            index++;
+        }
+        if (index == m_Free.size()) {
+            m_Free.push_back(false);
+            m_NumTemporaries = static_cast<uint8_t>(m_Free.size());
+        }
+        m_Free[index] = false;
+        return static_cast<uint8_t>(m_First + index);
+    }
+
+    void Lowering::Release(int value)
+    {
+        if (m_Owned[value]) {
+            m_Free[m_Reg[value] - m_First] = true;
+            m_Owned[value] = false;
+        }
+    }
+
+    /**
+     * Returns the information the emitters needs to read a value.
+     */
+    vf::ExpInfo Lowering::Operand(int value) const
+    {
+        const IR_Instruction & ins = m_Func.code[value];
+        vf::ExpInfo info = vf::ExpInfo();
+
+        switch(ins.op) {
+        case IR_Const:
+            info.isconst    = 1;
+            info.value      = ins.value;
+            break;
+        case IR_Uniform:
+            info.isuniform      = 1;
+            info.uniform_index  = ins.reg;
+            info.regidx         = ins.member;
+            break;
+        case IR_Member:
+            info = Operand(ins.args[0]);
+            if (info.isconst) {
+                for(size_t c = 0; c < NumComponents(ins.type); ++c) {
+                    info.value[c] = info.value[ins.member + c];
+                }
+            } else {
+                info.regidx = info.regidx + ins.member;
+            }
+            break;
+        case IR_Load:
+            info.reg    = (m_Copied[value] || m_Moved[value]) ? m_Reg[value] : ins.reg;
+            info.regidx = (m_Copied[value] || m_Moved[value]) ? m_Member[value] : ins.member;
+            break;
+        default:
+            info.reg    = m_Reg[value];
+            info.regidx = m_Member[value];
+            break;
+        }
+        info.type = ins.type;
+        return info;
+    }
+
+    /**
+     * Generates the code for a instruction.
+     */
+    bool Lowering::Emit(int index)
+    {
+        const IR_Instruction & ins = m_Func.code[index];
+
+        if (ins.op == IR_Store) {
+            if (m_Homed[index]) {
+                return true;
+            }
+            vf::ExpInfo operand = Operand(ins.args[0]);
+            if (!operand.isconst && !operand.isuniform && (operand.reg == ins.reg) && (operand.regidx == ins.member)) {
+                return true; /** assigns the register to itself */
+            }
+            if (!emit_assign(&m_Sink, ins.reg, ins.member, operand)) {
+                return false;
+            }
+            int value = ins.args[0];
+            if ((m_Func.code[value].op == IR_Load) && (m_MovedAt[value] == index)) {
+                m_Reg[value]    = ins.reg;
+                m_Member[value] = ins.member;
+                m_Moved[value]  = true;
+            }
+            return true;
+        }
+
+        if (ins.op == IR_Load) {
+            if (!m_Copied[index]) {
+                return true;
+            }
+            vf::ExpInfo operand = Operand(index);
+            m_Reg[index]    = Allocate();
+            m_Member[index] = 0;
+            m_Owned[index]  = true;
+            return emit_assign(&m_Sink, m_Reg[index], 0, operand);
+        }
+
+        if (!IR_IsEmitted(ins.op)) {
+            return true;
+        }
+
+        vf::ExpInfo first, second, third;
+        if (IR_NumArgs(ins.op) > 0) first   = Operand(ins.args[0]);
+        if (IR_NumArgs(ins.op) > 1) second  = Operand(ins.args[1]);
+        if (IR_NumArgs(ins.op) > 2) third   = Operand(ins.args[2]);
+
+        /** the destination, a operand that dies here is reused before a new register is allocated */
+        if (!m_IsHome[index]) {
+            int reused = -1;
+            for(size_t a = 0; (a < IR_NumArgs(ins.op)) && (reused < 0); ++a) {
+                int arg = ins.args[a];
+                if (m_Owned[arg] && (m_LastUse[arg] == index)) {
+                    reused = arg;
+                }
+            }
+            if (reused >= 0) {
+                m_Reg[index]    = m_Reg[reused];
+                m_Owned[reused] = false;
+            } else {
+                m_Reg[index]    = Allocate();
+            }
+            m_Member[index] = 0;
+            m_Owned[index]  = true;
+        }
+
+        uint8_t reg     = m_Reg[index];
+        uint8_t offset  = m_Member[index];
+
+        switch(ins.op) {
+        case IR_Add:        return emit_add(&m_Sink, reg, offset, first, second);
+        case IR_Sub:        return emit_sub(&m_Sink, reg, offset, first, second);
+        case IR_Mul:        return emit_mul(&m_Sink, reg, offset, first, second);
+        case IR_Div:        return emit_div(&m_Sink, reg, offset, first, second);
+        case IR_Min:        return emit_min(&m_Sink, reg, offset, first, second);
+        case IR_Max:        return emit_max(&m_Sink, reg, offset, first, second);
+        case IR_Dot:        return emit_dot(&m_Sink, reg, offset, first, second);
+        case IR_Cross:      return emit_cross(&m_Sink, reg, offset, first, second);
+        case IR_Negate:     return emit_negate(&m_Sink, reg, offset, first);
+        case IR_Length:     return emit_length(&m_Sink, reg, offset, first);
+        case IR_Normalize:  return emit_normalize(&m_Sink, reg, offset, first);
+        case IR_Sqrt:       return emit_sqrt(&m_Sink, reg, offset, first);
+        case IR_InvSqrt:    return emit_invsqrt(&m_Sink, reg, offset, first);
+        case IR_Sin:        return emit_sine(&m_Sink, reg, offset, first);
+        case IR_Cos:        return emit_cosine(&m_Sink, reg, offset, first);
+        case IR_Tan:        return emit_tangent(&m_Sink, reg, offset, first);
+        case IR_ArcSin:     return emit_arcsine(&m_Sink, reg, offset, first);
+        case IR_ArcCos:     return emit_arccosine(&m_Sink, reg, offset, first);
+        case IR_ArcTan:     return emit_arctangent(&m_Sink, reg, offset, first);
+        case IR_Floor:      return emit_floor(&m_Sink, reg, offset, first);
+        case IR_Ceil:       return emit_ceil(&m_Sink, reg, offset, first);
+        case IR_Sample:     return emit_sample(&m_Sink, reg, offset, ins.reg, first);
+        case IR_Select: {
+            /** the comparison is generated right before the select, since there is only one set of flags */
+            const IR_Instruction & cmp = m_Func.code[ins.args[0]];
+            vf::ExpInfo left = Operand(cmp.args[0]), right = Operand(cmp.args[1]);
+            bool result;
+            switch(cmp.reg) {
+            case IR_CmpEqual:           result = emit_equal(&m_Sink, left, right); break;
+            case IR_CmpGreater:         result = emit_greater(&m_Sink, left, right); break;
+            case IR_CmpLess:            result = emit_less(&m_Sink, left, right); break;
+            case IR_CmpGreaterEqual:    result = emit_greater_equal(&m_Sink, left, right); break;
+            case IR_CmpLessEqual:       result = emit_less_equal(&m_Sink, left, right); break;
+            default:                    return false;
+            }
+            return result && emit_cond_assign(&m_Sink, reg, offset, second, third);
+        }
+        default:
+            return false;
+        }
+    }
+
+    bool Lowering::Run()
+    {
+        int size = static_cast<int>(m_Func.code.size());
+        Analyze();
+
+        /** the values that dies at each position, values that are never used dies where they are defined */
+        std::vector<std::vector<int> > deaths(m_Func.code.size());
+        for(int i = 0; i < size; ++i) {
+            deaths[(m_LastUse[i] >= 0) ? m_LastUse[i] : i].push_back(i);
+        }
+
+        for(int i = 0; i < size; ++i) {
+            if (!Emit(i)) {
+                return false;
+            }
+            for(size_t d = 0; d < deaths[i].size(); ++d) {
+                Release(deaths[i][d]);
+            }
+        }
+        return true;
+    }
+}
+
+    bool IR_Lower(const IR_Function & func, vf::IEmitSink & sink, uint8_t firstTemporary, uint8_t & numTemporaries)
+    {
+        Lowering lowering(func, sink, firstTemporary);
+        if (!lowering.Run()) {
+            return false;
+        }
+        numTemporaries = lowering.NumTemporaries();
+        return true;
+    }
+}
@@ -0,0 +1,82 @@
+/**
+ * \file            verify.cpp
+ * \description     Verifies bytecode once when it's loaded, so that it can be executed without
+ *                  any checks.
+ *
+ *                  Each method is decoded the same way as by the virtual machines, which
+ *                  validates the opcodes, the register, uniform and sampler indices and the
+ *                  inline constants. The registers and samplers that a method refers to are
+ *                  listed, and are checked to be bound once per execution instead of on every
+ *                  access.
+ */
+
+#include "vf.h"
+#include "vfvm.h"
+#include "vfutil.h"
+
+#include <algorithm>
+
+namespace vf
+{
+    namespace
+    {
+        /** Marks the components of a register that a operand refers to */
+        void Bind_Register(MethodBindings & bindings, uint8_t reg, unsigned mask)
+        {
+            bindings.components[reg] |= static_cast<uint8_t>(mask);
+        }
+
+        /** Lists the registers and samplers that the steps of a plan refers to */
+        void List_Bindings(const ExecutionPlan & plan, size_t numRegisters, MethodBindings & bindings)
+        {
+            bindings.components.assign(numRegisters, 0);
+            bindings.registers.clear();
+            bindings.samplers.clear();
+            for(size_t s = 0; s < plan.steps.size(); ++s) {
+                const PlanStep & step = plan.steps[s];
+                if (step.family != Family_Compare) {
+                    Bind_Register(bindings, step.dst, step.mask);
+                }
+                for(size_t i = 0; i < 4; ++i) {
+                    const PlanOperand & op = step.src[i];
+                    if (op.isreg) {
+                        Bind_Register(bindings, op.reg,
+                            (op.numComponents == 1) ? (1u << op.op.member) : ((1u << op.numComponents) - 1));
+                    }
+                }
+                if ((step.family == Family_Sampler) &&
+                    (std::find(bindings.samplers.begin(), bindings.samplers.end(), step.sampler) == bindings.samplers.end()))
+                {
+                    bindings.samplers.push_back(step.sampler);
+                }
+            }
+            for(size_t i = 0; i < numRegisters; ++i) {
+                if (bindings.components[i]) {
+                    bindings.registers.push_back(static_cast<uint8_t>(i));
+                }
+            }
+        }
+    }
+
+    /**
+     * Verifies each method of the bytecode. A method is valid if every instruction is known, only
+     * refers to the registers, uniforms and samplers that the bytecode declares, and has all of
+     * its inline constants within the method. The plan that the method is compiled into while
+     * it's verified is kept, so that it isn't compiled a second time.
+     */
+    void Verify_ByteCode(const vf::ByteCode & bytecode, VirtualMachine & compiler, std::vector<ExecutionPlan> & plans,
+        std::vector<Status_t> & status, std::vector<MethodBindings> & bindings)
+    {
+        const std::vector<std::shared_ptr<ByteCode_Method> > & methods = bytecode.GetMethods();
+        plans.assign(methods.size(), ExecutionPlan());
+        status.assign(methods.size(), Err_Success);
+        bindings.assign(methods.size(), MethodBindings());
+        for(size_t i = 0; i < methods.size(); ++i) {
+            InstructionStream stream(methods[i]->GetCode());
+            status[i] = compiler.Compile(stream, plans[i]);
+            if (status[i] == Err_Success) {
+                List_Bindings(plans[i], bytecode.GetNumRegisters(), bindings[i]);
+            }
+        }
+    }
+}
@@ -4,9 +4,17 @@
 #include "bytecode.hpp"
 #include "vfexcept.h"
 
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <vector>
+
 namespace vf
 {
     class ExecutionImpl;
+    class ProgramImpl;
+    class ContextImpl;
 
     typedef enum {
         Err_Success,
@@ -22,29 +30,318 @@ namespace vf
         Err_ParseError
     } Status_t;
 
+    /**
+     * Memory layout of the registers used during execution.
+     */
+    typedef enum {
+        Layout_AoS,     /**< each element is stored as a packed 16 byte vf::Vector */
+        Layout_SoA      /**< each vector component is stored in a separate plane */
+    } Layout_t;
+
+    /**
+     * The engine used to execute the methods.
+     */
+    typedef enum {
+        Engine_Interpreter, /**< each method is executed as a pre-decoded plan */
+        Engine_JIT          /**< methods are compiled to native code, those that can't be are interpreted */
+    } Engine_t;
+
+    /**
+     * The accuracy of the operations that can be approximated: division, inversesqrt(),
+     * normalize() and the trigonometric functions. Other operations are always exact.
+     */
+    typedef enum {
+        Precision_Precise,  /**< correctly rounded, and within a few ULP for the trigonometric functions */
+        Precision_Fast,     /**< reciprocal estimates refined by a Newton-Raphson step, a relative error of about 1e-6 */
+        Precision_Fastest   /**< reciprocal estimates and low order polynomials, a error of at most 1e-3 */
+    } Precision_t;
+
+    /**
+     * How the number of elements that are executed at once is chosen.
+     */
+    typedef enum {
+        Tiling_Memory,      /**< as many elements as the temporary register memory can hold */
+        Tiling_Cache,       /**< the registers of a batch fits in the level 2 cache, the default */
+        Tiling_Autotune     /**< a few sizes are timed on the first executions, and the fastest is kept */
+    } Tiling_t;
+
+    /**
+     * How the interpreter dispatches the steps of a plan.
+     */
+    typedef enum {
+        Dispatch_Threaded,  /**< each handler jumps straight to the next, the default where the compiler supports it */
+        Dispatch_Switch     /**< a loop around a switch over the steps */
+    } Dispatch_t;
+
+    /**
+     * Describes how a ByteCode_Execution executes its methods.
+     */
+    struct ExecutionStats
+    {
+        Layout_t    layout;
+        Engine_t    engine;
+        Precision_t precision;
+        Tiling_t    tiling;
+        size_t      batchLimit;     /**< the number of elements executed at once */
+        size_t      numThreads;     /**< the number of threads that a method is executed on */
+        size_t      numInterpreted; /**< the number of methods executed by the interpreter */
+        size_t      numCompiled;    /**< the number of methods executed as native code by the JIT */
+        size_t      numNative;      /**< the number of methods executed by ahead-of-time kernels */
+    };
+
+    /**
+     * Interface of the threads that a method is executed on in parallel, which lets the
+     * library run on the job system of the application instead of threads of its own.
+     */
+    class IScheduler
+    {
+    public:
+        /** Executes a task, worker is the index of the thread that executes it. */
+        typedef std::function<void (size_t task, size_t worker)> Task_t;
+
+        virtual ~IScheduler() {}
+
+        /** Returns the number of workers, the worker index of every task is less than this */
+        virtual size_t  NumWorkers() const = 0;
+
+        /**
+         * Executes the tasks [0, numTasks) and returns when every task has finished. Tasks
+         * that are executed at the same time must have different worker indices, the calling
+         * thread may take part as any worker.
+         */
+        virtual void    ParallelFor(size_t numTasks, const Task_t & task) = 0;
+    };
+
+    /**
+     * Interface that a sampler may implement in addition to vf::ISampler, to be told about the
+     * positions that it's about to sample. The lookups of a sampler are usually random, so the
+     * data that the positions refer to can't be prefetched by the processor. The positions are
+     * passed as soon as they are known, which is ahead of the lookups by the steps in between,
+     * or by a whole batch for positions that are read from a stream.
+     */
+    class ISamplerPrefetch
+    {
+    public:
+        virtual ~ISamplerPrefetch() {}
+
+        /**
+         * Prefetches the data of count positions, one vf::Vector each. Dimensions is 1, 2 or 3,
+         * the number of components of each position that are used by the lookups.
+         */
+        virtual void    prefetch(const vf::Vector * positions, size_t count, size_t dimensions) const = 0;
+    };
+
     /**
      * Used for executing bytecode.
      */
     class ByteCode_Execution
     {
     public:
-        ByteCode_Execution(std::shared_ptr<vf::ByteCode>, void *, size_t);
+        ByteCode_Execution(std::shared_ptr<vf::ByteCode>, void *, size_t, Layout_t layout = Layout_AoS,
+            Engine_t engine = Engine_Interpreter, Precision_t precision = Precision_Precise);
         ~ByteCode_Execution();
 
         Status_t    Execute(size_t index, size_t batchSize);
+        Status_t    Execute(size_t index, size_t begin, size_t count, void * scratch, size_t scratchSize) const;
+        size_t      GetScratchSize(size_t numElements) const;
         Status_t    SetRegisterPointer(size_t, void *);
+
+        /**
+         * Binds a stream in the AoS layout whose elements are numComponents floats every stride
+         * bytes, such as a packed vec3 or a member of an array of structures. The stride must be
+         * a multiple of a float and hold at least the components, components that the stream
+         * doesn't have are read as zero and never written. Memory for the packed elements of the
+         * stream is reserved when it's bound, and counted by GetScratchSize from then on.
+         */
+        Status_t    SetRegisterPointer(size_t, void *, size_t stride, size_t numComponents);
+        Status_t    SetComponentPointers(size_t, float * x, float * y = nullptr, float * z = nullptr, float * w = nullptr);
         Status_t    SetUniform(size_t, float);
         Status_t    SetUniform(size_t, const vf::Vector2 &);
         Status_t    SetUniform(size_t, const vf::Vector3 &);
         Status_t    SetUniform(size_t, const vf::Vector4 &);
         Status_t    SetSampler(size_t, vf::ISampler *);
 
+        /**
+         * Selects if a stream that the methods only writes is stored with non-temporal stores,
+         * which writes it without reading it into the cache. It's enabled for every stream by
+         * default, and should be disabled for streams that are read right after the execution.
+         */
+        Status_t    SetNonTemporal(size_t, bool enable);
+
+        /**
+         * Sets the number of bytes at the start of each input stream of the next batch that are
+         * prefetched before the current batch is executed, and the number of positions of the
+         * next batch that are passed to the samplers that implements vf::ISamplerPrefetch.
+         * Zero disables prefetching across batches. The default is 4096 bytes.
+         */
+        Status_t    SetPrefetch(size_t bytes);
+        Status_t    SetThreads(size_t numThreads, size_t grainSize = 4096);
+        Status_t    SetScheduler(IScheduler * scheduler, size_t grainSize = 4096);
+        Status_t    SetTiling(Tiling_t tiling);
+
+        /**
+         * Selects how the interpreter dispatches the steps of the plans in the AoS layout, which is
+         * mostly of use to measure the cost of dispatching. Threaded dispatch isn't available when
+         * the library is built without computed goto, or with VF_NO_COMPUTED_GOTO defined.
+         */
+        Status_t    SetDispatch(Dispatch_t dispatch);
+        ExecutionStats GetStats() const;
+
     protected:
+        friend class SchedulerImpl;
+
         ByteCode_Execution(const ByteCode_Execution &);
         ByteCode_Execution & operator=(const ByteCode_Execution&);
 
+        Status_t    Reserve_Workers(size_t numWorkers);
+        Status_t    Execute_Worker(size_t methodIndex, size_t begin, size_t end, size_t worker);
+        size_t      GetBatchLimit() const;
+
         std::shared_ptr<ExecutionImpl> m_pImpl;
     };
+
+    /*************************************************************************/
+    /*                              Shared programs                          */
+    /*************************************************************************/
+
+    class ByteCode_Context;
+
+    /**
+     * Bytecode that is verified and compiled once, and is then executed through contexts. The
+     * program is never modified once it has been built, so it can be shared by any number of
+     * threads, each executing with a context of its own. Programs use the AoS layout.
+     */
+    class ByteCode_Program
+    {
+    public:
+        ByteCode_Program(std::shared_ptr<vf::ByteCode>, Engine_t engine = Engine_Interpreter,
+            Precision_t precision = Precision_Precise);
+        ~ByteCode_Program();
+
+        /**
+         * Returns a context with nothing bound. Released contexts are kept by the program and
+         * handed out again, so a context is cheap to create once the program has been in use.
+         */
+        std::shared_ptr<ByteCode_Context> CreateContext() const;
+
+        /** Returns the number of elements that a context executes at once */
+        size_t      GetBatchLimit() const;
+
+    protected:
+        ByteCode_Program(const ByteCode_Program &);
+        ByteCode_Program & operator=(const ByteCode_Program &);
+
+        std::shared_ptr<ProgramImpl> m_pImpl;
+    };
+
+    /**
+     * The streams, uniforms, samplers and temporary registers that a program is executed with.
+     * A context must only be used by one thread at a time.
+     */
+    class ByteCode_Context
+    {
+    public:
+        ~ByteCode_Context();
+
+        Status_t    Execute(size_t index, size_t begin, size_t count);
+        Status_t    SetRegisterPointer(size_t, void *);
+        Status_t    SetRegisterPointer(size_t, void *, size_t stride, size_t numComponents);
+        Status_t    SetUniform(size_t, float);
+        Status_t    SetUniform(size_t, const vf::Vector2 &);
+        Status_t    SetUniform(size_t, const vf::Vector3 &);
+        Status_t    SetUniform(size_t, const vf::Vector4 &);
+        Status_t    SetSampler(size_t, vf::ISampler *);
+        Status_t    SetNonTemporal(size_t, bool enable);
+        Status_t    SetPrefetch(size_t bytes);
+
+    protected:
+        friend class ProgramImpl;
+
+        ByteCode_Context(std::shared_ptr<ContextImpl>);
+        ByteCode_Context(const ByteCode_Context &);
+        ByteCode_Context & operator=(const ByteCode_Context &);
+
+        std::shared_ptr<ContextImpl> m_pImpl;
+    };
+
+    /*************************************************************************/
+    /*                                  Scheduling                           */
+    /*************************************************************************/
+
+    class SchedulerImpl;
+
+    /**
+     * A range of elements to execute a method of a ByteCode_Execution for.
+     */
+    struct Job
+    {
+        ByteCode_Execution *    execution;
+        size_t                  method;
+        size_t                  begin;      /**< the first element */
+        size_t                  count;      /**< the number of elements */
+        Status_t                status;     /**< the result of the job, set by Scheduler::Run */
+    };
+
+    /**
+     * Executes a set of jobs on a number of threads. Large jobs are split into ranges which are
+     * balanced between the threads by work stealing, so a thread that runs out of work takes over
+     * ranges from the threads that are still busy. The threads are either owned by the scheduler
+     * or are the workers of a IScheduler. Only executions in the AoS layout can be scheduled, and
+     * samplers must allow concurrent calls.
+     */
+    class Scheduler
+    {
+    public:
+        Scheduler(size_t numThreads = 0, size_t grainSize = 4096);
+        Scheduler(IScheduler * scheduler, size_t grainSize = 4096);
+        ~Scheduler();
+
+        size_t      NumThreads() const;
+        Status_t    Run(std::vector<Job> & jobs);
+
+    protected:
+        Scheduler(const Scheduler &);
+        Scheduler & operator=(const Scheduler &);
+
+        std::shared_ptr<SchedulerImpl> m_pImpl;
+    };
+
+    /*************************************************************************/
+    /*                          Ahead-of-time compilation                    */
+    /*************************************************************************/
+
+    /**
+     * A method compiled ahead-of-time to native code. Processes count elements in the AoS layout,
+     * registers are the register base pointers of the batch indexed by register, and uniforms
+     * are the current uniform values, four floats per uniform.
+     */
+    typedef void (*NativeKernel_t)(float * const * registers, const float * uniforms, size_t count);
+
+    /**
+     * Returns a hash that identifies the bytecode, the methods and the register layout. Kernels
+     * are registered under the hash of the bytecode that they were generated from.
+     */
+    uint64_t Native_Hash(const vf::ByteCode &);
+
+    /**
+     * Writes a C++ source file with one native kernel per method of the bytecode. The kernels
+     * are registered when the file is linked into the application, and is then used instead of
+     * the interpreter for bytecode with the same hash. Name is used as a prefix of the generated
+     * symbols, and must be a valid C++ identifier. Methods that uses samplers are left out
+     * and are still interpreted.
+     */
+    Status_t Native_Emit(const vf::ByteCode &, const char * name, std::ostream &);
+
+    /**
+     * Registers the native kernel of a method. Returns false if a kernel already is
+     * registered for the method.
+     */
+    bool Native_Register(uint64_t hash, size_t method, NativeKernel_t kernel);
+
+    /**
+     * Returns the native kernel of a method, or null if no kernel has been registered.
+     */
+    NativeKernel_t Native_Find(uint64_t hash, size_t method);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,238 @@
+#ifndef _VFKERNELS_H_
+#define _VFKERNELS_H_
+
+#include "vf.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define VF_KERNELS_X86 1
+#endif
+
+namespace vf
+{
+    /**
+     * Instruction sets that the virtual machine kernels are implemented for.
+     */
+    typedef enum {
+        ISA_Auto,       /**< use the best instruction set supported by the processor */
+        ISA_Portable,   /**< plain C++, used when no SIMD instruction set is available */
+        ISA_SSE41,
+        ISA_AVX2,
+        ISA_AVX512
+    } ISA_t;
+
+    /**
+     * How a kernel operand is read.
+     */
+    typedef enum {
+        Operand_Vector,     /**< one packed vf::Vector per element */
+        Operand_Splat,      /**< a single member of each element, replicated to all components */
+        Operand_Const       /**< the same four components for every element */
+    } OperandKind_t;
+
+    /**
+     * A source operand of a kernel. Register operands points to the first vf::Vector of the batch,
+     * constant operands stores their components in 'value'.
+     */
+    struct KernelOperand
+    {
+        const float *   ptr;
+        float           value[4];
+        OperandKind_t   kind;
+        unsigned        member;     /**< the member that is replicated by Operand_Splat */
+    };
+
+    /**
+     * Component wise kernel. Processes 'count' floats, where the components that are written
+     * to the destination is selected by the bits of 'mask', which is repeated every four floats.
+     */
+    typedef void (*BinaryKernel_t)(float * dst, const KernelOperand & lhs, const KernelOperand & rhs, size_t count, unsigned mask);
+    typedef void (*UnaryKernel_t)(float * dst, const KernelOperand & src, size_t count, unsigned mask);
+
+    /**
+     * Compares two scalar operands for 'count' elements, and stores the result as a predicate
+     * with one bit per element. Element i is bit i % 8 of byte i / 8.
+     */
+    typedef void (*CompareKernel_t)(uint8_t * predicate, const KernelOperand & lhs, const KernelOperand & rhs, size_t count);
+
+    /**
+     * Selects between two operands for 'count' floats depending on the bits of a predicate.
+     */
+    typedef void (*SelectKernel_t)(float * dst, const uint8_t * predicate, const KernelOperand & lhs, const KernelOperand & rhs,
+        size_t count, unsigned mask);
+
+    /**
+     * Copies 'count' floats with non-temporal stores, which writes the destination without
+     * reading it into the cache. The stores have been fenced when the kernel returns.
+     */
+    typedef void (*StreamKernel_t)(float * dst, const float * src, size_t count);
+
+    /**
+     * Starts loading the cache lines of 'bytes' bytes of memory into the cache, and returns
+     * without waiting for them.
+     */
+    typedef void (*PrefetchKernel_t)(const void * ptr, size_t bytes);
+
+    enum {
+        CACHE_LINE_SIZE = 64
+    };
+
+    /** Returns the number of bytes of a predicate for a number of elements */
+    inline size_t Predicate_Bytes(size_t numElements)
+    {
+        return (numElements + 7) / 8;
+    }
+
+    /**
+     * Component wise kernel with three operands, used by the fused multiply-add kernels.
+     */
+    typedef void (*TernaryKernel_t)(float * dst, const KernelOperand & a, const KernelOperand & b, const KernelOperand & c,
+        size_t count, unsigned mask);
+
+    enum {
+        KERNEL_ADD,
+        KERNEL_SUB,
+        KERNEL_MUL,
+        KERNEL_DIV,
+        KERNEL_MIN,
+        KERNEL_MAX,
+        KERNEL_BINARY_MAX
+    };
+
+    enum {
+        KERNEL_COPY,
+        KERNEL_NEGATE,
+        KERNEL_FLOOR,
+        KERNEL_CEIL,
+        KERNEL_SQRT,
+        KERNEL_INVSQRT,
+        KERNEL_SINE,
+        KERNEL_COSINE,
+        KERNEL_TANGENT,
+        KERNEL_ARCSINE,
+        KERNEL_ARCCOSINE,
+        KERNEL_ARCTANGENT,
+        KERNEL_UNARY_MAX
+    };
+
+    enum {
+        KERNEL_CMP_GRT,
+        KERNEL_CMP_LE,
+        KERNEL_CMP_EQ,
+        KERNEL_CMP_GEQ,
+        KERNEL_CMP_LEQ,
+        KERNEL_CMP_MAX
+    };
+
+    /**
+     * Multiply-add kernels. The product is rounded before it's added, so the result is identical
+     * to a multiplication followed by a addition. The rhs of a vector multiplication is a scalar,
+     * which makes the vector forms a scale-add.
+     */
+    enum {
+        KERNEL_MULADD,      /**< a * b + c */
+        KERNEL_MULSUB,      /**< a * b - c */
+        KERNEL_SUBMUL,      /**< c - a * b */
+        KERNEL_TERNARY_MAX
+    };
+
+    /**
+     * The kernels implemented for a single instruction set. The horizontal kernels (Dot, Length,
+     * Normalize) are indexed by the number of components minus two.
+     *
+     * The fused kernels computes a operation on the result of another, without writing the
+     * intermediate result to memory: normalize(a) * s, length(a - b) and sqrt(dot(a, b)).
+     *
+     * Stream copies the results of the streams that are only written to their destination,
+     * Prefetch reads the streams of the next batch ahead of time.
+     */
+    struct KernelTable
+    {
+        ISA_t           isa;
+        Precision_t     precision;
+        const char *    name;
+
+        BinaryKernel_t  Binary[KERNEL_BINARY_MAX];
+        UnaryKernel_t   Unary[KERNEL_UNARY_MAX];
+        CompareKernel_t Compare[KERNEL_CMP_MAX];
+        SelectKernel_t  Select;
+        StreamKernel_t  Stream;
+        PrefetchKernel_t Prefetch;
+
+        BinaryKernel_t  Dot[3];
+        UnaryKernel_t   Length[3];
+        UnaryKernel_t   Normalize[3];
+        BinaryKernel_t  Cross;
+
+        TernaryKernel_t Ternary[KERNEL_TERNARY_MAX];
+        BinaryKernel_t  NormalizeScale[3];
+        BinaryKernel_t  LengthOfDifference[3];
+        BinaryKernel_t  DotSqrt[3];
+    };
+
+    /**
+     * Returns the best instruction set supported by the processor.
+     */
+    ISA_t DetectISA();
+
+    /**
+     * Sizes in bytes of the data caches of the processor.
+     */
+    struct CacheSizes
+    {
+        size_t  L1;
+        size_t  L2;
+    };
+
+    /**
+     * Returns the data cache sizes of the processor, typical sizes are returned if they can't
+     * be queried.
+     */
+    const CacheSizes & DetectCaches();
+
+    /**
+     * Returns the kernels for a instruction set and precision. If the instruction set isn't
+     * supported by the processor, or wasn't compiled in, the best supported instruction set is
+     * used instead.
+     *
+     * The approximate precisions replaces the division, inversesqrt(), normalize() and the
+     * trigonometric kernels. Precision_Fast multiplies by the reciprocal estimates of the
+     * instruction set refined by one Newton-Raphson step, Precision_Fastest uses the estimates
+     * as they are and evaluates the trigonometric functions with low order polynomials. The
+     * elements after the last full register uses exact reciprocals.
+     */
+    const KernelTable * GetKernelTable(ISA_t isa = ISA_Auto, Precision_t precision = Precision_Precise);
+
+    /** Kernel tables, one set per translation unit */
+    const KernelTable * GetKernelTable_Portable(Precision_t precision = Precision_Precise);
+    const KernelTable * GetKernelTable_SSE41(Precision_t precision = Precision_Precise);
+    const KernelTable * GetKernelTable_AVX2(Precision_t precision = Precision_Precise);
+    const KernelTable * GetKernelTable_AVX512(Precision_t precision = Precision_Precise);
+
+    /**
+     * The polynomial approximations that the unary kernels uses for the trigonometric functions,
+     * evaluated for a single float. They are also used by the constant folding and the native
+     * kernels, so that the result is identical to the kernels of each instruction set. The result
+     * is within the following number of ULP of the correctly rounded result, measured for every
+     * float of the domain:
+     *
+     * Math_Sin, Math_Cos   2 ULP
+     * Math_Tan             4 ULP
+     * Math_ArcSin          2 ULP
+     * Math_ArcCos          1 ULP
+     * Math_ArcTan          3 ULP
+     *
+     * The bounds of sin, cos and tan holds for |x| <= 8192, larger arguments are passed to the
+     * C library. Math_ArcSin and Math_ArcCos returns NaN outside of [-1, 1].
+     */
+    float Math_Sin(float x);
+    float Math_Cos(float x);
+    float Math_Tan(float x);
+    float Math_ArcSin(float x);
+    float Math_ArcCos(float x);
+    float Math_ArcTan(float x);
+}
+
+#endif
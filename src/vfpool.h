@@ -0,0 +1,56 @@
+#ifndef _VFPOOL_H_
+#define _VFPOOL_H_
+
+#include "vf.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vf
+{
+    /**
+     * A fixed set of worker threads that executes a number of tasks in parallel. The calling
+     * thread takes part in the execution as worker zero, so a pool with a single thread
+     * executes every task on the caller. The pool is the scheduler that is used when the
+     * library starts threads of its own.
+     */
+    class ThreadPool : public IScheduler
+    {
+    public:
+        explicit ThreadPool(size_t numThreads);
+        ~ThreadPool();
+
+        size_t  NumThreads() const;
+        void    Run(size_t numTasks, const Task_t & task);
+
+        virtual size_t  NumWorkers() const;
+        virtual void    ParallelFor(size_t numTasks, const Task_t & task);
+
+    protected:
+        ThreadPool(const ThreadPool &);
+        ThreadPool & operator=(const ThreadPool &);
+
+        void    Stop();
+        void    Worker(size_t index);
+        void    Execute(size_t worker);
+
+        std::vector<std::thread>    m_Threads;
+        std::mutex                  m_Lock;
+        std::condition_variable     m_Start;
+        std::condition_variable     m_Done;
+        const Task_t *              m_Task;
+        size_t                      m_NumTasks;
+        std::atomic<size_t>         m_Next;         /**< the next task to execute */
+        size_t                      m_Active;       /**< the number of workers that hasn't finished the current run */
+        uint64_t                    m_Generation;   /**< incremented for each run */
+        bool                        m_Stop;
+    };
+}
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef _VFPROGRAM_H_
+#define _VFPROGRAM_H_
+
+#include "vf.h"
+#include "vfvm.h"
+#include "vfutil.h"
+
+#include <memory>
+#include <vector>
+
+namespace vf
+{
+    enum {
+        TILE_MIN_ELEMENTS   = 64    /**< smaller batches spends more time dispatching than executing */
+    };
+
+    /**
+     * Bytecode that has been verified and translated once, the part of a execution that never
+     * changes. A compiled program is never modified after it has been built, so it may be shared
+     * by any number of machines and threads. The machines keep the bindings and the temporary
+     * registers, and refer to the io map of the program.
+     */
+    struct CompiledProgram
+    {
+        CompiledProgram(std::shared_ptr<vf::ByteCode>, Layout_t, Engine_t, Precision_t);
+
+        void        AssignTemporaries(vf::VirtualMachine &, uint8_t *, size_t capacity) const;
+        Status_t    Check_Method(const vf::VirtualMachine &, size_t method) const;
+        Status_t    Execute_Range(vf::VirtualMachine &, size_t method, size_t begin, size_t end, size_t batchLimit) const;
+        Status_t    Evaluate_Uniforms(vf::VirtualMachine &, size_t method, const uint8_t * temporaries, size_t capacity) const;
+        size_t      NumTemporaries() const;
+        size_t      Tile_FromCache(size_t capacity) const;
+        const float * Temporary(const uint8_t * temporaries, size_t capacity, size_t reg) const;
+
+        std::shared_ptr<vf::ByteCode>           bytecode;
+        vfutil::Bitmap                          iomap;
+        Layout_t                                layout;
+        Engine_t                                engine;
+        Precision_t                             precision;
+        std::vector<ExecutionPlan>              plans;      /**< one plan per method, AoS layout only */
+        std::vector<Status_t>                   status;     /**< the result of verifying and building each method */
+        std::vector<MethodBindings>             bindings;   /**< the registers and samplers of each method */
+        std::vector<int>                        prologues;  /**< the prologue of each method, or -1 */
+        std::vector<std::vector<vf::Variable> > hoisted;    /**< the hidden uniforms of each method */
+    };
+
+    /** Assigns a value to a uniform of a execution or machine, as the type of the variable */
+    template<class T>
+    Status_t Assign_Uniform(T & target, const vf::Variable & var, const vf::Vector & value)
+    {
+        switch(var.m_Type) {
+        case vf::Type_Float:    return target.SetUniform(var.m_UniformIndex, value.u.f);
+        case vf::Type_Vec2:     return target.SetUniform(var.m_UniformIndex, value.u.v2);
+        case vf::Type_Vec3:     return target.SetUniform(var.m_UniformIndex, value.u.v3);
+        case vf::Type_Vec4:     return target.SetUniform(var.m_UniformIndex, value.u.v4);
+        default:                return Err_InvalidParameter;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,302 @@
+#ifndef _VFSSA_H_
+#define _VFSSA_H_
+
+#include "codegen.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace vf
+{
+    /*************************************************************************/
+    /*                          Intermediate representation                  */
+    /*************************************************************************/
+
+    /**
+     * The operations of the intermediate representation. Const, Uniform, Load and Member
+     * only describes where a operand is read from and doesn't generate any code by themselves,
+     * the comparison is generated together with the select that uses it.
+     */
+    typedef enum {
+        IR_Nop,         /**< removed instruction, dropped by IR_Compact */
+        IR_Const,       /**< value */
+        IR_Uniform,     /**< uniform reg, starting at member */
+        IR_Load,        /**< register reg, starting at member */
+        IR_Member,      /**< the components of args[0] starting at member */
+        IR_Add,
+        IR_Sub,
+        IR_Mul,         /**< args[1] is a scalar */
+        IR_Div,         /**< args[1] is a scalar */
+        IR_Min,
+        IR_Max,
+        IR_Dot,
+        IR_Cross,
+        IR_Negate,
+        IR_Length,
+        IR_Normalize,
+        IR_Sqrt,
+        IR_InvSqrt,
+        IR_Sin,
+        IR_Cos,
+        IR_Tan,
+        IR_ArcSin,
+        IR_ArcCos,
+        IR_ArcTan,
+        IR_Floor,
+        IR_Ceil,
+        IR_Sample,      /**< sampler reg at the position args[0] */
+        IR_Compare,     /**< compares args[0] with args[1], reg is a IR_Compare_t */
+        IR_Select,      /**< args[1] where the comparison args[0] holds, otherwise args[2] */
+        IR_Store,       /**< writes args[0] to register reg, starting at member */
+        IR_MAX
+    } IR_Opcode_t;
+
+    typedef enum {
+        IR_CmpEqual,
+        IR_CmpGreater,
+        IR_CmpLess,
+        IR_CmpGreaterEqual,
+        IR_CmpLessEqual
+    } IR_Compare_t;
+
+    /**
+     * A instruction in static single assignment form. Each instruction defines a single value
+     * that is identified by the index of the instruction, and the operands refers to the values
+     * of earlier instructions.
+     */
+    struct IR_Instruction
+    {
+        IR_Instruction(IR_Opcode_t op = IR_Nop, vf::DataType type = vf::Type_Invalid);
+
+        IR_Opcode_t     op;
+        vf::DataType    type;       /**< the type of the value, or of the stored value */
+        int             args[3];    /**< operand values, -1 if unused */
+        uint8_t         reg;        /**< register, uniform index, sampler or comparison */
+        uint8_t         member;     /**< the first component that is read or written */
+        vf::Vector      value;      /**< the value of a constant */
+    };
+
+    /**
+     * A method in the intermediate representation. Instructions are kept in program order,
+     * stores and loads of the same register must not be reordered.
+     */
+    struct IR_Function
+    {
+        IR_Function() : name(0)
+        {
+        }
+
+        int Append(const IR_Instruction & ins)
+        {
+            code.push_back(ins);
+            return static_cast<int>(code.size() - 1);
+        }
+
+        vf::SymbolTable::SymIndex   name;
+        std::vector<IR_Instruction> code;
+    };
+
+    /** Returns the number of operands of a instruction */
+    size_t IR_NumArgs(IR_Opcode_t op);
+
+    /** Returns true if the instruction generates code of its own */
+    bool IR_IsEmitted(IR_Opcode_t op);
+
+    /** Returns the number of uses of each value */
+    std::vector<size_t> IR_CountUses(const IR_Function &);
+
+    /** Replaces every use of a value with another value */
+    void IR_Replace(IR_Function &, int from, int to);
+
+    /** Removes the IR_Nop instructions and renumbers the remaining values */
+    void IR_Compact(IR_Function &);
+
+    /** Writes a readable listing of the function */
+    void IR_Dump(const IR_Function &, std::ostream &);
+
+    /**
+     * Translates a function from the syntax tree. Loads of variables that has been stored
+     * earlier in the function are replaced with the stored value. Returns false if the function
+     * uses a construct that can't be represented, the function should be compiled directly
+     * from the syntax tree instead.
+     */
+    bool IR_Build(const vf::Node_Function &, vf::Environment *,
+        const std::map<vf::SymbolTable::SymIndex, vf::Vector> & uniforms, IR_Function &);
+
+    /**
+     * Generates bytecode for a function. Values are computed directly into the register they
+     * are stored to when possible, also when the store belongs to a later statement, otherwise
+     * into temporary registers starting at firstTemporary that are reused once the value is dead.
+     *
+     * \param [out]     numTemporaries  The number of temporary registers that are required.
+     */
+    bool IR_Lower(const IR_Function &, vf::IEmitSink & sink, uint8_t firstTemporary, uint8_t & numTemporaries);
+
+    /*************************************************************************/
+    /*                                  Passes                               */
+    /*************************************************************************/
+
+    /**
+     * A optimization pass over a function.
+     */
+    class IR_Pass
+    {
+    public:
+        virtual ~IR_Pass() {}
+
+        virtual const char *    Name() const = 0;
+
+        /** Returns true if the function was changed */
+        virtual bool            Run(IR_Function &) = 0;
+    };
+
+    /** Evaluates operations on constants at compile time */
+    std::shared_ptr<IR_Pass> IR_ConstantFolding();
+
+    /** Removes instructions whose value is never used */
+    std::shared_ptr<IR_Pass> IR_DeadCodeElimination();
+
+    enum {
+        IR_MAX_TEMPORARIES = 16     /**< each temporary costs 16 bytes per element of a batch */
+    };
+
+    /**
+     * Computes identical expressions once, also when they appear in different statements.
+     * Reusing a value keeps it alive for longer, so a expression is only replaced if the number
+     * of values that are live at once stays within maxTemporaries, or within what the function
+     * already required.
+     */
+    std::shared_ptr<IR_Pass> IR_CommonSubexpressionElimination(size_t maxTemporaries = IR_MAX_TEMPORARIES);
+
+    /**
+     * Returns the largest number of values that are live at once and has to be placed in
+     * temporary registers. Values that are only stored are assumed to be computed directly
+     * into the stored register.
+     */
+    size_t IR_Pressure(const IR_Function &);
+
+    /**
+     * Finds the position of the last use of each value, members and comparisons are used where
+     * their own value is used. A value is temporary if anything other than a store uses it.
+     */
+    void IR_LiveRanges(const IR_Function &, std::vector<int> & lastUse, std::vector<bool> & temporary);
+
+    /**
+     * The accumulated run time of a pass.
+     */
+    struct IR_PassTiming
+    {
+        std::string     name;
+        size_t          runs;
+        size_t          changes;    /**< the number of runs that changed the function */
+        double          seconds;
+    };
+
+    /**
+     * Runs a sequence of passes over the functions of a program. Optionally dumps the function
+     * before the first pass and after each pass that changed it, and keeps the time spent in
+     * each pass. The pass manager may be used from several threads.
+     */
+    class IR_PassManager
+    {
+    public:
+        IR_PassManager();
+
+        void    Add(std::shared_ptr<IR_Pass> pass);
+        void    Clear();
+        void    SetDump(std::ostream * os);
+        void    Run(IR_Function &);
+
+        std::vector<IR_PassTiming>  GetTimings() const;
+        void                        PrintTimings(std::ostream &) const;
+        void                        ResetTimings();
+
+    protected:
+        IR_PassManager(const IR_PassManager &);
+        IR_PassManager & operator=(const IR_PassManager &);
+
+        mutable std::mutex                      m_Lock;
+        std::vector<std::shared_ptr<IR_Pass> >  m_Passes;
+        std::vector<IR_PassTiming>              m_Timings;  /**< one per pass */
+        std::ostream *                          m_Dump;
+    };
+
+    /**
+     * Returns the pass manager that is used by Program::Compile. It initially runs constant
+     * folding, common subexpression elimination and dead code elimination.
+     */
+    IR_PassManager & IR_GetPassManager();
+
+    /*************************************************************************/
+    /*                                  Hoisting                             */
+    /*************************************************************************/
+
+    enum {
+        IR_MAX_UNIFORMS = 63        /**< member 3 of uniform 63 is encoded as 0xff, which marks a constant */
+    };
+
+    /**
+     * A value that is computed once per execution and read from a hidden uniform.
+     */
+    struct IR_Hoisted
+    {
+        uint8_t         uniform;    /**< the hidden uniform that the function reads */
+        uint8_t         reg;        /**< the register that the prologue leaves the value in */
+        vf::DataType    type;
+    };
+
+    /**
+     * Moves the values that only depends on uniforms and constants out of a function and into a
+     * prologue, which is executed for a single element before the function. The function reads
+     * each moved value from a hidden uniform starting at firstUniform, the prologue stores it to a
+     * register starting at firstRegister. A value is only moved if it saves instructions, a single
+     * operation whose result is just assigned to a register stays in the function. Returns false
+     * if nothing was moved.
+     */
+    bool IR_HoistUniforms(IR_Function & func, IR_Function & prologue, uint8_t firstUniform,
+        uint8_t firstRegister, std::vector<IR_Hoisted> & hoisted);
+
+    /**
+     * Sink for the bytecode of a method that also accepts a prologue. When it's the sink of the
+     * code generator the uniform invariant values of the method are hoisted into the prologue,
+     * and the hidden uniforms they are read from are listed in hoisted.
+     */
+    class IR_PrologueSink : public vf::IEmitSink
+    {
+    public:
+        IR_PrologueSink(vf::IEmitSink & method, vf::IEmitSink & prologue, uint8_t firstUniform)
+            : m_Method(method), m_Prologue(prologue), m_FirstUniform(firstUniform)
+        {
+        }
+
+        using vf::IEmitSink::emit;
+
+        virtual bool emit(uint32_t instruction)
+        {
+            return m_Method.emit(instruction);
+        }
+
+        virtual bool emit(const void * ptr, size_t numBytes)
+        {
+            return m_Method.emit(ptr, numBytes);
+        }
+
+        vf::IEmitSink & Prologue()          { return m_Prologue; }
+        uint8_t         FirstUniform() const { return m_FirstUniform; }
+
+        std::vector<IR_Hoisted>     hoisted;
+
+    protected:
+        vf::IEmitSink &             m_Method;
+        vf::IEmitSink &             m_Prologue;
+        uint8_t                     m_FirstUniform;
+    };
+}
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <cstdint>
+#include <cstddef>
 
 namespace vfutil
 {
@@ -42,6 +43,22 @@ namespace vfutil
         std::vector<uint32_t>   m_vData;
         size_t m_NumBits;
     };
+
+    /**
+     * Fixed size memory of the object that holds it. A copy of the holder gets memory of its
+     * own, the contents aren't copied.
+     */
+    template<class T, size_t N>
+    class ScratchArray
+    {
+    public:
+        ScratchArray() {}
+        ScratchArray(const ScratchArray &) {}
+        ScratchArray & operator=(const ScratchArray &) { return *this; }
+        T * data() { return m_Data; }
+    protected:
+        T m_Data[N];
+    };
 }
 
 #endif
\ No newline at end of file
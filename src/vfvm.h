@@ -1,35 +1,397 @@
+#ifndef _VFVM_H_
+#define _VFVM_H_
+
 #include <vector>
 #include "vec4.hpp"
 #include "vf.h"
 #include "sampler.hpp"
 #include "vfutil.h"
+#include "vfkernels.h"
+
+#include <memory>
 
 namespace vf
 {
+    /**
+     * A register in the Structure-of-Arrays layout, one plane per vector component.
+     */
+    struct SoA_Register
+    {
+        float * plane[4];
+    };
+
+    /**
+     * A decoded instruction operand in the Structure-of-Arrays layout. Scalar operands are
+     * replicated to all four components which allows vector-scalar instructions to be executed
+     * component by component.
+     */
+    struct SoA_Operand
+    {
+        const float *   plane[4];   /**< register planes, only valid if the operand isn't constant */
+        float           value[4];   /**< the value of a constant or uniform operand */
+        bool            isconst;
+    };
+
+    /**
+     * A pre-decoded instruction operand. Register operands are resolved to the register base pointer,
+     * and uniforms to their current value, once per batch. Inline constants are decoded and
+     * replicated when the plan is built.
+     */
+    struct PlanOperand
+    {
+        KernelOperand   op;
+        uint8_t         reg;        /**< register or uniform index */
+        size_t          numComponents;
+        bool            isreg;
+        bool            isuniform;
+    };
+
+    /**
+     * The kinds of steps in a execution plan, each step kind has a specialized handler. The operand
+     * form is part of the kind, R is a register and C is a constant or uniform operand. The fused
+     * steps with more than two operands has a single handler for all forms.
+     */
+#define VF_PLAN_STEPS(X)    \
+        X(Binary_RR)        \
+        X(Binary_RC)        \
+        X(Binary_CR)        \
+        X(Binary_CC)        \
+        X(Unary_R)          \
+        X(Unary_C)          \
+        X(Compare_RR)       \
+        X(Compare_RC)       \
+        X(Compare_CR)       \
+        X(Compare_CC)       \
+        X(Select_RR)        \
+        X(Select_RC)        \
+        X(Select_CR)        \
+        X(Select_CC)        \
+        X(Ternary)          \
+        X(CompareSelect)    \
+        X(Accumulate)       \
+        X(Stream)           \
+        X(Prefetch)         \
+        X(Branch)           \
+        X(Sampler)
+
+    typedef enum {
+#define VF_PLAN_STEP_ENUM(name) Step_##name,
+        VF_PLAN_STEPS(VF_PLAN_STEP_ENUM)
+#undef VF_PLAN_STEP_ENUM
+        Step_Max
+    } StepType_t;
+
+    /**
+     * The kernel family of a step, together with the kernel index it identifies the operation
+     * independently of the kernel table.
+     */
+    typedef enum {
+        Family_Binary,      /**< indexed by KERNEL_ADD..KERNEL_MAX */
+        Family_Unary,       /**< indexed by KERNEL_COPY..KERNEL_ARCTANGENT */
+        Family_Dot,
+        Family_Length,
+        Family_Normalize,
+        Family_Cross,
+        Family_Compare,     /**< indexed by KERNEL_CMP_GRT..KERNEL_CMP_LEQ */
+        Family_Select,
+        Family_Sampler,
+        Family_Ternary,             /**< indexed by KERNEL_MULADD..KERNEL_SUBMUL */
+        Family_NormalizeScale,
+        Family_LengthOfDifference,
+        Family_DotSqrt,
+        Family_CompareSelect,       /**< indexed by the comparison */
+        Family_Accumulate,          /**< indexed by KERNEL_ADD or KERNEL_SUB */
+        Family_Prefetch
+    } Family_t;
+
+    union PlanKernel
+    {
+        BinaryKernel_t  binary;
+        UnaryKernel_t   unary;
+        CompareKernel_t compare;
+        SelectKernel_t  select;
+        TernaryKernel_t ternary;
+        StreamKernel_t  stream;
+    };
+
+    /**
+     * A single pre-decoded instruction, with the kernel that executes it. A fused step replaces
+     * two instructions, the operands of a multiply-add are a * b + c and the operands of a
+     * compare-select are the two compared values followed by the two selected values.
+     *
+     * The steps that are executed in blocks, compare-select and accumulate, evaluates the first
+     * instruction with the inner kernel. A accumulate step adds the result of any instruction to
+     * a operand, its operands are the operands of the inner instruction followed by the two
+     * operands of the addition, where src[innerOperand] reads the result of the inner instruction.
+     * A stream step evaluates a binary, unary or multiply-add instruction with the inner kernel,
+     * and copies the result to a stream that the plan only writes with the stream kernel.
+     *
+     * A prefetch step passes the positions of a later sampler step to the sampler, as soon as
+     * they have been computed. It doesn't write any register, dst is the position register and
+     * opcode the opcode of the sampler step.
+     *
+     * A branch step compares its two operands ahead of a conditional assignment, and is followed
+     * by the steps that only computes the first alternative and then the steps that only computes
+     * the second. The steps of a alternative that isn't selected by any element are skipped.
+     */
+    struct PlanStep
+    {
+        StepType_t          type;
+        PlanKernel          kernel;
+        PlanKernel          inner;
+        uint8_t             innerOperands;  /**< the number of operands of the inner kernel */
+        uint8_t             innerOperand;
+        unsigned            innerMask;      /**< the components that the inner kernel writes */
+        Family_t            family;
+        uint8_t             kernelIndex;
+        uint8_t             opcode;
+        uint8_t             dst;        /**< destination register */
+        unsigned            mask;       /**< the destination components that are written */
+        uint8_t             sampler;
+        size_t              branch[2];  /**< the number of steps of each alternative, for a branch step */
+        PlanOperand         src[4];     /**< only fused steps uses more than two operands */
+    };
+
+    class JitCode;
+
+    /**
+     * The layout of the elements of a stream. A stride of zero is the default, packed vf::Vector
+     * elements that the kernels work on directly. Other streams are made up of components floats
+     * every stride bytes, and are copied to and from packed elements one batch at a time.
+     */
+    struct StreamFormat
+    {
+        StreamFormat() : stride(0), components(4)
+        {
+        }
+
+        size_t              stride;     /**< bytes from one element to the next, or zero if packed */
+        size_t              components; /**< the number of floats of each element */
+    };
+
+    /**
+     * A method translated from bytecode into a list of kernel invocations. The plan is built once,
+     * and can then be executed for any number of batches.
+     */
+    struct ExecutionPlan
+    {
+        ExecutionPlan() : kernel(nullptr)
+        {
+        }
+
+        std::vector<PlanStep>       steps;
+        std::vector<uint8_t>        registers;  /**< the registers that are referenced by the plan */
+        std::vector<uint8_t>        streams;    /**< the i/o registers that the plan only writes */
+        std::vector<uint8_t>        outputs;    /**< the i/o registers that the plan writes */
+        std::shared_ptr<JitCode>    native;     /**< native code for the plan, null if it's interpreted */
+        NativeKernel_t              kernel;     /**< ahead-of-time compiled kernel, preferred over native code */
+    };
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define VF_JIT_X64 1
+#endif
+
+    typedef void (*JitFunction_t)(float * const * registers, const vf::Vector * uniforms, size_t count);
+
+    /**
+     * Executable memory that holds the native code of a execution plan. The code processes
+     * count elements, registers are the base pointers of the batch indexed by register and
+     * uniforms are the current values of the uniforms.
+     *
+     * Plans with streams that are only written has a second entry, that stores those streams
+     * with non-temporal stores. It requires each of the streams to be aligned to a vf::Vector.
+     */
+    class JitCode
+    {
+    public:
+        JitCode(const std::vector<uint8_t> & image, size_t entry, size_t streaming);
+        ~JitCode();
+
+        void Run(float * const * registers, const vf::Vector * uniforms, size_t count, bool stream = false) const
+        {
+            (stream ? m_Streaming : m_Entry)(registers, uniforms, count);
+        }
+
+    protected:
+        JitCode(const JitCode &);
+        JitCode & operator=(const JitCode &);
+
+        void *          m_Memory;
+        size_t          m_Size;
+        JitFunction_t   m_Entry;
+        JitFunction_t   m_Streaming;
+    };
+
+    /**
+     * Compiles a execution plan to native code. Returns null if the plan uses a instruction that
+     * can't be compiled, or if native code isn't supported on the platform. Precision_Fastest
+     * uses the reciprocal estimates of the processor for division and inverse square roots.
+     */
+    std::shared_ptr<JitCode> Jit_Compile(const ExecutionPlan & plan, const vfutil::Bitmap & IoMap, ISA_t isa,
+        Precision_t precision = Precision_Precise);
+
+    /**
+     * The registers and samplers that a method refers to. They are checked to be bound once
+     * before the method is executed, the machines then executes it without any checks.
+     */
+    struct MethodBindings
+    {
+        std::vector<uint8_t>    registers;
+        std::vector<uint8_t>    components; /**< the referenced components of each register, as a mask */
+        std::vector<uint8_t>    samplers;
+    };
+
     enum {
-        FLAG_CMP = (1 << 0)
-    }; 
+        FUSED_BLOCK_SIZE = 256      /**< elements per block, for the steps that are executed in blocks */
+    };
 
     /**
-     * VirtualMachine, executes bytecode from a instruction stream.
+     * VirtualMachine, translates bytecode into a execution plan, and executes the plan.
      */
     class VirtualMachine
     {
     public:
-        VirtualMachine(const vfutil::Bitmap & IoMap, uint8_t NumRegisters, uint8_t NumUniforms, uint8_t NumSamplers);
+        VirtualMachine(const vfutil::Bitmap & IoMap, uint8_t NumRegisters, uint8_t NumUniforms, uint8_t NumSamplers,
+            ISA_t isa = ISA_Auto, Precision_t precision = Precision_Precise);
 
-        Status_t    Execute(vf::InstructionStream & stream, size_t batchSize, size_t batchOffset);
+        Status_t    Compile(vf::InstructionStream & stream, ExecutionPlan & plan);
+        void        Fuse(ExecutionPlan & plan) const;
+        void        Mark_Branches(ExecutionPlan & plan) const;
+        void        Mark_Streams(ExecutionPlan & plan) const;
+        void        Mark_Prefetches(ExecutionPlan & plan) const;
+        void        Prefetch_Batch(const ExecutionPlan & plan, size_t batchSize, size_t batchOffset) const;
+        Status_t    Execute(const ExecutionPlan & plan, size_t batchSize, size_t batchOffset);
+        Status_t    Execute_Unchecked(const ExecutionPlan & plan, size_t batchSize, size_t batchOffset);
+        Status_t    Check_Bindings(const MethodBindings &) const;
+        void        Clear_Bindings();
+        void        Copy_Bindings(const VirtualMachine &);
         Status_t    SetRegisterPointer(size_t, void *);
+        Status_t    SetRegisterPointer(size_t, void *, size_t stride, size_t numComponents);
         Status_t    SetUniform(size_t, float);
         Status_t    SetUniform(size_t, const vf::Vector2 &);
         Status_t    SetUniform(size_t, const vf::Vector3 &);
         Status_t    SetUniform(size_t, const vf::Vector4 &);
         Status_t    SetSampler(size_t, vf::ISampler *);
+        Status_t    SetNonTemporal(size_t, bool);
+        Status_t    SetPrefetch(size_t);
+        Status_t    SetDispatch(Dispatch_t);
         void        SetFlagPointer(void *);
+        void        SetStagingPointer(void *, size_t numElements);
+        size_t      NumStrided() const;
 
     protected: // methods
 
-        typedef Status_t (VirtualMachine::*pInstrImpl_t) (const Instruction_t &, InstructionStream &, size_t, size_t);
+        typedef Status_t (VirtualMachine::*pCompileImpl_t) (const Instruction_t &, InstructionStream &, PlanStep &);
+        void BuildCallTable();
+
+        Status_t Compile_Binary(size_t kernel, const Instruction_t &, InstructionStream &, PlanStep &, size_t numComponents,
+            uint8_t form, size_t rhsComponents);
+        Status_t Compile_Unary(size_t kernel, const Instruction_t &, InstructionStream &, PlanStep &, size_t numComponents,
+            bool isconst);
+        template<bool Threaded>
+        Status_t Execute_Steps(const PlanStep * step, const PlanStep * end, size_t batchSize);
+        Status_t Execute_Sampler(const PlanStep &, size_t batchSize);
+        void     Execute_CompareSelect(const PlanStep &, size_t batchSize);
+        void     Execute_Accumulate(const PlanStep &, size_t batchSize);
+        void     Execute_Stream(const PlanStep &, size_t batchSize);
+        bool     Streaming(const ExecutionPlan &) const;
+        void     Execute_Prefetch(const PlanStep &, size_t batchSize) const;
+        Status_t Load_Strided(const ExecutionPlan &, size_t batchSize, size_t batchOffset);
+        void     Store_Strided(const ExecutionPlan &, size_t batchSize, size_t batchOffset) const;
+        bool     NonTemporal(uint8_t reg) const;
+
+        /*********************************************************************/
+        /*                              Instructions                         */
+        /*********************************************************************/
+        Status_t Compile_Add(const Instruction_t &, InstructionStream &, PlanStep &);
+        Status_t Compile_Sub(const Instruction_t &, InstructionStream &, PlanStep &);
+        Status_t Compile_Mul(const Instruction_t &, InstructionStream &, PlanStep &);
+        Status_t Compile_Div(const Instruction_t &, InstructionStream &, PlanStep &);
+        Status_t Compile_Negate(const Instruction_t &, InstructionStream &, PlanStep &);
+        Status_t Compile_Dot(const Instruction_t &, InstructionStream &, PlanStep &);
+        Status_t Compile_Trigonometric(const Instruction_t &, InstructionStream &, PlanStep &);
+        Status_t Compile_Length(const Instruction_t &, InstructionStream &, PlanStep &);
+        Status_t Compile_Sqrt(const Instruction_t &, InstructionStream &, PlanStep &);
+        Status_t Compile_Normalize(const Instruction_t &, InstructionStream &, PlanStep &);
+        Status_t Compile_Cross(const Instruction_t &, InstructionStream &, PlanStep &);
+        Status_t Compile_Assignment(const Instruction_t &, InstructionStream &, PlanStep &);
+        Status_t Compile_ConditionalAssignment(const Instruction_t &, InstructionStream &, PlanStep &);
+        Status_t Compile_Comparison(const Instruction_t &, InstructionStream &, PlanStep &);
+        Status_t Compile_Min(const Instruction_t &, InstructionStream &, PlanStep &);
+        Status_t Compile_Max(const Instruction_t &, InstructionStream &, PlanStep &);
+        Status_t Compile_Sampler(const Instruction_t &, InstructionStream &, PlanStep &);
+        Status_t Compile_Floor(const Instruction_t &, InstructionStream &, PlanStep &);
+        Status_t Compile_Ceil(const Instruction_t &, InstructionStream &, PlanStep &);
+
+    protected: // helper methods used while building the plan.
+        void            Retrive_Destination(PlanStep &, uint8_t, size_t numComponents);
+        void            Retrive_Operand(PlanOperand &, uint8_t, bool isconst, size_t numComponents, InstructionStream &);
+        void            Bind_Operand(KernelOperand &, const PlanOperand &) const;
+        StepType_t      Step_Type(StepType_t first, size_t operands, const PlanStep &) const;
+        void            List_Registers(ExecutionPlan &) const;
+        void            List_Streams(ExecutionPlan &) const;
+        bool            Fusable(const ExecutionPlan &, size_t i, size_t j) const;
+        bool            Fuse_Pair(ExecutionPlan &, size_t i, size_t j, size_t s) const;
+        bool            Exclusive(const ExecutionPlan &, size_t k, size_t end, size_t j, size_t s) const;
+        vf::ISampler *  GetSampler(uint8_t);
+        uint8_t *       GetFlags();
+
+    protected: // variables
+
+        std::vector<void *>         m_Registers;
+        std::vector<float *>        m_Base;         /**< register base pointers of the current batch */
+        std::vector<vf::Vector>     m_Uniforms;
+        std::vector<vf::ISampler *> m_Samplers;
+        uint8_t *                   m_Flags;        /**< the predicate, one bit per element */
+        std::vector<pCompileImpl_t> m_CallTable;
+        const KernelTable *         m_Kernels;
+        const vfutil::Bitmap &      m_IoMap;
+        vfutil::ScratchArray<float, FUSED_BLOCK_SIZE * 4> m_Scratch;   /**< the result of a inner kernel, for one block */
+        std::vector<bool>           m_NonTemporal;  /**< the streams that are stored with non-temporal stores */
+        std::vector<const vf::ISamplerPrefetch *> m_Prefetchers;   /**< the samplers that implements the prefetch hook */
+        size_t                      m_PrefetchBytes;    /**< the bytes of each stream that are prefetched ahead of a batch */
+        std::vector<StreamFormat>   m_Formats;      /**< the layout of each stream */
+        vf::Vector *                m_Staging;      /**< packed elements of the strided streams, for one batch */
+        size_t                      m_StagingSize;  /**< the number of elements of the staging memory */
+        Dispatch_t                  m_Dispatch;     /**< how the steps of the plans are dispatched */
+    };
+
+    /**
+     * Verifies the methods of a bytecode by compiling them with a machine, returns the plan and
+     * status of each method and the bindings of the methods that are valid. Only verified
+     * methods may be executed, and the plans are the ones that are executed.
+     */
+    void Verify_ByteCode(const vf::ByteCode &, VirtualMachine & compiler, std::vector<ExecutionPlan> & plans,
+        std::vector<Status_t> & status, std::vector<MethodBindings> & bindings);
+
+
+    /**
+     * SoA_VirtualMachine, executes bytecode on registers stored in a Structure-of-Arrays layout.
+     *
+     * Each register is made up of four separate planes, one per component, which means that
+     * scalar instructions only touches the plane that they operate on. The bytecode is decoded
+     * for each batch without any checks, it must have been verified by Verify_ByteCode and the
+     * bindings of the method checked with Check_Bindings.
+     */
+    class SoA_VirtualMachine
+    {
+    public:
+        SoA_VirtualMachine(const vfutil::Bitmap & IoMap, uint8_t NumRegisters, uint8_t NumUniforms, uint8_t NumSamplers,
+            ISA_t isa = ISA_Auto, Precision_t precision = Precision_Precise);
+
+        Status_t    Execute(vf::InstructionStream & stream, size_t batchSize, size_t batchOffset);
+        Status_t    Check_Bindings(const MethodBindings &) const;
+        Status_t    SetRegisterPointer(size_t, float *, float *, float *, float *);
+        Status_t    SetUniform(size_t, float);
+        Status_t    SetUniform(size_t, const vf::Vector2 &);
+        Status_t    SetUniform(size_t, const vf::Vector3 &);
+        Status_t    SetUniform(size_t, const vf::Vector4 &);
+        Status_t    SetSampler(size_t, vf::ISampler *);
+        void        SetFlagPointer(void *);
+
+    protected: // types
+
+        typedef Status_t (SoA_VirtualMachine::*pInstrImpl_t) (const Instruction_t &, InstructionStream &, size_t, size_t);
         void BuildCallTable();
 
         /*********************************************************************/
@@ -56,23 +418,56 @@ namespace vf
         Status_t Execute_Ceil(const Instruction_t &, InstructionStream &, size_t batchSize, size_t batchOffset);
 
     protected: // helper methods used during execution.
-        Vector *        Retrive_Register(uint8_t, size_t offset = 0);
-        float &         Retrive_Element(uint8_t, size_t offset = 0);
-        Vector *        Retrive_Uniform(uint8_t);
+        float *         Retrive_Plane(uint8_t, size_t component, size_t offset = 0);
+        void            Retrive_Destination(float * (&dst)[4], uint8_t, size_t numComponents, size_t offset);
+        void            Retrive_Operand(SoA_Operand &, uint8_t, bool isconst, size_t numComponents, InstructionStream &, size_t offset);
         float &         Retrive_UniformElement(uint8_t);
         vf::ISampler *  GetSampler(uint8_t);
         uint8_t *       GetFlags();
 
     protected: // variables
 
-        std::vector<void *>         m_Registers;
+        std::vector<SoA_Register>   m_Registers;
         std::vector<vf::Vector>     m_Uniforms;
         std::vector<vf::ISampler *> m_Samplers;
-        uint8_t *                   m_Flags;
+        std::vector<vf::Vector>     m_SampleBuffer;
+        uint8_t *                   m_Flags;        /**< the predicate, one bit per element */
         std::vector<pInstrImpl_t>   m_CallTable;
+        const KernelTable *         m_Kernels;
         const vfutil::Bitmap &      m_IoMap;
     };
 
+    enum {
+        PREFETCH_DEFAULT_BYTES  = 4096  /**< prefetched from each input stream ahead of a batch */
+    };
+
+    enum {
+        FORM_RR = 0,    /**< register, register */
+        FORM_RC,        /**< register, constant/uniform */
+        FORM_CR,        /**< constant/uniform, register */
+        FORM_CC         /**< constant/uniform, constant/uniform */
+    };
+
+    /**
+     * Returns the number of components that a instruction operates on, and the operand form
+     * (RR, RC, CR or CC) of the instruction. The first opcode of each type in the instruction
+     * family is supplied by the caller.
+     */
+    inline size_t Decode_Type(uint8_t opcode, uint8_t vec2, uint8_t vec3, uint8_t vec4, uint8_t scalar, uint8_t & form)
+    {
+        if (opcode >= vec4) {
+            form = opcode - vec4;
+            return 4;
+        } else if (opcode >= vec3) {
+            form = opcode - vec3;
+            return 3;
+        } else if (opcode >= vec2) {
+            form = opcode - vec2;
+            return 2;
+        }
+        form = opcode - scalar;
+        return 1;
+    }
 
     inline uint8_t Register_Index(uint8_t b)
     {
@@ -83,4 +478,6 @@ namespace vf
     {
         return b & 0x03;
     }
-}
\ No newline at end of file
+}
+
+#endif
@@ -1,16 +1,30 @@
 #include "vfvm.h"
-#include "vfmath.hpp"
+
+#include <algorithm>
+
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(VF_NO_COMPUTED_GOTO)
+#define VF_THREADED_DISPATCH
+#endif
 
 namespace vf
 {
-    VirtualMachine::VirtualMachine(const vfutil::Bitmap & IoMap, uint8_t NumRegisters, uint8_t NumUniforms, uint8_t NumSamplers)
-        : m_IoMap(IoMap)
+    VirtualMachine::VirtualMachine(const vfutil::Bitmap & IoMap, uint8_t NumRegisters, uint8_t NumUniforms, uint8_t NumSamplers,
+        ISA_t isa, Precision_t precision)
+        : m_Flags(nullptr), m_Kernels(GetKernelTable(isa, precision)), m_IoMap(IoMap),
+        m_PrefetchBytes(PREFETCH_DEFAULT_BYTES), m_Staging(nullptr), m_StagingSize(0),
+#if defined(VF_THREADED_DISPATCH)
+        m_Dispatch(Dispatch_Threaded)
+#else
+        m_Dispatch(Dispatch_Switch)
+#endif
     {
         m_Registers.resize(NumRegisters);
+        m_Base.resize(NumRegisters);
         m_Samplers.resize(NumSamplers);
         m_Uniforms.resize(NumUniforms);
-
-        BuildCallTable();
+        m_NonTemporal.resize(NumRegisters, true);
+        m_Prefetchers.resize(NumSamplers, nullptr);
+        m_Formats.resize(NumRegisters);
     }
 
     /*************************************************************************/
@@ -20,6 +34,26 @@ namespace vf
     Status_t VirtualMachine::SetRegisterPointer(size_t index, void * ptrMem)
     {
         m_Registers[index] = ptrMem;
+        m_Formats[index] = StreamFormat();
+        return Err_Success;
+    }
+
+    /**
+     * Binds a stream whose elements are numComponents floats every stride bytes, such as a member
+     * of an array of structures. The stride must be a multiple of a float, and large enough to
+     * hold the components. Streams of packed vf::Vector elements are bound as they are.
+     */
+    Status_t VirtualMachine::SetRegisterPointer(size_t index, void * ptrMem, size_t stride, size_t numComponents)
+    {
+        if (!numComponents || (numComponents > 4) || (stride % sizeof(float)) || (stride < numComponents * sizeof(float))) {
+            return Err_InvalidParameter;
+        }
+        m_Registers[index] = ptrMem;
+        m_Formats[index] = StreamFormat();
+        if ((stride != sizeof(vf::Vector)) || (numComponents != 4)) {
+            m_Formats[index].stride     = stride;
+            m_Formats[index].components = numComponents;
+        }
         return Err_Success;
     }
     
@@ -47,61 +81,196 @@ namespace vf
         return Err_Success;
     }
 
+    /**
+     * Binds a sampler, samplers that also implements vf::ISamplerPrefetch are passed the
+     * positions ahead of the lookups.
+     */
     Status_t VirtualMachine::SetSampler(size_t index, vf::ISampler * sampler)
     {
         m_Samplers[index] = sampler;
+        m_Prefetchers[index] = dynamic_cast<const vf::ISamplerPrefetch *>(sampler);
+        return Err_Success;
+    }
+
+    /**
+     * Sets the number of bytes of each input stream that Prefetch_Batch prefetches, zero disables
+     * the prefetching.
+     */
+    Status_t VirtualMachine::SetPrefetch(size_t bytes)
+    {
+        m_PrefetchBytes = bytes;
+        return Err_Success;
+    }
+
+    /**
+     * Selects how the steps of the plans are dispatched. Threaded dispatch is only supported by
+     * compilers that has computed goto, and not when VF_NO_COMPUTED_GOTO is defined.
+     */
+    Status_t VirtualMachine::SetDispatch(Dispatch_t dispatch)
+    {
+        if ((dispatch != Dispatch_Threaded) && (dispatch != Dispatch_Switch)) {
+            return Err_InvalidParameter;
+        }
+#if !defined(VF_THREADED_DISPATCH)
+        if (dispatch == Dispatch_Threaded) {
+            return Err_InvalidParameter;
+        }
+#endif
+        m_Dispatch = dispatch;
+        return Err_Success;
+    }
+
+    /**
+     * Selects if a stream that the plans only writes is stored with non-temporal stores, which
+     * is the default. Streams that are read right after the execution are better kept cached.
+     */
+    Status_t VirtualMachine::SetNonTemporal(size_t index, bool enable)
+    {
+        m_NonTemporal[index] = enable;
         return Err_Success;
     }
 
+    /**
+     * Clears the streams, uniforms and samplers. The temporary registers and the predicate
+     * are kept.
+     */
+    void VirtualMachine::Clear_Bindings()
+    {
+        for(size_t i = 0; i < m_Registers.size(); ++i) {
+            if (m_IoMap.Get(i)) {
+                m_Registers[i] = nullptr;
+                m_NonTemporal[i] = true;
+                m_Formats[i] = StreamFormat();
+            }
+        }
+        for(size_t i = 0; i < m_Uniforms.size(); ++i) {
+            for(size_t c = 0; c < 4; ++c) {
+                m_Uniforms[i][c] = 0.0f;
+            }
+        }
+        std::fill(m_Samplers.begin(), m_Samplers.end(), nullptr);
+        std::fill(m_Prefetchers.begin(), m_Prefetchers.end(), nullptr);
+        m_PrefetchBytes = PREFETCH_DEFAULT_BYTES;
+    }
+
+    /**
+     * Copies the streams, uniforms and samplers, and how they are stored, prefetched and
+     * dispatched, from a machine of the same program. The temporary registers, the predicate
+     * and the staging memory are kept, and nothing is allocated.
+     */
+    void VirtualMachine::Copy_Bindings(const VirtualMachine & other)
+    {
+        for(size_t i = 0; i < m_Registers.size(); ++i) {
+            if (m_IoMap.Get(i)) {
+                m_Registers[i] = other.m_Registers[i];
+                m_NonTemporal[i] = other.m_NonTemporal[i];
+                m_Formats[i] = other.m_Formats[i];
+            }
+        }
+        std::copy(other.m_Uniforms.begin(), other.m_Uniforms.end(), m_Uniforms.begin());
+        std::copy(other.m_Samplers.begin(), other.m_Samplers.end(), m_Samplers.begin());
+        std::copy(other.m_Prefetchers.begin(), other.m_Prefetchers.end(), m_Prefetchers.begin());
+        m_PrefetchBytes = other.m_PrefetchBytes;
+        m_Dispatch      = other.m_Dispatch;
+    }
+
     /*************************************************************************/
-    /*                  Utility methods used during execution                */
+    /*                  Utility methods used while building the plan         */
     /*************************************************************************/
-    Vector * VirtualMachine::Retrive_Register(uint8_t operand, size_t offset)
+
+    /**
+     * Retrives the register that the result of a instruction should be written to, and the mask
+     * of the components that should be written. Scalar results are written to the register member.
+     */
+    void VirtualMachine::Retrive_Destination(PlanStep & step, uint8_t operand, size_t numComponents)
     {
-        uint8_t reg = Register_Index(operand);
-        if (reg > m_Registers.size()) {
+        step.dst    = Register_Index(operand);
+        step.mask   = (numComponents == 1) ? (1 << Register_Member(operand)) : ((1 << numComponents) - 1);
+        if (step.dst >= m_Registers.size()) {
             throw std::runtime_error("invalid register index.");
         }
-        if (!m_Registers[reg]) {
-            throw std::runtime_error("register hasn't been initialized.");
-        }
-        return ((Vector *)m_Registers[reg]) + (m_IoMap.Get(reg) ? offset : 0);
     }
 
-    float & VirtualMachine::Retrive_Element(uint8_t operand, size_t offset)
+    /**
+     * Decodes a instruction operand, which is either a register, a uniform or a inline constant.
+     * Inline constants are read from the instruction stream and scalar constants are replicated
+     * to all four components. Registers and uniforms are bound when the plan is executed.
+     */
+    void VirtualMachine::Retrive_Operand(PlanOperand & op, uint8_t operand, bool isconst, size_t numComponents,
+        InstructionStream & is)
     {
-        uint8_t idx = Register_Member(operand);
-        Vector * ptr = Retrive_Register(operand);
-        return ptr->operator[](idx);
+        op.reg              = Register_Index(operand);
+        op.numComponents    = numComponents;
+        op.isreg            = !isconst;
+        op.isuniform        = isconst && (operand != 0xff);
+        op.op.ptr           = nullptr;
+        op.op.member        = (numComponents == 1) ? Register_Member(operand) : 0;
+        for(size_t c = 0; c < 4; ++c) {
+            op.op.value[c] = 0.0f;
+        }
+
+        if (op.isreg) {
+            if (op.reg >= m_Registers.size()) {
+                throw std::runtime_error("invalid register index.");
+            }
+            op.op.kind = (numComponents == 1) ? Operand_Splat : Operand_Vector;
+        } else {
+            op.op.kind = Operand_Const;
+            if (op.isuniform) {
+                if (op.reg >= m_Uniforms.size()) {
+                    throw std::runtime_error("invalid uniform index.");
+                }
+            } else {
+                for(size_t c = 0; c < numComponents; ++c) {
+                    op.op.value[c] = is.DecodeScalar();
+                }
+                if (numComponents == 1) {
+                    op.op.value[1] = op.op.value[2] = op.op.value[3] = op.op.value[0];
+                }
+            }
+        }
     }
 
-    Vector * VirtualMachine::Retrive_Uniform(uint8_t operand)
+    /**
+     * Binds a operand of the plan to the current batch. Registers are resolved to the base pointer
+     * of the batch, and uniforms to their current value.
+     */
+    void VirtualMachine::Bind_Operand(KernelOperand & op, const PlanOperand & src) const
     {
-        uint8_t id = Register_Index(operand);
-        if (id > m_Registers.size()) {
-            throw std::runtime_error("invalid uniform index.");
+        op = src.op;
+        if (src.isreg) {
+            op.ptr = m_Base[src.reg];
+        } else if (src.isuniform) {
+            const Vector & uniform = m_Uniforms[src.reg];
+            if (src.numComponents == 1) {
+                op.value[0] = op.value[1] = op.value[2] = op.value[3] = uniform[src.op.member];
+            } else {
+                for(size_t c = 0; c < src.numComponents; ++c) {
+                    op.value[c] = uniform[c];
+                }
+            }
         }
-        return &m_Uniforms[id];
     }
 
-    float & VirtualMachine::Retrive_UniformElement(uint8_t operand)
+    /**
+     * Returns the kind of a step from the first kind of the family (the RR or R form) and the
+     * forms of the operands of the step.
+     */
+    StepType_t VirtualMachine::Step_Type(StepType_t first, size_t operands, const PlanStep & step) const
     {
-        uint8_t id = Register_Index(operand), idx = Register_Member(operand);
-        if (id > m_Registers.size()) {
-            throw std::runtime_error("invalid register index.");
+        int form = step.src[0].isreg ? 0 : 1;
+        if (operands == 2) {
+            form = (form << 1) | (step.src[1].isreg ? 0 : 1);
         }
-        return m_Uniforms[id].operator[](idx);
+        return static_cast<StepType_t>(first + form);
     }
 
     /** Returns the sampler with the specified index */
     ISampler * VirtualMachine::GetSampler(uint8_t operand)
     {
-        if (operand > m_Samplers.size()) {
+        if (operand >= m_Samplers.size()) {
             throw std::runtime_error("Invalid sampler index.");
         }
-        if (m_Samplers[operand] == 0) {
-            throw std::runtime_error("Uninitialized sampler.");
-        }
         return m_Samplers[operand];
     }
 
@@ -110,76 +279,115 @@ namespace vf
         return m_Flags;
     }
     /**
-     * Sets the memory region that should be used to store the per batch flags.
+     * Sets the memory region that should be used to store the predicate of a batch, which is
+     * a bitmask with one bit per element.
      */ 
     void VirtualMachine::SetFlagPointer(void * ptr)
     {
         m_Flags = (uint8_t *)ptr;
     }
+
+    /**
+     * Sets the memory region that holds the packed elements of the strided streams of a batch,
+     * numElements vf::Vector elements. A batch needs NumStrided() times its size.
+     */
+    void VirtualMachine::SetStagingPointer(void * ptr, size_t numElements)
+    {
+        m_Staging       = (vf::Vector *)ptr;
+        m_StagingSize   = numElements;
+    }
+
+    /** Returns the number of streams that are bound with a stride */
+    size_t VirtualMachine::NumStrided() const
+    {
+        size_t num = 0;
+        for(size_t i = 0; i < m_Formats.size(); ++i) {
+            num += m_Formats[i].stride ? 1 : 0;
+        }
+        return num;
+    }
     /*************************************************************************/
-    /*                                  Execution                            */
+    /*                                  Compilation                          */
     /*************************************************************************/
     void VirtualMachine::BuildCallTable()
     {
         m_CallTable.resize(OP_MAX);
         for(size_t i = 0; i < OP_MAX; ++i) {
             if ((i >= OP_SCALAR_ADD_RR) && (i <= OP_VECTOR4_ADD_CC)) {
-                m_CallTable[i] = &VirtualMachine::Execute_Add;
+                m_CallTable[i] = &VirtualMachine::Compile_Add;
             } else if ((i >= OP_SCALAR_SUB_RR) && (i <= OP_VECTOR4_SUB_CC)) {
-                m_CallTable[i] = &VirtualMachine::Execute_Sub;
+                m_CallTable[i] = &VirtualMachine::Compile_Sub;
             } else if ((i >= OP_SCALAR_MUL_RR) && (i <= OP_VECTOR4_SCALAR_MUL_CC)) {
-                m_CallTable[i] = &VirtualMachine::Execute_Mul;
+                m_CallTable[i] = &VirtualMachine::Compile_Mul;
             } else if ((i >= OP_SCALAR_DIV_RR) && (i <= OP_VECTOR4_SCALAR_DIV_CC)) {
-                m_CallTable[i] = &VirtualMachine::Execute_Div;
+                m_CallTable[i] = &VirtualMachine::Compile_Div;
             } else if ((i >= OP_SCALAR_NEGATE_R) && (i <= OP_VECTOR4_NEGATE_C)) {
-                m_CallTable[i] = &VirtualMachine::Execute_Negate;
+                m_CallTable[i] = &VirtualMachine::Compile_Negate;
             } else if ((i >= OP_DOT_VECTOR2_RR) && (i <= OP_DOT_VECTOR4_CC)) {
-                m_CallTable[i] = &VirtualMachine::Execute_Dot;
+                m_CallTable[i] = &VirtualMachine::Compile_Dot;
             } else if ((i >= OP_CROSS_RR) && (i <= OP_CROSS_CC)) {
-                m_CallTable[i] = &VirtualMachine::Execute_Cross;
+                m_CallTable[i] = &VirtualMachine::Compile_Cross;
             } else if ((i >= OP_LENGTH_VECTOR2_R) && (i <= OP_LENGTH_VECTOR4_C)) {
-                m_CallTable[i] = &VirtualMachine::Execute_Length;
+                m_CallTable[i] = &VirtualMachine::Compile_Length;
             } else if ((i >= OP_SINE_R) && (i <= OP_ARCTANGENT_C)) {
-                m_CallTable[i] = &VirtualMachine::Execute_Trigonometric;
+                m_CallTable[i] = &VirtualMachine::Compile_Trigonometric;
             } else if ((i >= OP_SQRT_R) && (i <= OP_INVSQRT_C)) {
-                m_CallTable[i] = &VirtualMachine::Execute_Sqrt;
+                m_CallTable[i] = &VirtualMachine::Compile_Sqrt;
             } else if ((i >= OP_VECTOR2_NORMALIZE_R) && (i <= OP_VECTOR4_NORMALIZE_C)) {
-                m_CallTable[i] = &VirtualMachine::Execute_Normalize;
+                m_CallTable[i] = &VirtualMachine::Compile_Normalize;
             } else if ((i >= OP_ASSIGN_SCALAR_R) && (i <= OP_ASSIGN_VECTOR4_C)) {
-                m_CallTable[i] = &VirtualMachine::Execute_Assignment;
+                m_CallTable[i] = &VirtualMachine::Compile_Assignment;
             } else if ((i >= OP_CMP_GRT_RR) && (i <= OP_CMP_LEQ_CC)) {
-                m_CallTable[i] = &VirtualMachine::Execute_Comparison;
+                m_CallTable[i] = &VirtualMachine::Compile_Comparison;
             } else if ((i >= OP_COND_SCALAR_RR) && (i <= OP_COND_VECTOR4_CC)) {
-                m_CallTable[i] = &VirtualMachine::Execute_ConditionalAssignment;
+                m_CallTable[i] = &VirtualMachine::Compile_ConditionalAssignment;
             } else if ((i >= OP_MIN_SCALAR_RR) && (i <= OP_MIN_VECTOR4_CC)) {
-                m_CallTable[i] = &VirtualMachine::Execute_Min;
+                m_CallTable[i] = &VirtualMachine::Compile_Min;
             } else if ((i >= OP_MAX_SCALAR_RR) && (i <= OP_MAX_VECTOR4_CC)) {
-                m_CallTable[i] = &VirtualMachine::Execute_Max;
+                m_CallTable[i] = &VirtualMachine::Compile_Max;
             } else if ((i >= OP_SAMPLE1D_R) && (i <= OP_SAMPLE3D_C)) {
-                m_CallTable[i] = &VirtualMachine::Execute_Sampler;
+                m_CallTable[i] = &VirtualMachine::Compile_Sampler;
             } else if ((i >= OP_FLOOR_SCALAR_R) && (i <= OP_FLOOR_VECTOR4_C)) {
-                m_CallTable[i] = &VirtualMachine::Execute_Floor;
+                m_CallTable[i] = &VirtualMachine::Compile_Floor;
             } else if ((i >= OP_CEIL_SCALAR_R) && (i <= OP_CEIL_VECTOR4_C)) {
-                m_CallTable[i] = &VirtualMachine::Execute_Ceil;
+                m_CallTable[i] = &VirtualMachine::Compile_Ceil;
             }
         }
     }
 
     /**
-     * VirtualMachine::Execute
-     * Executes the instruction in the stream on the Virtual Machine (VM).
+     * VirtualMachine::Compile
+     * Translates the instructions in the stream into a execution plan. The instruction stream is
+     * decoded once, and the plan can then be executed for any number of batches. The call table
+     * is built by the first compilation, machines that only executes plans never needs it.
      */
-    Status_t VirtualMachine::Execute(vf::InstructionStream & stream, size_t batchSize, size_t batchOffset)
+    Status_t VirtualMachine::Compile(vf::InstructionStream & stream, ExecutionPlan & plan)
     {
+        if (m_CallTable.empty()) {
+            BuildCallTable();
+        }
         vf::Instruction_t instr;
+        plan.steps.clear();
+        plan.registers.clear();
         try {
             while(stream.Decode(instr)) {
-                if (instr.Opcode < OP_MAX) {
-                    VirtualMachine::pInstrImpl_t methodPtr = m_CallTable[instr.Opcode];
-                    Status_t err = (this->*methodPtr)(instr, stream, batchSize, batchOffset);
+                if ((instr.Opcode < OP_MAX) && m_CallTable[instr.Opcode]) {
+                    PlanStep step = PlanStep();
+                    step.opcode         = instr.Opcode;
+                    step.inner.binary   = nullptr;
+                    step.innerOperands  = 0;
+                    step.innerOperand   = 0;
+                    step.innerMask      = 0;
+                    step.branch[0]      = step.branch[1] = 0;
+                    for(size_t i = 0; i < 4; ++i) {
+                        step.src[i].isreg = step.src[i].isuniform = false;
+                    }
+                    VirtualMachine::pCompileImpl_t methodPtr = m_CallTable[instr.Opcode];
+                    Status_t err = (this->*methodPtr)(instr, stream, step);
                     if (err != Err_Success) {
                         return err;
                     }
+                    plan.steps.push_back(step);
                 } else {
                     return Err_InvalidBytecode;
                 }
@@ -187,2771 +395,1567 @@ namespace vf
         } catch(std::runtime_error &) {
             return Err_InvalidBytecode;
         }
+        List_Registers(plan);
+        List_Streams(plan);
         return Err_Success;
     }
 
-    /*************************************************************************/
-    /*                                  Instructions                         */
-    /*************************************************************************/
-
     /**
-    * Execute_Add
-    * Executes a addition bytecode instruction.
-    */
-    Status_t VirtualMachine::Execute_Add(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
+     * Lists the registers that are referenced by the steps of a plan.
+     */
+    void VirtualMachine::List_Registers(ExecutionPlan & plan) const
     {
-        switch(ins.Opcode)
-        {
-            /*****************************************************************/
-            /*                              Scalar                           */
-            /*****************************************************************/
-        case OP_SCALAR_ADD_RR:
-            {
-                float * pCurrentDst         = &Retrive_Element(ins.Dst, batchOffset);
-                const float * pCurrentSrc1  = &Retrive_Element(ins.Src1, batchOffset);
-                const float * pCurrentSrc2  = &Retrive_Element(ins.Src2, batchOffset);
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    pCurrentDst[i] = pCurrentSrc1[i] + pCurrentSrc2[i];
-                }
-                break;
+        std::vector<bool> used(m_Registers.size(), false);
+        for(size_t s = 0; s < plan.steps.size(); ++s) {
+            const PlanStep & step = plan.steps[s];
+            if ((step.family != Family_Compare) && (step.family != Family_Prefetch)) {
+                used[step.dst] = true;
             }
-        case OP_SCALAR_ADD_RC:      /** scalar register + scalar constant/uniform */
-            {
-                float * pCurrentDst = &Retrive_Element(ins.Dst, batchOffset);
-                const float * pLhs  = &Retrive_Element(ins.Src1, batchOffset);
-                float rhs           = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    pCurrentDst[i] = pLhs[i] + rhs;
-                }
-                break;
-            }
-        case OP_SCALAR_ADD_CR:      /** scalar constant/uniform + scalar register */
-            {
-                float * pCurrentDst = &Retrive_Element(ins.Dst, batchOffset);
-                const float * pRhs  = &Retrive_Element(ins.Src2, batchOffset);
-                float lhs           = (ins.Src1 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src1);
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    pCurrentDst[i] = lhs + pRhs[i];
+            for(size_t i = 0; i < 4; ++i) {
+                if (step.src[i].isreg) {
+                    used[step.src[i].reg] = true;
                 }
-                break;
             }
-        case OP_SCALAR_ADD_CC:      /** scalar constant/uniform + scalar constant/uniform */
-            {
-                float * pCurrentDst = &Retrive_Element(ins.Dst, batchOffset);
-                float lhs           = (ins.Src1 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src1);
-                float rhs           = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
-                float result        = lhs + rhs;
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    pCurrentDst[i] = result;
-                }
-                break;
+        }
+        plan.registers.clear();
+        for(size_t i = 0; i < used.size(); ++i) {
+            if (used[i]) {
+                plan.registers.push_back(static_cast<uint8_t>(i));
             }
+        }
+    }
 
-            /*****************************************************************/
-            /*                              Vector2                          */
-            /*****************************************************************/
-        case OP_VECTOR2_ADD_RR:
-            {
-                Vector * dst = Retrive_Register(ins.Dst, batchOffset);
-                Vector * src1 = Retrive_Register(ins.Src1, batchOffset);
-                Vector * src2 = Retrive_Register(ins.Src2, batchOffset);
+    /*************************************************************************/
+    /*                                  Fusion                               */
+    /*************************************************************************/
 
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Add((dst++)->u.v2, (src1++)->u.v2, (src2++)->u.v2);
+    namespace
+    {
+        /** Returns true if a step reads a register */
+        bool Reads(const PlanStep & step, uint8_t reg)
+        {
+            for(size_t i = 0; i < 4; ++i) {
+                if (step.src[i].isreg && (step.src[i].reg == reg)) {
+                    return true;
                 }
-                break;
             }
-        case OP_VECTOR2_ADD_RC:
-            {
-                Vector * dst        = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * src1 = Retrive_Register(ins.Src1, batchOffset);
-                const Vector2 & rhs = (ins.Src2 == 0xff) ? *is.Decode2() : Retrive_Uniform(ins.Src2)->u.v2;
+            return false;
+        }
 
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Add((dst++)->u.v2, (src1++)->u.v2, rhs);
+        /** Returns the components of a register that a step reads */
+        unsigned ReadMask(const PlanStep & step, uint8_t reg)
+        {
+            unsigned mask = 0;
+            for(size_t i = 0; i < 4; ++i) {
+                const PlanOperand & op = step.src[i];
+                if (op.isreg && (op.reg == reg)) {
+                    mask |= (op.numComponents == 1) ? (1u << op.op.member) : ((1u << op.numComponents) - 1);
                 }
             }
-            break;
-        case OP_VECTOR2_ADD_CR:
-            {
-                Vector * dst        = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * src2 = Retrive_Register(ins.Src2, batchOffset);
-                const Vector2 & lhs = (ins.Src1 == 0xff) ? *is.Decode2() : Retrive_Uniform(ins.Src1)->u.v2;
+            return mask;
+        }
 
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Add((dst++)->u.v2, lhs, (src2++)->u.v2);
-                }
-            }
-            break;
-        case OP_VECTOR2_ADD_CC:
-            {
-                Vector * dst        = Retrive_Register(ins.Dst, batchOffset);
-                const Vector2 & lhs = (ins.Src1 == 0xff) ? *is.Decode2() : Retrive_Uniform(ins.Src1)->u.v2;
-                const Vector2 & rhs = (ins.Src2 == 0xff) ? *is.Decode2() : Retrive_Uniform(ins.Src2)->u.v2;
-                Vector2 result      = lhs + rhs;
+        /** Returns true if a step writes to a register */
+        bool Writes(const PlanStep & step, uint8_t reg)
+        {
+            return (step.family != Family_Compare) && (step.family != Family_Prefetch) && (step.dst == reg);
+        }
 
-                for(size_t i = 0; i < batchSize; ++i) {
-                    (dst++)->u.v2 = result;
-                }
-            }
-            break;
-            /*****************************************************************/
-            /*                              Vector3                          */
-            /*****************************************************************/
-        case OP_VECTOR3_ADD_RR:
-            {
-                Vector * dst = Retrive_Register(ins.Dst, batchOffset);
-                Vector * src1 = Retrive_Register(ins.Src1, batchOffset);
-                Vector * src2 = Retrive_Register(ins.Src2, batchOffset);
+        /** Returns true if a step reads or writes the flags */
+        bool UsesFlags(const PlanStep & step)
+        {
+            return (step.family == Family_Compare) || (step.family == Family_Select) ||
+                (step.family == Family_CompareSelect);
+        }
 
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Add((dst++)->u.v3, (src1++)->u.v3, (src2++)->u.v3);
-                }
-                break;
+        /** Returns the number of components of the result of a step, horizontal operations has a scalar result */
+        size_t ResultComponents(const PlanStep & step)
+        {
+            switch(step.family) {
+            case Family_Dot:
+            case Family_Length:
+            case Family_LengthOfDifference:
+            case Family_DotSqrt:
+                return 1;
+            default:
+                return step.src[0].numComponents;
             }
-        case OP_VECTOR3_ADD_RC:
-            {
-                Vector * dst        = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * src1 = Retrive_Register(ins.Src1, batchOffset);
-                const Vector3 & rhs = (ins.Src2 == 0xff) ? *is.Decode3() : Retrive_Uniform(ins.Src2)->u.v3;
+        }
 
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Add((dst++)->u.v3, (src1++)->u.v3, rhs);
-                }
+        /** Returns true if the result of a step can be computed by a inner kernel */
+        bool IsInner(const PlanStep & step)
+        {
+            switch(step.family) {
+            case Family_Binary:
+            case Family_Dot:
+            case Family_Length:
+            case Family_Normalize:
+            case Family_Cross:
+            case Family_NormalizeScale:
+            case Family_LengthOfDifference:
+            case Family_DotSqrt:
+                return true;
+            case Family_Unary:
+                return step.kernelIndex != KERNEL_COPY;
+            default:
+                return false;
             }
-            break;
-        case OP_VECTOR3_ADD_CR:
-            {
-                Vector * dst        = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * src2 = Retrive_Register(ins.Src2, batchOffset);
-                const Vector3 & lhs = (ins.Src1 == 0xff) ? *is.Decode3() : Retrive_Uniform(ins.Src1)->u.v3;
+        }
 
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Add((dst++)->u.v3, lhs, (src2++)->u.v3);
-                }
+        /**
+         * Returns true if a operand reads exactly the numComponents components that a step writes,
+         * a scalar result is read as a splat of the member that was written.
+         */
+        bool ReadsResult(const PlanOperand & op, const PlanStep & step, size_t numComponents)
+        {
+            if (!op.isreg || (op.reg != step.dst) || (op.numComponents != numComponents)) {
+                return false;
             }
-            break;
-        case OP_VECTOR3_ADD_CC:
-            {
-                Vector * dst        = Retrive_Register(ins.Dst, batchOffset);
-                const Vector3 & lhs = (ins.Src1 == 0xff) ? *is.Decode3() : Retrive_Uniform(ins.Src1)->u.v3;
-                const Vector3 & rhs = (ins.Src2 == 0xff) ? *is.Decode3() : Retrive_Uniform(ins.Src2)->u.v3;
-                Vector3 result      = lhs + rhs;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    (dst++)->u.v3 = result;
-                }
+            if (numComponents == 1) {
+                return (op.op.kind == Operand_Splat) && (step.mask == (1u << op.op.member));
             }
-            break;
-            /*****************************************************************/
-            /*                              Vector3                          */
-            /*****************************************************************/
-        case OP_VECTOR4_ADD_RR:
-            {
-                Vector * dst = Retrive_Register(ins.Dst, batchOffset);
-                Vector * src1 = Retrive_Register(ins.Src1, batchOffset);
-                Vector * src2 = Retrive_Register(ins.Src2, batchOffset);
+            return (op.op.kind == Operand_Vector) && (step.mask == ((1u << numComponents) - 1));
+        }
+    }
 
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Add((dst++)->u.v4, (src1++)->u.v4, (src2++)->u.v4);
+    /**
+     * Returns true if the step at index i can be evaluated by the step at index j instead. The
+     * result of step i must be a temporary that is only read by step j, and the operands of step
+     * i must still hold the same values at step j. Registers that isn't bound to a stream only
+     * lives within a method, so the result is dead if it isn't read again before it's overwritten.
+     */
+    bool VirtualMachine::Fusable(const ExecutionPlan & plan, size_t i, size_t j) const
+    {
+        const PlanStep & producer = plan.steps[i];
+        const PlanStep & consumer = plan.steps[j];
+        for(size_t k = i + 1; k < j; ++k) {
+            for(size_t s = 0; s < 4; ++s) {
+                if (producer.src[s].isreg && Writes(plan.steps[k], producer.src[s].reg)) {
+                    return false;
                 }
-                break;
             }
-        case OP_VECTOR4_ADD_RC:
-            {
-                Vector * dst        = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * src1 = Retrive_Register(ins.Src1, batchOffset);
-                const Vector4 & rhs = (ins.Src2 == 0xff) ? *is.Decode4() : Retrive_Uniform(ins.Src2)->u.v4;
+        }
+        if (producer.family == Family_Compare) {
+            return true;
+        }
 
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Add((dst++)->u.v4, (src1++)->u.v4, rhs);
-                }
+        // the kernels evaluates each element in place, so the result may not overwrite a operand.
+        if (m_IoMap.Get(producer.dst)) {
+            return false;
+        }
+        for(size_t s = 0; s < 4; ++s) {
+            if (producer.src[s].isreg && (producer.src[s].reg == consumer.dst)) {
+                return false;
             }
-            break;
-        case OP_VECTOR4_ADD_CR:
-            {
-                Vector * dst        = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * src2 = Retrive_Register(ins.Src2, batchOffset);
-                const Vector4 & lhs = (ins.Src1 == 0xff) ? *is.Decode4() : Retrive_Uniform(ins.Src1)->u.v4;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Add((dst++)->u.v4, lhs, (src2++)->u.v4);
-                }
+        }
+        size_t reads = 0;
+        for(size_t s = 0; s < 4; ++s) {
+            if (consumer.src[s].isreg && (consumer.src[s].reg == producer.dst)) {
+                ++reads;
             }
-            break;
-        case OP_VECTOR4_ADD_CC:
-            {
-                Vector * dst        = Retrive_Register(ins.Dst, batchOffset);
-                const Vector4 & lhs = (ins.Src1 == 0xff) ? *is.Decode4() : Retrive_Uniform(ins.Src1)->u.v4;
-                const Vector4 & rhs = (ins.Src2 == 0xff) ? *is.Decode4() : Retrive_Uniform(ins.Src2)->u.v4;
-                Vector4 result      = lhs + rhs;
+        }
+        if (reads != 1) {
+            return false;
+        }
+        for(size_t k = i + 1; k < j; ++k) {
+            if (Reads(plan.steps[k], producer.dst) || Writes(plan.steps[k], producer.dst)) {
+                return false;
+            }
+        }
 
-                for(size_t i = 0; i < batchSize; ++i) {
-                    (dst++)->u.v4 = result;
-                }
+        // the components that still holds the result, until they are overwritten.
+        unsigned live = producer.mask;
+        if (Writes(consumer, producer.dst)) {
+            live &= ~consumer.mask;
+        }
+        for(size_t k = j + 1; (k < plan.steps.size()) && live; ++k) {
+            if (ReadMask(plan.steps[k], producer.dst) & live) {
+                return false;
+            }
+            if (Writes(plan.steps[k], producer.dst)) {
+                live &= ~plan.steps[k].mask;
             }
-            break;
-        default:
-            return Err_InvalidBytecode;
         }
-        return Err_Success;
+        return true;
     }
 
     /**
-    * Execute_Sub
-    * Executes a subtraction bytecode instruction.
-    */
-    Status_t VirtualMachine::Execute_Sub(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
+     * Replaces the step at index j, whose operand s is the result of the step at index i, with a
+     * fused step if the pair matches one of the superinstructions. Returns true if step i is no
+     * longer needed.
+     */
+    bool VirtualMachine::Fuse_Pair(ExecutionPlan & plan, size_t i, size_t j, size_t s) const
     {
-        switch(ins.Opcode)
+        const PlanStep & producer = plan.steps[i];
+        const PlanStep & consumer = plan.steps[j];
+        const size_t n = producer.src[0].numComponents;
+        PlanStep fused = consumer;
+
+        if ((producer.family == Family_Binary) && (producer.kernelIndex == KERNEL_MUL) &&
+            (consumer.family == Family_Binary) &&
+            ((consumer.kernelIndex == KERNEL_ADD) || (consumer.kernelIndex == KERNEL_SUB)) &&
+            ReadsResult(consumer.src[s], producer, n))
         {
-            /*****************************************************************/
-            /*                              Scalar                           */
-            /*****************************************************************/
-        case OP_SCALAR_SUB_RR:
-            {
-                float * pCurrentDst         = &Retrive_Element(ins.Dst, batchOffset);
-                const float * pCurrentSrc1  = &Retrive_Element(ins.Src1, batchOffset);
-                const float * pCurrentSrc2  = &Retrive_Element(ins.Src2, batchOffset);
+            size_t kernel = (consumer.kernelIndex == KERNEL_ADD) ? KERNEL_MULADD : ((s == 0) ? KERNEL_MULSUB : KERNEL_SUBMUL);
+            fused.type              = Step_Ternary;
+            fused.family            = Family_Ternary;
+            fused.kernelIndex       = static_cast<uint8_t>(kernel);
+            fused.kernel.ternary    = m_Kernels->Ternary[kernel];
+            fused.src[0]            = producer.src[0];
+            fused.src[1]            = producer.src[1];
+            fused.src[2]            = consumer.src[1 - s];
+        } else if ((producer.family == Family_Normalize) && (consumer.family == Family_Binary) &&
+            (consumer.kernelIndex == KERNEL_MUL) && (s == 0) && ReadsResult(consumer.src[0], producer, n))
+        {
+            fused.family            = Family_NormalizeScale;
+            fused.kernelIndex       = 0;
+            fused.kernel.binary     = m_Kernels->NormalizeScale[n - 2];
+            fused.src[0]            = producer.src[0];
+        } else if ((producer.family == Family_Binary) && (producer.kernelIndex == KERNEL_SUB) && (n > 1) &&
+            (consumer.family == Family_Length) && ReadsResult(consumer.src[0], producer, n))
+        {
+            fused.family            = Family_LengthOfDifference;
+            fused.kernelIndex       = 0;
+            fused.kernel.binary     = m_Kernels->LengthOfDifference[n - 2];
+            fused.src[0]            = producer.src[0];
+            fused.src[1]            = producer.src[1];
+        } else if ((producer.family == Family_Dot) && (consumer.family == Family_Unary) &&
+            (consumer.kernelIndex == KERNEL_SQRT) && ReadsResult(consumer.src[0], producer, 1))
+        {
+            fused.family            = Family_DotSqrt;
+            fused.kernelIndex       = 0;
+            fused.kernel.binary     = m_Kernels->DotSqrt[n - 2];
+            fused.src[0]            = producer.src[0];
+            fused.src[1]            = producer.src[1];
+        } else if ((producer.family == Family_Compare) && (consumer.family == Family_Select)) {
+            fused.type              = Step_CompareSelect;
+            fused.family            = Family_CompareSelect;
+            fused.kernelIndex       = producer.kernelIndex;
+            fused.inner.compare     = producer.kernel.compare;
+            fused.src[0]            = producer.src[0];
+            fused.src[1]            = producer.src[1];
+            fused.src[2]            = consumer.src[0];
+            fused.src[3]            = consumer.src[1];
+        } else if (IsInner(producer) && (consumer.family == Family_Binary) &&
+            ((consumer.kernelIndex == KERNEL_ADD) || (consumer.kernelIndex == KERNEL_SUB)) &&
+            ReadsResult(consumer.src[s], producer, ResultComponents(producer)))
+        {
+            fused.type              = Step_Accumulate;
+            fused.family            = Family_Accumulate;
+            fused.inner             = producer.kernel;
+            fused.innerOperands     = ((producer.type == Step_Unary_R) || (producer.type == Step_Unary_C)) ? 1 : 2;
+            fused.innerOperand      = static_cast<uint8_t>(2 + s);
+            fused.innerMask         = producer.mask;
+            fused.src[0]            = producer.src[0];
+            fused.src[1]            = producer.src[1];
+            fused.src[2]            = consumer.src[0];
+            fused.src[3]            = consumer.src[1];
+            fused.src[2 + s].isreg  = false;
+        } else {
+            return false;
+        }
+        if (!Fusable(plan, i, j)) {
+            return false;
+        }
+        if ((fused.family != Family_Ternary) && (fused.family != Family_CompareSelect) && (fused.family != Family_Accumulate)) {
+            fused.type = Step_Type(Step_Binary_RR, 2, fused);
+        }
+        plan.steps[j] = fused;
+        return true;
+    }
 
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    pCurrentDst[i] = pCurrentSrc1[i] - pCurrentSrc2[i];
+    /**
+     * VirtualMachine::Fuse
+     * Replaces pairs of steps with a fused step, which evaluates both instructions without
+     * writing the intermediate result to memory: a * b + c (and the subtracting forms) for
+     * any width, normalize(a) * s, length(a - b), sqrt(dot(a, b)) and a comparison followed by
+     * a conditional assignment. Any other operation whose result is added to, or subtracted
+     * from, a operand is accumulated in blocks, with the result of the operation kept in the
+     * scratch memory of the machine. This is what the addition of a accumulated output
+     * compiles to. The producer doesn't have to be adjacent to its consumer. The
+     * results are identical to the unfused plan. Only temporaries are removed, so the plan of a
+     * method whose registers are read afterwards by the caller, like a prologue, mustn't be fused.
+     * Fused plans can't be compiled to native code.
+     */
+    void VirtualMachine::Fuse(ExecutionPlan & plan) const
+    {
+        std::vector<bool> removed(plan.steps.size(), false);
+        for(size_t j = 0; j < plan.steps.size(); ++j) {
+            const PlanStep & consumer = plan.steps[j];
+            if (consumer.family == Family_Select) {
+                // the comparison that set the flags.
+                for(size_t i = j; i-- > 0;) {
+                    if (!removed[i] && UsesFlags(plan.steps[i])) {
+                        removed[i] = Fuse_Pair(plan, i, j, 0);
+                        break;
+                    }
                 }
-                break;
+                continue;
             }
-        case OP_SCALAR_SUB_RC:
-            {
-                float * pCurrentDst = &Retrive_Element(ins.Dst, batchOffset);
-                const float * pLhs  = &Retrive_Element(ins.Src1, batchOffset);
-                float rhs           = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    pCurrentDst[i] = pLhs[i] - rhs;
+            for(size_t s = 0; s < 2; ++s) {
+                if (!consumer.src[s].isreg) {
+                    continue;
                 }
-                break;
-            }
-        case OP_SCALAR_SUB_CR:      /** scalar constant/uniform + scalar register */
-            {
-                float * pCurrentDst = &Retrive_Element(ins.Dst, batchOffset);
-                const float * pRhs  = &Retrive_Element(ins.Src2, batchOffset);
-                float lhs           = (ins.Src1 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src1);
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    pCurrentDst[i] = lhs - pRhs[i];
+                // the step that last wrote the operand.
+                size_t i = j;
+                while((i-- > 0) && (removed[i] || !Writes(plan.steps[i], consumer.src[s].reg))) {
+                }
+                if ((i < j) && Fuse_Pair(plan, i, j, s)) {
+                    removed[i] = true;
+                    break;
                 }
-                break;
             }
-        case OP_SCALAR_SUB_CC:      /** scalar constant/uniform + scalar constant/uniform */
-            {
-                float * pCurrentDst = &Retrive_Element(ins.Dst, batchOffset);
-                float lhs           = (ins.Src1 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src1);
-                float rhs           = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
-                float result        = lhs - rhs;
+        }
 
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    pCurrentDst[i] = result;
-                }
-                break;
+        size_t num = 0;
+        for(size_t i = 0; i < plan.steps.size(); ++i) {
+            if (!removed[i]) {
+                plan.steps[num++] = plan.steps[i];
             }
+        }
+        plan.steps.resize(num);
+        List_Registers(plan);
+        List_Streams(plan);
+    }
 
-            /*****************************************************************/
-            /*                              Vector2                          */
-            /*****************************************************************/
-        case OP_VECTOR2_SUB_RR:
-            {
-                Vector * dst = Retrive_Register(ins.Dst, batchOffset);
-                Vector * src1 = Retrive_Register(ins.Src1, batchOffset);
-                Vector * src2 = Retrive_Register(ins.Src2, batchOffset);
+    /*************************************************************************/
+    /*                                  Branches                             */
+    /*************************************************************************/
 
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Sub((dst++)->u.v2, (src1++)->u.v2, (src2++)->u.v2);
+    namespace
+    {
+        /** Returns true if a step writes to a register that a comparison reads */
+        bool WritesOperands(const PlanStep & step, const PlanStep & cmp)
+        {
+            for(size_t i = 0; i < 2; ++i) {
+                if (cmp.src[i].isreg && Writes(step, cmp.src[i].reg)) {
+                    return true;
                 }
-                break;
             }
-        case OP_VECTOR2_SUB_RC:
-            {
-                Vector * dst        = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * src1 = Retrive_Register(ins.Src1, batchOffset);
-                const Vector2 & rhs = (ins.Src2 == 0xff) ? *is.Decode2() : Retrive_Uniform(ins.Src2)->u.v2;
+            return false;
+        }
 
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Sub((dst++)->u.v2, (src1++)->u.v2, rhs);
-                }
-            }
-            break;
-        case OP_VECTOR2_SUB_CR:
-            {
-                Vector * dst        = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * src2 = Retrive_Register(ins.Src2, batchOffset);
-                const Vector2 & lhs = (ins.Src1 == 0xff) ? *is.Decode2() : Retrive_Uniform(ins.Src1)->u.v2;
+        enum {
+            PREDICATE_NONE,
+            PREDICATE_ALL,
+            PREDICATE_MIXED
+        };
+
+        /**
+         * Returns whether none, all or some of the bits of a predicate are set. The bits after
+         * the last element are cleared by the comparison.
+         */
+        int Predicate_State(const uint8_t * predicate, size_t count)
+        {
+            const size_t num = Predicate_Bytes(count);
+            const uint8_t last = (count % 8) ? static_cast<uint8_t>((1u << (count % 8)) - 1) : 0xff;
+            bool any = false, all = true;
+            for(size_t i = 0; i < num; ++i) {
+                const uint8_t full = (i == (num - 1)) ? last : 0xff;
+                any |= (predicate[i] != 0);
+                all &= (predicate[i] == full);
+                if (any && !all) {
+                    return PREDICATE_MIXED;
+                }
+            }
+            return any ? PREDICATE_ALL : PREDICATE_NONE;
+        }
+    }
 
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Sub((dst++)->u.v2, lhs, (src2++)->u.v2);
+    /**
+     * Returns true if the result of the step at index k is only read by the steps before end,
+     * which computes the same alternative, and by operand s of the conditional assignment at
+     * index j. A branch step doesn't write any register and belongs to the alternative that
+     * contains it.
+     */
+    bool VirtualMachine::Exclusive(const ExecutionPlan & plan, size_t k, size_t end, size_t j, size_t s) const
+    {
+        const PlanStep & step = plan.steps[k];
+        if (step.type == Step_Branch) {
+            return true;
+        }
+        if ((step.family == Family_Compare) || (step.family == Family_Select) || m_IoMap.Get(step.dst)) {
+            return false;
+        }
+        unsigned live = step.mask;
+        for(size_t i = k + 1; (i < plan.steps.size()) && live; ++i) {
+            const PlanStep & other = plan.steps[i];
+            if (i == j) {
+                for(size_t o = 0; o < 4; ++o) {
+                    if ((o != s) && other.src[o].isreg && (other.src[o].reg == step.dst)) {
+                        return false;
+                    }
                 }
+            } else if ((i >= end) && (ReadMask(other, step.dst) & live)) {
+                return false;
             }
-            break;
-        case OP_VECTOR2_SUB_CC:
-            {
-                Vector * dst        = Retrive_Register(ins.Dst, batchOffset);
-                const Vector2 & lhs = (ins.Src1 == 0xff) ? *is.Decode2() : Retrive_Uniform(ins.Src1)->u.v2;
-                const Vector2 & rhs = (ins.Src2 == 0xff) ? *is.Decode2() : Retrive_Uniform(ins.Src2)->u.v2;
-                Vector2 result      = lhs - rhs;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    (dst++)->u.v2 = result;
-                }
+            if (Writes(other, step.dst)) {
+                live &= ~other.mask;
             }
-            break;
-            /*****************************************************************/
-            /*                              Vector3                          */
-            /*****************************************************************/
-        case OP_VECTOR3_SUB_RR:
-            {
-                Vector * dst = Retrive_Register(ins.Dst, batchOffset);
-                Vector * src1 = Retrive_Register(ins.Src1, batchOffset);
-                Vector * src2 = Retrive_Register(ins.Src2, batchOffset);
+        }
+        return true;
+    }
 
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Sub((dst++)->u.v3, (src1++)->u.v3, (src2++)->u.v3);
+    /**
+     * VirtualMachine::Mark_Branches
+     * Inserts a branch step ahead of the alternatives of each conditional assignment. The code
+     * generators emits the operands of the comparison first, then the instructions of the first
+     * alternative, the instructions of the second and last the comparison and the assignment. The
+     * steps of each alternative are found by following the results backwards from the assignment,
+     * a step belongs to a alternative if its result is only used to compute that alternative. The
+     * branch step compares the batch before the alternatives, and skips the alternative that isn't
+     * selected by any element. The assignment reads the predicate of the branch step, unless a
+     * conditional within the alternatives may have overwritten it, then the assignment compares
+     * the batch again. Like Fuse this assumes that temporaries are dead once the method returns.
+     */
+    void VirtualMachine::Mark_Branches(ExecutionPlan & plan) const
+    {
+        for(size_t j = 0; j < plan.steps.size(); ++j) {
+            const PlanStep & consumer = plan.steps[j];
+            PlanStep branch;
+            size_t end, first;
+            if (consumer.family == Family_CompareSelect) {
+                branch                  = consumer;
+                branch.kernel.compare   = consumer.inner.compare;
+                end                     = j;
+                first                   = 2;
+            } else if ((consumer.family == Family_Select) && (j > 0) && (plan.steps[j - 1].family == Family_Compare) &&
+                (plan.steps[j - 1].type != Step_Branch))
+            {
+                branch                  = plan.steps[j - 1];
+                end                     = j - 1;
+                first                   = 0;
+            } else {
+                continue;
+            }
+
+            // the second alternative, followed by the first.
+            size_t begin = end, middle;
+            while((begin > 0) && !WritesOperands(plan.steps[begin - 1], branch) &&
+                Exclusive(plan, begin - 1, end, j, first + 1))
+            {
+                --begin;
+            }
+            middle = begin;
+            while((begin > 0) && !WritesOperands(plan.steps[begin - 1], branch) &&
+                Exclusive(plan, begin - 1, middle, j, first))
+            {
+                --begin;
+            }
+
+            // a alternative may contain a complete branch, but mustn't start within one.
+            for(size_t k = 0; k < middle; ++k) {
+                const PlanStep & inner = plan.steps[k];
+                if ((inner.type == Step_Branch) && ((k + 1 + inner.branch[0] + inner.branch[1]) > middle)) {
+                    middle = begin = k + 1 + inner.branch[0] + inner.branch[1];
+                }
+            }
+            for(size_t k = 0; k < begin; ++k) {
+                const PlanStep & inner = plan.steps[k];
+                if ((inner.type == Step_Branch) && ((k + 1 + inner.branch[0] + inner.branch[1]) > begin)) {
+                    begin = k + 1 + inner.branch[0] + inner.branch[1];
+                }
+            }
+            if (begin == end) {
+                continue;
+            }
+
+            // the predicate of the branch is still set at the assignment, unless a alternative
+            // contains a conditional of its own.
+            bool reuse = true;
+            for(size_t k = begin; k < end; ++k) {
+                reuse &= !UsesFlags(plan.steps[k]);
+            }
+            if (reuse) {
+                PlanStep & select = plan.steps[j];
+                if (select.family == Family_CompareSelect) {
+                    select.family       = Family_Select;
+                    select.kernelIndex  = 0;
+                    select.src[0]       = select.src[2];
+                    select.src[1]       = select.src[3];
+                    select.src[2].isreg = select.src[3].isreg = false;
+                    select.type         = Step_Type(Step_Select_RR, 2, select);
+                } else {
+                    plan.steps.erase(plan.steps.begin() + end);
+                    --j;
                 }
-                break;
             }
-        case OP_VECTOR3_SUB_RC:
-            {
-                Vector * dst        = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * src1 = Retrive_Register(ins.Src1, batchOffset);
-                const Vector3 & rhs = (ins.Src2 == 0xff) ? *is.Decode3() : Retrive_Uniform(ins.Src2)->u.v3;
 
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Sub((dst++)->u.v3, (src1++)->u.v3, rhs);
-                }
-            }
-            break;
-        case OP_VECTOR3_SUB_CR:
-            {
-                Vector * dst        = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * src2 = Retrive_Register(ins.Src2, batchOffset);
-                const Vector3 & lhs = (ins.Src1 == 0xff) ? *is.Decode3() : Retrive_Uniform(ins.Src1)->u.v3;
+            branch.type             = Step_Branch;
+            branch.family           = Family_Compare;
+            branch.branch[0]        = middle - begin;
+            branch.branch[1]        = end - middle;
+            branch.src[2].isreg     = branch.src[3].isreg = false;
+            plan.steps.insert(plan.steps.begin() + begin, branch);
+            ++j;
+        }
+    }
 
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Sub((dst++)->u.v3, lhs, (src2++)->u.v3);
-                }
-            }
-            break;
-        case OP_VECTOR3_SUB_CC:
-            {
-                Vector * dst        = Retrive_Register(ins.Dst, batchOffset);
-                const Vector3 & lhs = (ins.Src1 == 0xff) ? *is.Decode3() : Retrive_Uniform(ins.Src1)->u.v3;
-                const Vector3 & rhs = (ins.Src2 == 0xff) ? *is.Decode3() : Retrive_Uniform(ins.Src2)->u.v3;
-                Vector3 result      = lhs - rhs;
+    /*************************************************************************/
+    /*                                  Streams                              */
+    /*************************************************************************/
 
-                for(size_t i = 0; i < batchSize; ++i) {
-                    (dst++)->u.v3 = result;
-                }
+    /**
+     * Lists the i/o registers that a plan only writes, where the first step that writes the
+     * register writes every component. The previous content of such a stream is never needed,
+     * so it can be written without reading it into the cache first. Also lists every i/o
+     * register that the plan writes.
+     */
+    void VirtualMachine::List_Streams(ExecutionPlan & plan) const
+    {
+        plan.streams.clear();
+        plan.outputs.clear();
+        for(size_t r = 0; r < plan.registers.size(); ++r) {
+            uint8_t reg = plan.registers[r];
+            if (!m_IoMap.Get(reg)) {
+                continue;
             }
-            break;
-            /*****************************************************************/
-            /*                              Vector3                          */
-            /*****************************************************************/
-        case OP_VECTOR4_SUB_RR:
-            {
-                Vector * dst = Retrive_Register(ins.Dst, batchOffset);
-                Vector * src1 = Retrive_Register(ins.Src1, batchOffset);
-                Vector * src2 = Retrive_Register(ins.Src2, batchOffset);
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Sub((dst++)->u.v4, (src1++)->u.v4, (src2++)->u.v4);
+            bool written = false, full = false, read = false;
+            for(size_t s = 0; s < plan.steps.size(); ++s) {
+                const PlanStep & step = plan.steps[s];
+                read = read || Reads(step, reg);
+                if (!written && Writes(step, reg)) {
+                    written = true;
+                    full    = ((step.mask & 0x0f) == 0x0f);
                 }
-                break;
             }
-        case OP_VECTOR4_SUB_RC:
-            {
-                Vector * dst        = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * src1 = Retrive_Register(ins.Src1, batchOffset);
-                const Vector4 & rhs = (ins.Src2 == 0xff) ? *is.Decode4() : Retrive_Uniform(ins.Src2)->u.v4;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Sub((dst++)->u.v4, (src1++)->u.v4, rhs);
-                }
+            if (written) {
+                plan.outputs.push_back(reg);
             }
-            break;
-        case OP_VECTOR4_SUB_CR:
-            {
-                Vector * dst        = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * src2 = Retrive_Register(ins.Src2, batchOffset);
-                const Vector4 & lhs = (ins.Src1 == 0xff) ? *is.Decode4() : Retrive_Uniform(ins.Src1)->u.v4;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Sub((dst++)->u.v4, lhs, (src2++)->u.v4);
-                }
-            }
-            break;
-        case OP_VECTOR4_SUB_CC:
-            {
-                Vector * dst        = Retrive_Register(ins.Dst, batchOffset);
-                const Vector4 & lhs = (ins.Src1 == 0xff) ? *is.Decode4() : Retrive_Uniform(ins.Src1)->u.v4;
-                const Vector4 & rhs = (ins.Src2 == 0xff) ? *is.Decode4() : Retrive_Uniform(ins.Src2)->u.v4;
-                Vector4 result      = lhs - rhs;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    (dst++)->u.v4 = result;
-                }
+            if (full && !read) {
+                plan.streams.push_back(reg);
             }
-            break;
-        default:
-            return Err_InvalidBytecode;
         }
-        return Err_Success;
     }
 
     /**
-    * Execute_Mul
-    * Executes a multiplication bytecode instruction.
-    */
-    Status_t VirtualMachine::Execute_Mul(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
+     * Replaces the binary, unary and multiply-add steps that writes every component of a stream
+     * that the plan only writes with stream steps. The step becomes the inner kernel of the
+     * stream step, which writes the result with non-temporal stores.
+     */
+    void VirtualMachine::Mark_Streams(ExecutionPlan & plan) const
     {
-        switch(ins.Opcode)
-        {
-            /*****************************************************************/
-            /*                              Scalar                           */
-            /*****************************************************************/
-        case OP_SCALAR_MUL_RR:
-            {
-                float * pDst        = &Retrive_Element(ins.Dst, batchOffset);
-                const float * pSrc1 = &Retrive_Element(ins.Src1, batchOffset);
-                const float * pSrc2 = &Retrive_Element(ins.Src2, batchOffset);
+        for(size_t i = 0; i < plan.steps.size(); ++i) {
+            PlanStep & step = plan.steps[i];
+            if (((step.mask & 0x0f) != 0x0f) ||
+                (std::find(plan.streams.begin(), plan.streams.end(), step.dst) == plan.streams.end()))
+            {
+                continue;
+            }
+            switch(step.type) {
+            case Step_Binary_RR:
+            case Step_Binary_RC:
+            case Step_Binary_CR:
+            case Step_Binary_CC:
+                step.innerOperands = 2;
+                break;
+            case Step_Unary_R:
+            case Step_Unary_C:
+                step.innerOperands = 1;
+                break;
+            case Step_Ternary:
+                step.innerOperands = 3;
+                break;
+            default:
+                continue;
+            }
+            step.inner          = step.kernel;
+            step.innerMask      = step.mask;
+            step.kernel.stream  = m_Kernels->Stream;
+            step.type           = Step_Stream;
+        }
+    }
 
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    pDst[i] = pSrc1[i] * pSrc2[i];
-                }
-                break;
-            }
-        case OP_SCALAR_MUL_RC:      /** scalar register - scalar constant/uniform */
-            {
-                float * pDst            = &Retrive_Element(ins.Dst, batchOffset);
-                const float * pSrc1     = &Retrive_Element(ins.Src1, batchOffset);
-                float rhs               = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
+    /*************************************************************************/
+    /*                                  Prefetching                          */
+    /*************************************************************************/
 
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    pDst[i] = pSrc1[i] * rhs;
-                }
-                break;
+    namespace
+    {
+        /** Returns the number of components of the positions of a sampler opcode */
+        size_t Sampler_Dimensions(uint8_t opcode)
+        {
+            switch(opcode) {
+            case OP_SAMPLE1D_R:
+            case OP_SAMPLE1D_C:
+                return 1;
+            case OP_SAMPLE2D_R:
+            case OP_SAMPLE2D_C:
+                return 2;
+            default:
+                return 3;
             }
-        case OP_SCALAR_MUL_CR:      /** scalar constant/uniform - scalar register */
-            {
-                float * pDst            = &Retrive_Element(ins.Dst, batchOffset);
-                const float * pSrc2     = &Retrive_Element(ins.Src2, batchOffset);
-                float lhs               = (ins.Src1 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src1);
+        }
+    }
 
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    pDst[i] = lhs * pSrc2[i];
-                }
-                break;
-            }
-        case OP_SCALAR_MUL_CC:      /** scalar constant/uniform - scalar constant/uniform */
-            {
-                float * pDst            = &Retrive_Element(ins.Dst, batchOffset);
-                float lhs               = (ins.Src1 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src1);
-                float rhs               = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
-                float result            = lhs * rhs;
+    /**
+     * Inserts a prefetch step ahead of each sampler step that reads its positions from a register,
+     * right after the last step that writes the positions. The sampler is passed the positions
+     * while the steps in between are executed. A sampler whose positions are computed by the step
+     * in front of it gains nothing, and is left as it is. Must be done before Mark_Branches, which
+     * counts the steps of each alternative.
+     */
+    void VirtualMachine::Mark_Prefetches(ExecutionPlan & plan) const
+    {
+        for(size_t j = 0; j < plan.steps.size(); ++j) {
+            if ((plan.steps[j].family != Family_Sampler) || !plan.steps[j].src[0].isreg) {
+                continue;
+            }
+            uint8_t reg = plan.steps[j].src[0].reg;
+            size_t at = 0;
+            for(size_t k = j; k > 0; --k) {
+                if (Writes(plan.steps[k - 1], reg)) {
+                    at = k;
+                    break;
+                }
+            }
+            if (at == j) {
+                continue;
+            }
+            PlanStep prefetch   = plan.steps[j];
+            prefetch.type       = Step_Prefetch;
+            prefetch.family     = Family_Prefetch;
+            prefetch.dst        = reg;
+            prefetch.mask       = 0;
+            plan.steps.insert(plan.steps.begin() + at, prefetch);
+            ++j;
+        }
+    }
 
-                for(size_t i = 0; i < (batchSize * 4); i += 4) {
-                    pDst[i] = result;
-                }
-                break;
+    /**
+     * Prefetches the start of a batch ahead of the batch in front of it. The processor has to
+     * detect each stream again when a new batch starts, so the first bytes of each stream that
+     * the plan reads are prefetched. Sampler steps that reads their positions from a stream are
+     * passed the positions of those bytes, unless the positions are strided. Streams that are
+     * only written are left alone.
+     */
+    void VirtualMachine::Prefetch_Batch(const ExecutionPlan & plan, size_t batchSize, size_t batchOffset) const
+    {
+        if (!m_PrefetchBytes) {
+            return;
+        }
+        const size_t bytes = std::min(m_PrefetchBytes, batchSize * sizeof(Vector));
+        for(size_t i = 0, num = plan.registers.size(); i < num; ++i) {
+            uint8_t reg = plan.registers[i];
+            if (m_IoMap.Get(reg) && (std::find(plan.streams.begin(), plan.streams.end(), reg) == plan.streams.end())) {
+                size_t stride = m_Formats[reg].stride ? m_Formats[reg].stride : sizeof(Vector);
+                m_Kernels->Prefetch(static_cast<const uint8_t *>(m_Registers[reg]) + (batchOffset * stride),
+                    std::min(m_PrefetchBytes, batchSize * stride));
             }
-            /*****************************************************************/
-            /*                  Vector2 multiplied with a scalar             */
-            /*****************************************************************/
-        case OP_VECTOR2_SCALAR_MUL_RR:
+        }
+        for(size_t i = 0, num = plan.steps.size(); i < num; ++i) {
+            const PlanStep & step = plan.steps[i];
+            if ((step.family == Family_Sampler) && step.src[0].isreg && m_IoMap.Get(step.src[0].reg) &&
+                !m_Formats[step.src[0].reg].stride && m_Prefetchers[step.sampler])
             {
-                Vector * dst    = Retrive_Register(ins.Dst, batchOffset);
-                Vector * src1   = Retrive_Register(ins.Src1, batchOffset);
-                float * fValue  = &Retrive_Element(ins.Src2, batchOffset);
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    vf::Mul((dst++)->u.v2, (src1++)->u.v2, fValue[i]);
-                }
-                break;
+                const Vector * positions = static_cast<const Vector *>(m_Registers[step.src[0].reg]) + batchOffset;
+                m_Prefetchers[step.sampler]->prefetch(positions, bytes / sizeof(Vector), Sampler_Dimensions(step.opcode));
             }
-        case OP_VECTOR2_SCALAR_MUL_RC:
-            {
-                Vector * dst    = Retrive_Register(ins.Dst, batchOffset);
-                Vector * src1   = Retrive_Register(ins.Src1, batchOffset);
-                float rhs       = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
+        }
+    }
 
-                for(size_t i = 0; i < batchSize; i++) {
-                    vf::Mul((dst++)->u.v2, (src1++)->u.v2, rhs);
-                }
-                break;
-            }
-        case OP_VECTOR2_SCALAR_MUL_CR:
-            {
-                Vector * dst        = Retrive_Register(ins.Dst, batchOffset);
-                float * pRhs        = &Retrive_Element(ins.Src2, batchOffset);
-                const Vector2 & lhs = (ins.Src1 == 0xff) ? *is.Decode2() : Retrive_Uniform(ins.Src1)->u.v2;
+    /*************************************************************************/
+    /*                                  Execution                            */
+    /*************************************************************************/
 
-                for(size_t i = 0; i < (batchSize * 4); i += 4) {
-                    vf::Mul((dst++)->u.v2, lhs, pRhs[i]);
-                }
-                break;
-            }
-        case OP_VECTOR2_SCALAR_MUL_CC:
-            {
-                Vector * dst         = Retrive_Register(ins.Dst, batchOffset);
-                const Vector2 & lhs  = (ins.Src1 == 0xff) ? *is.Decode2() : Retrive_Uniform(ins.Src1)->u.v2;
-                float rhs            = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
-                Vector2 result       = lhs * rhs;
+/** Binds a register operand, only the base pointer of the batch has to be resolved. */
+#define VF_BIND_R(operand, src)     operand = (src).op; operand.ptr = m_Base[(src).reg]
+/** Binds a constant or uniform operand. */
+#define VF_BIND_C(operand, src)     Bind_Operand(operand, src)
+
+/** Each handler is both a case of the switch and a label that the threaded handlers jumps to. */
+#if defined(VF_THREADED_DISPATCH)
+#define VF_DISPATCH()       if (step == end) return Err_Success; goto *Handlers[step->type]
+#define VF_HANDLER(name)    case Step_##name: Handler_##name:
+#define VF_NEXT()           if (Threaded) { ++step; VF_DISPATCH(); } break
+#define VF_JUMP(target)     if (Threaded) { step = (target); VF_DISPATCH(); } step = (target) - 1; break
+#else
+#define VF_HANDLER(name)    case Step_##name:
+#define VF_NEXT()           break
+#define VF_JUMP(target)     step = (target) - 1; break
+#endif
+
+#define VF_BINARY_HANDLER(form, bindl, bindr)                                               \
+    VF_HANDLER(Binary_##form)                                                               \
+        bindl(lhs, step->src[0]);                                                           \
+        bindr(rhs, step->src[1]);                                                           \
+        step->kernel.binary(m_Base[step->dst], lhs, rhs, count, step->mask);                \
+        VF_NEXT();
+
+#define VF_COMPARE_HANDLER(form, bindl, bindr)                                              \
+    VF_HANDLER(Compare_##form)                                                              \
+        bindl(lhs, step->src[0]);                                                           \
+        bindr(rhs, step->src[1]);                                                           \
+        step->kernel.compare(m_Flags, lhs, rhs, batchSize);                                 \
+        VF_NEXT();
+
+#define VF_SELECT_HANDLER(form, bindl, bindr)                                               \
+    VF_HANDLER(Select_##form)                                                               \
+        bindl(lhs, step->src[0]);                                                           \
+        bindr(rhs, step->src[1]);                                                           \
+        step->kernel.select(m_Base[step->dst], m_Flags, lhs, rhs, count, step->mask);       \
+        VF_NEXT();
 
-                for(size_t i = 0; i < batchSize; i++) {
-                    dst->u.v2 = result;
-                }
-                break;
+    /**
+     * VirtualMachine::Execute
+     * Checks that the registers and samplers that a plan refers to are bound, and executes the
+     * plan on a batch.
+     */
+    Status_t VirtualMachine::Execute(const ExecutionPlan & plan, size_t batchSize, size_t batchOffset)
+    {
+        for(size_t i = 0, num = plan.registers.size(); i < num; ++i) {
+            if (!m_Registers[plan.registers[i]]) {
+                return Err_UnassignedRegisterPointer;
             }
-            /*****************************************************************/
-            /*                  Vector3 multiplied with a scalar             */
-            /*****************************************************************/
-        case OP_VECTOR3_SCALAR_MUL_RR:
-            {
-                Vector * dst    = Retrive_Register(ins.Dst, batchOffset);
-                Vector * src1   = Retrive_Register(ins.Src1, batchOffset);
-                float * fValue  = &Retrive_Element(ins.Src2, batchOffset);
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    vf::Mul((dst++)->u.v3, (src1++)->u.v3, fValue[i]);
-                }
-                break;
+        }
+        for(size_t i = 0, num = plan.steps.size(); i < num; ++i) {
+            if ((plan.steps[i].family == Family_Sampler) && !m_Samplers[plan.steps[i].sampler]) {
+                return Err_InvalidBytecode;
             }
-        case OP_VECTOR3_SCALAR_MUL_RC:
-            {
-                Vector * dst    = Retrive_Register(ins.Dst, batchOffset);
-                Vector * src1   = Retrive_Register(ins.Src1, batchOffset);
-                float rhs       = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
+        }
+        return Execute_Unchecked(plan, batchSize, batchOffset);
+    }
 
-                for(size_t i = 0; i < batchSize; i++) {
-                    vf::Mul((dst++)->u.v3, (src1++)->u.v3, rhs);
-                }
-                break;
+    /**
+     * Checks that the registers and samplers of a verified method are bound. Registers of the
+     * AoS layout are bound as a whole.
+     */
+    Status_t VirtualMachine::Check_Bindings(const MethodBindings & bindings) const
+    {
+        for(size_t i = 0, num = bindings.registers.size(); i < num; ++i) {
+            if (!m_Registers[bindings.registers[i]]) {
+                return Err_UnassignedRegisterPointer;
             }
-        case OP_VECTOR3_SCALAR_MUL_CR:
-            {
-                Vector * dst        = Retrive_Register(ins.Dst, batchOffset);
-                float * pRhs        = &Retrive_Element(ins.Src2, batchOffset);
-                const Vector3 & lhs = (ins.Src1 == 0xff) ? *is.Decode3() : Retrive_Uniform(ins.Src1)->u.v3;
-
-                for(size_t i = 0; i < (batchSize * 4); i += 4) {
-                    vf::Mul((dst++)->u.v3, lhs, pRhs[i]);
-                }
-                break;
+        }
+        for(size_t i = 0, num = bindings.samplers.size(); i < num; ++i) {
+            if (!m_Samplers[bindings.samplers[i]]) {
+                return Err_InvalidBytecode;
             }
-        case OP_VECTOR3_SCALAR_MUL_CC:
-            {
-                Vector * dst         = Retrive_Register(ins.Dst, batchOffset);
-                const Vector3 & lhs  = (ins.Src1 == 0xff) ? *is.Decode3() : Retrive_Uniform(ins.Src1)->u.v3;
-                float rhs            = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
-                Vector3 result       = lhs * rhs;
+        }
+        return Err_Success;
+    }
 
-                for(size_t i = 0; i < batchSize; i++) {
-                    dst->u.v3 = result;
-                }
-                break;
+    /**
+     * VirtualMachine::Execute_Unchecked
+     * Executes a execution plan on a batch, the registers and samplers of the plan must be bound.
+     * The register base pointers are resolved once per batch, strided streams are copied to
+     * packed elements first and back afterwards. Plans that have been compiled to native code
+     * are executed directly, otherwise the steps are interpreted.
+     */
+    Status_t VirtualMachine::Execute_Unchecked(const ExecutionPlan & plan, size_t batchSize, size_t batchOffset)
+    {
+        for(size_t i = 0, num = plan.registers.size(); i < num; ++i) {
+            uint8_t reg = plan.registers[i];
+            m_Base[reg] = &(((Vector *)m_Registers[reg]) + (m_IoMap.Get(reg) ? batchOffset : 0))->operator[](0);
+        }
+        Status_t err = Load_Strided(plan, batchSize, batchOffset);
+        if (err != Err_Success) {
+            return err;
+        }
+        if (plan.kernel) {
+            plan.kernel(&m_Base[0], m_Uniforms.empty() ? nullptr : &m_Uniforms[0][0], batchSize);
+        } else if (plan.native) {
+            plan.native->Run(&m_Base[0], m_Uniforms.empty() ? nullptr : &m_Uniforms[0], batchSize, Streaming(plan));
+        } else {
+            const PlanStep * step = plan.steps.empty() ? nullptr : &plan.steps[0];
+            if (m_Dispatch == Dispatch_Threaded) {
+                err = Execute_Steps<true>(step, step + plan.steps.size(), batchSize);
+            } else {
+                err = Execute_Steps<false>(step, step + plan.steps.size(), batchSize);
             }
-            /*****************************************************************/
-            /*                  Vector4 multiplied with a scalar             */
-            /*****************************************************************/
-        case OP_VECTOR4_SCALAR_MUL_RR:
-            {
-                Vector * dst    = Retrive_Register(ins.Dst, batchOffset);
-                Vector * src1   = Retrive_Register(ins.Src1, batchOffset);
-                float * fValue  = &Retrive_Element(ins.Src2, batchOffset);
+        }
 
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    vf::Mul((dst++)->u.v4, (src1++)->u.v4, fValue[i]);
-                }
-                break;
-            }
-        case OP_VECTOR4_SCALAR_MUL_RC:
-            {
-                Vector * dst    = Retrive_Register(ins.Dst, batchOffset);
-                Vector * src1   = Retrive_Register(ins.Src1, batchOffset);
-                float rhs       = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
+        Store_Strided(plan, batchSize, batchOffset);
+        return err;
+    }
 
-                for(size_t i = 0; i < batchSize; i++) {
-                    vf::Mul((dst++)->u.v4, (src1++)->u.v4, rhs);
+    /**
+     * VirtualMachine::Execute_Steps
+     * Interprets a range of steps, each step is dispatched to the handler of its kind. Compilers
+     * that supports computed goto thread the handlers together when Threaded is set, which gives
+     * each handler its own indirect branch. Otherwise the handlers are cases of a switch. A branch
+     * step whose first alternative is selected by every element executes that alternative as a
+     * range of its own, and then continues after the second.
+     */
+    template<bool Threaded>
+    Status_t VirtualMachine::Execute_Steps(const PlanStep * step, const PlanStep * end, size_t batchSize)
+    {
+        const size_t count = batchSize * 4;
+        KernelOperand lhs, rhs, third;
+
+#if defined(VF_THREADED_DISPATCH)
+        static void * const Handlers[Step_Max] = {
+#define VF_PLAN_STEP_LABEL(name) &&Handler_##name,
+            VF_PLAN_STEPS(VF_PLAN_STEP_LABEL)
+#undef VF_PLAN_STEP_LABEL
+        };
+        if (Threaded) {
+            VF_DISPATCH();
+        }
+#endif
+        for(; step != end; ++step) {
+            switch(step->type) {
+            VF_BINARY_HANDLER(RR, VF_BIND_R, VF_BIND_R)
+            VF_BINARY_HANDLER(RC, VF_BIND_R, VF_BIND_C)
+            VF_BINARY_HANDLER(CR, VF_BIND_C, VF_BIND_R)
+            VF_BINARY_HANDLER(CC, VF_BIND_C, VF_BIND_C)
+
+            VF_HANDLER(Unary_R)
+                VF_BIND_R(lhs, step->src[0]);
+                step->kernel.unary(m_Base[step->dst], lhs, count, step->mask);
+                VF_NEXT();
+            VF_HANDLER(Unary_C)
+                VF_BIND_C(lhs, step->src[0]);
+                step->kernel.unary(m_Base[step->dst], lhs, count, step->mask);
+                VF_NEXT();
+
+            VF_COMPARE_HANDLER(RR, VF_BIND_R, VF_BIND_R)
+            VF_COMPARE_HANDLER(RC, VF_BIND_R, VF_BIND_C)
+            VF_COMPARE_HANDLER(CR, VF_BIND_C, VF_BIND_R)
+            VF_COMPARE_HANDLER(CC, VF_BIND_C, VF_BIND_C)
+
+            VF_SELECT_HANDLER(RR, VF_BIND_R, VF_BIND_R)
+            VF_SELECT_HANDLER(RC, VF_BIND_R, VF_BIND_C)
+            VF_SELECT_HANDLER(CR, VF_BIND_C, VF_BIND_R)
+            VF_SELECT_HANDLER(CC, VF_BIND_C, VF_BIND_C)
+
+            VF_HANDLER(Ternary)
+                VF_BIND_C(lhs, step->src[0]);
+                VF_BIND_C(rhs, step->src[1]);
+                VF_BIND_C(third, step->src[2]);
+                step->kernel.ternary(m_Base[step->dst], lhs, rhs, third, count, step->mask);
+                VF_NEXT();
+            VF_HANDLER(CompareSelect)
+                Execute_CompareSelect(*step, batchSize);
+                VF_NEXT();
+            VF_HANDLER(Accumulate)
+                Execute_Accumulate(*step, batchSize);
+                VF_NEXT();
+            VF_HANDLER(Stream)
+                Execute_Stream(*step, batchSize);
+                VF_NEXT();
+            VF_HANDLER(Prefetch)
+                Execute_Prefetch(*step, batchSize);
+                VF_NEXT();
+            VF_HANDLER(Branch)
+                VF_BIND_C(lhs, step->src[0]);
+                VF_BIND_C(rhs, step->src[1]);
+                step->kernel.compare(m_Flags, lhs, rhs, batchSize);
+                {
+                    int state = Predicate_State(m_Flags, batchSize);
+                    const PlanStep * second = step + 1 + step->branch[0];
+                    if (state == PREDICATE_ALL) {
+                        Status_t err = Execute_Steps<Threaded>(step + 1, second, batchSize);
+                        if (err != Err_Success) {
+                            return err;
+                        }
+                        VF_JUMP(second + step->branch[1]);
+                    } else if (state == PREDICATE_NONE) {
+                        VF_JUMP(second);
+                    }
                 }
-                break;
-            }
-        case OP_VECTOR4_SCALAR_MUL_CR:
-            {
-                Vector * dst        = Retrive_Register(ins.Dst, batchOffset);
-                float * pRhs        = &Retrive_Element(ins.Src2, batchOffset);
-                const Vector4 & lhs = (ins.Src1 == 0xff) ? *is.Decode4() : Retrive_Uniform(ins.Src1)->u.v4;
+                VF_NEXT();
 
-                for(size_t i = 0; i < (batchSize * 4); i += 4) {
-                    vf::Mul((dst++)->u.v4, lhs, pRhs[i]);
+            VF_HANDLER(Sampler)
+                {
+                    Status_t err = Execute_Sampler(*step, batchSize);
+                    if (err != Err_Success) {
+                        return err;
+                    }
                 }
-                break;
+                VF_NEXT();
+            default:
+                return Err_InvalidBytecode;
             }
-        case OP_VECTOR4_SCALAR_MUL_CC:
-            {
-                Vector * dst         = Retrive_Register(ins.Dst, batchOffset);
-                const Vector4 & lhs  = (ins.Src1 == 0xff) ? *is.Decode4() : Retrive_Uniform(ins.Src1)->u.v4;
-                float rhs            = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
-                Vector4 result       = lhs * rhs;
+        }
+        return Err_Success;
+    }
 
-                for(size_t i = 0; i < batchSize; i++) {
-                    dst->u.v4 = result;
-                }
-                break;
-            }
+#undef VF_BINARY_HANDLER
+#undef VF_COMPARE_HANDLER
+#undef VF_SELECT_HANDLER
+#undef VF_HANDLER
+#undef VF_NEXT
+#undef VF_JUMP
+#undef VF_DISPATCH
+#undef VF_BIND_R
+#undef VF_BIND_C
+
+    /**
+     * Executes a sample1D(), sample2D() or a sample3D() step.
+     */
+    Status_t VirtualMachine::Execute_Sampler(const PlanStep & step, size_t batchSize)
+    {
+        const vf::ISampler * sampler = m_Samplers[step.sampler];
+        KernelOperand pos;
+        Bind_Operand(pos, step.src[0]);
+        Vector * pDst = reinterpret_cast<Vector *>(m_Base[step.dst]);
+        Vector * pExp = const_cast<Vector *>(reinterpret_cast<const Vector *>(pos.ptr));
+        bool result;
+        switch(step.opcode) {
+        case OP_SAMPLE1D_R: result = sampler->sample1D(pExp, pDst, batchSize); break;
+        case OP_SAMPLE1D_C: result = sampler->sample1D(pos.value[0], pDst, batchSize); break;
+        case OP_SAMPLE2D_R: result = sampler->sample2D(pExp, pDst, batchSize); break;
+        case OP_SAMPLE2D_C: result = sampler->sample2D(*reinterpret_cast<const Vector2 *>(pos.value), pDst, batchSize); break;
+        case OP_SAMPLE3D_R: result = sampler->sample3D(pExp, pDst, batchSize); break;
+        case OP_SAMPLE3D_C: result = sampler->sample3D(*reinterpret_cast<const Vector3 *>(pos.value), pDst, batchSize); break;
         default:
             return Err_InvalidBytecode;
         }
-        return Err_Success;
+        return result ? Err_Success : Err_SamplingFailed;
     }
 
     /**
-    * Execute_Div
-    * Executes a division bytecode instruction.
-    */
-    Status_t VirtualMachine::Execute_Div(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
+     * Executes a fused comparison and conditional assignment. The batch is processed in blocks,
+     * the predicate of a block is still in the first level cache when it is selected on.
+     */
+    void VirtualMachine::Execute_CompareSelect(const PlanStep & step, size_t batchSize)
     {
-        switch(ins.Opcode)
-        {
-            /*****************************************************************/
-            /*                              Scalar                           */
-            /*****************************************************************/
-        case OP_SCALAR_DIV_RR:
-            {
-                float * pDst        = &Retrive_Element(ins.Dst, batchOffset);
-                const float * pSrc1 = &Retrive_Element(ins.Src1, batchOffset);
-                const float * pSrc2 = &Retrive_Element(ins.Src2, batchOffset);
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    pDst[i] = pSrc1[i] / pSrc2[i];
-                }
-                break;
-            }
-        case OP_SCALAR_DIV_RC:
-            {
-                float * pDst            = &Retrive_Element(ins.Dst, batchOffset);
-                const float * pSrc1     = &Retrive_Element(ins.Src1, batchOffset);
-                float rhs               = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    pDst[i] = pSrc1[i] / rhs;
+        KernelOperand ops[4];
+        for(size_t i = 0; i < 4; ++i) {
+            Bind_Operand(ops[i], step.src[i]);
+        }
+        for(size_t begin = 0; begin < batchSize; begin += FUSED_BLOCK_SIZE) {
+            size_t num = ((batchSize - begin) < FUSED_BLOCK_SIZE) ? (batchSize - begin) : FUSED_BLOCK_SIZE;
+            KernelOperand block[4];
+            for(size_t i = 0; i < 4; ++i) {
+                block[i] = ops[i];
+                if (block[i].ptr) {
+                    block[i].ptr += begin * 4;
                 }
-                break;
             }
-        case OP_SCALAR_DIV_CR:
-            {
-                float * pDst            = &Retrive_Element(ins.Dst, batchOffset);
-                const float * pSrc2     = &Retrive_Element(ins.Src2, batchOffset);
-                float lhs               = (ins.Src1 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src1);
+            step.inner.compare(m_Flags + (begin / 8), block[0], block[1], num);
+            step.kernel.select(m_Base[step.dst] + begin * 4, m_Flags + (begin / 8), block[2], block[3], num * 4, step.mask);
+        }
+    }
 
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    pDst[i] = lhs / pSrc2[i];
-                }
-                break;
+    /**
+     * Executes a accumulate step. The inner kernel writes the result of a block to the scratch
+     * memory, which is then added to the other operand, so the result never leaves the first
+     * level cache. Only the operands that the inner kernel reads are bound.
+     */
+    void VirtualMachine::Execute_Accumulate(const PlanStep & step, size_t batchSize)
+    {
+        KernelOperand ops[4];
+        for(size_t i = 0; i < 4; ++i) {
+            if ((i < 2) && (i >= step.innerOperands)) {
+                continue;
             }
-        case OP_SCALAR_DIV_CC:
-            {
-                float * pDst            = &Retrive_Element(ins.Dst, batchOffset);
-                float lhs               = (ins.Src1 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src1);
-                float rhs               = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
-                float result            = lhs / rhs;
-
-                for(size_t i = 0; i < (batchSize * 4); i += 4) {
-                    pDst[i] = result;
+            Bind_Operand(ops[i], step.src[i]);
+        }
+        for(size_t begin = 0; begin < batchSize; begin += FUSED_BLOCK_SIZE) {
+            size_t num = ((batchSize - begin) < FUSED_BLOCK_SIZE) ? (batchSize - begin) : FUSED_BLOCK_SIZE;
+            KernelOperand block[4];
+            for(size_t i = 0; i < 4; ++i) {
+                if ((i < 2) && (i >= step.innerOperands)) {
+                    continue;
                 }
-                break;
-            }
-            /*****************************************************************/
-            /*                  Vector2 divided with a scalar                */
-            /*****************************************************************/
-        case OP_VECTOR2_SCALAR_DIV_RR:
-            {
-                Vector * dst    = Retrive_Register(ins.Dst, batchOffset);
-                Vector * src1   = Retrive_Register(ins.Src1, batchOffset);
-                float * fValue  = &Retrive_Element(ins.Src2, batchOffset);
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    vf::Div((dst++)->u.v2, (src1++)->u.v2, fValue[i]);
+                block[i] = ops[i];
+                if (block[i].ptr) {
+                    block[i].ptr += begin * 4;
                 }
-                break;
             }
-        case OP_VECTOR2_SCALAR_DIV_RC:
-            {
-                Vector * dst    = Retrive_Register(ins.Dst, batchOffset);
-                Vector * src1   = Retrive_Register(ins.Src1, batchOffset);
-                float rhs       = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
-
-                for(size_t i = 0; i < batchSize; i++) {
-                    vf::Div((dst++)->u.v2, (src1++)->u.v2, rhs);
-                }
-                break;
+            block[step.innerOperand].ptr = m_Scratch.data();
+            if (step.innerOperands == 1) {
+                step.inner.unary(m_Scratch.data(), block[0], num * 4, step.innerMask);
+            } else {
+                step.inner.binary(m_Scratch.data(), block[0], block[1], num * 4, step.innerMask);
             }
-        case OP_VECTOR2_SCALAR_DIV_CR:
-            {
-                Vector * dst        = Retrive_Register(ins.Dst, batchOffset);
-                float * pRhs        = &Retrive_Element(ins.Src2, batchOffset);
-                const Vector2 & lhs = (ins.Src1 == 0xff) ? *is.Decode2() : Retrive_Uniform(ins.Src1)->u.v2;
+            step.kernel.binary(m_Base[step.dst] + begin * 4, block[2], block[3], num * 4, step.mask);
+        }
+    }
 
-                for(size_t i = 0; i < (batchSize * 4); i += 4) {
-                    vf::Div((dst++)->u.v2, lhs, pRhs[i]);
-                }
+    namespace
+    {
+        /** Evaluates the inner kernel of a stream step */
+        void Execute_Inner(const PlanStep & step, float * dst, const KernelOperand * ops, size_t count)
+        {
+            switch(step.innerOperands) {
+            case 1:
+                step.inner.unary(dst, ops[0], count, step.innerMask);
                 break;
-            }
-        case OP_VECTOR2_SCALAR_DIV_CC:
-            {
-                Vector * dst         = Retrive_Register(ins.Dst, batchOffset);
-                const Vector2 & lhs  = (ins.Src1 == 0xff) ? *is.Decode2() : Retrive_Uniform(ins.Src1)->u.v2;
-                float rhs            = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
-                Vector2 result       = lhs / rhs;
-
-                for(size_t i = 0; i < batchSize; i++) {
-                    dst->u.v2 = result;
-                }
+            case 2:
+                step.inner.binary(dst, ops[0], ops[1], count, step.innerMask);
                 break;
-            }
-            /*****************************************************************/
-            /*                  Vector3 divided with a scalar                */
-            /*****************************************************************/
-        case OP_VECTOR3_SCALAR_DIV_RR:
-            {
-                Vector * dst    = Retrive_Register(ins.Dst, batchOffset);
-                Vector * src1   = Retrive_Register(ins.Src1, batchOffset);
-                float * fValue  = &Retrive_Element(ins.Src2, batchOffset);
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    vf::Div((dst++)->u.v3, (src1++)->u.v3, fValue[i]);
-                }
+            default:
+                step.inner.ternary(dst, ops[0], ops[1], ops[2], count, step.innerMask);
                 break;
             }
-        case OP_VECTOR3_SCALAR_DIV_RC:
-            {
-                Vector * dst    = Retrive_Register(ins.Dst, batchOffset);
-                Vector * src1   = Retrive_Register(ins.Src1, batchOffset);
-                float rhs       = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
+        }
+    }
 
-                for(size_t i = 0; i < batchSize; i++) {
-                    vf::Div((dst++)->u.v3, (src1++)->u.v3, rhs);
+    /**
+     * Executes a stream step. The inner kernel writes the result of a block to the scratch memory,
+     * which is then copied to the stream with non-temporal stores. Streams that are kept cached
+     * are written by the inner kernel directly.
+     */
+    void VirtualMachine::Execute_Stream(const PlanStep & step, size_t batchSize)
+    {
+        KernelOperand ops[3];
+        for(size_t i = 0; i < step.innerOperands; ++i) {
+            Bind_Operand(ops[i], step.src[i]);
+        }
+        if (!NonTemporal(step.dst)) {
+            Execute_Inner(step, m_Base[step.dst], ops, batchSize * 4);
+            return;
+        }
+        for(size_t begin = 0; begin < batchSize; begin += FUSED_BLOCK_SIZE) {
+            size_t num = ((batchSize - begin) < FUSED_BLOCK_SIZE) ? (batchSize - begin) : FUSED_BLOCK_SIZE;
+            KernelOperand block[3];
+            for(size_t i = 0; i < step.innerOperands; ++i) {
+                block[i] = ops[i];
+                if (block[i].ptr) {
+                    block[i].ptr += begin * 4;
                 }
-                break;
             }
-        case OP_VECTOR3_SCALAR_DIV_CR:
-            {
-                Vector * dst        = Retrive_Register(ins.Dst, batchOffset);
-                float * pRhs        = &Retrive_Element(ins.Src2, batchOffset);
-                const Vector3 & lhs = (ins.Src1 == 0xff) ? *is.Decode3() : Retrive_Uniform(ins.Src1)->u.v3;
+            Execute_Inner(step, m_Scratch.data(), block, num * 4);
+            step.kernel.stream(m_Base[step.dst] + begin * 4, m_Scratch.data(), num * 4);
+        }
+    }
 
-                for(size_t i = 0; i < (batchSize * 4); i += 4) {
-                    vf::Div((dst++)->u.v3, lhs, pRhs[i]);
-                }
-                break;
-            }
-        case OP_VECTOR3_SCALAR_DIV_CC:
-            {
-                Vector * dst         = Retrive_Register(ins.Dst, batchOffset);
-                const Vector3 & lhs  = (ins.Src1 == 0xff) ? *is.Decode3() : Retrive_Uniform(ins.Src1)->u.v3;
-                float rhs            = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
-                Vector3 result       = lhs / rhs;
+    /**
+     * Passes the positions of a later sampler step to the sampler, if it implements the prefetch
+     * hook.
+     */
+    void VirtualMachine::Execute_Prefetch(const PlanStep & step, size_t batchSize) const
+    {
+        const vf::ISamplerPrefetch * prefetcher = m_Prefetchers[step.sampler];
+        if (prefetcher) {
+            prefetcher->prefetch(reinterpret_cast<const Vector *>(m_Base[step.dst]), batchSize, Sampler_Dimensions(step.opcode));
+        }
+    }
 
-                for(size_t i = 0; i < batchSize; i++) {
-                    dst->u.v3 = result;
-                }
-                break;
+    /**
+     * Returns true if the native code of a plan stores its streams with non-temporal stores. The
+     * native code streams all of them or none, and the stores requires aligned streams.
+     */
+    bool VirtualMachine::Streaming(const ExecutionPlan & plan) const
+    {
+        if (plan.streams.empty()) {
+            return false;
+        }
+        for(size_t i = 0, num = plan.streams.size(); i < num; ++i) {
+            uint8_t reg = plan.streams[i];
+            if (!NonTemporal(reg) || ((reinterpret_cast<uintptr_t>(m_Base[reg]) & 15) != 0)) {
+                return false;
             }
-            /*****************************************************************/
-            /*                  Vector4 divided with a scalar                */
-            /*****************************************************************/
-        case OP_VECTOR4_SCALAR_DIV_RR:
-            {
-                Vector * dst    = Retrive_Register(ins.Dst, batchOffset);
-                Vector * src1   = Retrive_Register(ins.Src1, batchOffset);
-                float * fValue  = &Retrive_Element(ins.Src2, batchOffset);
+        }
+        return true;
+    }
 
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    vf::Div((dst++)->u.v4, (src1++)->u.v4, fValue[i]);
-                }
-                break;
-            }
-        case OP_VECTOR4_SCALAR_DIV_RC:
-            {
-                Vector * dst    = Retrive_Register(ins.Dst, batchOffset);
-                Vector * src1   = Retrive_Register(ins.Src1, batchOffset);
-                float rhs       = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
+    /**
+     * Returns true if a stream is stored with non-temporal stores. The packed copy of a strided
+     * stream is read again right after the batch, and is always stored through the cache.
+     */
+    bool VirtualMachine::NonTemporal(uint8_t reg) const
+    {
+        return m_NonTemporal[reg] && !m_Formats[reg].stride;
+    }
 
-                for(size_t i = 0; i < batchSize; i++) {
-                    vf::Div((dst++)->u.v4, (src1++)->u.v4, rhs);
-                }
-                break;
-            }
-        case OP_VECTOR4_SCALAR_DIV_CR:
-            {
-                Vector * dst        = Retrive_Register(ins.Dst, batchOffset);
-                float * pRhs        = &Retrive_Element(ins.Src2, batchOffset);
-                const Vector4 & lhs = (ins.Src1 == 0xff) ? *is.Decode4() : Retrive_Uniform(ins.Src1)->u.v4;
+    /*************************************************************************/
+    /*                              Strided streams                          */
+    /*************************************************************************/
 
-                for(size_t i = 0; i < (batchSize * 4); i += 4) {
-                    vf::Div((dst++)->u.v4, lhs, pRhs[i]);
+    namespace
+    {
+        /**
+         * Copies count elements of N floats every stride bytes into packed elements, the
+         * components that the stream doesn't have are cleared.
+         */
+        template<size_t N>
+        void Load_Elements(Vector * dst, const uint8_t * src, size_t stride, size_t count)
+        {
+            for(size_t i = 0; i < count; ++i, src += stride) {
+                const float * element = reinterpret_cast<const float *>(src);
+                for(size_t c = 0; c < 4; ++c) {
+                    dst[i][c] = (c < N) ? element[c] : 0.0f;
                 }
-                break;
             }
-        case OP_VECTOR4_SCALAR_DIV_CC:
-            {
-                Vector * dst         = Retrive_Register(ins.Dst, batchOffset);
-                const Vector4 & lhs  = (ins.Src1 == 0xff) ? *is.Decode4() : Retrive_Uniform(ins.Src1)->u.v4;
-                float rhs            = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
-                Vector4 result       = lhs / rhs;
+        }
 
-                for(size_t i = 0; i < batchSize; i++) {
-                    dst->u.v4 = result;
+        /**
+         * Copies the first N components of count packed elements to elements every stride bytes,
+         * the rest of each element is left as it is.
+         */
+        template<size_t N>
+        void Store_Elements(uint8_t * dst, const Vector * src, size_t stride, size_t count)
+        {
+            for(size_t i = 0; i < count; ++i, dst += stride) {
+                float * element = reinterpret_cast<float *>(dst);
+                for(size_t c = 0; c < N; ++c) {
+                    element[c] = src[i][c];
                 }
-                break;
             }
-        default:
-            return Err_InvalidBytecode;
         }
-        return Err_Success;
     }
 
     /**
-    * Execute_Negate
-    * Executes a negation bytecode instruction.
-    */
-    Status_t VirtualMachine::Execute_Negate(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
+     * Points the strided streams of a plan to packed elements of their own, and copies the
+     * elements of the batch to them. Streams that the plan only writes aren't copied. The staging
+     * memory must hold the strided streams of the plan for the whole batch.
+     */
+    Status_t VirtualMachine::Load_Strided(const ExecutionPlan & plan, size_t batchSize, size_t batchOffset)
     {
-        switch(ins.Opcode) 
-        {
-        case OP_SCALAR_NEGATE_R:
-            {
-                float * pDst        = &Retrive_Element(ins.Dst, batchOffset);
-                const float * pSrc  = &Retrive_Element(ins.Src1, batchOffset);
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    pDst[i] = -pSrc[i];
-                }
-                break;
+        size_t numStrided = 0;
+        for(size_t i = 0, num = plan.registers.size(); i < num; ++i) {
+            uint8_t reg = plan.registers[i];
+            if (m_IoMap.Get(reg) && m_Formats[reg].stride) {
+                ++numStrided;
             }
-        case OP_SCALAR_NEGATE_C:
-            {
-                float * pDst = &Retrive_Element(ins.Dst, batchOffset);
-                float value  = (ins.Src1 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src1);
+        }
+        if (!numStrided) {
+            return Err_Success;
+        }
+        if ((numStrided * batchSize) > m_StagingSize) {
+            return Err_InvalidBatchSize;
+        }
 
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    pDst[i] = -value;
-                }
-                break;
+        Vector * staging = m_Staging;
+        for(size_t i = 0, num = plan.registers.size(); i < num; ++i) {
+            uint8_t reg = plan.registers[i];
+            const StreamFormat & format = m_Formats[reg];
+            if (!m_IoMap.Get(reg) || !format.stride) {
+                continue;
             }
-            /*****************************************************************/
-            /*                              Vector2                          */
-            /*****************************************************************/
-        case OP_VECTOR2_NEGATE_R:
-            {
-                Vector * pDst = Retrive_Register(ins.Dst, batchOffset);
-                Vector * pSrc = Retrive_Register(ins.Src1, batchOffset);
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Negate((pDst++)->u.v2, (pSrc++)->u.v2);
+            m_Base[reg] = &staging->operator[](0);
+            if (std::find(plan.streams.begin(), plan.streams.end(), reg) == plan.streams.end()) {
+                const uint8_t * src = static_cast<const uint8_t *>(m_Registers[reg]) + (batchOffset * format.stride);
+                switch(format.components) {
+                case 1: Load_Elements<1>(staging, src, format.stride, batchSize); break;
+                case 2: Load_Elements<2>(staging, src, format.stride, batchSize); break;
+                case 3: Load_Elements<3>(staging, src, format.stride, batchSize); break;
+                default: Load_Elements<4>(staging, src, format.stride, batchSize); break;
                 }
-                break;
             }
-        case OP_VECTOR2_NEGATE_C:
-            {
-                Vector * pDst       = Retrive_Register(ins.Dst, batchOffset);
-                const Vector2 & w   = Retrive_Uniform(ins.Src1)->u.v2;
+            staging += batchSize;
+        }
+        return Err_Success;
+    }
 
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Negate((pDst++)->u.v2, w);
-                }
-                break;
+    /**
+     * Copies the packed elements of the strided streams that a plan writes back to the streams.
+     */
+    void VirtualMachine::Store_Strided(const ExecutionPlan & plan, size_t batchSize, size_t batchOffset) const
+    {
+        for(size_t i = 0, num = plan.outputs.size(); i < num; ++i) {
+            uint8_t reg = plan.outputs[i];
+            const StreamFormat & format = m_Formats[reg];
+            if (!format.stride) {
+                continue;
+            }
+            const Vector * src = reinterpret_cast<const Vector *>(m_Base[reg]);
+            uint8_t * dst = static_cast<uint8_t *>(m_Registers[reg]) + (batchOffset * format.stride);
+            switch(format.components) {
+            case 1: Store_Elements<1>(dst, src, format.stride, batchSize); break;
+            case 2: Store_Elements<2>(dst, src, format.stride, batchSize); break;
+            case 3: Store_Elements<3>(dst, src, format.stride, batchSize); break;
+            default: Store_Elements<4>(dst, src, format.stride, batchSize); break;
             }
-            /*****************************************************************/
-            /*                              Vector3                          */
-            /*****************************************************************/
-        case OP_VECTOR3_NEGATE_R:
-            {
-                Vector * pDst = Retrive_Register(ins.Dst, batchOffset);
-                Vector * pSrc = Retrive_Register(ins.Src1, batchOffset);
+        }
+    }
 
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Negate((pDst++)->u.v3, (pSrc++)->u.v3);
-                }
-                break;
-            }
-        case OP_VECTOR3_NEGATE_C:
-            {
-                Vector * pDst       = Retrive_Register(ins.Dst, batchOffset);
-                const Vector3 & w   = Retrive_Uniform(ins.Src1)->u.v3;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Negate((pDst++)->u.v3, w);
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                              Vector4                          */
-            /*****************************************************************/
-        case OP_VECTOR4_NEGATE_R:
-            {
-                Vector * pDst = Retrive_Register(ins.Dst, batchOffset);
-                Vector * pSrc = Retrive_Register(ins.Src1, batchOffset);
+    /*************************************************************************/
+    /*                                  Instructions                         */
+    /*************************************************************************/
 
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Negate((pDst++)->u.v4, (pSrc++)->u.v4);
-                }
-                break;
-            }
-        case OP_VECTOR4_NEGATE_C:
-            {
-                Vector * pDst       = Retrive_Register(ins.Dst, batchOffset);
-                const Vector4 & w   = Retrive_Uniform(ins.Src1)->u.v4;
+    /**
+     * Compiles a component wise binary instruction. The rhs operand of Mul and Div is always a scalar.
+     */
+    Status_t VirtualMachine::Compile_Binary(size_t kernel, const Instruction_t & ins, InstructionStream & is, PlanStep & step,
+        size_t n, uint8_t form, size_t rhsComponents)
+    {
+        step.kernel.binary  = m_Kernels->Binary[kernel];
+        step.family         = Family_Binary;
+        step.kernelIndex    = static_cast<uint8_t>(kernel);
+        Retrive_Destination(step, ins.Dst, n);
+        Retrive_Operand(step.src[0], ins.Src1, (form == FORM_CR) || (form == FORM_CC), n, is);
+        Retrive_Operand(step.src[1], ins.Src2, (form == FORM_RC) || (form == FORM_CC), rhsComponents, is);
+        step.type           = Step_Type(Step_Binary_RR, 2, step);
+        return Err_Success;
+    }
 
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Negate((pDst++)->u.v4, w);
-                }
-                break;
-            }
-        default:
-            return Err_InvalidBytecode;
-        }
+    /**
+     * Compiles a component wise unary instruction.
+     */
+    Status_t VirtualMachine::Compile_Unary(size_t kernel, const Instruction_t & ins, InstructionStream & is, PlanStep & step,
+        size_t n, bool isconst)
+    {
+        step.kernel.unary   = m_Kernels->Unary[kernel];
+        step.family         = Family_Unary;
+        step.kernelIndex    = static_cast<uint8_t>(kernel);
+        Retrive_Destination(step, ins.Dst, n);
+        Retrive_Operand(step.src[0], ins.Src1, isconst, n, is);
+        step.type           = Step_Type(Step_Unary_R, 1, step);
         return Err_Success;
     }
 
     /**
-    * Execute_Negate
-    * Executes a negation bytecode instruction.
+    * Compile_Add
+    * Compiles a addition bytecode instruction.
     */
-    Status_t VirtualMachine::Execute_Trigonometric(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
+    Status_t VirtualMachine::Compile_Add(const Instruction_t & ins, InstructionStream & is, PlanStep & step)
     {
-        switch(ins.Opcode)
-        {
-            /*****************************************************************/
-            /*                              Sine                             */
-            /*****************************************************************/
-        case OP_SINE_R:
-            {
-                float * dst = &Retrive_Element(ins.Dst, batchOffset);
-                float * src = &Retrive_Element(ins.Src1, batchOffset);
-
-                for(size_t i = 0; i < (batchSize * 4); i+= 4) {
-                    dst[i] = sinf(src[i]);
-                }
-                break;
-            }
-        case OP_SINE_C:
-            {
-                float fValue    = (ins.Src1 == 0xff) ? sinf(is.DecodeScalar()) : sinf(Retrive_UniformElement(ins.Src1));
-                float * dst     = &Retrive_Element(ins.Dst, batchOffset);
-
-                for(size_t i = 0; i < (batchSize * 4); i += 4) {
-                    dst[i] = fValue;
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                              Cosine                           */
-            /*****************************************************************/
-        case OP_COSINE_R:
-            {
-                float * dst = &Retrive_Element(ins.Dst, batchOffset);
-                float * src = &Retrive_Element(ins.Src1, batchOffset);
-                
-                for(size_t i = 0; i < (batchSize * 4); i+= 4) {
-                    dst[i] = cosf(src[i]);
-                }
-                break;
-            }
-        case OP_COSINE_C:
-            {
-                float fValue    = (ins.Src1 == 0xff) ? cosf(is.DecodeScalar()) : cosf(Retrive_UniformElement(ins.Src1));
-                float * dst     = &Retrive_Element(ins.Dst, batchOffset);
-
-                for(size_t i = 0; i < (batchSize * 4); i += 4) {
-                    dst[i] = fValue;
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                              Tangent                          */
-            /*****************************************************************/
-        case OP_TANGENT_R:
-            {
-                float * dst = &Retrive_Element(ins.Dst, batchOffset);
-                float * src = &Retrive_Element(ins.Src1, batchOffset);
-
-                for(size_t i = 0; i < (batchSize * 4); i+= 4) {
-                    dst[i] = tanf(src[i]);
-                }
-                break;
-            }
-        case OP_TANGENT_C:
-            {
-                float fValue    = (ins.Src1 == 0xff) ? tanf(is.DecodeScalar()) : tanf(Retrive_UniformElement(ins.Src1));
-                float * dst     = &Retrive_Element(ins.Dst, batchOffset);
-
-                for(size_t i = 0; i < (batchSize * 4); i += 4) {
-                    dst[i] = fValue;
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                              ArcSine                          */
-            /*****************************************************************/
-        case OP_ARCSINE_R:
-            {
-                float * dst = &Retrive_Element(ins.Dst, batchOffset);
-                float * src = &Retrive_Element(ins.Src1, batchOffset);
+        uint8_t form;
+        size_t n = Decode_Type(ins.Opcode, OP_VECTOR2_ADD_RR, OP_VECTOR3_ADD_RR, OP_VECTOR4_ADD_RR, OP_SCALAR_ADD_RR, form);
+        return Compile_Binary(KERNEL_ADD, ins, is, step, n, form, n);
+    }
 
-                for(size_t i = 0; i < (batchSize * 4); i+= 4) {
-                    dst[i] = asinf(src[i]);
-                }
-                break;
-            }
-        case OP_ARCSINE_C:
-            {
-                float fValue    = (ins.Src1 == 0xff) ? asinf(is.DecodeScalar()) : asinf(Retrive_UniformElement(ins.Src1));
-                float * dst     = &Retrive_Element(ins.Dst, batchOffset);
+    /**
+    * Compile_Sub
+    * Compiles a subtraction bytecode instruction.
+    */
+    Status_t VirtualMachine::Compile_Sub(const Instruction_t & ins, InstructionStream & is, PlanStep & step)
+    {
+        uint8_t form;
+        size_t n = Decode_Type(ins.Opcode, OP_VECTOR2_SUB_RR, OP_VECTOR3_SUB_RR, OP_VECTOR4_SUB_RR, OP_SCALAR_SUB_RR, form);
+        return Compile_Binary(KERNEL_SUB, ins, is, step, n, form, n);
+    }
 
-                for(size_t i = 0; i < (batchSize * 4); i += 4) {
-                    dst[i] = fValue;
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                              ArcCosine                        */
-            /*****************************************************************/
-        case OP_ARCCOSINE_R:
-            {
-                float * dst = &Retrive_Element(ins.Dst, batchOffset);
-                float * src = &Retrive_Element(ins.Src1, batchOffset);
+    /**
+     * Compile_Mul
+     * Multiplies a scalar or a vector with a scalar.
+     */
+    Status_t VirtualMachine::Compile_Mul(const Instruction_t & ins, InstructionStream & is, PlanStep & step)
+    {
+        uint8_t form;
+        size_t n = Decode_Type(ins.Opcode, OP_VECTOR2_SCALAR_MUL_RR, OP_VECTOR3_SCALAR_MUL_RR, OP_VECTOR4_SCALAR_MUL_RR,
+            OP_SCALAR_MUL_RR, form);
+        return Compile_Binary(KERNEL_MUL, ins, is, step, n, form, 1);
+    }
 
-                for(size_t i = 0; i < (batchSize * 4); i+= 4) {
-                    dst[i] = acosf(src[i]);
-                }
-                break;
-            }
-        case OP_ARCCOSINE_C:
-            {
-                float fValue    = (ins.Src1 == 0xff) ? acosf(is.DecodeScalar()) : acosf(Retrive_UniformElement(ins.Src1));
-                float * dst     = &Retrive_Element(ins.Dst, batchOffset);
+    /**
+     * Compile_Div
+     * Divides a scalar or a vector with a scalar.
+     */
+    Status_t VirtualMachine::Compile_Div(const Instruction_t & ins, InstructionStream & is, PlanStep & step)
+    {
+        uint8_t form;
+        size_t n = Decode_Type(ins.Opcode, OP_VECTOR2_SCALAR_DIV_RR, OP_VECTOR3_SCALAR_DIV_RR, OP_VECTOR4_SCALAR_DIV_RR,
+            OP_SCALAR_DIV_RR, form);
+        return Compile_Binary(KERNEL_DIV, ins, is, step, n, form, 1);
+    }
 
-                for(size_t i = 0; i < (batchSize * 4); i += 4) {
-                    dst[i] = fValue;
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                              ArcTangent                       */
-            /*****************************************************************/
-        case OP_ARCTANGENT_R:
-            {
-                float * dst = &Retrive_Element(ins.Dst, batchOffset);
-                float * src = &Retrive_Element(ins.Src1, batchOffset);
+    /**
+     * Compile_Min
+     * Compiles a min() instruction.
+     */
+    Status_t VirtualMachine::Compile_Min(const Instruction_t & ins, InstructionStream & is, PlanStep & step)
+    {
+        uint8_t form;
+        size_t n = Decode_Type(ins.Opcode, OP_MIN_VECTOR2_RR, OP_MIN_VECTOR3_RR, OP_MIN_VECTOR4_RR, OP_MIN_SCALAR_RR, form);
+        return Compile_Binary(KERNEL_MIN, ins, is, step, n, form, n);
+    }
 
-                for(size_t i = 0; i < (batchSize * 4); i+= 4) {
-                    dst[i] = atanf(src[i]);
-                }
-                break;
-            }
-        case OP_ARCTANGENT_C:
-            {
-                float fValue    = (ins.Src1 == 0xff) ? atanf(is.DecodeScalar()) : atanf(Retrive_UniformElement(ins.Src1));
-                float * dst     = &Retrive_Element(ins.Dst, batchOffset);
+    /**
+     * Compile_Max
+     * Compiles a max() instruction.
+     */
+    Status_t VirtualMachine::Compile_Max(const Instruction_t & ins, InstructionStream & is, PlanStep & step)
+    {
+        uint8_t form;
+        size_t n = Decode_Type(ins.Opcode, OP_MAX_VECTOR2_RR, OP_MAX_VECTOR3_RR, OP_MAX_VECTOR4_RR, OP_MAX_SCALAR_RR, form);
+        return Compile_Binary(KERNEL_MAX, ins, is, step, n, form, n);
+    }
 
-                for(size_t i = 0; i < (batchSize * 4); i += 4) {
-                    dst[i] = fValue;
-                }
-                break;
-            }
+    /**
+     * Compile_Negate
+     * Compiles a negation bytecode instruction.
+     */
+    Status_t VirtualMachine::Compile_Negate(const Instruction_t & ins, InstructionStream & is, PlanStep & step)
+    {
+        size_t n;
+        bool isconst;
+        switch(ins.Opcode) {
+        case OP_SCALAR_NEGATE_R:    n = 1; isconst = false; break;
+        case OP_SCALAR_NEGATE_C:    n = 1; isconst = true; break;
+        case OP_VECTOR2_NEGATE_R:   n = 2; isconst = false; break;
+        case OP_VECTOR2_NEGATE_C:   n = 2; isconst = true; break;
+        case OP_VECTOR3_NEGATE_R:   n = 3; isconst = false; break;
+        case OP_VECTOR3_NEGATE_C:   n = 3; isconst = true; break;
+        case OP_VECTOR4_NEGATE_R:   n = 4; isconst = false; break;
+        case OP_VECTOR4_NEGATE_C:   n = 4; isconst = true; break;
         default:
             return Err_InvalidBytecode;
         }
-        return Err_Success;
+        return Compile_Unary(KERNEL_NEGATE, ins, is, step, n, isconst);
     }
 
     /**
-     * Execute_Length
-     * Executes a length bytecode instruction.
+     * Compile_Trigonometric
+     * Compiles a sin(), cos(), tan(), asin(), acos() or atan() instruction.
      */
-    Status_t VirtualMachine::Execute_Length(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
+    Status_t VirtualMachine::Compile_Trigonometric(const Instruction_t & ins, InstructionStream & is, PlanStep & step)
     {
         switch(ins.Opcode) {
-            /*****************************************************************/
-            /*                              Vector2                          */
-            /*****************************************************************/
-        case OP_LENGTH_VECTOR2_R:
-            {
-                float * pDst    = &Retrive_Element(ins.Dst, batchOffset);
-                Vector * src    = Retrive_Register(ins.Src1, batchOffset);
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    pDst[i] = (src++)->u.v2.length();
-                }
-                break;
-            }
-        case OP_LENGTH_VECTOR2_C:
-            {
-                float * pDst    = &Retrive_Element(ins.Dst, batchOffset);
-                float fLength   = (ins.Src1 == 0xff) ? is.Decode2()->length() : Retrive_Uniform(ins.Src1)->u.v2.length();
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    pDst[i] = fLength;
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                              Vector3                          */
-            /*****************************************************************/
-        case OP_LENGTH_VECTOR3_R:
-            {
-                float * pDst    = &Retrive_Element(ins.Dst, batchOffset);
-                Vector * src    = Retrive_Register(ins.Src1, batchOffset);
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    pDst[i] = (src++)->u.v3.length();
-                }
-                break;
-            }
-        case OP_LENGTH_VECTOR3_C:
-            {
-                float * pDst    = &Retrive_Element(ins.Dst, batchOffset);
-                float fLength   = (ins.Src1 == 0xff) ? is.Decode3()->length() : Retrive_Uniform(ins.Src1)->u.v3.length();
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    pDst[i] = fLength;
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                              Vector4                          */
-            /*****************************************************************/
-        case OP_LENGTH_VECTOR4_R:
-            {
-                float * pDst    = &Retrive_Element(ins.Dst, batchOffset);
-                Vector * src    = Retrive_Register(ins.Src1, batchOffset);
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    pDst[i] = (src++)->u.v3.length();
-                }
-                break;
-            }
-        case OP_LENGTH_VECTOR4_C:
-            {
-                float * pDst    = &Retrive_Element(ins.Dst, batchOffset);
-                float fLength   = (ins.Src1 == 0xff) ? is.Decode4()->length() : Retrive_Uniform(ins.Src1)->u.v4.length();
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    pDst[i] = fLength;
-                }
-                break;
-            }
-
+        case OP_SINE_R:         return Compile_Unary(KERNEL_SINE, ins, is, step, 1, false);
+        case OP_SINE_C:         return Compile_Unary(KERNEL_SINE, ins, is, step, 1, true);
+        case OP_COSINE_R:       return Compile_Unary(KERNEL_COSINE, ins, is, step, 1, false);
+        case OP_COSINE_C:       return Compile_Unary(KERNEL_COSINE, ins, is, step, 1, true);
+        case OP_TANGENT_R:      return Compile_Unary(KERNEL_TANGENT, ins, is, step, 1, false);
+        case OP_TANGENT_C:      return Compile_Unary(KERNEL_TANGENT, ins, is, step, 1, true);
+        case OP_ARCSINE_R:      return Compile_Unary(KERNEL_ARCSINE, ins, is, step, 1, false);
+        case OP_ARCSINE_C:      return Compile_Unary(KERNEL_ARCSINE, ins, is, step, 1, true);
+        case OP_ARCCOSINE_R:    return Compile_Unary(KERNEL_ARCCOSINE, ins, is, step, 1, false);
+        case OP_ARCCOSINE_C:    return Compile_Unary(KERNEL_ARCCOSINE, ins, is, step, 1, true);
+        case OP_ARCTANGENT_R:   return Compile_Unary(KERNEL_ARCTANGENT, ins, is, step, 1, false);
+        case OP_ARCTANGENT_C:   return Compile_Unary(KERNEL_ARCTANGENT, ins, is, step, 1, true);
         default:
             return Err_InvalidBytecode;
         }
-        return Err_Success;
     }
 
     /**
-     * Execute_Sqrt
-     * Executes a sqrt or invsqrt instruction.
+     * Compile_Sqrt
+     * Compiles a sqrt or invsqrt instruction.
      */
-    Status_t VirtualMachine::Execute_Sqrt(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
+    Status_t VirtualMachine::Compile_Sqrt(const Instruction_t & ins, InstructionStream & is, PlanStep & step)
     {
         switch(ins.Opcode) {
-            /*****************************************************************/
-            /*                              SQRT                             */
-            /*****************************************************************/
-        case OP_SQRT_R:
-            {
-                float * dst = &Retrive_Element(ins.Dst, batchOffset);
-                float * src = &Retrive_Element(ins.Src1, batchOffset);
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    dst[i] = sqrtf(src[i]);
-                }
-                break;
-            }
-        case OP_SQRT_C:
-            {
-                float fValue = (ins.Src1 == 0xff) ? sqrtf(is.DecodeScalar()) : sqrtf(Retrive_UniformElement(ins.Src1));
-                float * dst = &Retrive_Element(ins.Dst, batchOffset);
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    dst[i] = fValue;
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                              INVSQRT                          */
-            /*****************************************************************/
-        case OP_INVSQRT_R:
-            {
-                float * dst = &Retrive_Element(ins.Dst, batchOffset);
-                float * src = &Retrive_Element(ins.Src1, batchOffset);
+        case OP_SQRT_R:         return Compile_Unary(KERNEL_SQRT, ins, is, step, 1, false);
+        case OP_SQRT_C:         return Compile_Unary(KERNEL_SQRT, ins, is, step, 1, true);
+        case OP_INVSQRT_R:      return Compile_Unary(KERNEL_INVSQRT, ins, is, step, 1, false);
+        case OP_INVSQRT_C:      return Compile_Unary(KERNEL_INVSQRT, ins, is, step, 1, true);
+        default:
+            return Err_InvalidBytecode;
+        }
+    }
 
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    dst[i] = 1.0f / sqrtf(src[i]);
-                }
-                break;
-            }
-        case OP_INVSQRT_C:
-            {
-                float fValue = 1.0f / ((ins.Src1 == 0xff) ? sqrtf(is.DecodeScalar()) : sqrtf(Retrive_UniformElement(ins.Src1)));
-                float * dst = &Retrive_Element(ins.Dst, batchOffset);
+    /** 
+     * Compile_Floor, compiles a floor() instructiion.
+     */
+    Status_t VirtualMachine::Compile_Floor(const Instruction_t & ins, InstructionStream & is, PlanStep & step)
+    {
+        size_t n;
+        bool isconst;
+        switch(ins.Opcode) {
+        case OP_FLOOR_SCALAR_R:     n = 1; isconst = false; break;
+        case OP_FLOOR_SCALAR_C:     n = 1; isconst = true; break;
+        case OP_FLOOR_VECTOR2_R:    n = 2; isconst = false; break;
+        case OP_FLOOR_VECTOR2_C:    n = 2; isconst = true; break;
+        case OP_FLOOR_VECTOR3_R:    n = 3; isconst = false; break;
+        case OP_FLOOR_VECTOR3_C:    n = 3; isconst = true; break;
+        case OP_FLOOR_VECTOR4_R:    n = 4; isconst = false; break;
+        case OP_FLOOR_VECTOR4_C:    n = 4; isconst = true; break;
+        default:
+            return Err_InvalidBytecode;
+        }
+        return Compile_Unary(KERNEL_FLOOR, ins, is, step, n, isconst);
+    }
 
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    dst[i] = fValue;
-                }
-                break;
-            }
+    /** 
+     * Compile_Ceil, compiles a ceil() instructiion.
+     */
+    Status_t VirtualMachine::Compile_Ceil(const Instruction_t & ins, InstructionStream & is, PlanStep & step)
+    {
+        size_t n;
+        bool isconst;
+        switch(ins.Opcode) {
+        case OP_CEIL_SCALAR_R:      n = 1; isconst = false; break;
+        case OP_CEIL_SCALAR_C:      n = 1; isconst = true; break;
+        case OP_CEIL_VECTOR2_R:     n = 2; isconst = false; break;
+        case OP_CEIL_VECTOR2_C:     n = 2; isconst = true; break;
+        case OP_CEIL_VECTOR3_R:     n = 3; isconst = false; break;
+        case OP_CEIL_VECTOR3_C:     n = 3; isconst = true; break;
+        case OP_CEIL_VECTOR4_R:     n = 4; isconst = false; break;
+        case OP_CEIL_VECTOR4_C:     n = 4; isconst = true; break;
         default:
             return Err_InvalidBytecode;
         }
-        return Err_Success;
+        return Compile_Unary(KERNEL_CEIL, ins, is, step, n, isconst);
     }
 
     /**
-     * Execute_Normalize
-     * Executes a normalize instruction.
+     * Compile_Assignment. Compiles a assignment bytecode instruction.
      */
-    Status_t VirtualMachine::Execute_Normalize(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
+    Status_t VirtualMachine::Compile_Assignment(const Instruction_t & ins, InstructionStream & is, PlanStep & step)
     {
+        size_t n;
+        bool isconst;
         switch(ins.Opcode) {
-            /*****************************************************************/
-            /*                              Vector2                          */
-            /*****************************************************************/
-        case OP_VECTOR2_NORMALIZE_R:
-            {
-                Vector * dst        = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * src1 = Retrive_Register(ins.Src1, batchOffset);
-                
-                for(size_t i = 0; i < batchSize; i++) {
-                    (dst++)->u.v2 = (src1++)->u.v2.normalize();
-                }
-                break;
-            }
-        case OP_VECTOR2_NORMALIZE_C:
-            {
-                Vector * dst    = Retrive_Register(ins.Dst, batchOffset);
-                Vector2 value   = (ins.Src1 == 0xff) ? is.Decode2()->normalize() : Retrive_Uniform(ins.Src1)->u.v2.normalize();
+        case OP_ASSIGN_SCALAR_R:    n = 1; isconst = false; break;
+        case OP_ASSIGN_SCALAR_C:    n = 1; isconst = true; break;
+        case OP_ASSIGN_VECTOR2_R:   n = 2; isconst = false; break;
+        case OP_ASSIGN_VECTOR2_C:   n = 2; isconst = true; break;
+        case OP_ASSIGN_VECTOR3_R:   n = 3; isconst = false; break;
+        case OP_ASSIGN_VECTOR3_C:   n = 3; isconst = true; break;
+        case OP_ASSIGN_VECTOR4_R:   n = 4; isconst = false; break;
+        case OP_ASSIGN_VECTOR4_C:   n = 4; isconst = true; break;
+        default:
+            return Err_InvalidBytecode;
+        }
+        return Compile_Unary(KERNEL_COPY, ins, is, step, n, isconst);
+    }
 
-                for(size_t i = 0; i < batchSize; ++i) {
-                    (dst++)->u.v2 = value;
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                              Vector3                          */
-            /*****************************************************************/
-        case OP_VECTOR3_NORMALIZE_R:
-            {
-                Vector * dst        = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * src1 = Retrive_Register(ins.Src1, batchOffset);
-                
-                for(size_t i = 0; i < batchSize; i++) {
-                    (dst++)->u.v3 = (src1++)->u.v3.normalize();
-                }
-                break;
-            }
-        case OP_VECTOR3_NORMALIZE_C:
-            {
-                Vector * dst    = Retrive_Register(ins.Dst, batchOffset);
-                Vector3 value   = (ins.Src1 == 0xff) ? is.Decode3()->normalize() : Retrive_Uniform(ins.Src1)->u.v3.normalize();
+    /**
+     * Compile_Dot - Dot-product.
+     */
+    Status_t VirtualMachine::Compile_Dot(const Instruction_t & ins, InstructionStream & is, PlanStep & step)
+    {
+        uint8_t form;
+        size_t n = Decode_Type(ins.Opcode, OP_DOT_VECTOR2_RR, OP_DOT_VECTOR3_RR, OP_DOT_VECTOR4_RR, OP_DOT_VECTOR2_RR, form);
+
+        step.kernel.binary  = m_Kernels->Dot[n - 2];
+        step.family         = Family_Dot;
+        step.kernelIndex    = 0;
+        Retrive_Destination(step, ins.Dst, 1);
+        Retrive_Operand(step.src[0], ins.Src1, (form == FORM_CR) || (form == FORM_CC), n, is);
+        Retrive_Operand(step.src[1], ins.Src2, (form == FORM_RC) || (form == FORM_CC), n, is);
+        step.type           = Step_Type(Step_Binary_RR, 2, step);
+        return Err_Success;
+    }
 
-                for(size_t i = 0; i < batchSize; ++i) {
-                    (dst++)->u.v3 = value;
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                              Vector4                          */
-            /*****************************************************************/
-        case OP_VECTOR4_NORMALIZE_R:
-            {
-                Vector * dst        = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * src1 = Retrive_Register(ins.Src1, batchOffset);
-                
-                for(size_t i = 0; i < batchSize; i++) {
-                    (dst++)->u.v4 = (src1++)->u.v4.normalize();
-                }
-                break;
-            }
-        case OP_VECTOR4_NORMALIZE_C:
-            {
-                Vector * dst    = Retrive_Register(ins.Dst, batchOffset);
-                Vector4 value   = (ins.Src1 == 0xff) ? is.Decode4()->normalize() : Retrive_Uniform(ins.Src1)->u.v4.normalize();
+    /**
+     * Compile_Length
+     * Compiles a length bytecode instruction.
+     */
+    Status_t VirtualMachine::Compile_Length(const Instruction_t & ins, InstructionStream & is, PlanStep & step)
+    {
+        size_t n;
+        bool isconst;
+        switch(ins.Opcode) {
+        case OP_LENGTH_VECTOR2_R:   n = 2; isconst = false; break;
+        case OP_LENGTH_VECTOR2_C:   n = 2; isconst = true; break;
+        case OP_LENGTH_VECTOR3_R:   n = 3; isconst = false; break;
+        case OP_LENGTH_VECTOR3_C:   n = 3; isconst = true; break;
+        case OP_LENGTH_VECTOR4_R:   n = 4; isconst = false; break;
+        case OP_LENGTH_VECTOR4_C:   n = 4; isconst = true; break;
+        default:
+            return Err_InvalidBytecode;
+        }
 
-                for(size_t i = 0; i < batchSize; ++i) {
-                    (dst++)->u.v4 = value;
-                }
-                break;
-            }
+        step.kernel.unary   = m_Kernels->Length[n - 2];
+        step.family         = Family_Length;
+        step.kernelIndex    = 0;
+        Retrive_Destination(step, ins.Dst, 1);
+        Retrive_Operand(step.src[0], ins.Src1, isconst, n, is);
+        step.type           = Step_Type(Step_Unary_R, 1, step);
+        return Err_Success;
+    }
 
+    /**
+     * Compile_Normalize
+     * Compiles a normalize instruction.
+     */
+    Status_t VirtualMachine::Compile_Normalize(const Instruction_t & ins, InstructionStream & is, PlanStep & step)
+    {
+        size_t n;
+        bool isconst;
+        switch(ins.Opcode) {
+        case OP_VECTOR2_NORMALIZE_R:    n = 2; isconst = false; break;
+        case OP_VECTOR2_NORMALIZE_C:    n = 2; isconst = true; break;
+        case OP_VECTOR3_NORMALIZE_R:    n = 3; isconst = false; break;
+        case OP_VECTOR3_NORMALIZE_C:    n = 3; isconst = true; break;
+        case OP_VECTOR4_NORMALIZE_R:    n = 4; isconst = false; break;
+        case OP_VECTOR4_NORMALIZE_C:    n = 4; isconst = true; break;
         default:
             return Err_InvalidBytecode;
         }
+
+        step.kernel.unary   = m_Kernels->Normalize[n - 2];
+        step.family         = Family_Normalize;
+        step.kernelIndex    = 0;
+        Retrive_Destination(step, ins.Dst, n);
+        Retrive_Operand(step.src[0], ins.Src1, isconst, n, is);
+        step.type           = Step_Type(Step_Unary_R, 1, step);
+        return Err_Success;
+    }
+
+    /**
+     * Compile_Cross - Compiles a cross() virtual machine instruction.
+     */
+    Status_t VirtualMachine::Compile_Cross(const Instruction_t & ins, InstructionStream & is, PlanStep & step)
+    {
+        uint8_t form = static_cast<uint8_t>(ins.Opcode - OP_CROSS_RR);
+
+        step.kernel.binary  = m_Kernels->Cross;
+        step.family         = Family_Cross;
+        step.kernelIndex    = 0;
+        Retrive_Destination(step, ins.Dst, 3);
+        Retrive_Operand(step.src[0], ins.Src1, (form == FORM_CR) || (form == FORM_CC), 3, is);
+        Retrive_Operand(step.src[1], ins.Src2, (form == FORM_RC) || (form == FORM_CC), 3, is);
+        step.type           = Step_Type(Step_Binary_RR, 2, step);
         return Err_Success;
     }
 
     /**
-     * Executes a min() instruction.
+     * Compiles a sample1D(), sample2D() or a sample3D() bytecode instruction. The sampler itself
+     * is retrived when the plan is executed, since it may be assigned after the plan is built.
      */
-    Status_t VirtualMachine::Execute_Min(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
+    Status_t VirtualMachine::Compile_Sampler(const Instruction_t & ins, InstructionStream & is, PlanStep & step)
     {
+        size_t n;
+        bool isconst;
         switch(ins.Opcode) {
-            /*****************************************************************/
-            /*                              Scalar                           */
-            /*****************************************************************/
-        case OP_MIN_SCALAR_RR:
-            {
-                float * fDst            = &Retrive_Element(ins.Dst, batchOffset);
-                const float * fSrc1     = &Retrive_Element(ins.Src1, batchOffset);
-                const float * fSrc2     = &Retrive_Element(ins.Src2, batchOffset);
+        case OP_SAMPLE1D_R: n = 1; isconst = false; break;
+        case OP_SAMPLE1D_C: n = 1; isconst = true; break;
+        case OP_SAMPLE2D_R: n = 2; isconst = false; break;
+        case OP_SAMPLE2D_C: n = 2; isconst = true; break;
+        case OP_SAMPLE3D_R: n = 3; isconst = false; break;
+        case OP_SAMPLE3D_C: n = 3; isconst = true; break;
+        default:
+            return Err_InvalidBytecode;
+        }
 
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    fDst[i] = std::min(fSrc1[i], fSrc2[i]);
-                }
-                break;
-            }
-        case OP_MIN_SCALAR_RC:
-            {
-                float * fDst            = &Retrive_Element(ins.Dst, batchOffset);
-                const float * fSrc1     = &Retrive_Element(ins.Src1, batchOffset);
-                float rhs               = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
+        GetSampler(ins.Src1);
+        step.type           = Step_Sampler;
+        step.family         = Family_Sampler;
+        step.kernelIndex    = 0;
+        step.sampler        = ins.Src1;
+        Retrive_Destination(step, ins.Dst, 4);
+        Retrive_Operand(step.src[0], ins.Src2, isconst, isconst ? n : 4, is);
+        return Err_Success;
+    }
 
-                for(size_t i = 0; i < (batchSize * 4); i += 4) {
-                    fDst[i] = std::min(fSrc1[i], rhs);
-                }
-                break;
-            }
-        case OP_MIN_SCALAR_CR:
-            {
-                float * fDst            = &Retrive_Element(ins.Dst, batchOffset);
-                const float * fSrc2     = &Retrive_Element(ins.Src2, batchOffset);
-                float lhs               = (ins.Src1 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src1);
+    /**
+     * Compiles the bytecode instructions for comparing scalar values.
+     */
+    Status_t VirtualMachine::Compile_Comparison(const Instruction_t & ins, InstructionStream & is, PlanStep & step)
+    {
+        size_t kernel;
+        uint8_t form;
+        if (ins.Opcode >= OP_CMP_LEQ_RR) {
+            kernel = KERNEL_CMP_LEQ;
+            form = ins.Opcode - OP_CMP_LEQ_RR;
+        } else if (ins.Opcode >= OP_CMP_GEQ_RR) {
+            kernel = KERNEL_CMP_GEQ;
+            form = ins.Opcode - OP_CMP_GEQ_RR;
+        } else if (ins.Opcode >= OP_CMP_EQ_RR) {
+            kernel = KERNEL_CMP_EQ;
+            form = ins.Opcode - OP_CMP_EQ_RR;
+        } else if (ins.Opcode >= OP_CMP_LE_RR) {
+            kernel = KERNEL_CMP_LE;
+            form = ins.Opcode - OP_CMP_LE_RR;
+        } else {
+            kernel = KERNEL_CMP_GRT;
+            form = ins.Opcode - OP_CMP_GRT_RR;
+        }
 
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    fDst[i] = std::min(lhs, fSrc2[i]);
-                }
-                break;
-            }
-        case OP_MIN_SCALAR_CC:
-            {
-                float * fDst            = &Retrive_Element(ins.Dst, batchOffset);
-                float lhs               = (ins.Src1 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src1);
-                float rhs               = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    fDst[i] = std::min(lhs, rhs);
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                              Vector2                          */
-            /*****************************************************************/
-        case OP_MIN_VECTOR2_RR:
-            {
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * pSrc1    = Retrive_Register(ins.Src1, batchOffset);
-                const Vector * pSrc2    = Retrive_Register(ins.Src2, batchOffset);
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Min(pDst[i].u.v2, pSrc1[i].u.v2, pSrc2[i].u.v2);
-                }
-                break;
-            }
-        case OP_MIN_VECTOR2_RC:
-            {
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * pSrc1    = Retrive_Register(ins.Src1, batchOffset);
-                const Vector2 & rhs     = (ins.Src2 == 0xff) ? *is.Decode2() : Retrive_Uniform(ins.Src2)->u.v2;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Min(pDst[i].u.v2, pSrc1[i].u.v2, rhs);
-                }
-                break;
-            }
-        case OP_MIN_VECTOR2_CR:
-            {
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * pSrc2    = Retrive_Register(ins.Src2, batchOffset);
-                const Vector2 & lhs     = (ins.Src1 == 0xff) ? *is.Decode2() : Retrive_Uniform(ins.Src1)->u.v2;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Min(pDst[i].u.v2, lhs, pSrc2[i].u.v2);
-                }
-                break;
-            }
-        case OP_MIN_VECTOR2_CC:
-            {
-                Vector2 result;
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector2 & lhs     = (ins.Src1 == 0xff) ? *is.Decode2() : Retrive_Uniform(ins.Src1)->u.v2;
-                const Vector2 & rhs     = (ins.Src2 == 0xff) ? *is.Decode2() : Retrive_Uniform(ins.Src2)->u.v2;
-                vf::Min(result, lhs, rhs);
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    pDst[i].u.v2 = result;
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                              Vector3                          */
-            /*****************************************************************/
-        case OP_MIN_VECTOR3_RR:
-            {
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * pSrc1    = Retrive_Register(ins.Src1, batchOffset);
-                const Vector * pSrc2    = Retrive_Register(ins.Src2, batchOffset);
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Min(pDst[i].u.v3, pSrc1[i].u.v3, pSrc2[i].u.v3);
-                }
-                break;
-            }
-        case OP_MIN_VECTOR3_RC:
-            {
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * pSrc1    = Retrive_Register(ins.Src1, batchOffset);
-                const Vector3 & rhs     = (ins.Src2 == 0xff) ? *is.Decode3() : Retrive_Uniform(ins.Src2)->u.v3;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Min(pDst[i].u.v3, pSrc1[i].u.v3, rhs);
-                }
-                break;
-            }
-        case OP_MIN_VECTOR3_CR:
-            {
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * pSrc2    = Retrive_Register(ins.Src2, batchOffset);
-                const Vector3 & lhs     = (ins.Src1 == 0xff) ? *is.Decode3() : Retrive_Uniform(ins.Src1)->u.v3;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Min(pDst[i].u.v3, lhs, pSrc2[i].u.v3);
-                }
-                break;
-            }
-        case OP_MIN_VECTOR3_CC:
-            {
-                Vector3 result;
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector3 & lhs     = (ins.Src1 == 0xff) ? *is.Decode3() : Retrive_Uniform(ins.Src1)->u.v3;
-                const Vector3 & rhs     = (ins.Src2 == 0xff) ? *is.Decode3() : Retrive_Uniform(ins.Src2)->u.v3;
-                vf::Min(result, lhs, rhs);
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    pDst[i].u.v3 = result;
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                              Vector4                          */
-            /*****************************************************************/
-        case OP_MIN_VECTOR4_RR:
-            {
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * pSrc1    = Retrive_Register(ins.Src1, batchOffset);
-                const Vector * pSrc2    = Retrive_Register(ins.Src2, batchOffset);
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Min(pDst[i].u.v4, pSrc1[i].u.v4, pSrc2[i].u.v4);
-                }
-                break;
-            }
-        case OP_MIN_VECTOR4_RC:
-            {
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * pSrc1    = Retrive_Register(ins.Src1, batchOffset);
-                const Vector4 & rhs     = (ins.Src2 == 0xff) ? *is.Decode4() : Retrive_Uniform(ins.Src2)->u.v4;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Min(pDst[i].u.v4, pSrc1[i].u.v4, rhs);
-                }
-                break;
-            }
-        case OP_MIN_VECTOR4_CR:
-            {
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * pSrc2    = Retrive_Register(ins.Src2, batchOffset);
-                const Vector4 & lhs     = (ins.Src1 == 0xff) ? *is.Decode4() : Retrive_Uniform(ins.Src1)->u.v4;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Min(pDst[i].u.v4, lhs, pSrc2[i].u.v4);
-                }
-                break;
-            }
-        case OP_MIN_VECTOR4_CC:
-            {
-                Vector4 result;
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector4 & lhs     = (ins.Src1 == 0xff) ? *is.Decode4() : Retrive_Uniform(ins.Src1)->u.v4;
-                const Vector4 & rhs     = (ins.Src2 == 0xff) ? *is.Decode4() : Retrive_Uniform(ins.Src2)->u.v4;
-                vf::Min(result, lhs, rhs);
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    pDst[i].u.v4 = result;
-                }
-                break;
-            }
-        default:
-            return Err_InvalidBytecode;
-        }
-        return Err_Success;
-    }
-
-    /**
-     * Executes a max() instruction.
-     */
-    Status_t VirtualMachine::Execute_Max(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
-    {
-        switch(ins.Opcode) {
-            /*****************************************************************/
-            /*                              Scalar                           */
-            /*****************************************************************/
-        case OP_MAX_SCALAR_RR:
-            {
-                float * fDst            = &Retrive_Element(ins.Dst, batchOffset);
-                const float * fSrc1     = &Retrive_Element(ins.Src1, batchOffset);
-                const float * fSrc2     = &Retrive_Element(ins.Src2, batchOffset);
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    fDst[i] = std::max(fSrc1[i], fSrc2[i]);
-                }
-                break;
-            }
-        case OP_MAX_SCALAR_RC:
-            {
-                float * fDst            = &Retrive_Element(ins.Dst, batchOffset);
-                const float * fSrc1     = &Retrive_Element(ins.Src1, batchOffset);
-                float rhs               = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
-
-                for(size_t i = 0; i < (batchSize * 4); i += 4) {
-                    fDst[i] = std::max(fSrc1[i], rhs);
-                }
-                break;
-            }
-        case OP_MAX_SCALAR_CR:
-            {
-                float * fDst            = &Retrive_Element(ins.Dst, batchOffset);
-                const float * fSrc2     = &Retrive_Element(ins.Src2, batchOffset);
-                float lhs               = (ins.Src1 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src1);
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    fDst[i] = std::max(lhs, fSrc2[i]);
-                }
-                break;
-            }
-        case OP_MAX_SCALAR_CC:
-            {
-                float * fDst            = &Retrive_Element(ins.Dst, batchOffset);
-                float lhs               = (ins.Src1 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src1);
-                float rhs               = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
-                float result            = std::max(lhs, rhs);
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    fDst[i] = result;
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                              Vector2                          */
-            /*****************************************************************/
-        case OP_MAX_VECTOR2_RR:
-            {
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * pSrc1    = Retrive_Register(ins.Src1, batchOffset);
-                const Vector * pSrc2    = Retrive_Register(ins.Src2, batchOffset);
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Max(pDst[i].u.v2, pSrc1[i].u.v2, pSrc2[i].u.v2);
-                }
-                break;
-            }
-        case OP_MAX_VECTOR2_RC:
-            {
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * pSrc1    = Retrive_Register(ins.Src1, batchOffset);
-                const Vector2 & rhs     = (ins.Src2 == 0xff) ? *is.Decode2() : Retrive_Uniform(ins.Src2)->u.v2;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Max(pDst[i].u.v2, pSrc1[i].u.v2, rhs);
-                }
-                break;
-            }
-        case OP_MAX_VECTOR2_CR:
-            {
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * pSrc2    = Retrive_Register(ins.Src2, batchOffset);
-                const Vector2 & lhs     = (ins.Src1 == 0xff) ? *is.Decode2() : Retrive_Uniform(ins.Src1)->u.v2;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Max(pDst[i].u.v2, lhs, pSrc2[i].u.v2);
-                }
-                break;
-            }
-        case OP_MAX_VECTOR2_CC:
-            {
-                Vector2 result;
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector2 & lhs     = (ins.Src1 == 0xff) ? *is.Decode2() : Retrive_Uniform(ins.Src1)->u.v2;
-                const Vector2 & rhs     = (ins.Src2 == 0xff) ? *is.Decode2() : Retrive_Uniform(ins.Src2)->u.v2;
-                vf::Max(result, lhs, rhs);
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    pDst[i].u.v2 = result;
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                              Vector3                          */
-            /*****************************************************************/
-        case OP_MAX_VECTOR3_RR:
-            {
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * pSrc1    = Retrive_Register(ins.Src1, batchOffset);
-                const Vector * pSrc2    = Retrive_Register(ins.Src2, batchOffset);
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Max(pDst[i].u.v3, pSrc1[i].u.v3, pSrc2[i].u.v3);
-                }
-                break;
-            }
-        case OP_MAX_VECTOR3_RC:
-            {
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * pSrc1    = Retrive_Register(ins.Src1, batchOffset);
-                const Vector3 & rhs     = (ins.Src2 == 0xff) ? *is.Decode3() : Retrive_Uniform(ins.Src2)->u.v3;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Max(pDst[i].u.v3, pSrc1[i].u.v3, rhs);
-                }
-                break;
-            }
-        case OP_MAX_VECTOR3_CR:
-            {
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * pSrc2    = Retrive_Register(ins.Src2, batchOffset);
-                const Vector3 & lhs     = (ins.Src1 == 0xff) ? *is.Decode3() : Retrive_Uniform(ins.Src1)->u.v3;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Max(pDst[i].u.v3, lhs, pSrc2[i].u.v3);
-                }
-                break;
-            }
-        case OP_MAX_VECTOR3_CC:
-            {
-                Vector3 result;
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector3 & lhs     = (ins.Src1 == 0xff) ? *is.Decode3() : Retrive_Uniform(ins.Src1)->u.v3;
-                const Vector3 & rhs     = (ins.Src2 == 0xff) ? *is.Decode3() : Retrive_Uniform(ins.Src2)->u.v3;
-                vf::Max(result, lhs, rhs);
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    pDst[i].u.v3 = result;
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                              Vector4                          */
-            /*****************************************************************/
-        case OP_MAX_VECTOR4_RR:
-            {
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * pSrc1    = Retrive_Register(ins.Src1, batchOffset);
-                const Vector * pSrc2    = Retrive_Register(ins.Src2, batchOffset);
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Max(pDst[i].u.v4, pSrc1[i].u.v4, pSrc2[i].u.v4);
-                }
-                break;
-            }
-        case OP_MAX_VECTOR4_RC:
-            {
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * pSrc1    = Retrive_Register(ins.Src1, batchOffset);
-                const Vector4 & rhs     = (ins.Src2 == 0xff) ? *is.Decode4() : Retrive_Uniform(ins.Src2)->u.v4;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Max(pDst[i].u.v4, pSrc1[i].u.v4, rhs);
-                }
-                break;
-            }
-        case OP_MAX_VECTOR4_CR:
-            {
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * pSrc2    = Retrive_Register(ins.Src2, batchOffset);
-                const Vector4 & lhs     = (ins.Src1 == 0xff) ? *is.Decode4() : Retrive_Uniform(ins.Src1)->u.v4;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Max(pDst[i].u.v4, lhs, pSrc2[i].u.v4);
-                }
-                break;
-            }
-        case OP_MAX_VECTOR4_CC:
-            {
-                Vector4 result;
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector4 & lhs     = (ins.Src1 == 0xff) ? *is.Decode4() : Retrive_Uniform(ins.Src1)->u.v4;
-                const Vector4 & rhs     = (ins.Src2 == 0xff) ? *is.Decode4() : Retrive_Uniform(ins.Src2)->u.v4;
-                vf::Max(result, lhs, rhs);
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    pDst[i].u.v4 = result;
-                }
-                break;
-            }
-        default:
-            return Err_InvalidBytecode;
-        }
-        return Err_Success;
-    }
-
-    /**
-     * Execute_Dot - Dot-product.
-     */
-    Status_t VirtualMachine::Execute_Dot(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
-    {
-        switch(ins.Opcode) {
-            /*****************************************************************/
-            /*                              Vector2                          */
-            /*****************************************************************/
-        case OP_DOT_VECTOR2_RR:
-            {
-                float * pDst            = &Retrive_Element(ins.Dst, batchOffset);
-                const Vector * pSrc1    = Retrive_Register(ins.Src1, batchOffset);
-                const Vector * pSrc2    = Retrive_Register(ins.Src2, batchOffset);
-
-                for(size_t i = 0; i < (batchOffset*4); i += 4) {
-                    pDst[i] = vf::Dot((pSrc1++)->u.v2, (pSrc2++)->u.v2);
-                }
-                break;
-            }
-        case OP_DOT_VECTOR2_RC:
-            {
-                float * pDst            = &Retrive_Element(ins.Dst, batchOffset);
-                const Vector * pSrc1    = Retrive_Register(ins.Src1, batchOffset);
-                const Vector2 & rhs     = (ins.Src2 == 0xff) ? *is.Decode2() : Retrive_Uniform(ins.Src2)->u.v2;
-
-                for(size_t i = 0; i < (batchOffset*4); i += 4) {
-                    pDst[i] = vf::Dot((pSrc1++)->u.v2, rhs);
-                }
-                break;
-            }
-        case OP_DOT_VECTOR2_CR:
-            {
-                float * pDst            = &Retrive_Element(ins.Dst, batchOffset);
-                const Vector * pSrc2    = Retrive_Register(ins.Src2, batchOffset);
-                const Vector2 & lhs     = (ins.Src1 == 0xff) ? *is.Decode2() : Retrive_Uniform(ins.Src1)->u.v2;
-
-                for(size_t i = 0; i < (batchOffset*4); i += 4) {
-                    pDst[i] = vf::Dot(lhs, (pSrc2++)->u.v2);
-                }
-                break;
-            }
-        case OP_DOT_VECTOR2_CC:
-            {
-                float * pDst            = &Retrive_Element(ins.Dst, batchOffset);
-                const Vector2 & lhs     = (ins.Src1 == 0xff) ? *is.Decode2() : Retrive_Uniform(ins.Src1)->u.v2;
-                const Vector2 & rhs     = (ins.Src2 == 0xff) ? *is.Decode2() : Retrive_Uniform(ins.Src2)->u.v2;
-                float v                 = vf::Dot(lhs, rhs);
-
-                for(size_t i = 0; i < (batchOffset*4); i += 4) {
-                    pDst[i] = v;
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                              Vector3                          */
-            /*****************************************************************/
-        case OP_DOT_VECTOR3_RR:
-            {
-                float * pDst            = &Retrive_Element(ins.Dst, batchOffset);
-                const Vector * pSrc1    = Retrive_Register(ins.Src1, batchOffset);
-                const Vector * pSrc2    = Retrive_Register(ins.Src2, batchOffset);
-
-                for(size_t i = 0; i < (batchOffset*4); i += 4) {
-                    pDst[i] = vf::Dot((pSrc1++)->u.v3, (pSrc2++)->u.v3);
-                }
-                break;
-            }
-        case OP_DOT_VECTOR3_RC:
-            {
-                float * pDst            = &Retrive_Element(ins.Dst, batchOffset);
-                const Vector * pSrc1    = Retrive_Register(ins.Src1, batchOffset);
-                const Vector3 & rhs     = (ins.Src2 == 0xff) ? *is.Decode3() : Retrive_Uniform(ins.Src2)->u.v3;
-
-                for(size_t i = 0; i < (batchOffset*4); i += 4) {
-                    pDst[i] = vf::Dot((pSrc1++)->u.v3, rhs);
-                }
-                break;
-            }
-        case OP_DOT_VECTOR3_CR:
-            {
-                float * pDst            = &Retrive_Element(ins.Dst, batchOffset);
-                const Vector * pSrc2    = Retrive_Register(ins.Src2, batchOffset);
-                const Vector3 & lhs     = (ins.Src1 == 0xff) ? *is.Decode3() : Retrive_Uniform(ins.Src1)->u.v3;
-
-                for(size_t i = 0; i < (batchOffset*4); i += 4) {
-                    pDst[i] = vf::Dot(lhs, (pSrc2++)->u.v3);
-                }
-                break;
-            }
-        case OP_DOT_VECTOR3_CC:
-            {
-                float * pDst            = &Retrive_Element(ins.Dst, batchOffset);
-                const Vector3 & lhs     = (ins.Src1 == 0xff) ? *is.Decode3() : Retrive_Uniform(ins.Src1)->u.v3;
-                const Vector3 & rhs     = (ins.Src2 == 0xff) ? *is.Decode3() : Retrive_Uniform(ins.Src2)->u.v3;
-                float v                 = vf::Dot(lhs, rhs);
-
-                for(size_t i = 0; i < (batchOffset*4); i += 4) {
-                    pDst[i] = v;
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                              Vector4                          */
-            /*****************************************************************/
-        case OP_DOT_VECTOR4_RR:
-            {
-                float * pDst            = &Retrive_Element(ins.Dst, batchOffset);
-                const Vector * pSrc1    = Retrive_Register(ins.Src1, batchOffset);
-                const Vector * pSrc2    = Retrive_Register(ins.Src2, batchOffset);
-
-                for(size_t i = 0; i < (batchOffset*4); i += 4) {
-                    pDst[i] = vf::Dot((pSrc1++)->u.v4, (pSrc2++)->u.v4);
-                }
-                break;
-            }
-        case OP_DOT_VECTOR4_RC:
-            {
-                float * pDst            = &Retrive_Element(ins.Dst, batchOffset);
-                const Vector * pSrc1    = Retrive_Register(ins.Src1, batchOffset);
-                const Vector4 & rhs     = (ins.Src2 == 0xff) ? *is.Decode4() : Retrive_Uniform(ins.Src2)->u.v4;
-
-                for(size_t i = 0; i < (batchOffset*4); i += 4) {
-                    pDst[i] = vf::Dot((pSrc1++)->u.v4, rhs);
-                }
-                break;
-            }
-        case OP_DOT_VECTOR4_CR:
-            {
-                float * pDst            = &Retrive_Element(ins.Dst, batchOffset);
-                const Vector * pSrc2    = Retrive_Register(ins.Src2, batchOffset);
-                const Vector4 & lhs     = (ins.Src1 == 0xff) ? *is.Decode4() : Retrive_Uniform(ins.Src1)->u.v4;
-
-                for(size_t i = 0; i < (batchOffset*4); i += 4) {
-                    pDst[i] = vf::Dot(lhs, (pSrc2++)->u.v4);
-                }
-                break;
-            }
-        case OP_DOT_VECTOR4_CC:
-            {
-                float * pDst            = &Retrive_Element(ins.Dst, batchOffset);
-                const Vector4 & lhs     = (ins.Src1 == 0xff) ? *is.Decode4() : Retrive_Uniform(ins.Src1)->u.v4;
-                const Vector4 & rhs     = (ins.Src2 == 0xff) ? *is.Decode4() : Retrive_Uniform(ins.Src2)->u.v4;
-                float v                 = vf::Dot(lhs, rhs);
-
-                for(size_t i = 0; i < (batchOffset*4); i += 4) {
-                    pDst[i] = v;
-                }
-                break;
-            }
-        default:
-            return Err_InvalidBytecode;
-        }
-        return Err_Success;
-    }
-
-    /**
-     * Execute_Cross - Executes a cross() virtual machine instruction.
-     */
-    Status_t VirtualMachine::Execute_Cross(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
-    {
-        switch(ins.Opcode) 
-        {
-        case OP_CROSS_RR:
-            {
-                Vector * pDst        = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * pSrc1 = Retrive_Register(ins.Src1, batchOffset);
-                const Vector * pSrc2 = Retrive_Register(ins.Src2, batchOffset);
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Cross((pDst++)->u.v3, (pSrc1++)->u.v3, (pSrc2++)->u.v3);
-                }
-                break;
-            }
-        case OP_CROSS_RC:
-            {
-                Vector * pDst        = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * pSrc1 = Retrive_Register(ins.Src1, batchOffset);
-                const Vector3 & rhs = (ins.Src2 == 0xff) ? *is.Decode3() : Retrive_Uniform(ins.Src2)->u.v3;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Cross((pDst++)->u.v3, (pSrc1++)->u.v3, rhs);
-                }
-                break;
-            }
-        case OP_CROSS_CR:
-            {
-                Vector * pDst        = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * pSrc2 = Retrive_Register(ins.Src2, batchOffset);
-                const Vector3 & lhs  = (ins.Src1 == 0xff) ? *is.Decode3() : Retrive_Uniform(ins.Src1)->u.v3;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Cross((pDst++)->u.v3, lhs, (pSrc2++)->u.v3);
-                }
-                break;
-            }
-        case OP_CROSS_CC:
-            {
-                Vector3 result;
-                Vector * pDst        = Retrive_Register(Register_Index(ins.Dst)) + batchOffset;
-                const Vector3 & lhs  = (ins.Src1 == 0xff) ? *is.Decode3() : Retrive_Uniform(ins.Src1)->u.v3;
-                const Vector3 & rhs  = (ins.Src2 == 0xff) ? *is.Decode3() : Retrive_Uniform(ins.Src2)->u.v3;
-
-                vf::Cross(result, lhs, rhs);
-                for(size_t i = 0; i < batchSize; ++i) {
-                    (pDst++)->u.v3 = result;
-                }
-                break;
-            }
-        default:
-            return Err_InvalidBytecode;
-        }
-
-        return Err_Success;
-    }
-
-    /**
-     * Executes a sample1D(), sample2D() or a sample3D() bytecode instruction.
-     */
-    Status_t VirtualMachine::Execute_Sampler(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
-    {
-        switch(ins.Opcode) {
-        case OP_SAMPLE1D_R:
-            {
-                Vector * pDst                   = Retrive_Register(ins.Dst, batchOffset);
-                Vector * pExp                   = Retrive_Register(ins.Src2, batchOffset);
-                const vf::ISampler * sampler    = GetSampler(ins.Src1);
-
-                if (!sampler->sample1D(pExp, pDst, batchSize)) {
-                    return Err_SamplingFailed;
-                }
-                break;
-            }
-        case OP_SAMPLE1D_C:
-            {
-                Vector * pDst                   = Retrive_Register(ins.Dst, batchOffset);
-                float fwide                     = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
-                const vf::ISampler * sampler    = GetSampler(ins.Src1);
-
-                if (!sampler->sample1D(fwide, pDst, batchSize)) {
-                    return Err_SamplingFailed;
-                }
-                break;
-            }
-        case OP_SAMPLE2D_R:
-            {
-                Vector * pDst                   = Retrive_Register(ins.Dst, batchOffset);
-                Vector * pExp                   = Retrive_Register(ins.Src2, batchOffset);
-                const vf::ISampler * sampler    = GetSampler(ins.Src1);
-                
-                if (!sampler->sample2D(pExp, pDst, batchSize)) {
-                    return Err_SamplingFailed;
-                }
-                break;
-            }
-        case OP_SAMPLE2D_C:
-            {
-                Vector * pDst                   = Retrive_Register(ins.Dst, batchOffset);
-                const vf::Vector2 & pos         = (ins.Src2 == 0xff) ? *is.Decode2() : Retrive_Uniform(ins.Src2)->u.v2;
-                const vf::ISampler * sampler    = GetSampler(ins.Src1);
-
-                if (!sampler->sample2D(pos, pDst, batchSize)) {
-                    return Err_SamplingFailed;
-                }
-                break;
-            }
-        case OP_SAMPLE3D_R:
-            {
-                Vector * pDst                   = Retrive_Register(ins.Dst, batchOffset);
-                Vector * pExp                   = Retrive_Register(ins.Src2, batchOffset);
-                const vf::ISampler * sampler    = GetSampler(ins.Src1);
-
-                if (!sampler->sample3D(pExp, pDst, batchSize)) {
-                    return Err_SamplingFailed;
-                }
-                break;
-            }
-        case OP_SAMPLE3D_C:
-            {
-                Vector * pDst                   = Retrive_Register(ins.Dst, batchOffset);
-                const vf::Vector3 & pos         = (ins.Src2 == 0xff) ? *is.Decode3() : Retrive_Uniform(ins.Src2)->u.v3;
-                const vf::ISampler * sampler    = GetSampler(ins.Src1);
-
-                if (!sampler->sample3D(pos, pDst, batchSize)) {
-                    return Err_SamplingFailed;
-                }
-                break;
-            }
-        default:
-            return Err_InvalidBytecode;
-        }
-        return Err_Success;
-    }
-
-    /** 
-     * Execute_Floor, executes a floor() instructiion.
-     */
-    Status_t VirtualMachine::Execute_Floor(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
-    {
-        switch(ins.Opcode) 
-        {
-        case OP_FLOOR_SCALAR_R:
-            {
-                float * pDst        = &Retrive_Element(ins.Dst, batchOffset);
-                const float * pSrc  = &Retrive_Element(ins.Src1, batchOffset);
-                
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    pDst[i] = floorf(pSrc[i]);
-                }
-                break;
-            }
-        case OP_FLOOR_SCALAR_C:
-            {
-                float * pDst = &Retrive_Element(ins.Dst, batchOffset);
-                float value  = (ins.Src1 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src1);
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    pDst[i] = floorf(value);
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                              Vector2                          */
-            /*****************************************************************/
-        case OP_FLOOR_VECTOR2_R:
-            {
-                Vector * pDst = Retrive_Register(ins.Dst, batchOffset);
-                Vector * pSrc = Retrive_Register(ins.Src1, batchOffset);
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Floor((pDst++)->u.v2, (pSrc++)->u.v2);
-                }
-                break;
-            }
-        case OP_FLOOR_VECTOR2_C:
-            {
-                Vector * pDst       = Retrive_Register(ins.Dst, batchOffset);
-                const Vector2 & w   = Retrive_Uniform(ins.Src1)->u.v2;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Floor((pDst++)->u.v2, w);
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                              Vector3                          */
-            /*****************************************************************/
-        case OP_FLOOR_VECTOR3_R:
-            {
-                Vector * pDst = Retrive_Register(ins.Dst, batchOffset);
-                Vector * pSrc = Retrive_Register(ins.Src1, batchOffset);
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Floor((pDst++)->u.v3, (pSrc++)->u.v3);
-                }
-                break;
-            }
-        case OP_FLOOR_VECTOR3_C:
-            {
-                Vector * pDst       = Retrive_Register(ins.Dst, batchOffset);
-                const Vector3 & w   = Retrive_Uniform(ins.Src1)->u.v3;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Floor((pDst++)->u.v3, w);
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                              Vector4                          */
-            /*****************************************************************/
-        case OP_FLOOR_VECTOR4_R:
-            {
-                Vector * pDst = Retrive_Register(ins.Dst, batchOffset);
-                Vector * pSrc = Retrive_Register(ins.Src1, batchOffset);
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Floor((pDst++)->u.v4, (pSrc++)->u.v4);
-                }
-                break;
-            }
-        case OP_FLOOR_VECTOR4_C:
-            {
-                Vector * pDst       = Retrive_Register(ins.Dst, batchOffset);
-                const Vector4 & w   = Retrive_Uniform(ins.Src1)->u.v4;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Floor((pDst++)->u.v4, w);
-                }
-                break;
-            }
-        default:
-            return Err_InvalidBytecode;
-        }
-        return Err_Success;
-     }
-
-    /** 
-     * Execute_Ceil, executes a ceil() instructiion.
-     */
-    Status_t VirtualMachine::Execute_Ceil(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
-    {
-        switch(ins.Opcode) 
-        {
-        case OP_CEIL_SCALAR_R:
-            {
-                float * pDst        = &Retrive_Element(ins.Dst, batchOffset);
-                const float * pSrc  = &Retrive_Element(ins.Src1, batchOffset);
-                
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    pDst[i] = ceilf(pSrc[i]);
-                }
-                break;
-            }
-        case OP_CEIL_SCALAR_C:
-            {
-                float * pDst = &Retrive_Element(ins.Dst, batchOffset);
-                float value  = (ins.Src1 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src1);
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    pDst[i] = ceilf(value);
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                              Vector2                          */
-            /*****************************************************************/
-        case OP_CEIL_VECTOR2_R:
-            {
-                Vector * pDst = Retrive_Register(ins.Dst, batchOffset);
-                Vector * pSrc = Retrive_Register(ins.Src1, batchOffset);
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Ceil((pDst++)->u.v2, (pSrc++)->u.v2);
-                }
-                break;
-            }
-        case OP_CEIL_VECTOR2_C:
-            {
-                Vector * pDst       = Retrive_Register(ins.Dst, batchOffset);
-                const Vector2 & w   = Retrive_Uniform(ins.Src1)->u.v2;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Ceil((pDst++)->u.v2, w);
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                              Vector3                          */
-            /*****************************************************************/
-        case OP_CEIL_VECTOR3_R:
-            {
-                Vector * pDst = Retrive_Register(ins.Dst, batchOffset);
-                Vector * pSrc = Retrive_Register(ins.Src1, batchOffset);
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Ceil((pDst++)->u.v3, (pSrc++)->u.v3);
-                }
-                break;
-            }
-        case OP_CEIL_VECTOR3_C:
-            {
-                Vector * pDst       = Retrive_Register(ins.Dst, batchOffset);
-                const Vector3 & w   = Retrive_Uniform(ins.Src1)->u.v3;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Ceil((pDst++)->u.v3, w);
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                              Vector4                          */
-            /*****************************************************************/
-        case OP_CEIL_VECTOR4_R:
-            {
-                Vector * pDst = Retrive_Register(ins.Dst, batchOffset);
-                Vector * pSrc = Retrive_Register(ins.Src1, batchOffset);
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Ceil((pDst++)->u.v4, (pSrc++)->u.v4);
-                }
-                break;
-            }
-        case OP_CEIL_VECTOR4_C:
-            {
-                Vector * pDst       = Retrive_Register(ins.Dst, batchOffset);
-                const Vector4 & w   = Retrive_Uniform(ins.Src1)->u.v4;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    vf::Ceil((pDst++)->u.v4, w);
-                }
-                break;
-            }
-        default:
-            return Err_InvalidBytecode;
-        }
-        return Err_Success;
-     }
-
-    /**
-     * Execute bytecode instructions for comparing scalar values.
-     */
-    Status_t VirtualMachine::Execute_Comparison(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
-    {
-        uint8_t * flags = GetFlags();
-        switch(ins.Opcode)
-        {
-            /*****************************************************************/
-            /*                              Greater                          */
-            /*****************************************************************/
-        case OP_CMP_GRT_RR:
-            {
-                const float * pLhs  = &Retrive_Element(ins.Src1, batchOffset);
-                const float * pRhs  = &Retrive_Element(ins.Src1, batchOffset);
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    flags[i] = (pLhs[i] > pRhs[i]) ? FLAG_CMP : 0;
-                }
-                break;
-            }
-        case OP_CMP_GRT_RC:
-            {
-                const float * pLhs  = &Retrive_Element(ins.Src1, batchOffset);
-                float rhs           = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
-            
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    flags[i] = (pLhs[i] > rhs) ? FLAG_CMP : 0;
-                }
-                break;
-            }
-        case OP_CMP_GRT_CR:
-            {
-                const float * pRhs  = &Retrive_Element(ins.Src2, batchOffset);
-                float lhs           = (ins.Src1 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src1);
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    flags[i] = (lhs > pRhs[i]) ? FLAG_CMP : 0;
-                }
-                break;
-            }
-        case OP_CMP_GRT_CC:
-            {
-                float lhs           = (ins.Src1 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src1);
-                float rhs           = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
-                if (lhs > rhs) {
-                    memset(flags, FLAG_CMP, batchSize);
-                } else {
-                    memset(flags, 0, batchSize);
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                              Less                             */
-            /*****************************************************************/
-        case OP_CMP_LE_RR:
-            {
-                const float * pLhs  = &Retrive_Element(ins.Src1, batchOffset);
-                const float * pRhs  = &Retrive_Element(ins.Src1, batchOffset);
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    flags[i] = (pLhs[i] < pRhs[i]) ? FLAG_CMP : 0;
-                }
-                break;
-            }
-        case OP_CMP_LE_RC:
-            {
-                const float * pLhs  = &Retrive_Element(ins.Src1, batchOffset);
-                float rhs           = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
-            
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    flags[i] = (pLhs[i] < rhs) ? FLAG_CMP : 0;
-                }
-                break;
-            }
-        case OP_CMP_LE_CR:
-            {
-                const float * pRhs  = &Retrive_Element(ins.Src2, batchOffset);
-                float lhs           = (ins.Src1 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src1);
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    flags[i] = (lhs < pRhs[i]) ? FLAG_CMP : 0;
-                }
-                break;
-            }
-        case OP_CMP_LE_CC:
-            {
-                float lhs           = (ins.Src1 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src1);
-                float rhs           = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
-                if (lhs < rhs) {
-                    memset(flags, FLAG_CMP, batchSize);
-                } else {
-                    memset(flags, 0, batchSize);
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                              Equal                            */
-            /*****************************************************************/
-        case OP_CMP_EQ_RR:
-            {
-                const float * pLhs  = &Retrive_Element(ins.Src1, batchOffset);
-                const float * pRhs  = &Retrive_Element(ins.Src1, batchOffset);
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    flags[i] = (pLhs[i] == pRhs[i]) ? FLAG_CMP : 0;
-                }
-                break;
-            }
-        case OP_CMP_EQ_RC:
-            {
-                const float * pLhs  = &Retrive_Element(ins.Src1, batchOffset);
-                float rhs           = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
-            
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    flags[i] = (pLhs[i] == rhs) ? FLAG_CMP : 0;
-                }
-                break;
-            }
-        case OP_CMP_EQ_CR:
-            {
-                const float * pRhs  = &Retrive_Element(ins.Src2, batchOffset);
-                float lhs           = (ins.Src1 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src1);
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    flags[i] = (lhs == pRhs[i]) ? FLAG_CMP : 0;
-                }
-                break;
-            }
-        case OP_CMP_EQ_CC:
-            {
-                float lhs           = (ins.Src1 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src1);
-                float rhs           = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
-                if (lhs == rhs) {
-                    memset(flags, FLAG_CMP, batchSize);
-                } else {
-                    memset(flags, 0, batchSize);
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                          Greater or equal                     */
-            /*****************************************************************/
-        case OP_CMP_GEQ_RR:
-            {
-                const float * pLhs  = &Retrive_Element(ins.Src1, batchOffset);
-                const float * pRhs  = &Retrive_Element(ins.Src1, batchOffset);
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    flags[i] = (pLhs[i] >= pRhs[i]) ? FLAG_CMP : 0;
-                }
-                break;
-            }
-        case OP_CMP_GEQ_RC:
-            {
-                const float * pLhs  = &Retrive_Element(ins.Src1, batchOffset);
-                float rhs           = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
-            
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    flags[i] = (pLhs[i] >= rhs) ? FLAG_CMP : 0;
-                }
-                break;
-            }
-        case OP_CMP_GEQ_CR:
-            {
-                const float * pRhs  = &Retrive_Element(ins.Src2, batchOffset);
-                float lhs           = (ins.Src1 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src1);
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    flags[i] = (lhs >= pRhs[i]) ? FLAG_CMP : 0;
-                }
-                break;
-            }
-        case OP_CMP_GEQ_CC:
-            {
-                float lhs           = (ins.Src1 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src1);
-                float rhs           = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
-                if (lhs >= rhs) {
-                    memset(flags, FLAG_CMP, batchSize);
-                } else {
-                    memset(flags, 0, batchSize);
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                          Less or equal                        */
-            /*****************************************************************/
-        case OP_CMP_LEQ_RR:
-            {
-                const float * pLhs  = &Retrive_Element(ins.Src1, batchOffset);
-                const float * pRhs  = &Retrive_Element(ins.Src1, batchOffset);
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    flags[i] = (pLhs[i] <= pRhs[i]) ? FLAG_CMP : 0;
-                }
-                break;
-            }
-        case OP_CMP_LEQ_RC:
-            {
-                const float * pLhs  = &Retrive_Element(ins.Src1, batchOffset);
-                float rhs           = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
-            
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    flags[i] = (pLhs[i] <= rhs) ? FLAG_CMP : 0;
-                }
-                break;
-            }
-        case OP_CMP_LEQ_CR:
-            {
-                const float * pRhs  = &Retrive_Element(ins.Src2, batchOffset);
-                float lhs           = (ins.Src1 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src1);
-
-                for(size_t i = 0; i < (batchSize*4); i += 4) {
-                    flags[i] = (lhs <= pRhs[i]) ? FLAG_CMP : 0;
-                }
-                break;
-            }
-        case OP_CMP_LEQ_CC:
-            {
-                float lhs           = (ins.Src1 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src1);
-                float rhs           = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
-                if (lhs <= rhs) {
-                    memset(flags, FLAG_CMP, batchSize);
-                } else {
-                    memset(flags, 0, batchSize);
-                }
-                break;
-            }
-        default:
-            return Err_InvalidBytecode;
-        }
-        return Err_Success;
-    }
-
-    /*************************************************************************/
-    /*                                  Statements                           */
-    /*************************************************************************/
-
-    /**
-     * Execute_ConditionalAssignment. Exectutes a conditional assignment bytecode instruction.
-     */
-    Status_t VirtualMachine::Execute_ConditionalAssignment(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
-    {
-        const uint8_t * flags = GetFlags();
-        switch(ins.Opcode) {
-            /*****************************************************************/
-            /*                              Scalar                           */
-            /*****************************************************************/
-        case OP_COND_SCALAR_RR:
-            {
-                float * fDst            = &Retrive_Element(ins.Dst, batchOffset);
-                const float * fSrc1     = &Retrive_Element(ins.Src1, batchOffset);
-                const float * fSrc2     = &Retrive_Element(ins.Src2, batchOffset);
-
-                for(size_t i = 0; i < batchSize; i++) {
-                    fDst[i] = (flags[i] & FLAG_CMP) ? fSrc1[i] : fSrc2[i];
-                }
-                break;
-            }
-        case OP_COND_SCALAR_RC:
-            {
-                float * fDst            = &Retrive_Element(ins.Dst, batchOffset);
-                const float * fSrc1     = &Retrive_Element(ins.Src1, batchOffset);
-                float rhs               = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
-
-                for(size_t i = 0; i < batchSize; i++) {
-                    fDst[i] = (flags[i] & FLAG_CMP) ? fSrc1[i] : rhs;
-                }
-                break;
-            }
-        case OP_COND_SCALAR_CR:
-            {
-                float * fDst            = &Retrive_Element(ins.Dst, batchOffset);
-                const float * fSrc2     = &Retrive_Element(ins.Src2, batchOffset);
-                float lhs               = (ins.Src1 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src1);
-
-                for(size_t i = 0; i < batchSize; i++) {
-                    fDst[i] = (flags[i] & FLAG_CMP) ? lhs : fSrc2[i];
-                }
-                break;
-            }
-        case OP_COND_SCALAR_CC:
-            {
-                float * fDst            = &Retrive_Element(ins.Dst, batchOffset);
-                float lhs               = (ins.Src1 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src1);
-                float rhs               = (ins.Src2 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src2);
-
-                for(size_t i = 0; i < batchSize; i++) {
-                    fDst[i] = (flags[i] & FLAG_CMP) ? lhs : rhs;
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                              Vector2                          */
-            /*****************************************************************/
-        case OP_COND_VECTOR2_RR:
-            {
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * pSrc1    = Retrive_Register(ins.Src1, batchOffset);
-                const Vector * pSrc2    = Retrive_Register(ins.Src2, batchOffset);
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    pDst[i].u.v2 = (flags[i] & FLAG_CMP) ? pSrc1[i].u.v2 : pSrc2[i].u.v2;
-                }
-                break;
-            }
-        case OP_COND_VECTOR2_RC:
-            {
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * pSrc1    = Retrive_Register(ins.Src1, batchOffset);
-                const Vector2 & rhs     = (ins.Src2 == 0xff) ? *is.Decode2() : Retrive_Uniform(ins.Src2)->u.v2;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    pDst[i].u.v2 = (flags[i] & FLAG_CMP) ? pSrc1[i].u.v2 : rhs;
-                }
-                break;
-            }
-        case OP_COND_VECTOR2_CR:
-            {
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * pSrc2    = Retrive_Register(ins.Src2, batchOffset);
-                const Vector2 & lhs     = (ins.Src1 == 0xff) ? *is.Decode2() : Retrive_Uniform(ins.Src1)->u.v2;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    pDst[i].u.v2 = (flags[i] & FLAG_CMP) ? lhs : pSrc2[i].u.v2;
-                }
-                break;
-            }
-        case OP_COND_VECTOR2_CC:
-            {
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector2 & lhs     = (ins.Src1 == 0xff) ? *is.Decode2() : Retrive_Uniform(ins.Src1)->u.v2;
-                const Vector2 & rhs     = (ins.Src2 == 0xff) ? *is.Decode2() : Retrive_Uniform(ins.Src2)->u.v2;
-                
-                for(size_t i = 0; i < batchSize; ++i) {
-                    pDst[i].u.v2 = (flags[i] & FLAG_CMP) ? lhs : rhs;
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                              Vector3                          */
-            /*****************************************************************/
-        case OP_COND_VECTOR3_RR:
-            {
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * pSrc1    = Retrive_Register(ins.Src1, batchOffset);
-                const Vector * pSrc2    = Retrive_Register(ins.Src2, batchOffset);
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    pDst[i].u.v3 = (flags[i] & FLAG_CMP) ? pSrc1[i].u.v3 : pSrc2[i].u.v3;
-                }
-                break;
-            }
-        case OP_COND_VECTOR3_RC:
-            {
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * pSrc1    = Retrive_Register(ins.Src1, batchOffset);
-                const Vector3 & rhs     = (ins.Src2 == 0xff) ? *is.Decode3() : Retrive_Uniform(ins.Src2)->u.v3;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    pDst[i].u.v3 = (flags[i] & FLAG_CMP) ? pSrc1[i].u.v3 : rhs;
-                }
-                break;
-            }
-        case OP_COND_VECTOR3_CR:
-            {
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * pSrc2    = Retrive_Register(ins.Src2, batchOffset);
-                const Vector3 & lhs     = (ins.Src1 == 0xff) ? *is.Decode3() : Retrive_Uniform(ins.Src1)->u.v3;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    pDst[i].u.v3 = (flags[i] & FLAG_CMP) ? lhs : pSrc2[i].u.v3;
-                }
-                break;
-            }
-        case OP_COND_VECTOR3_CC:
-            {
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector3 & lhs     = (ins.Src1 == 0xff) ? *is.Decode3() : Retrive_Uniform(ins.Src1)->u.v3;
-                const Vector3 & rhs     = (ins.Src2 == 0xff) ? *is.Decode3() : Retrive_Uniform(ins.Src2)->u.v3;
-                
-                for(size_t i = 0; i < batchSize; ++i) {
-                    pDst[i].u.v3 = (flags[i] & FLAG_CMP) ? lhs : rhs;
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                              Vector4                          */
-            /*****************************************************************/
-        case OP_COND_VECTOR4_RR:
-            {
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * pSrc1    = Retrive_Register(ins.Src1, batchOffset);
-                const Vector * pSrc2    = Retrive_Register(ins.Src2, batchOffset);
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    pDst[i].u.v4 = (flags[i] & FLAG_CMP) ? pSrc1[i].u.v4 : pSrc2[i].u.v4;
-                }
-                break;
-            }
-        case OP_COND_VECTOR4_RC:
-            {
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * pSrc1    = Retrive_Register(ins.Src1, batchOffset);
-                const Vector4 & rhs     = (ins.Src2 == 0xff) ? *is.Decode4() : Retrive_Uniform(ins.Src2)->u.v4;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    pDst[i].u.v4 = (flags[i] & FLAG_CMP) ? pSrc1[i].u.v4 : rhs;
-                }
-                break;
-            }
-        case OP_COND_VECTOR4_CR:
-            {
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * pSrc2    = Retrive_Register(ins.Src2, batchOffset);
-                const Vector4 & lhs     = (ins.Src1 == 0xff) ? *is.Decode4() : Retrive_Uniform(ins.Src1)->u.v4;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    pDst[i].u.v4 = (flags[i] & FLAG_CMP) ? lhs : pSrc2[i].u.v4;
-                }
-                break;
-            }
-        case OP_COND_VECTOR4_CC:
-            {
-                Vector * pDst           = Retrive_Register(ins.Dst, batchOffset);
-                const Vector4 & lhs     = (ins.Src1 == 0xff) ? *is.Decode4() : Retrive_Uniform(ins.Src1)->u.v4;
-                const Vector4 & rhs     = (ins.Src2 == 0xff) ? *is.Decode4() : Retrive_Uniform(ins.Src2)->u.v4;
-                
-                for(size_t i = 0; i < batchSize; ++i) {
-                    pDst[i].u.v4 = (flags[i] & FLAG_CMP) ? lhs : rhs;
-                }
-                break;
-            }
-        default:
-            return Err_InvalidBytecode;
-        }
-        return Err_Success;
-    }
+        step.kernel.compare = m_Kernels->Compare[kernel];
+        step.family         = Family_Compare;
+        step.kernelIndex    = static_cast<uint8_t>(kernel);
+        step.dst            = 0;
+        step.mask           = 0;
+        Retrive_Operand(step.src[0], ins.Src1, (form == FORM_CR) || (form == FORM_CC), 1, is);
+        Retrive_Operand(step.src[1], ins.Src2, (form == FORM_RC) || (form == FORM_CC), 1, is);
+        step.type           = Step_Type(Step_Compare_RR, 2, step);
+        return Err_Success;
+    }
 
     /**
-     * Execute_Assignment. Executes a assignment bytecode instruction.
+     * Compile_ConditionalAssignment. Compiles a conditional assignment bytecode instruction.
      */
-    Status_t VirtualMachine::Execute_Assignment(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
+    Status_t VirtualMachine::Compile_ConditionalAssignment(const Instruction_t & ins, InstructionStream & is, PlanStep & step)
     {
-        switch(ins.Opcode)
-        {
-            /*****************************************************************/
-            /*                              Scalar                           */
-            /*****************************************************************/
-        case OP_ASSIGN_SCALAR_R:
-            {
-                float * pDst = &Retrive_Element(ins.Dst, batchOffset);
-                float * pSrc = &Retrive_Element(ins.Src1, batchOffset);
-
-                for(size_t i = 0; i < (batchOffset*4); i += 4) {
-                    pDst[i] = pSrc[i];
-                }
-                break;
-            }
-        case OP_ASSIGN_SCALAR_C:
-            {
-                float * pDst = &Retrive_Element(ins.Dst, batchOffset);
-                float fValue = (ins.Src1 == 0xff) ? is.DecodeScalar() : Retrive_UniformElement(ins.Src1);
-                
-                for(size_t i = 0; i < (batchOffset*4); i += 4) {
-                    pDst[i] = fValue;
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                              Vector2                          */
-            /*****************************************************************/
-        case OP_ASSIGN_VECTOR2_R:
-            {
-                Vector * pDst       = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * pSrc = Retrive_Register(ins.Src1, batchOffset);
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    (pDst++)->u.v2 = (pSrc++)->u.v2;
-                }
-                break;
-            }
-        case OP_ASSIGN_VECTOR2_C:
-            {
-                Vector * pDst       = Retrive_Register(ins.Dst, batchOffset);
-                const Vector2 w     = Retrive_Uniform(ins.Src1)->u.v2;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    (pDst++)->u.v2 = w;
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                              Vector3                          */
-            /*****************************************************************/
-        case OP_ASSIGN_VECTOR3_R:
-            {
-                Vector * pDst       = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * pSrc = Retrive_Register(ins.Src1, batchOffset);
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    (pDst++)->u.v3 = (pSrc++)->u.v3;
-                }
-                break;
-            }
-        case OP_ASSIGN_VECTOR3_C:
-            {
-                Vector * pDst       = Retrive_Register(ins.Dst, batchOffset);
-                const Vector3 & w   = Retrive_Uniform(ins.Src1)->u.v3;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    (pDst++)->u.v3 = w;
-                }
-                break;
-            }
-            /*****************************************************************/
-            /*                              Vector3                          */
-            /*****************************************************************/
-        case OP_ASSIGN_VECTOR4_R:
-            {
-                Vector * pDst       = Retrive_Register(ins.Dst, batchOffset);
-                const Vector * pSrc = Retrive_Register(ins.Src1, batchOffset);
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    (pDst++)->u.v4 = (pSrc++)->u.v4;
-                }
-                break;
-            }
-        case OP_ASSIGN_VECTOR4_C:
-            {
-                Vector * pDst       = Retrive_Register(ins.Dst, batchOffset);
-                const Vector4 & w   = Retrive_Uniform(ins.Src1)->u.v4;
-
-                for(size_t i = 0; i < batchSize; ++i) {
-                    (pDst++)->u.v4 = w;
-                }
-                break;
-            }
-        default:
-            return Err_InvalidBytecode;
-        }
+        uint8_t form;
+        size_t n = Decode_Type(ins.Opcode, OP_COND_VECTOR2_RR, OP_COND_VECTOR3_RR, OP_COND_VECTOR4_RR, OP_COND_SCALAR_RR, form);
+
+        step.kernel.select  = m_Kernels->Select;
+        step.family         = Family_Select;
+        step.kernelIndex    = 0;
+        Retrive_Destination(step, ins.Dst, n);
+        Retrive_Operand(step.src[0], ins.Src1, (form == FORM_CR) || (form == FORM_CC), n, is);
+        Retrive_Operand(step.src[1], ins.Src2, (form == FORM_RC) || (form == FORM_CC), n, is);
+        step.type           = Step_Type(Step_Select_RR, 2, step);
         return Err_Success;
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,938 @@
+/**
+ * \file            vm_soa.cpp
+ * \description     Virtual Machine (VM) that executes bytecode on registers stored in a
+ *                  Structure-of-Arrays (SoA) layout, where each vector component is kept in a
+ *                  separate plane.
+ */
+
+#include "vfvm.h"
+
+namespace vf
+{
+namespace
+{
+    /*************************************************************************/
+    /*                              Kernels                                  */
+    /*************************************************************************/
+    struct Op_Greater       { static bool Apply(float a, float b) { return a > b; } };
+    struct Op_Less          { static bool Apply(float a, float b) { return a < b; } };
+    struct Op_Equal         { static bool Apply(float a, float b) { return a == b; } };
+    struct Op_GreaterEqual  { static bool Apply(float a, float b) { return a >= b; } };
+    struct Op_LessEqual     { static bool Apply(float a, float b) { return a <= b; } };
+
+    /** Reads the elements of a plane */
+    struct Plane_Reader
+    {
+        const float * p;
+        float operator()(size_t i) const { return p[i]; }
+    };
+
+    /** Reads a constant, which is the same for every element */
+    struct Const_Reader
+    {
+        float v;
+        float operator()(size_t) const { return v; }
+    };
+}
+
+    /**
+     * Fills a plane with a single value.
+     */
+    static void Fill(float * dst, float value, size_t batchSize)
+    {
+        for(size_t i = 0; i < batchSize; ++i) {
+            dst[i] = value;
+        }
+    }
+
+    /**
+     * Describes a single component of a operand as a kernel operand. A plane is processed by the
+     * kernels as a contiguous array of floats.
+     */
+    static void Plane_Operand(KernelOperand & op, const SoA_Operand & src, size_t component)
+    {
+        if (src.isconst) {
+            op.kind = Operand_Const;
+            op.ptr  = nullptr;
+            op.value[0] = op.value[1] = op.value[2] = op.value[3] = src.value[component];
+        } else {
+            op.kind = Operand_Vector;
+            op.ptr  = src.plane[component];
+        }
+    }
+
+    /**
+     * Executes a component wise binary operation.
+     */
+    static void Binary(BinaryKernel_t kernel, float * const (&dst)[4], const SoA_Operand & lhs, const SoA_Operand & rhs,
+        size_t numComponents, size_t batchSize)
+    {
+        for(size_t c = 0; c < numComponents; ++c) {
+            KernelOperand l, r;
+            Plane_Operand(l, lhs, c);
+            Plane_Operand(r, rhs, c);
+            kernel(dst[c], l, r, batchSize, 0x0f);
+        }
+    }
+
+    /**
+     * Executes a component wise unary operation.
+     */
+    static void Unary(UnaryKernel_t kernel, float * const (&dst)[4], const SoA_Operand & src, size_t numComponents, size_t batchSize)
+    {
+        for(size_t c = 0; c < numComponents; ++c) {
+            KernelOperand op;
+            Plane_Operand(op, src, c);
+            kernel(dst[c], op, batchSize, 0x0f);
+        }
+    }
+
+    /**
+     * Compares the elements of two operands, the comparisons of eight elements are gathered into
+     * each byte of the predicate.
+     */
+    template<class Op, class L, class R>
+    static void Compare(uint8_t * predicate, L lhs, R rhs, size_t batchSize)
+    {
+        for(size_t i = 0; i < batchSize; i += 8) {
+            size_t num = ((batchSize - i) < 8) ? (batchSize - i) : 8;
+            unsigned bits = 0;
+            for(size_t k = 0; k < num; ++k) {
+                bits |= unsigned(Op::Apply(lhs(i + k), rhs(i + k))) << k;
+            }
+            predicate[i / 8] = static_cast<uint8_t>(bits);
+        }
+    }
+
+    /**
+     * Compares two scalar operands and stores the result in the predicate, one bit per element.
+     */
+    template<class Op>
+    static void Compare(uint8_t * predicate, const SoA_Operand & lhs, const SoA_Operand & rhs, size_t batchSize)
+    {
+        if (lhs.isconst && rhs.isconst) {
+            Const_Reader l = { lhs.value[0] }, r = { rhs.value[0] };
+            Compare<Op>(predicate, l, r, batchSize);
+        } else if (lhs.isconst) {
+            Const_Reader l = { lhs.value[0] };
+            Plane_Reader r = { rhs.plane[0] };
+            Compare<Op>(predicate, l, r, batchSize);
+        } else if (rhs.isconst) {
+            Plane_Reader l = { lhs.plane[0] };
+            Const_Reader r = { rhs.value[0] };
+            Compare<Op>(predicate, l, r, batchSize);
+        } else {
+            Plane_Reader l = { lhs.plane[0] }, r = { rhs.plane[0] };
+            Compare<Op>(predicate, l, r, batchSize);
+        }
+    }
+
+    /**
+     * Returns the dot product of two vector operands for the element at index i.
+     */
+    static float Dot(const SoA_Operand & lhs, const SoA_Operand & rhs, size_t numComponents, size_t i)
+    {
+        float sum = 0.0f;
+        for(size_t c = 0; c < numComponents; ++c) {
+            float l = lhs.isconst ? lhs.value[c] : lhs.plane[c][i];
+            float r = rhs.isconst ? rhs.value[c] : rhs.plane[c][i];
+            sum += l * r;
+        }
+        return sum;
+    }
+
+    /*************************************************************************/
+    /*                          SoA_VirtualMachine                           */
+    /*************************************************************************/
+    SoA_VirtualMachine::SoA_VirtualMachine(const vfutil::Bitmap & IoMap, uint8_t NumRegisters, uint8_t NumUniforms,
+        uint8_t NumSamplers, ISA_t isa, Precision_t precision)
+        : m_Flags(nullptr), m_Kernels(GetKernelTable(isa, precision)), m_IoMap(IoMap)
+    {
+        SoA_Register empty = { { nullptr, nullptr, nullptr, nullptr } };
+        m_Registers.resize(NumRegisters, empty);
+        m_Samplers.resize(NumSamplers);
+        m_Uniforms.resize(NumUniforms);
+
+        BuildCallTable();
+    }
+
+    /*************************************************************************/
+    /*                                  Modifiers                            */
+    /*************************************************************************/
+
+    /**
+     * Assigns the component planes of a register. Components that aren't used by the register
+     * may be null.
+     */
+    Status_t SoA_VirtualMachine::SetRegisterPointer(size_t index, float * x, float * y, float * z, float * w)
+    {
+        SoA_Register & reg = m_Registers[index];
+        reg.plane[0] = x;
+        reg.plane[1] = y;
+        reg.plane[2] = z;
+        reg.plane[3] = w;
+        return Err_Success;
+    }
+
+    Status_t SoA_VirtualMachine::SetUniform(size_t index, float value)
+    {
+        m_Uniforms[index].u.f = value;
+        return Err_Success;
+    }
+
+    Status_t SoA_VirtualMachine::SetUniform(size_t index, const vf::Vector2 & value)
+    {
+        m_Uniforms[index].u.v2 = value;
+        return Err_Success;
+    }
+
+    Status_t SoA_VirtualMachine::SetUniform(size_t index, const vf::Vector3 & value)
+    {
+        m_Uniforms[index].u.v3 = value;
+        return Err_Success;
+    }
+
+    Status_t SoA_VirtualMachine::SetUniform(size_t index, const vf::Vector4 & value)
+    {
+        m_Uniforms[index].u.v4 = value;
+        return Err_Success;
+    }
+
+    Status_t SoA_VirtualMachine::SetSampler(size_t index, vf::ISampler * sampler)
+    {
+        m_Samplers[index] = sampler;
+        return Err_Success;
+    }
+
+    /**
+     * Sets the memory region that should be used to store the predicate of a batch, which is
+     * a bitmask with one bit per element.
+     */
+    void SoA_VirtualMachine::SetFlagPointer(void * ptr)
+    {
+        m_Flags = (uint8_t *)ptr;
+    }
+
+    /**
+     * Checks that the component planes and samplers that a verified method refers to are bound.
+     */
+    Status_t SoA_VirtualMachine::Check_Bindings(const MethodBindings & bindings) const
+    {
+        for(size_t i = 0, num = bindings.registers.size(); i < num; ++i) {
+            uint8_t reg = bindings.registers[i];
+            for(size_t c = 0; c < 4; ++c) {
+                if ((bindings.components[reg] & (1 << c)) && !m_Registers[reg].plane[c]) {
+                    return Err_UnassignedRegisterPointer;
+                }
+            }
+        }
+        for(size_t i = 0, num = bindings.samplers.size(); i < num; ++i) {
+            if (!m_Samplers[bindings.samplers[i]]) {
+                return Err_InvalidBytecode;
+            }
+        }
+        return Err_Success;
+    }
+
+    /*************************************************************************/
+    /*                  Utility methods used during execution                */
+    /*************************************************************************/
+
+    /**
+     * Returns a pointer to a single component plane of a register.
+     */
+    float * SoA_VirtualMachine::Retrive_Plane(uint8_t operand, size_t component, size_t offset)
+    {
+        uint8_t reg = Register_Index(operand);
+        return m_Registers[reg].plane[component] + (m_IoMap.Get(reg) ? offset : 0);
+    }
+
+    /**
+     * Retrives the planes that the result of a instruction should be written to. Scalar
+     * results are written to the plane selected by the register member.
+     */
+    void SoA_VirtualMachine::Retrive_Destination(float * (&dst)[4], uint8_t operand, size_t numComponents, size_t offset)
+    {
+        if (numComponents == 1) {
+            dst[0] = Retrive_Plane(operand, Register_Member(operand), offset);
+        } else {
+            for(size_t c = 0; c < numComponents; ++c) {
+                dst[c] = Retrive_Plane(operand, c, offset);
+            }
+        }
+    }
+
+    /**
+     * Decodes a instruction operand, which is either a register or a constant/uniform value.
+     * Inline constants are read from the instruction stream.
+     */
+    void SoA_VirtualMachine::Retrive_Operand(SoA_Operand & op, uint8_t operand, bool isconst, size_t numComponents,
+        InstructionStream & is, size_t offset)
+    {
+        op.isconst = isconst;
+        if (isconst) {
+            for(size_t c = 0; c < 4; ++c) {
+                op.value[c] = 0.0f;
+            }
+            if (operand == 0xff) {
+                for(size_t c = 0; c < numComponents; ++c) {
+                    op.value[c] = is.DecodeScalar();
+                }
+            } else if (numComponents == 1) {
+                op.value[0] = Retrive_UniformElement(operand);
+            } else {
+                uint8_t id = Register_Index(operand);
+                for(size_t c = 0; c < numComponents; ++c) {
+                    op.value[c] = m_Uniforms[id][c];
+                }
+            }
+            if (numComponents == 1) {
+                op.value[1] = op.value[2] = op.value[3] = op.value[0];
+            }
+        } else if (numComponents == 1) {
+            const float * plane = Retrive_Plane(operand, Register_Member(operand), offset);
+            op.plane[0] = op.plane[1] = op.plane[2] = op.plane[3] = plane;
+        } else {
+            for(size_t c = 0; c < 4; ++c) {
+                op.plane[c] = (c < numComponents) ? Retrive_Plane(operand, c, offset) : nullptr;
+            }
+        }
+    }
+
+    float & SoA_VirtualMachine::Retrive_UniformElement(uint8_t operand)
+    {
+        uint8_t id = Register_Index(operand), idx = Register_Member(operand);
+        return m_Uniforms[id].operator[](idx);
+    }
+
+    /** Returns the sampler with the specified index */
+    ISampler * SoA_VirtualMachine::GetSampler(uint8_t operand)
+    {
+        return m_Samplers[operand];
+    }
+
+    uint8_t * SoA_VirtualMachine::GetFlags()
+    {
+        return m_Flags;
+    }
+
+    /*************************************************************************/
+    /*                                  Execution                            */
+    /*************************************************************************/
+    void SoA_VirtualMachine::BuildCallTable()
+    {
+        m_CallTable.resize(OP_MAX);
+        for(size_t i = 0; i < OP_MAX; ++i) {
+            if ((i >= OP_SCALAR_ADD_RR) && (i <= OP_VECTOR4_ADD_CC)) {
+                m_CallTable[i] = &SoA_VirtualMachine::Execute_Add;
+            } else if ((i >= OP_SCALAR_SUB_RR) && (i <= OP_VECTOR4_SUB_CC)) {
+                m_CallTable[i] = &SoA_VirtualMachine::Execute_Sub;
+            } else if ((i >= OP_SCALAR_MUL_RR) && (i <= OP_VECTOR4_SCALAR_MUL_CC)) {
+                m_CallTable[i] = &SoA_VirtualMachine::Execute_Mul;
+            } else if ((i >= OP_SCALAR_DIV_RR) && (i <= OP_VECTOR4_SCALAR_DIV_CC)) {
+                m_CallTable[i] = &SoA_VirtualMachine::Execute_Div;
+            } else if ((i >= OP_SCALAR_NEGATE_R) && (i <= OP_VECTOR4_NEGATE_C)) {
+                m_CallTable[i] = &SoA_VirtualMachine::Execute_Negate;
+            } else if ((i >= OP_DOT_VECTOR2_RR) && (i <= OP_DOT_VECTOR4_CC)) {
+                m_CallTable[i] = &SoA_VirtualMachine::Execute_Dot;
+            } else if ((i >= OP_CROSS_RR) && (i <= OP_CROSS_CC)) {
+                m_CallTable[i] = &SoA_VirtualMachine::Execute_Cross;
+            } else if ((i >= OP_LENGTH_VECTOR2_R) && (i <= OP_LENGTH_VECTOR4_C)) {
+                m_CallTable[i] = &SoA_VirtualMachine::Execute_Length;
+            } else if ((i >= OP_SINE_R) && (i <= OP_ARCTANGENT_C)) {
+                m_CallTable[i] = &SoA_VirtualMachine::Execute_Trigonometric;
+            } else if ((i >= OP_SQRT_R) && (i <= OP_INVSQRT_C)) {
+                m_CallTable[i] = &SoA_VirtualMachine::Execute_Sqrt;
+            } else if ((i >= OP_VECTOR2_NORMALIZE_R) && (i <= OP_VECTOR4_NORMALIZE_C)) {
+                m_CallTable[i] = &SoA_VirtualMachine::Execute_Normalize;
+            } else if ((i >= OP_ASSIGN_SCALAR_R) && (i <= OP_ASSIGN_VECTOR4_C)) {
+                m_CallTable[i] = &SoA_VirtualMachine::Execute_Assignment;
+            } else if ((i >= OP_CMP_GRT_RR) && (i <= OP_CMP_LEQ_CC)) {
+                m_CallTable[i] = &SoA_VirtualMachine::Execute_Comparison;
+            } else if ((i >= OP_COND_SCALAR_RR) && (i <= OP_COND_VECTOR4_CC)) {
+                m_CallTable[i] = &SoA_VirtualMachine::Execute_ConditionalAssignment;
+            } else if ((i >= OP_MIN_SCALAR_RR) && (i <= OP_MIN_VECTOR4_CC)) {
+                m_CallTable[i] = &SoA_VirtualMachine::Execute_Min;
+            } else if ((i >= OP_MAX_SCALAR_RR) && (i <= OP_MAX_VECTOR4_CC)) {
+                m_CallTable[i] = &SoA_VirtualMachine::Execute_Max;
+            } else if ((i >= OP_SAMPLE1D_R) && (i <= OP_SAMPLE3D_C)) {
+                m_CallTable[i] = &SoA_VirtualMachine::Execute_Sampler;
+            } else if ((i >= OP_FLOOR_SCALAR_R) && (i <= OP_FLOOR_VECTOR4_C)) {
+                m_CallTable[i] = &SoA_VirtualMachine::Execute_Floor;
+            } else if ((i >= OP_CEIL_SCALAR_R) && (i <= OP_CEIL_VECTOR4_C)) {
+                m_CallTable[i] = &SoA_VirtualMachine::Execute_Ceil;
+            }
+        }
+    }
+
+    /**
+     * SoA_VirtualMachine::Execute
+     * Executes the instruction in the stream on the Virtual Machine (VM). The stream must have
+     * been verified, so every opcode has a handler and every operand is within range.
+     */
+    Status_t SoA_VirtualMachine::Execute(vf::InstructionStream & stream, size_t batchSize, size_t batchOffset)
+    {
+        vf::Instruction_t instr;
+        while(stream.Decode(instr)) {
+            SoA_VirtualMachine::pInstrImpl_t methodPtr = m_CallTable[instr.Opcode];
+            Status_t err = (this->*methodPtr)(instr, stream, batchSize, batchOffset);
+            if (err != Err_Success) {
+                return err;
+            }
+        }
+        return Err_Success;
+    }
+
+    /*************************************************************************/
+    /*                                  Instructions                         */
+    /*************************************************************************/
+
+    /**
+     * Execute_Add
+     * Executes a addition bytecode instruction.
+     */
+    Status_t SoA_VirtualMachine::Execute_Add(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
+    {
+        uint8_t form;
+        size_t n = Decode_Type(ins.Opcode, OP_VECTOR2_ADD_RR, OP_VECTOR3_ADD_RR, OP_VECTOR4_ADD_RR, OP_SCALAR_ADD_RR, form);
+
+        float * dst[4];
+        SoA_Operand lhs, rhs;
+        Retrive_Destination(dst, ins.Dst, n, batchOffset);
+        Retrive_Operand(lhs, ins.Src1, (form == FORM_CR) || (form == FORM_CC), n, is, batchOffset);
+        Retrive_Operand(rhs, ins.Src2, (form == FORM_RC) || (form == FORM_CC), n, is, batchOffset);
+
+        Binary(m_Kernels->Binary[KERNEL_ADD], dst, lhs, rhs, n, batchSize);
+        return Err_Success;
+    }
+
+    /**
+     * Execute_Sub
+     * Executes a subtraction bytecode instruction.
+     */
+    Status_t SoA_VirtualMachine::Execute_Sub(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
+    {
+        uint8_t form;
+        size_t n = Decode_Type(ins.Opcode, OP_VECTOR2_SUB_RR, OP_VECTOR3_SUB_RR, OP_VECTOR4_SUB_RR, OP_SCALAR_SUB_RR, form);
+
+        float * dst[4];
+        SoA_Operand lhs, rhs;
+        Retrive_Destination(dst, ins.Dst, n, batchOffset);
+        Retrive_Operand(lhs, ins.Src1, (form == FORM_CR) || (form == FORM_CC), n, is, batchOffset);
+        Retrive_Operand(rhs, ins.Src2, (form == FORM_RC) || (form == FORM_CC), n, is, batchOffset);
+
+        Binary(m_Kernels->Binary[KERNEL_SUB], dst, lhs, rhs, n, batchSize);
+        return Err_Success;
+    }
+
+    /**
+     * Execute_Mul
+     * Multiplies a scalar or a vector with a scalar.
+     */
+    Status_t SoA_VirtualMachine::Execute_Mul(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
+    {
+        uint8_t form;
+        size_t n = Decode_Type(ins.Opcode, OP_VECTOR2_SCALAR_MUL_RR, OP_VECTOR3_SCALAR_MUL_RR, OP_VECTOR4_SCALAR_MUL_RR,
+            OP_SCALAR_MUL_RR, form);
+
+        float * dst[4];
+        SoA_Operand lhs, rhs;
+        Retrive_Destination(dst, ins.Dst, n, batchOffset);
+        Retrive_Operand(lhs, ins.Src1, (form == FORM_CR) || (form == FORM_CC), n, is, batchOffset);
+        Retrive_Operand(rhs, ins.Src2, (form == FORM_RC) || (form == FORM_CC), 1, is, batchOffset);
+
+        Binary(m_Kernels->Binary[KERNEL_MUL], dst, lhs, rhs, n, batchSize);
+        return Err_Success;
+    }
+
+    /**
+     * Execute_Div
+     * Divides a scalar or a vector with a scalar.
+     */
+    Status_t SoA_VirtualMachine::Execute_Div(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
+    {
+        uint8_t form;
+        size_t n = Decode_Type(ins.Opcode, OP_VECTOR2_SCALAR_DIV_RR, OP_VECTOR3_SCALAR_DIV_RR, OP_VECTOR4_SCALAR_DIV_RR,
+            OP_SCALAR_DIV_RR, form);
+
+        float * dst[4];
+        SoA_Operand lhs, rhs;
+        Retrive_Destination(dst, ins.Dst, n, batchOffset);
+        Retrive_Operand(lhs, ins.Src1, (form == FORM_CR) || (form == FORM_CC), n, is, batchOffset);
+        Retrive_Operand(rhs, ins.Src2, (form == FORM_RC) || (form == FORM_CC), 1, is, batchOffset);
+
+        Binary(m_Kernels->Binary[KERNEL_DIV], dst, lhs, rhs, n, batchSize);
+        return Err_Success;
+    }
+
+    /**
+     * Execute_Min
+     * Executes a min() instruction.
+     */
+    Status_t SoA_VirtualMachine::Execute_Min(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
+    {
+        uint8_t form;
+        size_t n = Decode_Type(ins.Opcode, OP_MIN_VECTOR2_RR, OP_MIN_VECTOR3_RR, OP_MIN_VECTOR4_RR, OP_MIN_SCALAR_RR, form);
+
+        float * dst[4];
+        SoA_Operand lhs, rhs;
+        Retrive_Destination(dst, ins.Dst, n, batchOffset);
+        Retrive_Operand(lhs, ins.Src1, (form == FORM_CR) || (form == FORM_CC), n, is, batchOffset);
+        Retrive_Operand(rhs, ins.Src2, (form == FORM_RC) || (form == FORM_CC), n, is, batchOffset);
+
+        Binary(m_Kernels->Binary[KERNEL_MIN], dst, lhs, rhs, n, batchSize);
+        return Err_Success;
+    }
+
+    /**
+     * Execute_Max
+     * Executes a max() instruction.
+     */
+    Status_t SoA_VirtualMachine::Execute_Max(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
+    {
+        uint8_t form;
+        size_t n = Decode_Type(ins.Opcode, OP_MAX_VECTOR2_RR, OP_MAX_VECTOR3_RR, OP_MAX_VECTOR4_RR, OP_MAX_SCALAR_RR, form);
+
+        float * dst[4];
+        SoA_Operand lhs, rhs;
+        Retrive_Destination(dst, ins.Dst, n, batchOffset);
+        Retrive_Operand(lhs, ins.Src1, (form == FORM_CR) || (form == FORM_CC), n, is, batchOffset);
+        Retrive_Operand(rhs, ins.Src2, (form == FORM_RC) || (form == FORM_CC), n, is, batchOffset);
+
+        Binary(m_Kernels->Binary[KERNEL_MAX], dst, lhs, rhs, n, batchSize);
+        return Err_Success;
+    }
+
+    /**
+     * Execute_Negate
+     * Executes a negation bytecode instruction.
+     */
+    Status_t SoA_VirtualMachine::Execute_Negate(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
+    {
+        size_t n;
+        bool isconst;
+        switch(ins.Opcode) {
+        case OP_SCALAR_NEGATE_R:    n = 1; isconst = false; break;
+        case OP_SCALAR_NEGATE_C:    n = 1; isconst = true; break;
+        case OP_VECTOR2_NEGATE_R:   n = 2; isconst = false; break;
+        case OP_VECTOR2_NEGATE_C:   n = 2; isconst = true; break;
+        case OP_VECTOR3_NEGATE_R:   n = 3; isconst = false; break;
+        case OP_VECTOR3_NEGATE_C:   n = 3; isconst = true; break;
+        case OP_VECTOR4_NEGATE_R:   n = 4; isconst = false; break;
+        case OP_VECTOR4_NEGATE_C:   n = 4; isconst = true; break;
+        default:
+            return Err_InvalidBytecode;
+        }
+
+        float * dst[4];
+        SoA_Operand src;
+        Retrive_Destination(dst, ins.Dst, n, batchOffset);
+        Retrive_Operand(src, ins.Src1, isconst, n, is, batchOffset);
+
+        Unary(m_Kernels->Unary[KERNEL_NEGATE], dst, src, n, batchSize);
+        return Err_Success;
+    }
+
+    /**
+     * Execute_Trigonometric
+     * Executes a sin(), cos(), tan(), asin(), acos() or atan() instruction.
+     */
+    Status_t SoA_VirtualMachine::Execute_Trigonometric(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
+    {
+        float * dst[4];
+        SoA_Operand src;
+        bool isconst = (ins.Opcode == OP_SINE_C) || (ins.Opcode == OP_COSINE_C) || (ins.Opcode == OP_TANGENT_C) ||
+            (ins.Opcode == OP_ARCSINE_C) || (ins.Opcode == OP_ARCCOSINE_C) || (ins.Opcode == OP_ARCTANGENT_C);
+
+        Retrive_Destination(dst, ins.Dst, 1, batchOffset);
+        Retrive_Operand(src, ins.Src1, isconst, 1, is, batchOffset);
+
+        switch(ins.Opcode) {
+        case OP_SINE_R:
+        case OP_SINE_C:         Unary(m_Kernels->Unary[KERNEL_SINE], dst, src, 1, batchSize); break;
+        case OP_COSINE_R:
+        case OP_COSINE_C:       Unary(m_Kernels->Unary[KERNEL_COSINE], dst, src, 1, batchSize); break;
+        case OP_TANGENT_R:
+        case OP_TANGENT_C:      Unary(m_Kernels->Unary[KERNEL_TANGENT], dst, src, 1, batchSize); break;
+        case OP_ARCSINE_R:
+        case OP_ARCSINE_C:      Unary(m_Kernels->Unary[KERNEL_ARCSINE], dst, src, 1, batchSize); break;
+        case OP_ARCCOSINE_R:
+        case OP_ARCCOSINE_C:    Unary(m_Kernels->Unary[KERNEL_ARCCOSINE], dst, src, 1, batchSize); break;
+        case OP_ARCTANGENT_R:
+        case OP_ARCTANGENT_C:   Unary(m_Kernels->Unary[KERNEL_ARCTANGENT], dst, src, 1, batchSize); break;
+        default:
+            return Err_InvalidBytecode;
+        }
+        return Err_Success;
+    }
+
+    /**
+     * Execute_Sqrt
+     * Executes a sqrt or invsqrt instruction.
+     */
+    Status_t SoA_VirtualMachine::Execute_Sqrt(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
+    {
+        float * dst[4];
+        SoA_Operand src;
+        bool isconst = (ins.Opcode == OP_SQRT_C) || (ins.Opcode == OP_INVSQRT_C);
+
+        Retrive_Destination(dst, ins.Dst, 1, batchOffset);
+        Retrive_Operand(src, ins.Src1, isconst, 1, is, batchOffset);
+
+        switch(ins.Opcode) {
+        case OP_SQRT_R:
+        case OP_SQRT_C:         Unary(m_Kernels->Unary[KERNEL_SQRT], dst, src, 1, batchSize); break;
+        case OP_INVSQRT_R:
+        case OP_INVSQRT_C:      Unary(m_Kernels->Unary[KERNEL_INVSQRT], dst, src, 1, batchSize); break;
+        default:
+            return Err_InvalidBytecode;
+        }
+        return Err_Success;
+    }
+
+    /**
+     * Execute_Floor, executes a floor() instruction.
+     */
+    Status_t SoA_VirtualMachine::Execute_Floor(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
+    {
+        size_t n;
+        bool isconst;
+        switch(ins.Opcode) {
+        case OP_FLOOR_SCALAR_R:     n = 1; isconst = false; break;
+        case OP_FLOOR_SCALAR_C:     n = 1; isconst = true; break;
+        case OP_FLOOR_VECTOR2_R:    n = 2; isconst = false; break;
+        case OP_FLOOR_VECTOR2_C:    n = 2; isconst = true; break;
+        case OP_FLOOR_VECTOR3_R:    n = 3; isconst = false; break;
+        case OP_FLOOR_VECTOR3_C:    n = 3; isconst = true; break;
+        case OP_FLOOR_VECTOR4_R:    n = 4; isconst = false; break;
+        case OP_FLOOR_VECTOR4_C:    n = 4; isconst = true; break;
+        default:
+            return Err_InvalidBytecode;
+        }
+
+        float * dst[4];
+        SoA_Operand src;
+        Retrive_Destination(dst, ins.Dst, n, batchOffset);
+        Retrive_Operand(src, ins.Src1, isconst, n, is, batchOffset);
+
+        Unary(m_Kernels->Unary[KERNEL_FLOOR], dst, src, n, batchSize);
+        return Err_Success;
+    }
+
+    /**
+     * Execute_Ceil, executes a ceil() instruction.
+     */
+    Status_t SoA_VirtualMachine::Execute_Ceil(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
+    {
+        size_t n;
+        bool isconst;
+        switch(ins.Opcode) {
+        case OP_CEIL_SCALAR_R:      n = 1; isconst = false; break;
+        case OP_CEIL_SCALAR_C:      n = 1; isconst = true; break;
+        case OP_CEIL_VECTOR2_R:     n = 2; isconst = false; break;
+        case OP_CEIL_VECTOR2_C:     n = 2; isconst = true; break;
+        case OP_CEIL_VECTOR3_R:     n = 3; isconst = false; break;
+        case OP_CEIL_VECTOR3_C:     n = 3; isconst = true; break;
+        case OP_CEIL_VECTOR4_R:     n = 4; isconst = false; break;
+        case OP_CEIL_VECTOR4_C:     n = 4; isconst = true; break;
+        default:
+            return Err_InvalidBytecode;
+        }
+
+        float * dst[4];
+        SoA_Operand src;
+        Retrive_Destination(dst, ins.Dst, n, batchOffset);
+        Retrive_Operand(src, ins.Src1, isconst, n, is, batchOffset);
+
+        Unary(m_Kernels->Unary[KERNEL_CEIL], dst, src, n, batchSize);
+        return Err_Success;
+    }
+
+    /**
+     * Execute_Assignment. Executes a assignment bytecode instruction.
+     */
+    Status_t SoA_VirtualMachine::Execute_Assignment(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
+    {
+        size_t n;
+        bool isconst;
+        switch(ins.Opcode) {
+        case OP_ASSIGN_SCALAR_R:    n = 1; isconst = false; break;
+        case OP_ASSIGN_SCALAR_C:    n = 1; isconst = true; break;
+        case OP_ASSIGN_VECTOR2_R:   n = 2; isconst = false; break;
+        case OP_ASSIGN_VECTOR2_C:   n = 2; isconst = true; break;
+        case OP_ASSIGN_VECTOR3_R:   n = 3; isconst = false; break;
+        case OP_ASSIGN_VECTOR3_C:   n = 3; isconst = true; break;
+        case OP_ASSIGN_VECTOR4_R:   n = 4; isconst = false; break;
+        case OP_ASSIGN_VECTOR4_C:   n = 4; isconst = true; break;
+        default:
+            return Err_InvalidBytecode;
+        }
+
+        float * dst[4];
+        SoA_Operand src;
+        Retrive_Destination(dst, ins.Dst, n, batchOffset);
+        Retrive_Operand(src, ins.Src1, isconst, n, is, batchOffset);
+
+        Unary(m_Kernels->Unary[KERNEL_COPY], dst, src, n, batchSize);
+        return Err_Success;
+    }
+
+    /**
+     * Execute_Dot - Dot-product.
+     */
+    Status_t SoA_VirtualMachine::Execute_Dot(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
+    {
+        uint8_t form;
+        size_t n = Decode_Type(ins.Opcode, OP_DOT_VECTOR2_RR, OP_DOT_VECTOR3_RR, OP_DOT_VECTOR4_RR, OP_DOT_VECTOR2_RR, form);
+
+        float * dst[4];
+        SoA_Operand lhs, rhs;
+        Retrive_Destination(dst, ins.Dst, 1, batchOffset);
+        Retrive_Operand(lhs, ins.Src1, (form == FORM_CR) || (form == FORM_CC), n, is, batchOffset);
+        Retrive_Operand(rhs, ins.Src2, (form == FORM_RC) || (form == FORM_CC), n, is, batchOffset);
+
+        float * pDst = dst[0];
+        if (lhs.isconst && rhs.isconst) {
+            Fill(pDst, Dot(lhs, rhs, n, 0), batchSize);
+        } else {
+            for(size_t i = 0; i < batchSize; ++i) {
+                pDst[i] = Dot(lhs, rhs, n, i);
+            }
+        }
+        return Err_Success;
+    }
+
+    /**
+     * Execute_Length
+     * Executes a length bytecode instruction.
+     */
+    Status_t SoA_VirtualMachine::Execute_Length(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
+    {
+        size_t n;
+        bool isconst;
+        switch(ins.Opcode) {
+        case OP_LENGTH_VECTOR2_R:   n = 2; isconst = false; break;
+        case OP_LENGTH_VECTOR2_C:   n = 2; isconst = true; break;
+        case OP_LENGTH_VECTOR3_R:   n = 3; isconst = false; break;
+        case OP_LENGTH_VECTOR3_C:   n = 3; isconst = true; break;
+        case OP_LENGTH_VECTOR4_R:   n = 4; isconst = false; break;
+        case OP_LENGTH_VECTOR4_C:   n = 4; isconst = true; break;
+        default:
+            return Err_InvalidBytecode;
+        }
+
+        float * dst[4];
+        SoA_Operand src;
+        Retrive_Destination(dst, ins.Dst, 1, batchOffset);
+        Retrive_Operand(src, ins.Src1, isconst, n, is, batchOffset);
+
+        float * pDst = dst[0];
+        if (src.isconst) {
+            Fill(pDst, sqrtf(Dot(src, src, n, 0)), batchSize);
+        } else {
+            for(size_t i = 0; i < batchSize; ++i) {
+                pDst[i] = sqrtf(Dot(src, src, n, i));
+            }
+        }
+        return Err_Success;
+    }
+
+    /**
+     * Execute_Normalize
+     * Executes a normalize instruction.
+     */
+    Status_t SoA_VirtualMachine::Execute_Normalize(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
+    {
+        size_t n;
+        bool isconst;
+        switch(ins.Opcode) {
+        case OP_VECTOR2_NORMALIZE_R:    n = 2; isconst = false; break;
+        case OP_VECTOR2_NORMALIZE_C:    n = 2; isconst = true; break;
+        case OP_VECTOR3_NORMALIZE_R:    n = 3; isconst = false; break;
+        case OP_VECTOR3_NORMALIZE_C:    n = 3; isconst = true; break;
+        case OP_VECTOR4_NORMALIZE_R:    n = 4; isconst = false; break;
+        case OP_VECTOR4_NORMALIZE_C:    n = 4; isconst = true; break;
+        default:
+            return Err_InvalidBytecode;
+        }
+
+        float * dst[4];
+        SoA_Operand src;
+        Retrive_Destination(dst, ins.Dst, n, batchOffset);
+        Retrive_Operand(src, ins.Src1, isconst, n, is, batchOffset);
+
+        if (src.isconst) {
+            float scale = 1.0f / sqrtf(Dot(src, src, n, 0));
+            for(size_t c = 0; c < n; ++c) {
+                Fill(dst[c], src.value[c] * scale, batchSize);
+            }
+        } else {
+            for(size_t i = 0; i < batchSize; ++i) {
+                float scale = 1.0f / sqrtf(Dot(src, src, n, i));
+                for(size_t c = 0; c < n; ++c) {
+                    dst[c][i] = src.plane[c][i] * scale;
+                }
+            }
+        }
+        return Err_Success;
+    }
+
+    /**
+     * Execute_Cross - Executes a cross() virtual machine instruction.
+     */
+    Status_t SoA_VirtualMachine::Execute_Cross(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
+    {
+        uint8_t form = static_cast<uint8_t>(ins.Opcode - OP_CROSS_RR);
+
+        float * dst[4];
+        SoA_Operand lhs, rhs;
+        Retrive_Destination(dst, ins.Dst, 3, batchOffset);
+        Retrive_Operand(lhs, ins.Src1, (form == FORM_CR) || (form == FORM_CC), 3, is, batchOffset);
+        Retrive_Operand(rhs, ins.Src2, (form == FORM_RC) || (form == FORM_CC), 3, is, batchOffset);
+
+        size_t count = (lhs.isconst && rhs.isconst) ? 1 : batchSize;
+        for(size_t i = 0; i < count; ++i) {
+            float a[3], b[3];
+            for(size_t c = 0; c < 3; ++c) {
+                a[c] = lhs.isconst ? lhs.value[c] : lhs.plane[c][i];
+                b[c] = rhs.isconst ? rhs.value[c] : rhs.plane[c][i];
+            }
+            dst[0][i] = a[1] * b[2] - a[2] * b[1];
+            dst[1][i] = a[2] * b[0] - a[0] * b[2];
+            dst[2][i] = a[0] * b[1] - a[1] * b[0];
+        }
+        if (count == 1) {
+            for(size_t c = 0; c < 3; ++c) {
+                Fill(dst[c], dst[c][0], batchSize);
+            }
+        }
+        return Err_Success;
+    }
+
+    /**
+     * Execute bytecode instructions for comparing scalar values.
+     */
+    Status_t SoA_VirtualMachine::Execute_Comparison(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
+    {
+        uint8_t form;
+        uint8_t * flags = GetFlags();
+        if (ins.Opcode >= OP_CMP_LEQ_RR) {
+            form = ins.Opcode - OP_CMP_LEQ_RR;
+        } else if (ins.Opcode >= OP_CMP_GEQ_RR) {
+            form = ins.Opcode - OP_CMP_GEQ_RR;
+        } else if (ins.Opcode >= OP_CMP_EQ_RR) {
+            form = ins.Opcode - OP_CMP_EQ_RR;
+        } else if (ins.Opcode >= OP_CMP_LE_RR) {
+            form = ins.Opcode - OP_CMP_LE_RR;
+        } else {
+            form = ins.Opcode - OP_CMP_GRT_RR;
+        }
+
+        SoA_Operand lhs, rhs;
+        Retrive_Operand(lhs, ins.Src1, (form == FORM_CR) || (form == FORM_CC), 1, is, batchOffset);
+        Retrive_Operand(rhs, ins.Src2, (form == FORM_RC) || (form == FORM_CC), 1, is, batchOffset);
+
+        if (ins.Opcode >= OP_CMP_LEQ_RR) {
+            Compare<Op_LessEqual>(flags, lhs, rhs, batchSize);
+        } else if (ins.Opcode >= OP_CMP_GEQ_RR) {
+            Compare<Op_GreaterEqual>(flags, lhs, rhs, batchSize);
+        } else if (ins.Opcode >= OP_CMP_EQ_RR) {
+            Compare<Op_Equal>(flags, lhs, rhs, batchSize);
+        } else if (ins.Opcode >= OP_CMP_LE_RR) {
+            Compare<Op_Less>(flags, lhs, rhs, batchSize);
+        } else {
+            Compare<Op_Greater>(flags, lhs, rhs, batchSize);
+        }
+        return Err_Success;
+    }
+
+    /**
+     * Execute_ConditionalAssignment. Exectutes a conditional assignment bytecode instruction.
+     */
+    Status_t SoA_VirtualMachine::Execute_ConditionalAssignment(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
+    {
+        uint8_t form;
+        const uint8_t * flags = GetFlags();
+        size_t n = Decode_Type(ins.Opcode, OP_COND_VECTOR2_RR, OP_COND_VECTOR3_RR, OP_COND_VECTOR4_RR, OP_COND_SCALAR_RR, form);
+
+        float * dst[4];
+        SoA_Operand lhs, rhs;
+        Retrive_Destination(dst, ins.Dst, n, batchOffset);
+        Retrive_Operand(lhs, ins.Src1, (form == FORM_CR) || (form == FORM_CC), n, is, batchOffset);
+        Retrive_Operand(rhs, ins.Src2, (form == FORM_RC) || (form == FORM_CC), n, is, batchOffset);
+
+        for(size_t c = 0; c < n; ++c) {
+            float * pDst = dst[c];
+            for(size_t i = 0; i < batchSize; ++i) {
+                float l = lhs.isconst ? lhs.value[c] : lhs.plane[c][i];
+                float r = rhs.isconst ? rhs.value[c] : rhs.plane[c][i];
+                pDst[i] = ((flags[i / 8] >> (i % 8)) & 1) ? l : r;
+            }
+        }
+        return Err_Success;
+    }
+
+    /**
+     * Executes a sample1D(), sample2D() or a sample3D() bytecode instruction. The sampler interface
+     * works on packed vectors, so the positions are gathered into a temporary buffer and the result
+     * is scattered back to the planes of the destination register.
+     */
+    Status_t SoA_VirtualMachine::Execute_Sampler(const Instruction_t & ins, InstructionStream & is, size_t batchSize, size_t batchOffset)
+    {
+        size_t n;
+        bool isconst;
+        switch(ins.Opcode) {
+        case OP_SAMPLE1D_R: n = 1; isconst = false; break;
+        case OP_SAMPLE1D_C: n = 1; isconst = true; break;
+        case OP_SAMPLE2D_R: n = 2; isconst = false; break;
+        case OP_SAMPLE2D_C: n = 2; isconst = true; break;
+        case OP_SAMPLE3D_R: n = 3; isconst = false; break;
+        case OP_SAMPLE3D_C: n = 3; isconst = true; break;
+        default:
+            return Err_InvalidBytecode;
+        }
+
+        float * dst[4];
+        SoA_Operand pos;
+        const vf::ISampler * sampler = GetSampler(ins.Src1);
+        Retrive_Destination(dst, ins.Dst, 4, batchOffset);
+        Retrive_Operand(pos, ins.Src2, isconst, n, is, batchOffset);
+
+        if (m_SampleBuffer.size() < (batchSize * 2)) {
+            m_SampleBuffer.resize(batchSize * 2);
+        }
+        Vector * pResult = &m_SampleBuffer[0];
+        Vector * pPos    = &m_SampleBuffer[batchSize];
+
+        bool success;
+        if (pos.isconst) {
+            switch(n) {
+            case 1:     success = sampler->sample1D(pos.value[0], pResult, batchSize); break;
+            case 2:     success = sampler->sample2D(*reinterpret_cast<const Vector2 *>(pos.value), pResult, batchSize); break;
+            default:    success = sampler->sample3D(*reinterpret_cast<const Vector3 *>(pos.value), pResult, batchSize); break;
+            }
+        } else {
+            for(size_t i = 0; i < batchSize; ++i) {
+                for(size_t c = 0; c < n; ++c) {
+                    pPos[i][c] = pos.plane[c][i];
+                }
+            }
+            switch(n) {
+            case 1:     success = sampler->sample1D(pPos, pResult, batchSize); break;
+            case 2:     success = sampler->sample2D(pPos, pResult, batchSize); break;
+            default:    success = sampler->sample3D(pPos, pResult, batchSize); break;
+            }
+        }
+        if (!success) {
+            return Err_SamplingFailed;
+        }
+
+        for(size_t c = 0; c < 4; ++c) {
+            float * pDst = dst[c];
+            for(size_t i = 0; i < batchSize; ++i) {
+                pDst[i] = pResult[i][c];
+            }
+        }
+        return Err_Success;
+    }
+}
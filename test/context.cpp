@@ -0,0 +1,154 @@
+#include <intermediate.hpp>
+#include <gtest\gtest.h>
+#include <memory>
+#include <cstring>
+#include <thread>
+
+using namespace vf;
+
+/*****************************************************************************/
+/*                                      Utility                              */
+/*****************************************************************************/
+
+static std::shared_ptr<vf::ByteCode> Compile(const char * pSource)
+{
+    std::shared_ptr<vf::Program>    pProgram;
+    EXPECT_NO_THROW(pProgram = std::make_shared<vf::Program>(pSource));
+    return pProgram->Compile();
+}
+
+static const size_t NumElements = 10007;
+
+static const char * pSource =
+    "in vec4        a;"
+    "uniform vec4   u;"
+    "out vec4       c;"
+    "void main()"
+    "{"
+    "   c = a * length(u) + normalize(u) * dot(a, a);"
+    "}";
+
+static void Initialize(std::vector<vf::Vector4> & a, std::vector<vf::Vector4> & c)
+{
+    a.resize(NumElements);
+    c.resize(NumElements);
+    for(size_t i = 0; i < NumElements; ++i) {
+        a[i].x = float(i % 11) * 0.5f - 2.0f;
+        a[i].y = float(i % 7) + 0.25f;
+        a[i].z = -float(i % 3);
+        a[i].w = 1.0f;
+        c[i].x = c[i].y = c[i].z = c[i].w = 0.0f;
+    }
+}
+
+static vf::Vector4 Uniform()
+{
+    vf::Vector4 u;
+    u.x = 1.0f;
+    u.y = -2.0f;
+    u.z = 0.5f;
+    u.w = 3.0f;
+    return u;
+}
+
+/** Executes the program with a ByteCode_Execution, which is the expected result */
+static std::vector<vf::Vector4> Execute(std::shared_ptr<vf::ByteCode> bc, vf::Engine_t engine)
+{
+    std::vector<vf::Vector4> a, c;
+    Initialize(a, c);
+    uint8_t mem[1024];
+    vf::ByteCode_Execution be(bc, mem, sizeof(mem), vf::Layout_AoS, engine);
+    be.SetRegisterPointer(bc->StreamLocation("a"), (float *) &a[0]);
+    be.SetRegisterPointer(bc->StreamLocation("c"), (float *) &c[0]);
+    be.SetUniform(bc->UniformLocation("u"), Uniform());
+    EXPECT_EQ(be.Execute(0, NumElements), vf::Err_Success);
+    return c;
+}
+
+/*****************************************************************************/
+/*                                      Context                              */
+/*****************************************************************************/
+
+/**
+ * Each thread executes a part of the elements with a context of its own, created from a
+ * program that is shared by all threads.
+ */
+TEST(Context, SharedProgram)
+{
+    std::shared_ptr<vf::ByteCode> bc = Compile(pSource);
+    ASSERT_NE(bc, nullptr);
+
+    for(size_t engine = 0; engine < 2; ++engine) {
+        std::vector<vf::Vector4> expected = Execute(bc, vf::Engine_t(engine));
+        std::vector<vf::Vector4> a, c;
+        Initialize(a, c);
+
+        vf::ByteCode_Program program(bc, vf::Engine_t(engine));
+        const size_t NumThreads = 4;
+        vf::Status_t status[NumThreads];
+        std::vector<std::thread> threads;
+        for(size_t i = 0; i < NumThreads; ++i) {
+            threads.push_back(std::thread([&, i]() {
+                std::shared_ptr<vf::ByteCode_Context> context = program.CreateContext();
+                context->SetRegisterPointer(bc->StreamLocation("a"), (float *) &a[0]);
+                context->SetRegisterPointer(bc->StreamLocation("c"), (float *) &c[0]);
+                context->SetUniform(bc->UniformLocation("u"), Uniform());
+                size_t begin = (NumElements * i) / NumThreads, end = (NumElements * (i + 1)) / NumThreads;
+                status[i] = context->Execute(0, begin, end - begin);
+            }));
+        }
+        for(size_t i = 0; i < NumThreads; ++i) {
+            threads[i].join();
+            EXPECT_EQ(status[i], vf::Err_Success);
+        }
+        EXPECT_EQ(memcmp(&expected[0], &c[0], NumElements * sizeof(vf::Vector4)), 0) << "engine " << engine;
+    }
+}
+
+/**
+ * A context that is released is handed out again, with nothing bound.
+ */
+TEST(Context, Reuse)
+{
+    std::shared_ptr<vf::ByteCode> bc = Compile(pSource);
+    ASSERT_NE(bc, nullptr);
+
+    std::vector<vf::Vector4> a, c;
+    Initialize(a, c);
+    vf::ByteCode_Program program(bc);
+    std::shared_ptr<vf::ByteCode_Context> context = program.CreateContext();
+    vf::ByteCode_Context * first = context.get();
+    context->SetRegisterPointer(bc->StreamLocation("a"), (float *) &a[0]);
+    context->SetRegisterPointer(bc->StreamLocation("c"), (float *) &c[0]);
+    EXPECT_EQ(context->Execute(0, 0, NumElements), vf::Err_Success);
+    EXPECT_EQ(context->Execute(1, 0, NumElements), vf::Err_InvalidIndex);
+    EXPECT_EQ(context->SetRegisterPointer(100, &a[0]), vf::Err_InvalidRegister);
+
+    context.reset();
+    context = program.CreateContext();
+    EXPECT_EQ(context.get(), first);
+    EXPECT_EQ(context->Execute(0, 0, NumElements), vf::Err_UnassignedRegisterPointer);
+}
+
+/**
+ * A context keeps the program alive.
+ */
+TEST(Context, OutlivesProgram)
+{
+    std::shared_ptr<vf::ByteCode> bc = Compile(pSource);
+    ASSERT_NE(bc, nullptr);
+
+    std::vector<vf::Vector4> expected = Execute(bc, vf::Engine_Interpreter);
+    std::vector<vf::Vector4> a, c;
+    Initialize(a, c);
+    std::shared_ptr<vf::ByteCode_Context> context;
+    {
+        vf::ByteCode_Program program(bc);
+        context = program.CreateContext();
+    }
+    context->SetRegisterPointer(bc->StreamLocation("a"), (float *) &a[0]);
+    context->SetRegisterPointer(bc->StreamLocation("c"), (float *) &c[0]);
+    context->SetUniform(bc->UniformLocation("u"), Uniform());
+    EXPECT_EQ(context->Execute(0, 0, NumElements), vf::Err_Success);
+    EXPECT_EQ(memcmp(&expected[0], &c[0], NumElements * sizeof(vf::Vector4)), 0);
+}
@@ -0,0 +1,236 @@
+#include <intermediate.hpp>
+#include <gtest\gtest.h>
+#include <memory>
+#include <cmath>
+
+using namespace vf;
+
+/*****************************************************************************/
+/*                                      Utility                              */
+/*****************************************************************************/
+
+static std::shared_ptr<vf::ByteCode> Compile(const char * pSource)
+{
+    std::shared_ptr<vf::Program>    pProgram;
+    EXPECT_NO_THROW(pProgram = std::make_shared<vf::Program>(pSource));
+    return pProgram->Compile();
+}
+
+static const size_t NumElements = 300;    /**< more than one block of a compare-select */
+
+static vf::Vector4 Input_A(size_t i)
+{
+    vf::Vector4 v;
+    v.x = float(i % 11) * 0.5f - 2.0f;
+    v.y = float(i % 5) + 0.25f;
+    v.z = -float(i % 3) - 1.0f;
+    v.w = 2.0f;
+    return v;
+}
+
+static vf::Vector4 Input_B(size_t i)
+{
+    vf::Vector4 v;
+    v.x = float(i % 7) - 3.5f;
+    v.y = 1.0f / float(i + 1);
+    v.z = float(i % 13) * 0.125f;
+    v.w = -1.5f;
+    return v;
+}
+
+/**
+ * Executes a program with the streams a, b (inputs) and c (output) on the interpreter, which
+ * executes the fused plan, and compares the output with the expected function. The output
+ * initially holds b, which is what a accumulated output is added to. The plan is executed with
+ * each kind of dispatch that the build supports.
+ */
+template<class F>
+static void ExpectResult(const char * pSource, F expected)
+{
+    std::shared_ptr<vf::ByteCode> bc = Compile(pSource);
+    ASSERT_NE(bc, nullptr);
+
+    const vf::Dispatch_t Dispatches[] = { vf::Dispatch_Threaded, vf::Dispatch_Switch };
+    for(size_t d = 0; d < 2; ++d) {
+        std::vector<vf::Vector4> a(NumElements), b(NumElements), c(NumElements);
+        for(size_t i = 0; i < NumElements; ++i) {
+            a[i] = Input_A(i);
+            b[i] = Input_B(i);
+            c[i] = Input_B(i);
+        }
+
+        std::vector<uint8_t> mem(64 * 1024);
+        vf::ByteCode_Execution be(bc, &mem[0], mem.size(), vf::Layout_AoS, vf::Engine_Interpreter);
+        if (be.SetDispatch(Dispatches[d]) != vf::Err_Success) {
+            continue;
+        }
+        be.SetRegisterPointer(bc->StreamLocation("a"), (float *) &a[0]);
+        be.SetRegisterPointer(bc->StreamLocation("b"), (float *) &b[0]);
+        be.SetRegisterPointer(bc->StreamLocation("c"), (float *) &c[0]);
+        EXPECT_EQ(be.Execute(0, NumElements), vf::Err_Success);
+
+        for(size_t i = 0; i < NumElements; ++i) {
+            vf::Vector4 value = expected(a[i], b[i]);
+            const float * e = &value.x;
+            const float * r = &c[i].x;
+            for(size_t k = 0; k < 4; ++k) {
+                EXPECT_NEAR(e[k], r[k], 1e-4f * (1.0f + fabsf(e[k]))) << "dispatch " << d << ", element " << i <<
+                    ", component " << k;
+            }
+        }
+    }
+}
+
+static vf::Vector4 Make(float x, float y, float z, float w)
+{
+    vf::Vector4 v;
+    v.x = x; v.y = y; v.z = z; v.w = w;
+    return v;
+}
+
+/*****************************************************************************/
+/*                                      Fusion                               */
+/*****************************************************************************/
+
+TEST(Fusion, MultiplyAdd)
+{
+    ExpectResult(
+        "in vec4    a;"
+        "in vec4    b;"
+        "out vec4   c;"
+        "void main()"
+        "{"
+        "   c = b - (a * a.y + b) * 0.5 + b * (a.x * b.y + a.z);"
+        "}",
+        [](const vf::Vector4 & a, const vf::Vector4 & b) {
+            float s = a.x * b.y + a.z;
+            return Make(b.x - (a.x * a.y + b.x) * 0.5f + b.x * s, b.y - (a.y * a.y + b.y) * 0.5f + b.y * s,
+                b.z - (a.z * a.y + b.z) * 0.5f + b.z * s, b.w - (a.w * a.y + b.w) * 0.5f + b.w * s);
+        });
+}
+
+TEST(Fusion, HorizontalOperations)
+{
+    ExpectResult(
+        "in vec4    a;"
+        "in vec4    b;"
+        "out vec4   c;"
+        "void main()"
+        "{"
+        "   c = normalize(a) * b.y + b * length(a - b) + a * sqrt(dot(a, a));"
+        "}",
+        [](const vf::Vector4 & a, const vf::Vector4 & b) {
+            float la = sqrtf(a.x * a.x + a.y * a.y + a.z * a.z + a.w * a.w);
+            float dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z, dw = a.w - b.w;
+            float ld = sqrtf(dx * dx + dy * dy + dz * dz + dw * dw);
+            return Make(a.x / la * b.y + b.x * ld + a.x * la, a.y / la * b.y + b.y * ld + a.y * la,
+                a.z / la * b.y + b.z * ld + a.z * la, a.w / la * b.y + b.w * ld + a.w * la);
+        });
+}
+
+TEST(Fusion, CompareSelect)
+{
+    ExpectResult(
+        "in vec4    a;"
+        "in vec4    b;"
+        "out vec4   c;"
+        "void main()"
+        "{"
+        "   c = a.x > b.x ? a * 2.0 : b;"
+        "}",
+        [](const vf::Vector4 & a, const vf::Vector4 & b) {
+            return (a.x > b.x) ? Make(a.x * 2.0f, a.y * 2.0f, a.z * 2.0f, a.w * 2.0f) : b;
+        });
+}
+
+TEST(Fusion, Accumulate)
+{
+    ExpectResult(
+        "in vec4                a;"
+        "in vec4                b;"
+        "out accumulate vec4    c;"
+        "void main()"
+        "{"
+        "   c = normalize(a);"
+        "}",
+        [](const vf::Vector4 & a, const vf::Vector4 & b) {
+            float la = sqrtf(a.x * a.x + a.y * a.y + a.z * a.z + a.w * a.w);
+            return Make(b.x + a.x / la, b.y + a.y / la, b.z + a.z / la, b.w + a.w / la);
+        });
+    ExpectResult(
+        "in vec4                a;"
+        "in vec4                b;"
+        "out accumulate vec4    c;"
+        "void main()"
+        "{"
+        "   c = a - b;"
+        "}",
+        [](const vf::Vector4 & a, const vf::Vector4 & b) {
+            return Make(a.x, a.y, a.z, a.w);
+        });
+}
+
+/*****************************************************************************/
+/*                                      Branches                             */
+/*****************************************************************************/
+
+TEST(Branches, CoherentPredicate)
+{
+    // a.w is 2 and b.w is -1.5 for every element, so only one alternative is executed.
+    ExpectResult(
+        "in vec4    a;"
+        "in vec4    b;"
+        "out vec4   c;"
+        "void main()"
+        "{"
+        "   c = a.w > 0.0 ? a + b : normalize(b) * a.x;"
+        "}",
+        [](const vf::Vector4 & a, const vf::Vector4 & b) {
+            return Make(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w);
+        });
+    ExpectResult(
+        "in vec4    a;"
+        "in vec4    b;"
+        "out vec4   c;"
+        "void main()"
+        "{"
+        "   c = b.w > 0.0 ? normalize(b) * a.x : a - b;"
+        "}",
+        [](const vf::Vector4 & a, const vf::Vector4 & b) {
+            return Make(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w);
+        });
+}
+
+TEST(Branches, MixedPredicate)
+{
+    // the assignment reads the predicate of the branch step, which selects both alternatives.
+    ExpectResult(
+        "in vec4    a;"
+        "in vec4    b;"
+        "out vec4   c;"
+        "void main()"
+        "{"
+        "   c = a.x > b.x ? normalize(a) * b.y : a - b;"
+        "}",
+        [](const vf::Vector4 & a, const vf::Vector4 & b) {
+            float s = b.y / sqrtf(a.x * a.x + a.y * a.y + a.z * a.z + a.w * a.w);
+            return (a.x > b.x) ? Make(a.x * s, a.y * s, a.z * s, a.w * s) :
+                Make(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w);
+        });
+}
+
+TEST(Branches, Nested)
+{
+    ExpectResult(
+        "in vec4    a;"
+        "in vec4    b;"
+        "out vec4   c;"
+        "void main()"
+        "{"
+        "   c = a.w > 0.0 ? (a.x > b.x ? a * 2.0 : b - a) : b;"
+        "}",
+        [](const vf::Vector4 & a, const vf::Vector4 & b) {
+            return (a.x > b.x) ? Make(a.x * 2.0f, a.y * 2.0f, a.z * 2.0f, a.w * 2.0f) :
+                Make(b.x - a.x, b.y - a.y, b.z - a.z, b.w - a.w);
+        });
+}
@@ -0,0 +1,175 @@
+#include <intermediate.hpp>
+#include <gtest\gtest.h>
+#include <memory>
+#include <cmath>
+
+using namespace vf;
+
+/*****************************************************************************/
+/*                                      Utility                              */
+/*****************************************************************************/
+
+static std::shared_ptr<vf::ByteCode> Compile(const char * pSource)
+{
+    std::shared_ptr<vf::Program>    pProgram;
+    EXPECT_NO_THROW(pProgram = std::make_shared<vf::Program>(pSource));
+    return pProgram->Compile();
+}
+
+static const size_t NumElements = 37;
+
+/**
+ * Executes a program with the streams a, b (inputs) and c (output) using the specified engine,
+ * and returns the output stream.
+ */
+static std::vector<vf::Vector4> Execute(std::shared_ptr<vf::ByteCode> bc, vf::Engine_t engine,
+    vf::Precision_t precision = vf::Precision_Precise)
+{
+    std::vector<vf::Vector4> a(NumElements), b(NumElements), c(NumElements);
+    for(size_t i = 0; i < NumElements; ++i) {
+        a[i].x = float(i) * 0.5f - 4.0f;
+        a[i].y = float(i % 5) + 0.25f;
+        a[i].z = -float(i % 3) - 1.0f;
+        a[i].w = 2.0f;
+        b[i].x = float(i % 7) - 3.5f;
+        b[i].y = 1.0f / float(i + 1);
+        b[i].z = float(i) * 0.125f;
+        b[i].w = -1.5f;
+        c[i].x = c[i].y = c[i].z = c[i].w = 0.0f;
+    }
+
+    uint8_t mem[1024];
+    vf::ByteCode_Execution be(bc, mem, sizeof(mem), vf::Layout_AoS, engine, precision);
+    be.SetRegisterPointer(bc->StreamLocation("a"), (float *) &a[0]);
+    be.SetRegisterPointer(bc->StreamLocation("b"), (float *) &b[0]);
+    be.SetRegisterPointer(bc->StreamLocation("c"), (float *) &c[0]);
+    EXPECT_EQ(be.Execute(0, NumElements), vf::Err_Success);
+    return c;
+}
+
+/** Executes the program with both engines, and expects the same result. */
+static void ExpectSameResult(const char * pSource)
+{
+    std::shared_ptr<vf::ByteCode> bc = Compile(pSource);
+    ASSERT_NE(bc, nullptr);
+
+    std::vector<vf::Vector4> expected = Execute(bc, vf::Engine_Interpreter);
+    std::vector<vf::Vector4> actual = Execute(bc, vf::Engine_JIT);
+    for(size_t i = 0; i < NumElements; ++i) {
+        EXPECT_FLOAT_EQ(expected[i].x, actual[i].x) << "element " << i;
+        EXPECT_FLOAT_EQ(expected[i].y, actual[i].y) << "element " << i;
+        EXPECT_FLOAT_EQ(expected[i].z, actual[i].z) << "element " << i;
+        EXPECT_FLOAT_EQ(expected[i].w, actual[i].w) << "element " << i;
+    }
+}
+
+/*****************************************************************************/
+/*                                      JIT                                  */
+/*****************************************************************************/
+
+TEST(Jit, Arithmetic)
+{
+    ExpectSameResult(
+        "in vec4    a;"
+        "in vec4    b;"
+        "out vec4   c;"
+        "void main()"
+        "{"
+        "   c = ((a + b) * 2.0 - b) / 4.0;"
+        "}");
+}
+
+TEST(Jit, ScalarMembers)
+{
+    ExpectSameResult(
+        "in vec4    a;"
+        "in vec4    b;"
+        "out vec4   c;"
+        "void main()"
+        "{"
+        "   c = a * (a.y * b.z + a.w) - b * sqrt(a.y);"
+        "   c = c + b * (min(a.x, b.x) + max(a.z, b.z)) - a;"
+        "}");
+}
+
+TEST(Jit, VectorFunctions)
+{
+    ExpectSameResult(
+        "in vec4    a;"
+        "in vec4    b;"
+        "out vec4   c;"
+        "void main()"
+        "{"
+        "   c = b * (dot(a, b) + length(b.xyz)) + a * dot(cross(a.xyz, b.xyz), normalize(a.xyz));"
+        "}");
+}
+
+TEST(Jit, Conditional)
+{
+    ExpectSameResult(
+        "in vec4    a;"
+        "in vec4    b;"
+        "out vec4   c;"
+        "void main()"
+        "{"
+        "   c = a.x > b.x ? a : b;"
+        "}");
+}
+
+/**
+ * Trigonometric functions aren't compiled to native code, the method is interpreted instead.
+ */
+TEST(Jit, Fallback)
+{
+    ExpectSameResult(
+        "in vec4    a;"
+        "in vec4    b;"
+        "out vec4   c;"
+        "void main()"
+        "{"
+        "   c = a * sin(a.x) + b;"
+        "}");
+}
+
+/**
+ * The approximate precisions are close to the precise result with both engines, and the JIT
+ * still compiles the method.
+ */
+TEST(Jit, Precision)
+{
+    std::shared_ptr<vf::ByteCode> bc = Compile(
+        "in vec4    a;"
+        "in vec4    b;"
+        "out vec4   c;"
+        "void main()"
+        "{"
+        "   c = a / b.x + normalize(a) * invsqrt(a.y);"
+        "}");
+    ASSERT_NE(bc, nullptr);
+
+    std::vector<vf::Vector4> expected = Execute(bc, vf::Engine_Interpreter);
+    const vf::Engine_t engines[]        = { vf::Engine_Interpreter, vf::Engine_JIT };
+    const vf::Precision_t precisions[]  = { vf::Precision_Fast, vf::Precision_Fastest };
+    const float tolerances[]            = { 1.0e-5f, 2.0e-3f };
+    for(size_t e = 0; e < 2; ++e) {
+        for(size_t p = 0; p < 2; ++p) {
+            std::vector<vf::Vector4> actual = Execute(bc, engines[e], precisions[p]);
+            for(size_t i = 0; i < NumElements; ++i) {
+                EXPECT_NEAR(expected[i].x, actual[i].x, tolerances[p] * (1.0f + fabsf(expected[i].x))) << "element " << i;
+                EXPECT_NEAR(expected[i].y, actual[i].y, tolerances[p] * (1.0f + fabsf(expected[i].y))) << "element " << i;
+                EXPECT_NEAR(expected[i].z, actual[i].z, tolerances[p] * (1.0f + fabsf(expected[i].z))) << "element " << i;
+                EXPECT_NEAR(expected[i].w, actual[i].w, tolerances[p] * (1.0f + fabsf(expected[i].w))) << "element " << i;
+            }
+        }
+    }
+
+    uint8_t mem[1024];
+    vf::ByteCode_Execution be(bc, mem, sizeof(mem), vf::Layout_AoS, vf::Engine_JIT, vf::Precision_Fastest);
+    vf::ExecutionStats stats = be.GetStats();
+    EXPECT_EQ(stats.layout, vf::Layout_AoS);
+    EXPECT_EQ(stats.engine, vf::Engine_JIT);
+    EXPECT_EQ(stats.precision, vf::Precision_Fastest);
+    EXPECT_EQ(stats.numThreads, 1u);
+    EXPECT_EQ(stats.numCompiled + stats.numNative, 1u);
+    EXPECT_EQ(stats.numInterpreted, 0u);
+}
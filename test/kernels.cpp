@@ -0,0 +1,500 @@
+#include <vfkernels.h>
+#include <vfvm.h>
+#include <gtest\gtest.h>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <limits>
+
+using namespace vf;
+
+/*****************************************************************************/
+/*                                      Utility                              */
+/*****************************************************************************/
+
+static const size_t NumElements = 37;     /**< not a multiple of any SIMD width */
+static const size_t NumFloats   = NumElements * 4;
+
+static std::vector<float> Random(float minValue, float maxValue, unsigned seed)
+{
+    std::vector<float> v(NumFloats);
+    srand(seed);
+    for(size_t i = 0; i < NumFloats; ++i) {
+        v[i] = minValue + (maxValue - minValue) * (float(rand()) / float(RAND_MAX));
+    }
+    return v;
+}
+
+static KernelOperand Operand(OperandKind_t kind, const std::vector<float> & data, unsigned member = 0)
+{
+    KernelOperand op;
+    op.kind     = kind;
+    op.ptr      = &data[0];
+    op.member   = member;
+    for(size_t c = 0; c < 4; ++c) {
+        op.value[c] = data[(kind == Operand_Splat) ? member : c];
+    }
+    if (kind == Operand_Const) {
+        op.ptr = nullptr;
+    }
+    return op;
+}
+
+/** Returns the kernel tables that are supported by the processor, except the portable one */
+static std::vector<const KernelTable *> SimdTables()
+{
+    std::vector<const KernelTable *> tables;
+    ISA_t isas[] = { ISA_SSE41, ISA_AVX2, ISA_AVX512 };
+    for(size_t i = 0; i < 3; ++i) {
+        const KernelTable * table = GetKernelTable(isas[i]);
+        if (table->isa == isas[i]) {
+            tables.push_back(table);
+        }
+    }
+    return tables;
+}
+
+static void ExpectEqual(const std::vector<float> & expected, const std::vector<float> & actual, float tolerance)
+{
+    for(size_t i = 0; i < NumFloats; ++i) {
+        if (std::isnan(expected[i])) {
+            EXPECT_TRUE(std::isnan(actual[i])) << "index " << i;
+        } else {
+            EXPECT_NEAR(expected[i], actual[i], tolerance * (1.0f + fabsf(expected[i]))) << "index " << i;
+        }
+    }
+}
+
+static const OperandKind_t Kinds[]  = { Operand_Vector, Operand_Splat, Operand_Const };
+static const unsigned Masks[]       = { 0x1, 0x2, 0x4, 0x8, 0x3, 0x7, 0xf };
+
+/*****************************************************************************/
+/*                                      Tables                               */
+/*****************************************************************************/
+
+TEST(Kernels, TablesAreComplete)
+{
+    std::vector<const KernelTable *> tables = SimdTables();
+    tables.push_back(GetKernelTable(ISA_Portable));
+    for(size_t t = 0; t < tables.size(); ++t) {
+        const KernelTable * table = tables[t];
+        for(size_t i = 0; i < KERNEL_BINARY_MAX; ++i)   EXPECT_NE(table->Binary[i], nullptr);
+        for(size_t i = 0; i < KERNEL_UNARY_MAX; ++i)    EXPECT_NE(table->Unary[i], nullptr);
+        for(size_t i = 0; i < KERNEL_CMP_MAX; ++i)      EXPECT_NE(table->Compare[i], nullptr);
+        for(size_t i = 0; i < 3; ++i) {
+            EXPECT_NE(table->Dot[i], nullptr);
+            EXPECT_NE(table->Length[i], nullptr);
+            EXPECT_NE(table->Normalize[i], nullptr);
+        }
+        EXPECT_NE(table->Select, nullptr);
+        EXPECT_NE(table->Stream, nullptr);
+        EXPECT_NE(table->Prefetch, nullptr);
+        EXPECT_NE(table->Cross, nullptr);
+        for(size_t i = 0; i < KERNEL_TERNARY_MAX; ++i)  EXPECT_NE(table->Ternary[i], nullptr);
+        for(size_t i = 0; i < 3; ++i) {
+            EXPECT_NE(table->NormalizeScale[i], nullptr);
+            EXPECT_NE(table->LengthOfDifference[i], nullptr);
+            EXPECT_NE(table->DotSqrt[i], nullptr);
+        }
+    }
+}
+
+TEST(Kernels, AutoSelectsDetectedISA)
+{
+    EXPECT_EQ(GetKernelTable(ISA_Auto)->isa, DetectISA());
+    EXPECT_EQ(GetKernelTable(ISA_Portable)->isa, ISA_Portable);
+}
+
+/*****************************************************************************/
+/*                                      Portable                             */
+/*****************************************************************************/
+
+TEST(Kernels, Portable_ScalarMember)
+{
+    std::vector<float> lhs = Random(-10.0f, 10.0f, 1), rhs = Random(-10.0f, 10.0f, 2), dst = Random(0.0f, 1.0f, 3);
+    std::vector<float> expected = dst;
+    for(size_t i = 0; i < NumElements; ++i) {
+        expected[i * 4 + 1] = lhs[i * 4 + 3] + rhs[i * 4 + 0];
+    }
+
+    KernelOperand l = Operand(Operand_Splat, lhs, 3), r = Operand(Operand_Splat, rhs, 0);
+    GetKernelTable(ISA_Portable)->Binary[KERNEL_ADD](&dst[0], l, r, NumFloats, 0x2);
+    ExpectEqual(expected, dst, 0.0f);
+}
+
+TEST(Kernels, Portable_Dot3)
+{
+    std::vector<float> lhs = Random(-10.0f, 10.0f, 4), rhs = Random(-10.0f, 10.0f, 5), dst = Random(0.0f, 1.0f, 6);
+    std::vector<float> expected = dst;
+    for(size_t i = 0; i < NumElements; ++i) {
+        expected[i * 4 + 2] = lhs[i * 4] * rhs[i * 4] + lhs[i * 4 + 1] * rhs[i * 4 + 1] + lhs[i * 4 + 2] * rhs[i * 4 + 2];
+    }
+
+    KernelOperand l = Operand(Operand_Vector, lhs), r = Operand(Operand_Vector, rhs);
+    GetKernelTable(ISA_Portable)->Dot[1](&dst[0], l, r, NumFloats, 0x4);
+    ExpectEqual(expected, dst, 1e-5f);
+}
+
+/*****************************************************************************/
+/*                          SIMD kernels against portable                    */
+/*****************************************************************************/
+
+TEST(Kernels, Binary)
+{
+    const KernelTable * reference = GetKernelTable(ISA_Portable);
+    std::vector<const KernelTable *> tables = SimdTables();
+    std::vector<float> lhs = Random(-10.0f, 10.0f, 7), rhs = Random(0.5f, 10.0f, 8), init = Random(0.0f, 1.0f, 9);
+
+    for(size_t t = 0; t < tables.size(); ++t) {
+        for(size_t k = 0; k < KERNEL_BINARY_MAX; ++k) {
+            for(size_t a = 0; a < 3; ++a) {
+                for(size_t b = 0; b < 3; ++b) {
+                    for(size_t m = 0; m < sizeof(Masks) / sizeof(Masks[0]); ++m) {
+                        KernelOperand l = Operand(Kinds[a], lhs, 1), r = Operand(Kinds[b], rhs, 2);
+                        std::vector<float> expected = init, actual = init;
+                        reference->Binary[k](&expected[0], l, r, NumFloats, Masks[m]);
+                        tables[t]->Binary[k](&actual[0], l, r, NumFloats, Masks[m]);
+                        ExpectEqual(expected, actual, 0.0f);
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST(Kernels, Unary)
+{
+    const KernelTable * reference = GetKernelTable(ISA_Portable);
+    std::vector<const KernelTable *> tables = SimdTables();
+    std::vector<float> src = Random(-0.99f, 0.99f, 10), init = Random(0.0f, 1.0f, 11);
+
+    for(size_t t = 0; t < tables.size(); ++t) {
+        for(size_t k = 0; k < KERNEL_UNARY_MAX; ++k) {
+            for(size_t a = 0; a < 3; ++a) {
+                for(size_t m = 0; m < sizeof(Masks) / sizeof(Masks[0]); ++m) {
+                    KernelOperand s = Operand(Kinds[a], src, 3);
+                    std::vector<float> expected = init, actual = init;
+                    reference->Unary[k](&expected[0], s, NumFloats, Masks[m]);
+                    tables[t]->Unary[k](&actual[0], s, NumFloats, Masks[m]);
+                    ExpectEqual(expected, actual, 0.0f);
+                }
+            }
+        }
+    }
+}
+
+TEST(Kernels, Horizontal)
+{
+    const KernelTable * reference = GetKernelTable(ISA_Portable);
+    std::vector<const KernelTable *> tables = SimdTables();
+    std::vector<float> lhs = Random(-10.0f, 10.0f, 12), rhs = Random(-10.0f, 10.0f, 13), init = Random(0.0f, 1.0f, 14);
+    OperandKind_t kinds[] = { Operand_Vector, Operand_Const };
+
+    for(size_t t = 0; t < tables.size(); ++t) {
+        for(size_t a = 0; a < 2; ++a) {
+            for(size_t b = 0; b < 2; ++b) {
+                KernelOperand l = Operand(kinds[a], lhs), r = Operand(kinds[b], rhs);
+                for(size_t n = 0; n < 3; ++n) {
+                    for(size_t member = 0; member < 4; ++member) {
+                        std::vector<float> expected = init, actual = init;
+                        reference->Dot[n](&expected[0], l, r, NumFloats, 1 << member);
+                        tables[t]->Dot[n](&actual[0], l, r, NumFloats, 1 << member);
+                        ExpectEqual(expected, actual, 1e-5f);
+
+                        expected = actual = init;
+                        reference->Length[n](&expected[0], l, NumFloats, 1 << member);
+                        tables[t]->Length[n](&actual[0], l, NumFloats, 1 << member);
+                        ExpectEqual(expected, actual, 1e-5f);
+                    }
+                    std::vector<float> expected = init, actual = init;
+                    reference->Normalize[n](&expected[0], l, NumFloats, (1 << (n + 2)) - 1);
+                    tables[t]->Normalize[n](&actual[0], l, NumFloats, (1 << (n + 2)) - 1);
+                    ExpectEqual(expected, actual, 1e-5f);
+                }
+                std::vector<float> expected = init, actual = init;
+                reference->Cross(&expected[0], l, r, NumFloats, 0x7);
+                tables[t]->Cross(&actual[0], l, r, NumFloats, 0x7);
+                ExpectEqual(expected, actual, 1e-5f);
+            }
+        }
+    }
+}
+
+TEST(Kernels, CompareAndSelect)
+{
+    const KernelTable * reference = GetKernelTable(ISA_Portable);
+    std::vector<const KernelTable *> tables = SimdTables();
+    std::vector<float> lhs = Random(-1.0f, 1.0f, 15), rhs = Random(-1.0f, 1.0f, 16), init = Random(0.0f, 1.0f, 17);
+    OperandKind_t kinds[] = { Operand_Splat, Operand_Const };
+
+    for(size_t t = 0; t < tables.size(); ++t) {
+        for(size_t k = 0; k < KERNEL_CMP_MAX; ++k) {
+            for(size_t a = 0; a < 2; ++a) {
+                for(size_t b = 0; b < 2; ++b) {
+                    KernelOperand l = Operand(kinds[a], lhs, 0), r = Operand(kinds[b], rhs, 2);
+                    std::vector<uint8_t> expected(Predicate_Bytes(NumElements), 0xff), actual(Predicate_Bytes(NumElements), 0xff);
+                    reference->Compare[k](&expected[0], l, r, NumElements);
+                    tables[t]->Compare[k](&actual[0], l, r, NumElements);
+                    EXPECT_EQ(expected, actual);
+
+                    for(size_t m = 0; m < sizeof(Masks) / sizeof(Masks[0]); ++m) {
+                        KernelOperand vl = Operand(Operand_Vector, lhs), vr = Operand(kinds[b], rhs, 2);
+                        std::vector<float> dstExpected = init, dstActual = init;
+                        reference->Select(&dstExpected[0], &expected[0], vl, vr, NumFloats, Masks[m]);
+                        tables[t]->Select(&dstActual[0], &expected[0], vl, vr, NumFloats, Masks[m]);
+                        ExpectEqual(dstExpected, dstActual, 0.0f);
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST(Kernels, PredicateBits)
+{
+    std::vector<const KernelTable *> tables = SimdTables();
+    tables.push_back(GetKernelTable(ISA_Portable));
+    std::vector<float> lhs = Random(-1.0f, 1.0f, 22), rhs = Random(-1.0f, 1.0f, 23);
+
+    for(size_t t = 0; t < tables.size(); ++t) {
+        KernelOperand l = Operand(Operand_Splat, lhs, 1), r = Operand(Operand_Const, rhs, 0);
+        std::vector<uint8_t> predicate(Predicate_Bytes(NumElements), 0xff);
+        tables[t]->Compare[KERNEL_CMP_GRT](&predicate[0], l, r, NumElements);
+        for(size_t i = 0; i < NumElements; ++i) {
+            bool bit = ((predicate[i / 8] >> (i % 8)) & 1) != 0;
+            EXPECT_EQ(lhs[(i * 4) + 1] > rhs[0], bit) << "element " << i;
+        }
+        // the unused bits of the last byte are cleared
+        EXPECT_EQ(predicate.back() >> (NumElements % 8), 0);
+    }
+}
+
+/*****************************************************************************/
+/*                          Fused kernels against unfused                    */
+/*****************************************************************************/
+
+/** Returns all kernel tables, the fused kernels are compared with the same table */
+static std::vector<const KernelTable *> AllTables()
+{
+    std::vector<const KernelTable *> tables = SimdTables();
+    tables.push_back(GetKernelTable(ISA_Portable));
+    return tables;
+}
+
+TEST(Kernels, MultiplyAdd)
+{
+    std::vector<const KernelTable *> tables = AllTables();
+    std::vector<float> a = Random(-10.0f, 10.0f, 18), b = Random(-10.0f, 10.0f, 19), c = Random(-10.0f, 10.0f, 20);
+    std::vector<float> init = Random(0.0f, 1.0f, 21);
+    const size_t outer[KERNEL_TERNARY_MAX] = { KERNEL_ADD, KERNEL_SUB, KERNEL_SUB };
+
+    for(size_t t = 0; t < tables.size(); ++t) {
+        for(size_t k = 0; k < KERNEL_TERNARY_MAX; ++k) {
+            for(size_t x = 0; x < 27; ++x) {
+                KernelOperand oa = Operand(Kinds[x % 3], a, 1), ob = Operand(Kinds[(x / 3) % 3], b, 2);
+                KernelOperand oc = Operand(Kinds[x / 9], c, 3);
+                std::vector<float> product = init;
+                tables[t]->Binary[KERNEL_MUL](&product[0], oa, ob, NumFloats, 0xf);
+                KernelOperand op = Operand(Operand_Vector, product);
+
+                for(size_t m = 0; m < sizeof(Masks) / sizeof(Masks[0]); ++m) {
+                    std::vector<float> expected = init, actual = init;
+                    if (k == KERNEL_SUBMUL) {
+                        tables[t]->Binary[outer[k]](&expected[0], oc, op, NumFloats, Masks[m]);
+                    } else {
+                        tables[t]->Binary[outer[k]](&expected[0], op, oc, NumFloats, Masks[m]);
+                    }
+                    tables[t]->Ternary[k](&actual[0], oa, ob, oc, NumFloats, Masks[m]);
+                    ExpectEqual(expected, actual, 0.0f);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * The non-temporal copy, to destinations that are aligned and misaligned to a register.
+ */
+TEST(Kernels, Stream)
+{
+    std::vector<const KernelTable *> tables = AllTables();
+    std::vector<float> src = Random(-10.0f, 10.0f, 22);
+    for(size_t t = 0; t < tables.size(); ++t) {
+        for(size_t offset = 0; offset < 4; ++offset) {
+            std::vector<float> dst(NumFloats + 20, 0.0f);
+            float * aligned = &dst[0] + ((16 - (reinterpret_cast<uintptr_t>(&dst[0]) & 63) / 4) & 15);
+            tables[t]->Stream(aligned + offset, &src[0], NumFloats);
+            EXPECT_EQ(memcmp(aligned + offset, &src[0], NumFloats * sizeof(float)), 0) << tables[t]->name << " offset " << offset;
+        }
+    }
+}
+
+TEST(Kernels, FusedHorizontal)
+{
+    std::vector<const KernelTable *> tables = AllTables();
+    std::vector<float> lhs = Random(-10.0f, 10.0f, 22), rhs = Random(-10.0f, 10.0f, 23), init = Random(0.0f, 1.0f, 24);
+    OperandKind_t kinds[] = { Operand_Vector, Operand_Const };
+
+    for(size_t t = 0; t < tables.size(); ++t) {
+        const KernelTable * table = tables[t];
+        for(size_t a = 0; a < 2; ++a) {
+            for(size_t b = 0; b < 2; ++b) {
+                KernelOperand l = Operand(kinds[a], lhs), r = Operand(kinds[b], rhs);
+                KernelOperand s = Operand(kinds[b] == Operand_Vector ? Operand_Splat : Operand_Const, rhs, 1);
+                for(size_t n = 0; n < 3; ++n) {
+                    std::vector<float> tmp = init, expected = init, actual = init;
+                    table->Normalize[n](&tmp[0], l, NumFloats, 0xf);
+                    table->Binary[KERNEL_MUL](&expected[0], Operand(Operand_Vector, tmp), s, NumFloats, (1 << (n + 2)) - 1);
+                    table->NormalizeScale[n](&actual[0], l, s, NumFloats, (1 << (n + 2)) - 1);
+                    ExpectEqual(expected, actual, 0.0f);
+
+                    tmp = init;
+                    table->Binary[KERNEL_SUB](&tmp[0], l, r, NumFloats, 0xf);
+                    for(size_t member = 0; member < 4; ++member) {
+                        expected = actual = init;
+                        table->Length[n](&expected[0], Operand(Operand_Vector, tmp), NumFloats, 1 << member);
+                        table->LengthOfDifference[n](&actual[0], l, r, NumFloats, 1 << member);
+                        ExpectEqual(expected, actual, 0.0f);
+                    }
+
+                    tmp = init;
+                    table->Dot[n](&tmp[0], l, r, NumFloats, 0xf);
+                    for(size_t member = 0; member < 4; ++member) {
+                        expected = actual = init;
+                        table->Unary[KERNEL_SQRT](&expected[0], Operand(Operand_Vector, tmp), NumFloats, 1 << member);
+                        table->DotSqrt[n](&actual[0], l, r, NumFloats, 1 << member);
+                        ExpectEqual(expected, actual, 0.0f);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*****************************************************************************/
+/*                                      Math                                 */
+/*****************************************************************************/
+
+/** Returns the distance in ULP between a float and the correctly rounded reference */
+static double Ulp_Distance(float actual, double reference)
+{
+    float expected = static_cast<float>(reference);
+    int32_t a, b;
+    memcpy(&a, &actual, sizeof(a));
+    memcpy(&b, &expected, sizeof(b));
+    int64_t x = (a < 0) ? -int64_t(a & 0x7fffffff) : int64_t(a);
+    int64_t y = (b < 0) ? -int64_t(b & 0x7fffffff) : int64_t(b);
+    return fabs(double(x - y));
+}
+
+/**
+ * The trigonometric kernels and the scalar math functions are within the documented bounds of
+ * the double precision result, also for the largest reduced arguments and for the registers
+ * that are evaluated by the C library.
+ */
+TEST(Kernels, Transcendental)
+{
+    struct Function {
+        size_t  kernel;
+        float   (*scalar)(float);
+        double  (*reference)(double);
+        float   minValue, maxValue;
+        double  bound;
+    };
+    const Function functions[] = {
+        { KERNEL_SINE,          Math_Sin,       sin,    -8192.0f,   8192.0f,    2.0 },
+        { KERNEL_COSINE,        Math_Cos,       cos,    -8192.0f,   8192.0f,    2.0 },
+        { KERNEL_TANGENT,       Math_Tan,       tan,    -8192.0f,   8192.0f,    4.0 },
+        { KERNEL_SINE,          Math_Sin,       sin,    -3.2f,      3.2f,       2.0 },
+        { KERNEL_COSINE,        Math_Cos,       cos,    -3.2f,      3.2f,       2.0 },
+        { KERNEL_TANGENT,       Math_Tan,       tan,    -1.6f,      1.6f,       4.0 },
+        { KERNEL_ARCSINE,       Math_ArcSin,    asin,   -1.0f,      1.0f,       2.0 },
+        { KERNEL_ARCCOSINE,     Math_ArcCos,    acos,   -1.0f,      1.0f,       1.0 },
+        { KERNEL_ARCTANGENT,    Math_ArcTan,    atan,   -100.0f,    100.0f,     3.0 },
+    };
+    std::vector<const KernelTable *> tables = AllTables();
+
+    for(size_t f = 0; f < sizeof(functions) / sizeof(functions[0]); ++f) {
+        const Function & fn = functions[f];
+        std::vector<float> src = Random(fn.minValue, fn.maxValue, 26 + unsigned(f));
+        src[0] = 0.0f;
+        src[1] = fn.minValue;
+        src[2] = fn.maxValue;
+        if (fn.kernel <= KERNEL_TANGENT) {
+            src[5] = 1.0e5f;    // the register is evaluated by the C library
+        }
+
+        for(size_t t = 0; t < tables.size(); ++t) {
+            std::vector<float> dst(NumFloats);
+            tables[t]->Unary[fn.kernel](&dst[0], Operand(Operand_Vector, src), NumFloats, 0xf);
+            for(size_t i = 0; i < NumFloats; ++i) {
+                EXPECT_LE(Ulp_Distance(dst[i], fn.reference(src[i])), fn.bound) << tables[t]->name << " x = " << src[i];
+                EXPECT_EQ(dst[i], fn.scalar(src[i])) << tables[t]->name << " x = " << src[i];
+            }
+        }
+    }
+
+    EXPECT_TRUE(std::isnan(Math_ArcSin(1.5f)));
+    EXPECT_TRUE(std::isnan(Math_ArcCos(-1.5f)));
+    EXPECT_TRUE(std::isnan(Math_Sin(std::numeric_limits<float>::infinity())));
+}
+
+/**
+ * The approximate precisions are compared with the precise kernels of the same instruction set,
+ * with a error relative to the magnitude of the result.
+ */
+TEST(Kernels, Precision)
+{
+    const ISA_t isas[]              = { ISA_SSE41, ISA_AVX2, ISA_AVX512, ISA_Portable };
+    const Precision_t precisions[]  = { Precision_Fast, Precision_Fastest };
+    const float tolerances[]        = { 1.0e-5f, 2.0e-3f };
+    std::vector<float> a = Random(-10.0f, 10.0f, 40), b = Random(0.5f, 10.0f, 41), angle = Random(-3.2f, 3.2f, 42);
+    std::vector<float> ratio = Random(-1.0f, 1.0f, 43);
+    const struct {
+        size_t                      kernel;
+        const std::vector<float> *  src;
+    } functions[] = {
+        { KERNEL_SINE, &angle }, { KERNEL_COSINE, &angle }, { KERNEL_TANGENT, &ratio },
+        { KERNEL_ARCSINE, &ratio }, { KERNEL_ARCCOSINE, &ratio }, { KERNEL_ARCTANGENT, &a }
+    };
+    for(size_t i = 0; i < NumFloats; i += 2) {
+        b[i] = -b[i];
+    }
+
+    for(size_t t = 0; t < sizeof(isas) / sizeof(isas[0]); ++t) {
+        const KernelTable * precise = GetKernelTable(isas[t]);
+        if (precise->isa != isas[t]) {
+            continue;
+        }
+        EXPECT_EQ(precise->precision, Precision_Precise);
+        for(size_t p = 0; p < 2; ++p) {
+            const KernelTable * table = GetKernelTable(isas[t], precisions[p]);
+            ASSERT_EQ(table->isa, isas[t]);
+            EXPECT_EQ(table->precision, precisions[p]);
+            EXPECT_NE(table, precise);
+            std::vector<float> expected(NumFloats), actual(NumFloats);
+
+            precise->Binary[KERNEL_DIV](&expected[0], Operand(Operand_Vector, a), Operand(Operand_Vector, b), NumFloats, 0xf);
+            table->Binary[KERNEL_DIV](&actual[0], Operand(Operand_Vector, a), Operand(Operand_Vector, b), NumFloats, 0xf);
+            ExpectEqual(expected, actual, tolerances[p]);
+
+            precise->Unary[KERNEL_INVSQRT](&expected[0], Operand(Operand_Vector, b), NumFloats, 0xf);
+            table->Unary[KERNEL_INVSQRT](&actual[0], Operand(Operand_Vector, b), NumFloats, 0xf);
+            ExpectEqual(expected, actual, tolerances[p]);
+
+            for(size_t n = 0; n < 3; ++n) {
+                precise->Normalize[n](&expected[0], Operand(Operand_Vector, a), NumFloats, 0xf);
+                table->Normalize[n](&actual[0], Operand(Operand_Vector, a), NumFloats, 0xf);
+                ExpectEqual(expected, actual, tolerances[p]);
+            }
+
+            for(size_t f = 0; f < sizeof(functions) / sizeof(functions[0]); ++f) {
+                KernelOperand src = Operand(Operand_Vector, *functions[f].src);
+                precise->Unary[functions[f].kernel](&expected[0], src, NumFloats, 0xf);
+                table->Unary[functions[f].kernel](&actual[0], src, NumFloats, 0xf);
+                ExpectEqual(expected, actual, tolerances[p]);
+            }
+        }
+    }
+}
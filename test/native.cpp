@@ -0,0 +1,192 @@
+#include <intermediate.hpp>
+#include <gtest\gtest.h>
+#include <memory>
+#include <sstream>
+
+using namespace vf;
+
+/*****************************************************************************/
+/*                                      Utility                              */
+/*****************************************************************************/
+
+static std::shared_ptr<vf::ByteCode> Compile(const char * pSource)
+{
+    std::shared_ptr<vf::Program>    pProgram;
+    EXPECT_NO_THROW(pProgram = std::make_shared<vf::Program>(pSource));
+    return pProgram->Compile();
+}
+
+static const char * pSource =
+    "in vec4    a;"
+    "out vec4   c;"
+    "void main()"
+    "{"
+    "   c = a * 2.0 + a;"
+    "}";
+
+/** Stands in for a generated kernel, writes the element index to each component of stream 'c'. */
+static size_t StreamC = 0;
+static void Kernel_Index(float * const * registers, const float *, size_t count)
+{
+    for(size_t i = 0; i < count; ++i) {
+        for(size_t c = 0; c < 4; ++c) {
+            registers[StreamC][i * 4 + c] = float(i);
+        }
+    }
+}
+
+static const char * pHoistSource =
+    "in vec4        r;"
+    "uniform float  t;"
+    "out vec4       y;"
+    "void main()"
+    "{"
+    "   y = r * 2.0 * sin(t);"
+    "}";
+
+/** Stands in for the generated kernel of the hoisted program, y = r * $main.0. */
+static size_t StreamR = 0, StreamY = 0, HiddenUniform = 0;
+static void Kernel_Hoisted(float * const * registers, const float * uniforms, size_t count)
+{
+    for(size_t i = 0; i < count * 4; ++i) {
+        registers[StreamY][i] = registers[StreamR][i] * uniforms[HiddenUniform * 4];
+    }
+}
+
+/** Stands in for a kernel of a prologue, which would only write its results to local arrays. */
+static void Kernel_None(float * const *, const float *, size_t)
+{
+}
+
+/** Executes the hoisted program with the specified engine, and returns the output stream. */
+static std::vector<vf::Vector4> Execute_Hoisted(std::shared_ptr<vf::ByteCode> bc, vf::Engine_t engine)
+{
+    const size_t NumElements = 37;
+    std::vector<vf::Vector4> r(NumElements), y(NumElements);
+    for(size_t i = 0; i < NumElements; ++i) {
+        r[i].x = float(i) * 0.5f - 4.0f;
+        r[i].y = float(i % 5) + 0.25f;
+        r[i].z = -float(i % 3) - 1.0f;
+        r[i].w = 2.0f;
+        y[i].x = y[i].y = y[i].z = y[i].w = 0.0f;
+    }
+
+    uint8_t mem[1024];
+    vf::ByteCode_Execution be(bc, mem, sizeof(mem), vf::Layout_AoS, engine);
+    be.SetRegisterPointer(bc->StreamLocation("r"), (float *) &r[0]);
+    be.SetRegisterPointer(bc->StreamLocation("y"), (float *) &y[0]);
+    be.SetUniform(bc->UniformLocation("t"), 0.75f);
+    EXPECT_EQ(be.Execute(0, NumElements), vf::Err_Success);
+    return y;
+}
+
+/*****************************************************************************/
+/*                                      Native                               */
+/*****************************************************************************/
+
+TEST(Native, HashIdentifiesBytecode)
+{
+    std::shared_ptr<vf::ByteCode> bc1 = Compile(pSource), bc2 = Compile(pSource);
+    std::shared_ptr<vf::ByteCode> other = Compile(
+        "in vec4    a;"
+        "out vec4   c;"
+        "void main()"
+        "{"
+        "   c = a * 3.0 + a;"
+        "}");
+    ASSERT_NE(bc1, nullptr);
+    ASSERT_NE(other, nullptr);
+    EXPECT_EQ(Native_Hash(*bc1), Native_Hash(*bc2));
+    EXPECT_NE(Native_Hash(*bc1), Native_Hash(*other));
+}
+
+TEST(Native, EmitsOneKernelPerMethod)
+{
+    std::shared_ptr<vf::ByteCode> bc = Compile(pSource);
+    ASSERT_NE(bc, nullptr);
+
+    std::ostringstream os;
+    EXPECT_EQ(Native_Emit(*bc, "field", os), Err_Success);
+    std::string source = os.str();
+    EXPECT_NE(source.find("void field_0(float * const * registers, const float * uniforms, size_t count)"), std::string::npos);
+    EXPECT_NE(source.find("vf::Native_Register("), std::string::npos);
+    EXPECT_NE(source.find("2.0f"), std::string::npos);
+    EXPECT_EQ(source.find("field_1"), std::string::npos);
+}
+
+TEST(Native, InvalidName)
+{
+    std::shared_ptr<vf::ByteCode> bc = Compile(pSource);
+    ASSERT_NE(bc, nullptr);
+
+    std::ostringstream os;
+    EXPECT_EQ(Native_Emit(*bc, "1field", os), Err_InvalidParameter);
+    EXPECT_EQ(Native_Emit(*bc, "my-field", os), Err_InvalidParameter);
+    EXPECT_EQ(Native_Emit(*bc, nullptr, os), Err_InvalidParameter);
+}
+
+/**
+ * A registered kernel is used instead of the interpreter, for bytecode with the same hash.
+ */
+TEST(Native, RegisteredKernelIsUsed)
+{
+    std::shared_ptr<vf::ByteCode> bc = Compile(
+        "in vec4    a;"
+        "out vec4   c;"
+        "void main()"
+        "{"
+        "   c = a - 1.0;"
+        "}");
+    ASSERT_NE(bc, nullptr);
+    StreamC = bc->StreamLocation("c");
+
+    EXPECT_EQ(Native_Find(Native_Hash(*bc), 0), nullptr);
+    EXPECT_TRUE(Native_Register(Native_Hash(*bc), 0, &Kernel_Index));
+    EXPECT_FALSE(Native_Register(Native_Hash(*bc), 0, &Kernel_Index));
+    EXPECT_EQ(Native_Find(Native_Hash(*bc), 0), &Kernel_Index);
+
+    std::vector<vf::Vector4> a(10), c(10);
+    uint8_t mem[1024];
+    vf::ByteCode_Execution be(bc, mem, sizeof(mem));
+    be.SetRegisterPointer(bc->StreamLocation("a"), (float *) &a[0]);
+    be.SetRegisterPointer(bc->StreamLocation("c"), (float *) &c[0]);
+    EXPECT_EQ(be.Execute(0, 10), vf::Err_Success);
+    for(size_t i = 0; i < 10; ++i) {
+        EXPECT_EQ(c[i].x, float(i));
+        EXPECT_EQ(c[i].w, float(i));
+    }
+}
+
+/**
+ * The prologue that computes the hidden uniforms is interpreted, also when a kernel has been
+ * registered for it, and the kernel of the method reads the hidden uniforms it computed.
+ */
+TEST(Native, HoistedPrologueIsInterpreted)
+{
+    std::shared_ptr<vf::ByteCode> bc = Compile(pHoistSource);
+    ASSERT_NE(bc, nullptr);
+    ASSERT_EQ(bc->GetMethods().size(), 2);
+    ASSERT_EQ(bc->GetMethods()[1]->GetName(), "$main");
+    StreamR = bc->StreamLocation("r");
+    StreamY = bc->StreamLocation("y");
+    HiddenUniform = bc->GetUniforms().find("$main.0")->second.m_UniformIndex;
+
+    std::ostringstream os;
+    EXPECT_EQ(Native_Emit(*bc, "hoisted", os), Err_Success);
+    EXPECT_NE(os.str().find("void hoisted_0("), std::string::npos);
+    EXPECT_EQ(os.str().find("hoisted_1"), std::string::npos);
+
+    std::vector<vf::Vector4> expected = Execute_Hoisted(bc, vf::Engine_Interpreter);
+    std::vector<vf::Vector4> jit = Execute_Hoisted(bc, vf::Engine_JIT);
+    EXPECT_TRUE(Native_Register(Native_Hash(*bc), 0, &Kernel_Hoisted));
+    EXPECT_TRUE(Native_Register(Native_Hash(*bc), 1, &Kernel_None));
+    std::vector<vf::Vector4> aot = Execute_Hoisted(bc, vf::Engine_Interpreter);
+    for(size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_FLOAT_EQ(expected[i].x, jit[i].x) << "element " << i;
+        EXPECT_FLOAT_EQ(expected[i].w, jit[i].w) << "element " << i;
+        EXPECT_FLOAT_EQ(expected[i].x, aot[i].x) << "element " << i;
+        EXPECT_FLOAT_EQ(expected[i].y, aot[i].y) << "element " << i;
+        EXPECT_FLOAT_EQ(expected[i].z, aot[i].z) << "element " << i;
+        EXPECT_FLOAT_EQ(expected[i].w, aot[i].w) << "element " << i;
+    }
+}
@@ -0,0 +1,248 @@
+#include <intermediate.hpp>
+#include <gtest\gtest.h>
+#include <memory>
+#include <cstring>
+#include <thread>
+
+using namespace vf;
+
+/*****************************************************************************/
+/*                                      Utility                              */
+/*****************************************************************************/
+
+static std::shared_ptr<vf::ByteCode> Compile(const char * pSource)
+{
+    std::shared_ptr<vf::Program>    pProgram;
+    EXPECT_NO_THROW(pProgram = std::make_shared<vf::Program>(pSource));
+    return pProgram->Compile();
+}
+
+static const size_t NumElements = 10007;
+
+/**
+ * Executes a program with the streams a (input) and c (output) on the specified number of
+ * threads, and returns the output stream.
+ */
+static std::vector<vf::Vector4> Execute(std::shared_ptr<vf::ByteCode> bc, size_t numThreads, vf::Engine_t engine)
+{
+    std::vector<vf::Vector4> a(NumElements), c(NumElements);
+    for(size_t i = 0; i < NumElements; ++i) {
+        a[i].x = float(i) * 0.5f - 4.0f;
+        a[i].y = float(i % 5) + 0.25f;
+        a[i].z = -float(i % 3) - 1.0f;
+        a[i].w = 2.0f;
+        c[i].x = c[i].y = c[i].z = c[i].w = 0.0f;
+    }
+
+    uint8_t mem[1024];
+    vf::ByteCode_Execution be(bc, mem, sizeof(mem), vf::Layout_AoS, engine);
+    EXPECT_EQ(be.SetThreads(numThreads, 64), vf::Err_Success);
+    be.SetRegisterPointer(bc->StreamLocation("a"), (float *) &a[0]);
+    be.SetRegisterPointer(bc->StreamLocation("c"), (float *) &c[0]);
+    be.SetUniform(bc->UniformLocation("s"), 0.75f);
+    EXPECT_EQ(be.Execute(0, NumElements), vf::Err_Success);
+    return c;
+}
+
+/**
+ * Binds the streams a and c and the uniform s of a execution.
+ */
+static void Bind(vf::ByteCode_Execution & be, std::shared_ptr<vf::ByteCode> bc, std::vector<vf::Vector4> & a,
+    std::vector<vf::Vector4> & c)
+{
+    a.resize(NumElements);
+    c.assign(NumElements, vf::Vector4());
+    for(size_t i = 0; i < NumElements; ++i) {
+        a[i].x = float(i) * 0.5f - 4.0f;
+        a[i].y = float(i % 5) + 0.25f;
+        a[i].z = -float(i % 3) - 1.0f;
+        a[i].w = 2.0f;
+    }
+    be.SetRegisterPointer(bc->StreamLocation("a"), (float *) &a[0]);
+    be.SetRegisterPointer(bc->StreamLocation("c"), (float *) &c[0]);
+    be.SetUniform(bc->UniformLocation("s"), 0.75f);
+}
+
+/**
+ * Executes the tasks of a parallel-for on the calling thread, last task first.
+ */
+class ReverseScheduler : public vf::IScheduler
+{
+public:
+    ReverseScheduler() : m_Calls(0)
+    {
+    }
+
+    virtual size_t NumWorkers() const
+    {
+        return 3;
+    }
+
+    virtual void ParallelFor(size_t numTasks, const Task_t & task)
+    {
+        ++m_Calls;
+        for(size_t i = numTasks; i > 0; --i) {
+            task(i - 1, (i - 1) % 3);
+        }
+    }
+
+    size_t  m_Calls;
+};
+
+static const char * pSource =
+    "in vec4        a;"
+    "uniform float  s;"
+    "out vec4       c;"
+    "void main()"
+    "{"
+    "   vec4 t = a * s + normalize(a);"
+    "   c = t * dot(t, a) - a * length(a.xyz);"
+    "}";
+
+/*****************************************************************************/
+/*                                      Parallel                             */
+/*****************************************************************************/
+
+/**
+ * The elements are batched the same way regardless of the number of threads, so the result
+ * is identical.
+ */
+TEST(Parallel, SameResultAsSingleThread)
+{
+    std::shared_ptr<vf::ByteCode> bc = Compile(pSource);
+    ASSERT_NE(bc, nullptr);
+
+    std::vector<vf::Vector4> expected = Execute(bc, 1, vf::Engine_Interpreter);
+    for(size_t threads = 2; threads <= 8; threads *= 2) {
+        std::vector<vf::Vector4> actual = Execute(bc, threads, vf::Engine_Interpreter);
+        EXPECT_EQ(memcmp(&expected[0], &actual[0], NumElements * sizeof(vf::Vector4)), 0) << threads << " threads";
+    }
+}
+
+TEST(Parallel, JIT)
+{
+    std::shared_ptr<vf::ByteCode> bc = Compile(pSource);
+    ASSERT_NE(bc, nullptr);
+
+    std::vector<vf::Vector4> expected = Execute(bc, 1, vf::Engine_JIT);
+    std::vector<vf::Vector4> actual = Execute(bc, 4, vf::Engine_JIT);
+    EXPECT_EQ(memcmp(&expected[0], &actual[0], NumElements * sizeof(vf::Vector4)), 0);
+}
+
+TEST(Parallel, InvalidParameters)
+{
+    std::shared_ptr<vf::ByteCode> bc = Compile(pSource);
+    ASSERT_NE(bc, nullptr);
+
+    uint8_t mem[1024];
+    vf::ByteCode_Execution aos(bc, mem, sizeof(mem), vf::Layout_AoS);
+    EXPECT_EQ(aos.SetThreads(4, 0), vf::Err_InvalidParameter);
+    EXPECT_EQ(aos.SetThreads(0), vf::Err_Success);
+
+    // the workers are given the same bindings, past the last index nothing is written.
+    EXPECT_EQ(aos.SetUniform(bc->GetNumUniforms(), 1.0f), vf::Err_InvalidRegister);
+    EXPECT_EQ(aos.SetRegisterPointer(bc->GetNumRegisters(), mem), vf::Err_InvalidRegister);
+
+    vf::ByteCode_Execution soa(bc, mem, sizeof(mem), vf::Layout_SoA);
+    EXPECT_EQ(soa.SetThreads(4), vf::Err_InvalidParameter);
+    EXPECT_EQ(soa.SetThreads(1), vf::Err_Success);
+}
+
+/**
+ * Each thread executes a range of its own, with its own scratch memory, on the same execution.
+ */
+TEST(Parallel, Ranges)
+{
+    std::shared_ptr<vf::ByteCode> bc = Compile(pSource);
+    ASSERT_NE(bc, nullptr);
+
+    for(size_t engine = 0; engine < 2; ++engine) {
+        std::vector<vf::Vector4> expected = Execute(bc, 1, vf::Engine_t(engine));
+        std::vector<vf::Vector4> a, c;
+        uint8_t mem[1024];
+        vf::ByteCode_Execution be(bc, mem, sizeof(mem), vf::Layout_AoS, vf::Engine_t(engine));
+        Bind(be, bc, a, c);
+
+        const size_t NumRanges = 4;
+        std::vector<std::vector<uint8_t> > scratch(NumRanges, std::vector<uint8_t>(be.GetScratchSize(100)));
+        vf::Status_t status[NumRanges];
+        std::vector<std::thread> threads;
+        for(size_t i = 0; i < NumRanges; ++i) {
+            size_t begin = (NumElements * i) / NumRanges, end = (NumElements * (i + 1)) / NumRanges;
+            threads.push_back(std::thread([&, i, begin, end]() {
+                status[i] = be.Execute(0, begin, end - begin, &scratch[i][0], scratch[i].size());
+            }));
+        }
+        for(size_t i = 0; i < NumRanges; ++i) {
+            threads[i].join();
+            EXPECT_EQ(status[i], vf::Err_Success);
+        }
+        EXPECT_EQ(memcmp(&expected[0], &c[0], NumElements * sizeof(vf::Vector4)), 0) << "engine " << engine;
+
+        uint8_t small[16];
+        EXPECT_EQ(be.Execute(0, 0, 10, small, sizeof(small)), vf::Err_InvalidParameter);
+        EXPECT_EQ(be.Execute(1, 0, 10, &scratch[0][0], scratch[0].size()), vf::Err_InvalidIndex);
+    }
+}
+
+/**
+ * The ranges read the hidden uniforms that were evaluated when the uniforms were set, and the
+ * machines that are reused by later ranges follow the bindings.
+ */
+TEST(Parallel, RangesFollowBindings)
+{
+    std::shared_ptr<vf::ByteCode> bc = Compile(
+        "in vec4        a;"
+        "uniform float  s;"
+        "out vec4       c;"
+        "void main()"
+        "{"
+        "   c = a * 2.0 * sin(s);"
+        "}");
+    ASSERT_NE(bc, nullptr);
+    ASSERT_EQ(bc->GetMethods().size(), 2);
+
+    std::vector<vf::Vector4> expected = Execute(bc, 1, vf::Engine_Interpreter);
+    std::vector<vf::Vector4> a, c, other(NumElements);
+    uint8_t mem[1024];
+    vf::ByteCode_Execution be(bc, mem, sizeof(mem), vf::Layout_AoS);
+    Bind(be, bc, a, c);
+    be.SetUniform(bc->UniformLocation("s"), 0.25f);
+
+    std::vector<uint8_t> scratch(be.GetScratchSize(100));
+    for(size_t begin = 0; begin < NumElements; begin += 1000) {
+        size_t count = (NumElements - begin) < 1000 ? (NumElements - begin) : 1000;
+        EXPECT_EQ(be.Execute(0, begin, count, &scratch[0], scratch.size()), vf::Err_Success);
+    }
+    EXPECT_NE(memcmp(&expected[0], &c[0], NumElements * sizeof(vf::Vector4)), 0);
+
+    be.SetUniform(bc->UniformLocation("s"), 0.75f);
+    be.SetRegisterPointer(bc->StreamLocation("c"), (float *) &other[0]);
+    for(size_t begin = 0; begin < NumElements; begin += 1000) {
+        size_t count = (NumElements - begin) < 1000 ? (NumElements - begin) : 1000;
+        EXPECT_EQ(be.Execute(0, begin, count, &scratch[0], scratch.size()), vf::Err_Success);
+    }
+    EXPECT_EQ(memcmp(&expected[0], &other[0], NumElements * sizeof(vf::Vector4)), 0);
+}
+
+TEST(Parallel, Scheduler)
+{
+    std::shared_ptr<vf::ByteCode> bc = Compile(pSource);
+    ASSERT_NE(bc, nullptr);
+
+    std::vector<vf::Vector4> expected = Execute(bc, 1, vf::Engine_Interpreter);
+    std::vector<vf::Vector4> a, c;
+    uint8_t mem[1024];
+    vf::ByteCode_Execution be(bc, mem, sizeof(mem), vf::Layout_AoS);
+    Bind(be, bc, a, c);
+
+    ReverseScheduler scheduler;
+    EXPECT_EQ(be.SetScheduler(&scheduler, 64), vf::Err_Success);
+    EXPECT_EQ(be.Execute(0, NumElements), vf::Err_Success);
+    EXPECT_EQ(scheduler.m_Calls, 1);
+    EXPECT_EQ(be.GetStats().numThreads, 3);
+    EXPECT_EQ(memcmp(&expected[0], &c[0], NumElements * sizeof(vf::Vector4)), 0);
+
+    EXPECT_EQ(be.SetScheduler(&scheduler, 0), vf::Err_InvalidParameter);
+    EXPECT_EQ(be.SetScheduler(nullptr), vf::Err_Success);
+}
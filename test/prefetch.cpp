@@ -0,0 +1,138 @@
+#include <intermediate.hpp>
+#include <gtest\gtest.h>
+#include <memory>
+#include <cstring>
+
+using namespace vf;
+
+/*****************************************************************************/
+/*                                      Utility                              */
+/*****************************************************************************/
+
+static std::shared_ptr<vf::ByteCode> Compile(const char * pSource)
+{
+    std::shared_ptr<vf::Program>    pProgram;
+    EXPECT_NO_THROW(pProgram = std::make_shared<vf::Program>(pSource));
+    return pProgram->Compile();
+}
+
+static const size_t NumElements = 20011;   /**< several batches, and a partial one */
+
+/**
+ * The positions q are computed a few steps ahead of the first lookup, and the positions p are
+ * read from a stream.
+ */
+static const char * pSource =
+    "sampler        s;"
+    "in vec3        p;"
+    "in vec4        a;"
+    "out vec4       c;"
+    "void main()"
+    "{"
+    "   vec3 q = p * 2.0;"
+    "   vec4 t = a * 0.5;"
+    "   t = t + a;"
+    "   c = t + sample3D(s, q) + sample3D(s, p);"
+    "}";
+
+/**
+ * Sampler that computes the samples from the positions, and counts the positions that it's
+ * told about ahead of the lookups.
+ */
+class CountingSampler : public vf::ISampler, public vf::ISamplerPrefetch
+{
+public:
+    CountingSampler() : calls(0), positions(0), dimensions(0) {}
+
+    bool sample1D(const vf::Vector *, vf::Vector *, size_t) const       { return false; }
+    bool sample1D(float, vf::Vector *, size_t) const                    { return false; }
+    bool sample2D(const vf::Vector *, vf::Vector *, size_t) const       { return false; }
+    bool sample2D(const vf::Vector2 &, vf::Vector *, size_t) const      { return false; }
+    bool sample3D(const vf::Vector3 &, vf::Vector *, size_t) const      { return false; }
+
+    bool sample3D(const vf::Vector * pos, vf::Vector * dst, size_t count) const
+    {
+        for(size_t i = 0; i < count; ++i) {
+            dst[i].u.v4.x = pos[i].u.v3.x + pos[i].u.v3.y;
+            dst[i].u.v4.y = pos[i].u.v3.y - pos[i].u.v3.z;
+            dst[i].u.v4.z = pos[i].u.v3.z * 0.5f;
+            dst[i].u.v4.w = 1.0f;
+        }
+        return true;
+    }
+
+    void prefetch(const vf::Vector *, size_t count, size_t dims) const
+    {
+        ++calls;
+        positions += count;
+        dimensions = dims;
+    }
+
+    mutable size_t calls, positions, dimensions;
+};
+
+/** Executes the program with a number of bytes prefetched ahead of each batch */
+static std::vector<vf::Vector4> Execute(std::shared_ptr<vf::ByteCode> bc, vf::Engine_t engine, size_t bytes,
+    CountingSampler & sampler)
+{
+    std::vector<vf::Vector4> p(NumElements), a(NumElements), c(NumElements);
+    for(size_t i = 0; i < NumElements; ++i) {
+        p[i].x = float(i % 13) * 0.5f;
+        p[i].y = float(i % 7) - 3.0f;
+        p[i].z = float(i % 5) + 0.25f;
+        p[i].w = 0.0f;
+        a[i].x = a[i].y = a[i].z = a[i].w = float(i % 3);
+    }
+
+    std::vector<uint8_t> mem(64 * 1024);
+    vf::ByteCode_Execution be(bc, &mem[0], mem.size(), vf::Layout_AoS, engine);
+    be.SetRegisterPointer(bc->StreamLocation("p"), &p[0]);
+    be.SetRegisterPointer(bc->StreamLocation("a"), &a[0]);
+    be.SetRegisterPointer(bc->StreamLocation("c"), &c[0]);
+    be.SetSampler(bc->SamplerLocation("s"), &sampler);
+    EXPECT_EQ(be.SetPrefetch(bytes), vf::Err_Success);
+    EXPECT_EQ(be.Execute(0, NumElements), vf::Err_Success);
+    return c;
+}
+
+/*****************************************************************************/
+/*                                      Prefetch                             */
+/*****************************************************************************/
+
+/**
+ * Prefetching doesn't change the result. The sampler is told about every position ahead of the
+ * lookups, and also about the start of the next batch when prefetching is enabled.
+ */
+TEST(Prefetch, SameResult)
+{
+    std::shared_ptr<vf::ByteCode> bc = Compile(pSource);
+    ASSERT_NE(bc, nullptr);
+
+    for(size_t engine = 0; engine < 2; ++engine) {
+        CountingSampler disabled, enabled;
+        std::vector<vf::Vector4> expected = Execute(bc, vf::Engine_t(engine), 0, disabled);
+        std::vector<vf::Vector4> result = Execute(bc, vf::Engine_t(engine), 4096, enabled);
+        EXPECT_EQ(memcmp(&expected[0], &result[0], NumElements * sizeof(vf::Vector4)), 0) << "engine " << engine;
+
+        EXPECT_GE(disabled.positions, NumElements);
+        EXPECT_GT(enabled.positions, disabled.positions);
+        EXPECT_GT(enabled.calls, disabled.calls);
+        EXPECT_EQ(enabled.dimensions, 3);
+    }
+}
+
+TEST(Prefetch, Context)
+{
+    std::shared_ptr<vf::ByteCode> bc = Compile(pSource);
+    ASSERT_NE(bc, nullptr);
+
+    vf::ByteCode_Program program(bc);
+    std::shared_ptr<vf::ByteCode_Context> context = program.CreateContext();
+    EXPECT_EQ(context->SetPrefetch(0), vf::Err_Success);
+    EXPECT_EQ(context->SetPrefetch(16 * 1024), vf::Err_Success);
+
+    CountingSampler sampler;
+    std::vector<uint8_t> mem(1024);
+    vf::ByteCode_Execution be(bc, &mem[0], mem.size());
+    EXPECT_EQ(be.SetSampler(bc->GetNumSamplers(), &sampler), vf::Err_InvalidRegister);
+}
@@ -147,4 +147,67 @@ TEST(Simple, Test2_Normalize)
         Make_Opcode(OP_VECTOR4_SCALAR_DIV_RR)|Make_Destination(Make_Register(1,0))|Make_FirstOperand(Make_Register(0,0))|
         Make_SecondOperand(Make_Register(2,0)),
         code[1]);
-}
\ No newline at end of file
+}
+
+/*****************************************************************************/
+/*                              Temporary registers                          */
+/*****************************************************************************/
+
+/**
+ * Temporaries are released as soon as they have been consumed, so the second product reuses
+ * the register that held the scalar operand of the first product.
+ */
+TEST(Simple, Temporaries_ReusedWithinStatement)
+{
+    std::vector<uint32_t> code;
+    const char * pSource =
+        "in vec4    x;"     // register 0
+        "in vec4    y;"     // register 1
+        "out vec4   w;"     // register 2
+        "void main()"
+        "{"
+        "   w = (x + y) * (x.y + y.x) + (x - y) * (x.z - y.w);"
+        "}";
+
+    auto bytecode = Compile(pSource);
+    ASSERT_NE(bytecode, nullptr);
+    ASSERT_TRUE(GetMethodSource(bytecode, code));
+    ASSERT_EQ(code.size(), 7);
+    EXPECT_EQ(bytecode->GetNumRegisters(), 6);
+
+    // r3 = r0 + r1
+    EXPECT_EQ(
+        Make_Opcode(OP_VECTOR4_ADD_RR)|Make_Destination(Make_Register(3,0))|Make_FirstOperand(Make_Register(0,0))|Make_SecondOperand(Make_Register(1,0)),
+        code[0]
+    );
+    // r4.x = r0.y + r1.x
+    EXPECT_EQ(
+        Make_Opcode(OP_SCALAR_ADD_RR)|Make_Destination(Make_Register(4,0))|Make_FirstOperand(Make_Register(0,1))|Make_SecondOperand(Make_Register(1,0)),
+        code[1]
+    );
+    // r3 = r3 * r4.x, r4 is dead afterwards
+    EXPECT_EQ(
+        Make_Opcode(OP_VECTOR4_SCALAR_MUL_RR)|Make_Destination(Make_Register(3,0))|Make_FirstOperand(Make_Register(3,0))|Make_SecondOperand(Make_Register(4,0)),
+        code[2]
+    );
+    // r4 = r0 - r1
+    EXPECT_EQ(
+        Make_Opcode(OP_VECTOR4_SUB_RR)|Make_Destination(Make_Register(4,0))|Make_FirstOperand(Make_Register(0,0))|Make_SecondOperand(Make_Register(1,0)),
+        code[3]
+    );
+    // r5.x = r0.z - r1.w
+    EXPECT_EQ(
+        Make_Opcode(OP_SCALAR_SUB_RR)|Make_Destination(Make_Register(5,0))|Make_FirstOperand(Make_Register(0,2))|Make_SecondOperand(Make_Register(1,3)),
+        code[4]
+    );
+    // r4 = r4 * r5.x, r5 is dead afterwards
+    EXPECT_EQ(
+        Make_Opcode(OP_VECTOR4_SCALAR_MUL_RR)|Make_Destination(Make_Register(4,0))|Make_FirstOperand(Make_Register(4,0))|Make_SecondOperand(Make_Register(5,0)),
+        code[5]
+    );
+    // r2 = r3 + r4
+    EXPECT_EQ(
+        Make_Opcode(OP_VECTOR4_ADD_RR)|Make_Destination(Make_Register(2,0))|Make_FirstOperand(Make_Register(3,0))|Make_SecondOperand(Make_Register(4,0)),
+        code[6]
+    );
+}
@@ -0,0 +1,107 @@
+#include <intermediate.hpp>
+#include <gtest\gtest.h>
+#include <memory>
+#include <cstring>
+
+using namespace vf;
+
+/*****************************************************************************/
+/*                                      Utility                              */
+/*****************************************************************************/
+
+static std::shared_ptr<vf::ByteCode> Compile(const char * pSource)
+{
+    std::shared_ptr<vf::Program>    pProgram;
+    EXPECT_NO_THROW(pProgram = std::make_shared<vf::Program>(pSource));
+    return pProgram->Compile();
+}
+
+static const char * Sources[] = {
+    "in vec4 a; out vec4 c; void main() { c = a * 2.0 - 1.0; }",
+    "in vec4 a; out vec4 c; void main() { c = normalize(a) * length(a.xyz) + a; }",
+    "in vec4 a; out vec4 c; void main() { c = a.x > a.y ? a * dot(a, a) : -a; }"
+};
+
+static const size_t NumFields = 3;
+static const size_t NumElements[NumFields] = { 50000, 17, 9000 };
+
+/**
+ * The streams of a field.
+ */
+struct Field
+{
+    std::shared_ptr<vf::ByteCode>               bytecode;
+    std::shared_ptr<vf::ByteCode_Execution>     execution;
+    std::vector<vf::Vector4>                    a, c;
+    std::vector<uint8_t>                        memory;
+};
+
+static void Initialize(Field & field, size_t index)
+{
+    size_t n = NumElements[index];
+    field.bytecode = Compile(Sources[index]);
+    field.a.resize(n);
+    field.c.resize(n);
+    for(size_t i = 0; i < n; ++i) {
+        field.a[i].x = float(i % 13) - 6.0f;
+        field.a[i].y = float(i % 7) * 0.5f;
+        field.a[i].z = 1.0f + float(index);
+        field.a[i].w = -2.0f;
+        field.c[i].x = field.c[i].y = field.c[i].z = field.c[i].w = 0.0f;
+    }
+    field.memory.resize(2048);
+    field.execution = std::make_shared<vf::ByteCode_Execution>(field.bytecode, &field.memory[0], field.memory.size());
+    field.execution->SetRegisterPointer(field.bytecode->StreamLocation("a"), (float *) &field.a[0]);
+    field.execution->SetRegisterPointer(field.bytecode->StreamLocation("c"), (float *) &field.c[0]);
+}
+
+/*****************************************************************************/
+/*                                      Scheduler                            */
+/*****************************************************************************/
+
+TEST(Scheduler, SameResultAsSingleThread)
+{
+    Field expected[NumFields], actual[NumFields];
+    std::vector<vf::Job> jobs;
+    for(size_t i = 0; i < NumFields; ++i) {
+        Initialize(expected[i], i);
+        Initialize(actual[i], i);
+        ASSERT_EQ(expected[i].execution->Execute(0, NumElements[i]), vf::Err_Success);
+
+        // The first field is divided into two jobs.
+        size_t half = (i == 0) ? (NumElements[i] / 2) : 0;
+        vf::Job first = { actual[i].execution.get(), 0, 0, half, vf::Err_Success };
+        vf::Job second = { actual[i].execution.get(), 0, half, NumElements[i] - half, vf::Err_Success };
+        if (half) {
+            jobs.push_back(first);
+        }
+        jobs.push_back(second);
+    }
+
+    vf::Scheduler scheduler(4, 64);
+    EXPECT_EQ(scheduler.NumThreads(), 4);
+    EXPECT_EQ(scheduler.Run(jobs), vf::Err_Success);
+    for(size_t i = 0; i < NumFields; ++i) {
+        EXPECT_EQ(memcmp(&expected[i].c[0], &actual[i].c[0], NumElements[i] * sizeof(vf::Vector4)), 0) << "field " << i;
+    }
+    for(size_t i = 0; i < jobs.size(); ++i) {
+        EXPECT_EQ(jobs[i].status, vf::Err_Success);
+    }
+}
+
+TEST(Scheduler, FailedJob)
+{
+    Field field;
+    Initialize(field, 0);
+
+    std::vector<vf::Job> jobs;
+    vf::Job valid = { field.execution.get(), 0, 0, 100, vf::Err_Success };
+    vf::Job invalid = { field.execution.get(), 3, 0, 100, vf::Err_Success };
+    jobs.push_back(valid);
+    jobs.push_back(invalid);
+
+    vf::Scheduler scheduler(2, 16);
+    EXPECT_EQ(scheduler.Run(jobs), vf::Err_InvalidIndex);
+    EXPECT_EQ(jobs[0].status, vf::Err_Success);
+    EXPECT_EQ(jobs[1].status, vf::Err_InvalidIndex);
+}
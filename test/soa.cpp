@@ -0,0 +1,300 @@
+#include <intermediate.hpp>
+#include <gtest\gtest.h>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+
+using namespace vf;
+
+/*****************************************************************************/
+/*                                      Utility                              */
+/*****************************************************************************/
+
+/**
+ * Number of elements that are executed. The memory of the machines holds about 30 elements per
+ * batch, so these cover a partial first batch, whole batches and whole batches followed by a tail.
+ */
+static const size_t Lengths[]       = { 1, 3, 4, 5, 7, 8, 15, 16, 17, 31, 32, 33, 64, 100 };
+static const size_t NumLengths      = sizeof(Lengths) / sizeof(Lengths[0]);
+static const size_t MemorySize      = 512;
+
+/**
+ * A family of opcodes, which starts at the RR (or R) form of the scalar (or smallest) type and
+ * has four forms per type for two operands and two forms per type for a single operand.
+ */
+struct Family
+{
+    const char *    pName;
+    uint8_t         first;
+    size_t          numOpcodes;
+    size_t          numOperands;
+};
+
+static const Family Families[] = {
+    { "add",        OP_SCALAR_ADD_RR,       16, 2 },
+    { "sub",        OP_SCALAR_SUB_RR,       16, 2 },
+    { "mul",        OP_SCALAR_MUL_RR,       16, 2 },
+    { "div",        OP_SCALAR_DIV_RR,       16, 2 },
+    { "min",        OP_MIN_SCALAR_RR,       16, 2 },
+    { "max",        OP_MAX_SCALAR_RR,       16, 2 },
+    { "dot",        OP_DOT_VECTOR2_RR,      12, 2 },
+    { "cross",      OP_CROSS_RR,             4, 2 },
+    { "cmp",        OP_CMP_GRT_RR,          20, 2 },
+    { "cond",       OP_COND_SCALAR_RR,      16, 2 },
+    { "negate",     OP_SCALAR_NEGATE_R,      8, 1 },
+    { "trig",       OP_SINE_R,              12, 1 },
+    { "length",     OP_LENGTH_VECTOR2_R,     6, 1 },
+    { "sqrt",       OP_SQRT_R,               4, 1 },
+    { "normalize",  OP_VECTOR2_NORMALIZE_R,  6, 1 },
+    { "assign",     OP_ASSIGN_SCALAR_R,      8, 1 },
+    { "floor",      OP_FLOOR_SCALAR_R,       8, 1 },
+    { "ceil",       OP_CEIL_SCALAR_R,        8, 1 }
+};
+
+static uint32_t Make_Instruction(uint8_t opcode, uint8_t destination, uint8_t first, uint8_t second)
+{
+    return Make_Opcode(opcode)|Make_Destination(destination)|Make_FirstOperand(first)|Make_SecondOperand(second);
+}
+
+static uint32_t Make_Constant(float value)
+{
+    return *((uint32_t *)&value);
+}
+
+/**
+ * Returns a operand, which is the stream a or b for the register forms and the uniform u or v for
+ * the constant forms since both share the same index. Scalar operations read the member.
+ */
+static uint8_t Make_Operand(size_t index, size_t member)
+{
+    return static_cast<uint8_t>(Make_Register(index, member));
+}
+
+/**
+ * Creates bytecode with a single method, the input streams a (register 0) and b (register 1), the
+ * output stream c (register 2), the temporary t (register 3) and the uniforms u and v.
+ */
+static std::shared_ptr<vf::ByteCode> Make_ByteCode(const std::vector<uint32_t> & code)
+{
+    std::map<std::string, vf::Variable> io, uniforms, samplers;
+    vf::Variable variable = vf::Variable();
+    variable.m_Type         = vf::Type_Vec4;
+    variable.m_Register     = 0;
+    io["a"] = variable;
+    variable.m_Register     = 1;
+    io["b"] = variable;
+    variable.m_Register     = 2;
+    io["c"] = variable;
+    variable.m_Register     = 0;
+    variable.m_UniformIndex = 0;
+    uniforms["u"] = variable;
+    variable.m_UniformIndex = 1;
+    uniforms["v"] = variable;
+
+    std::vector<std::shared_ptr<vf::ByteCode_Method> > methods;
+    methods.push_back(std::make_shared<vf::ByteCode_Method>("main"));
+    for(size_t i = 0; i < code.size(); ++i) {
+        methods[0]->emit(code[i]);
+    }
+    return std::make_shared<vf::ByteCode>(4, io, uniforms, samplers, methods);
+}
+
+/**
+ * Wraps a instruction in a program that initializes the temporary from the uniform v, executes
+ * the instruction into the temporary and copies the temporary to the stream c. Components that
+ * the instruction doesn't write are therefore defined in both layouts.
+ */
+static std::vector<uint32_t> Make_Program(const std::vector<uint32_t> & instruction)
+{
+    std::vector<uint32_t> code;
+    code.push_back(Make_Instruction(OP_ASSIGN_VECTOR4_C, Make_Register(3, 0), Make_Register(1, 0), 0));
+    code.insert(code.end(), instruction.begin(), instruction.end());
+    code.push_back(Make_Instruction(OP_ASSIGN_VECTOR4_R, Make_Register(2, 0), Make_Register(3, 0), 0));
+    return code;
+}
+
+/** Returns the value of a component of a input stream, which is in (-1, 1) and never zero */
+static float Input(size_t stream, size_t element, size_t component)
+{
+    size_t k = (element * 4 + component) * 37 + stream * 11;
+    return float(k % 23) * 0.08f - 0.9f;
+}
+
+/**
+ * Executes bytecode on count elements in a layout, and returns the status. The results are
+ * returned in AoS order in c regardless of the layout.
+ */
+static vf::Status_t Execute(std::shared_ptr<vf::ByteCode> bc, vf::Layout_t layout, size_t count,
+    std::vector<vf::Vector4> & c)
+{
+    std::vector<vf::Vector4> a(count), b(count);
+    c.assign(count, vf::Vector4());
+    for(size_t i = 0; i < count; ++i) {
+        float * pa = &a[i].x;
+        float * pb = &b[i].x;
+        float * pc = &c[i].x;
+        for(size_t k = 0; k < 4; ++k) {
+            pa[k] = Input(0, i, k);
+            pb[k] = Input(1, i, k);
+            pc[k] = 42.0f;
+        }
+    }
+
+    uint8_t mem[MemorySize];
+    vf::ByteCode_Execution be(bc, mem, sizeof(mem), layout);
+    vf::Vector4 u, v;
+    u.x = 0.25f; u.y = -0.5f; u.z = 0.75f; u.w = -0.125f;
+    v.x = -0.375f; v.y = 0.625f; v.z = 0.5f; v.w = 0.875f;
+    be.SetUniform(0, u);
+    be.SetUniform(1, v);
+
+    if (layout == vf::Layout_AoS) {
+        be.SetRegisterPointer(0, &a[0]);
+        be.SetRegisterPointer(1, &b[0]);
+        be.SetRegisterPointer(2, &c[0]);
+        return be.Execute(0, count);
+    }
+
+    std::vector<float> planes(3 * 4 * count);
+    for(size_t i = 0; i < count; ++i) {
+        for(size_t k = 0; k < 4; ++k) {
+            planes[(0 * 4 + k) * count + i] = (&a[i].x)[k];
+            planes[(1 * 4 + k) * count + i] = (&b[i].x)[k];
+            planes[(2 * 4 + k) * count + i] = (&c[i].x)[k];
+        }
+    }
+    for(size_t r = 0; r < 3; ++r) {
+        float * p = &planes[r * 4 * count];
+        be.SetComponentPointers(r, p, p + count, p + 2 * count, p + 3 * count);
+    }
+    vf::Status_t status = be.Execute(0, count);
+    for(size_t i = 0; i < count; ++i) {
+        for(size_t k = 0; k < 4; ++k) {
+            (&c[i].x)[k] = planes[(2 * 4 + k) * count + i];
+        }
+    }
+    return status;
+}
+
+/**
+ * Returns true if two results agree, both NaN (the square root of a negative input) counts as
+ * agreeing. Trigonometric and normalize operations may be evaluated differently in the two
+ * layouts, so a small relative error is accepted.
+ */
+static bool Equivalent(float aos, float soa)
+{
+    if ((aos != aos) || (soa != soa)) {
+        return (aos != aos) && (soa != soa);
+    }
+    if (aos == soa) {
+        return true;
+    }
+    return fabsf(aos - soa) <= 1e-5f * (1.0f + fabsf(aos));
+}
+
+/**
+ * Executes code in both layouts over every length, and returns the number of components that
+ * differ. The element of the first difference is reported.
+ */
+static size_t Compare(const std::vector<uint32_t> & code, const char * pName, uint8_t opcode)
+{
+    std::shared_ptr<vf::ByteCode> bc = Make_ByteCode(Make_Program(code));
+    size_t mismatches = 0;
+    for(size_t n = 0; n < NumLengths; ++n) {
+        std::vector<vf::Vector4> aos, soa;
+        EXPECT_EQ(Execute(bc, vf::Layout_AoS, Lengths[n], aos), vf::Err_Success);
+        EXPECT_EQ(Execute(bc, vf::Layout_SoA, Lengths[n], soa), vf::Err_Success);
+        for(size_t i = 0; i < Lengths[n]; ++i) {
+            for(size_t k = 0; k < 4; ++k) {
+                float x = (&aos[i].x)[k], y = (&soa[i].x)[k];
+                if (!Equivalent(x, y)) {
+                    if (mismatches == 0) {
+                        printf("%s opcode %u, %u elements: element %u component %u is %g (AoS), %g (SoA)\n",
+                            pName, unsigned(opcode), unsigned(Lengths[n]), unsigned(i), unsigned(k), x, y);
+                    }
+                    ++mismatches;
+                }
+            }
+        }
+    }
+    return mismatches;
+}
+
+/**
+ * Returns the instructions that exercise a opcode of a family in a form. Comparisons only set
+ * the condition, so they are followed by a conditional assignment, and conditional assignments
+ * are preceded by a comparison.
+ */
+static std::vector<uint32_t> Make_Instructions(const Family & family, uint8_t opcode)
+{
+    std::vector<uint32_t> code;
+    uint8_t first = Make_Operand(0, 1);
+    uint8_t second = (family.numOperands == 2) ? Make_Operand(1, 2) : 0;
+
+    if (family.first == OP_COND_SCALAR_RR) {
+        code.push_back(Make_Instruction(OP_CMP_GRT_RR, 0, Make_Register(0, 0), Make_Register(1, 3)));
+    }
+    code.push_back(Make_Instruction(opcode, Make_Register(3, 1), first, second));
+    if (family.first == OP_CMP_GRT_RR) {
+        code.push_back(Make_Instruction(OP_COND_VECTOR4_RR, Make_Register(3, 0), Make_Register(0, 0),
+            Make_Register(1, 0)));
+    }
+    return code;
+}
+
+/*****************************************************************************/
+/*                                      SoA                                  */
+/*****************************************************************************/
+
+TEST(SoA, EveryOpcodeMatchesAoS)
+{
+    for(size_t f = 0; f < sizeof(Families) / sizeof(Families[0]); ++f) {
+        const Family & family = Families[f];
+        for(size_t i = 0; i < family.numOpcodes; ++i) {
+            uint8_t opcode = static_cast<uint8_t>(family.first + i);
+            EXPECT_EQ(Compare(Make_Instructions(family, opcode), family.pName, opcode), size_t(0));
+        }
+    }
+}
+
+TEST(SoA, InlineConstantsMatchAoS)
+{
+    std::vector<uint32_t> code;
+    code.push_back(Make_Instruction(OP_VECTOR4_ADD_RC, Make_Register(3, 0), Make_Register(0, 0), 0xff));
+    code.push_back(Make_Constant(1.0f));
+    code.push_back(Make_Constant(-2.0f));
+    code.push_back(Make_Constant(0.5f));
+    code.push_back(Make_Constant(4.0f));
+    code.push_back(Make_Instruction(OP_SCALAR_MUL_RC, Make_Register(3, 2), Make_Register(1, 3), 0xff));
+    code.push_back(Make_Constant(1.5f));
+    EXPECT_EQ(Compare(code, "inline", OP_VECTOR4_ADD_RC), size_t(0));
+}
+
+TEST(SoA, ChainedTemporariesMatchAoS)
+{
+    std::vector<uint32_t> code;
+    code.push_back(Make_Instruction(OP_VECTOR4_NORMALIZE_R, Make_Register(3, 0), Make_Register(0, 0), 0));
+    code.push_back(Make_Instruction(OP_VECTOR4_SCALAR_MUL_RC, Make_Register(2, 0), Make_Register(1, 0),
+        Make_Register(0, 0)));
+    code.push_back(Make_Instruction(OP_VECTOR4_ADD_RR, Make_Register(3, 0), Make_Register(3, 0), Make_Register(2, 0)));
+    code.push_back(Make_Instruction(OP_DOT_VECTOR3_RR, Make_Register(3, 1), Make_Register(0, 0), Make_Register(1, 0)));
+    code.push_back(Make_Instruction(OP_CMP_GRT_RC, 0, Make_Register(3, 1), 0xff));
+    code.push_back(Make_Constant(0.1f));
+    code.push_back(Make_Instruction(OP_VECTOR4_NEGATE_R, Make_Register(2, 0), Make_Register(0, 0), 0));
+    code.push_back(Make_Instruction(OP_COND_VECTOR4_RR, Make_Register(3, 0), Make_Register(3, 0), Make_Register(2, 0)));
+    EXPECT_EQ(Compare(code, "chain", OP_VECTOR4_NORMALIZE_R), size_t(0));
+}
+
+TEST(SoA, ComponentPointerIndexOutOfRange)
+{
+    std::vector<uint32_t> code;
+    code.push_back(Make_Instruction(OP_ASSIGN_VECTOR4_R, Make_Register(2, 0), Make_Register(0, 0), 0));
+    std::shared_ptr<vf::ByteCode> bc = Make_ByteCode(code);
+
+    float x[4];
+    uint8_t mem[MemorySize];
+    vf::ByteCode_Execution be(bc, mem, sizeof(mem), vf::Layout_SoA);
+    EXPECT_EQ(be.SetComponentPointers(2, x, x, x, x), vf::Err_Success);
+    EXPECT_EQ(be.SetComponentPointers(3, x, x, x, x), vf::Err_InvalidRegister);
+    EXPECT_EQ(be.SetComponentPointers(bc->GetNumRegisters(), x, x, x, x), vf::Err_InvalidRegister);
+}
@@ -0,0 +1,372 @@
+#include <intermediate.hpp>
+#include <vfssa.h>
+#include <gtest\gtest.h>
+#include <memory>
+#include <sstream>
+#include <cmath>
+
+using namespace vf;
+
+/*****************************************************************************/
+/*                                      Utility                              */
+/*****************************************************************************/
+
+static std::shared_ptr<vf::ByteCode> Compile(const char * pSource)
+{
+    std::shared_ptr<vf::Program>    pProgram;
+    EXPECT_NO_THROW(pProgram = std::make_shared<vf::Program>(pSource));
+    return pProgram->Compile();
+}
+
+static bool GetMethodSource(std::shared_ptr<vf::ByteCode> bc, std::vector<uint32_t> & code)
+{
+    const std::vector<std::shared_ptr<vf::ByteCode_Method> > & methods = bc->GetMethods();
+    if (methods.empty())
+        return false;
+
+    const std::shared_ptr<vf::ByteCode_Method> method = methods[0];
+    code = method->GetCode();
+    return true;
+}
+
+static IR_Instruction Load(uint8_t reg, vf::DataType type)
+{
+    IR_Instruction ins(IR_Load, type);
+    ins.reg = reg;
+    return ins;
+}
+
+static IR_Instruction Operation(IR_Opcode_t op, vf::DataType type, int first, int second = -1)
+{
+    IR_Instruction ins(op, type);
+    ins.args[0] = first;
+    ins.args[1] = second;
+    return ins;
+}
+
+static IR_Instruction Store(uint8_t reg, vf::DataType type, int value)
+{
+    IR_Instruction ins(IR_Store, type);
+    ins.reg     = reg;
+    ins.args[0] = value;
+    return ins;
+}
+
+/*****************************************************************************/
+/*                                  Optimization                             */
+/*****************************************************************************/
+
+/**
+ * Operations on constants are evaluated at compile time, also through members of constants.
+ */
+TEST(Ssa, ConstantsAreFolded)
+{
+    std::vector<uint32_t> code;
+    const char * pSource =
+        "const vec4 c = {1.0, 2.0, 3.0, 4.0};"
+        "out vec4   y;"
+        "void main()"
+        "{"
+        "   y = c * (c.z + 1.0);"
+        "}";
+
+    auto bytecode = Compile(pSource);
+    ASSERT_NE(bytecode, nullptr);
+    ASSERT_TRUE(GetMethodSource(bytecode, code));
+    ASSERT_EQ(code.size(), 5);
+
+    EXPECT_EQ(
+        Make_Opcode(OP_ASSIGN_VECTOR4_C)|Make_Destination(Make_Register(0,0))|Make_FirstOperand(0xff),
+        code[0]
+    );
+    EXPECT_FLOAT_EQ(4.0, *((float *)&code[1]));
+    EXPECT_FLOAT_EQ(8.0, *((float *)&code[2]));
+    EXPECT_FLOAT_EQ(12.0, *((float *)&code[3]));
+    EXPECT_FLOAT_EQ(16.0, *((float *)&code[4]));
+}
+
+/**
+ * A variable that is read after it has been assigned refers to the assigned value, which
+ * allows the constant to be folded into the following statement.
+ */
+TEST(Ssa, StoredValuesAreForwarded)
+{
+    std::vector<uint32_t> code;
+    const char * pSource =
+        "in vec4    a;"     // register 0
+        "out vec4   b;"     // register 1
+        "void main()"
+        "{"
+        "   float s = 2.0;"
+        "   b = a * (s + 1.0);"
+        "}";
+
+    auto bytecode = Compile(pSource);
+    ASSERT_NE(bytecode, nullptr);
+    ASSERT_TRUE(GetMethodSource(bytecode, code));
+    ASSERT_EQ(code.size(), 4);
+
+    // b = a * 3.0
+    EXPECT_EQ(
+        Make_Opcode(OP_VECTOR4_SCALAR_MUL_RC)|Make_Destination(Make_Register(1,0))|Make_FirstOperand(Make_Register(0,0))|Make_SecondOperand(0xff),
+        code[2]
+    );
+    EXPECT_FLOAT_EQ(3.0, *((float *)&code[3]));
+}
+
+TEST(Ssa, DeadCodeElimination)
+{
+    IR_Function func;
+    func.Append(Load(0, vf::Type_Vec4));                         // %0
+    func.Append(Load(1, vf::Type_Vec4));                         // %1
+    func.Append(Operation(IR_Add, vf::Type_Vec4, 0, 1));         // %2, never used
+    func.Append(Operation(IR_Sub, vf::Type_Vec4, 0, 1));         // %3
+    func.Append(Store(2, vf::Type_Vec4, 3));
+
+    EXPECT_TRUE(IR_DeadCodeElimination()->Run(func));
+    ASSERT_EQ(func.code.size(), 4);
+    EXPECT_EQ(func.code[2].op, IR_Sub);
+    EXPECT_EQ(func.code[3].op, IR_Store);
+    EXPECT_EQ(func.code[3].args[0], 2);
+    EXPECT_FALSE(IR_DeadCodeElimination()->Run(func));
+}
+
+/**
+ * A expression that appears in several statements is only computed once.
+ */
+TEST(Ssa, CommonSubexpressions)
+{
+    std::vector<uint32_t> code;
+    const char * pSource =
+        "in vec4    a;"     // register 0
+        "out vec4   b;"     // register 1
+        "out vec4   c;"     // register 2
+        "void main()"
+        "{"
+        "   b = normalize(a) * 2.0;"
+        "   c = normalize(a) + b;"
+        "}";
+
+    auto bytecode = Compile(pSource);
+    ASSERT_NE(bytecode, nullptr);
+    ASSERT_TRUE(GetMethodSource(bytecode, code));
+    ASSERT_EQ(code.size(), 4);
+
+    // r3 = normalize(r0)
+    EXPECT_EQ(
+        Make_Opcode(OP_VECTOR4_NORMALIZE_R)|Make_Destination(Make_Register(3,0))|Make_FirstOperand(Make_Register(0,0)),
+        code[0]
+    );
+    // r2 = r3 + r1
+    EXPECT_EQ(
+        Make_Opcode(OP_VECTOR4_ADD_RR)|Make_Destination(Make_Register(2,0))|Make_FirstOperand(Make_Register(3,0))|Make_SecondOperand(Make_Register(1,0)),
+        code[3]
+    );
+}
+
+/**
+ * A value that is reused by a later statement is computed directly into the output of that
+ * statement, instead of into a temporary register that is assigned to the output.
+ */
+TEST(Ssa, ValuesAreComputedIntoOutputs)
+{
+    std::vector<uint32_t> code;
+    const char * pSource =
+        "in vec4    a;"     // register 0
+        "in vec4    b;"     // register 1
+        "out vec4   c;"     // register 2
+        "out vec4   d;"     // register 3
+        "void main()"
+        "{"
+        "   c = (a + b) * 2.0;"
+        "   d = a + b;"
+        "}";
+
+    auto bytecode = Compile(pSource);
+    ASSERT_NE(bytecode, nullptr);
+    ASSERT_TRUE(GetMethodSource(bytecode, code));
+    ASSERT_EQ(code.size(), 3);
+
+    // r3 = r0 + r1
+    EXPECT_EQ(
+        Make_Opcode(OP_VECTOR4_ADD_RR)|Make_Destination(Make_Register(3,0))|Make_FirstOperand(Make_Register(0,0))|Make_SecondOperand(Make_Register(1,0)),
+        code[0]
+    );
+    // r2 = r3 * 2.0
+    EXPECT_EQ(
+        Make_Opcode(OP_VECTOR4_SCALAR_MUL_RC)|Make_Destination(Make_Register(2,0))|Make_FirstOperand(Make_Register(3,0))|Make_SecondOperand(0xff),
+        code[1]
+    );
+    EXPECT_FLOAT_EQ(2.0, *((float *)&code[2]));
+}
+
+/**
+ * Reusing the first addition would keep it alive while the other values are computed, which
+ * isn't allowed when the pass may not raise the number of live values.
+ */
+TEST(Ssa, CommonSubexpressions_RegisterPressure)
+{
+    IR_Function func;
+    func.Append(Load(0, vf::Type_Vec4));                         // %0
+    func.Append(Load(1, vf::Type_Vec4));                         // %1
+    func.Append(Operation(IR_Add, vf::Type_Vec4, 0, 1));         // %2
+    func.Append(Operation(IR_Negate, vf::Type_Vec4, 2));         // %3
+    func.Append(Store(2, vf::Type_Vec4, 3));
+    func.Append(Operation(IR_Sub, vf::Type_Vec4, 0, 1));         // %5
+    func.Append(Operation(IR_Negate, vf::Type_Vec4, 5));         // %6
+    func.Append(Operation(IR_Min, vf::Type_Vec4, 6, 5));         // %7
+    func.Append(Store(3, vf::Type_Vec4, 7));
+    func.Append(Operation(IR_Add, vf::Type_Vec4, 1, 0));         // %9, same as %2
+    func.Append(Operation(IR_Negate, vf::Type_Vec4, 9));         // %10
+    func.Append(Store(4, vf::Type_Vec4, 10));
+    ASSERT_EQ(IR_Pressure(func), 2);
+
+    IR_Function limited = func;
+    EXPECT_FALSE(IR_CommonSubexpressionElimination(0)->Run(limited));
+    EXPECT_EQ(limited.code.size(), func.code.size());
+
+    EXPECT_TRUE(IR_CommonSubexpressionElimination()->Run(func));
+    ASSERT_EQ(func.code.size(), 10);
+    EXPECT_EQ(func.code[9].op, IR_Store);
+    EXPECT_EQ(func.code[9].args[0], 3);
+}
+
+/*****************************************************************************/
+/*                                  Hoisting                                 */
+/*****************************************************************************/
+
+static const char * pHoistSource =
+    "in vec4        r;"     // register 0
+    "uniform float  t;"     // uniform 0
+    "out vec4       y;"     // register 1
+    "void main()"
+    "{"
+    "   y = r * 2.0 * sin(t);"
+    "}";
+
+/**
+ * sin(t) only depends on a uniform, so it's computed by the prologue and read from a hidden
+ * uniform by the method.
+ */
+TEST(Ssa, UniformsAreHoisted)
+{
+    std::vector<uint32_t> code;
+    auto bytecode = Compile(pHoistSource);
+    ASSERT_NE(bytecode, nullptr);
+    ASSERT_TRUE(GetMethodSource(bytecode, code));
+    ASSERT_EQ(code.size(), 3);
+
+    // y = r2 * $main.0
+    EXPECT_EQ(
+        Make_Opcode(OP_VECTOR4_SCALAR_MUL_RC)|Make_Destination(Make_Register(1,0))|Make_FirstOperand(Make_Register(2,0))|Make_SecondOperand(Make_Register(1,0)),
+        code[2]
+    );
+
+    const std::vector<std::shared_ptr<vf::ByteCode_Method> > & methods = bytecode->GetMethods();
+    ASSERT_EQ(methods.size(), 2);
+    EXPECT_EQ(methods[1]->GetName(), "$main");
+    ASSERT_EQ(methods[1]->GetCode().size(), 1);
+    EXPECT_EQ(
+        Make_Opcode(OP_SINE_C)|Make_Destination(Make_Register(2,0))|Make_FirstOperand(Make_Register(0,0)),
+        methods[1]->GetCode()[0]
+    );
+
+    const std::map<std::string, vf::Variable> & uniforms = bytecode->GetUniforms();
+    ASSERT_EQ(uniforms.count("$main.0"), 1);
+    EXPECT_EQ(uniforms.find("$main.0")->second.m_UniformIndex, 1);
+    EXPECT_EQ(uniforms.find("$main.0")->second.m_Register, 2);
+}
+
+/**
+ * The hidden uniforms are computed again when the uniforms they depend on has changed.
+ */
+TEST(Ssa, HoistedUniformsFollowChanges)
+{
+    auto bytecode = Compile(pHoistSource);
+    ASSERT_NE(bytecode, nullptr);
+
+    const size_t NumElements = 100;
+    vf::Layout_t layouts[] = { vf::Layout_AoS, vf::Layout_SoA };
+    for(size_t l = 0; l < 2; ++l) {
+        std::vector<float> r(NumElements * 4), y(NumElements * 4, 0.0f);
+        for(size_t i = 0; i < r.size(); ++i) {
+            r[i] = float(i) * 0.25f - 10.0f;
+        }
+
+        uint8_t mem[4096];
+        vf::ByteCode_Execution be(bytecode, mem, sizeof(mem), layouts[l]);
+        if (layouts[l] == vf::Layout_AoS) {
+            be.SetRegisterPointer(bytecode->StreamLocation("r"), &r[0]);
+            be.SetRegisterPointer(bytecode->StreamLocation("y"), &y[0]);
+        } else {
+            be.SetComponentPointers(bytecode->StreamLocation("r"), &r[0], &r[NumElements], &r[2 * NumElements], &r[3 * NumElements]);
+            be.SetComponentPointers(bytecode->StreamLocation("y"), &y[0], &y[NumElements], &y[2 * NumElements], &y[3 * NumElements]);
+        }
+
+        float times[] = { 0.5f, 1.25f };
+        for(size_t k = 0; k < 2; ++k) {
+            be.SetUniform(bytecode->UniformLocation("t"), times[k]);
+            ASSERT_EQ(be.Execute(0, NumElements), vf::Err_Success);
+            for(size_t i = 0; i < r.size(); ++i) {
+                EXPECT_NEAR(y[i], r[i] * 2.0f * sinf(times[k]), 1e-4f);
+            }
+        }
+    }
+}
+
+/*****************************************************************************/
+/*                                  Diagnostics                              */
+/*****************************************************************************/
+
+TEST(Ssa, Dump)
+{
+    IR_Function func;
+    func.Append(Load(0, vf::Type_Vec4));
+    func.Append(Load(1, vf::Type_Vec4));
+    func.Append(Operation(IR_Add, vf::Type_Vec4, 0, 1));
+    func.Append(Store(2, vf::Type_Vec4, 2));
+
+    std::ostringstream os;
+    IR_Dump(func, os);
+    EXPECT_NE(os.str().find("%0 = load vec4 r0.xyzw"), std::string::npos);
+    EXPECT_NE(os.str().find("%2 = add vec4 %0, %1"), std::string::npos);
+    EXPECT_NE(os.str().find("store vec4 r2.xyzw, %2"), std::string::npos);
+}
+
+/**
+ * The pass manager dumps the function after each pass that changed it, and keeps the
+ * time spent in each pass.
+ */
+TEST(Ssa, PassManager)
+{
+    std::ostringstream os;
+    IR_PassManager & manager = IR_GetPassManager();
+    manager.ResetTimings();
+    manager.SetDump(&os);
+
+    auto bytecode = Compile(
+        "in vec4    a;"
+        "out vec4   b;"
+        "void main()"
+        "{"
+        "   b = a * (2.0 + 1.0);"
+        "}");
+    manager.SetDump(nullptr);
+    ASSERT_NE(bytecode, nullptr);
+
+    EXPECT_NE(os.str().find("*** before optimization ***"), std::string::npos);
+    EXPECT_NE(os.str().find("*** after fold ***"), std::string::npos);
+
+    std::vector<IR_PassTiming> timings = manager.GetTimings();
+    ASSERT_EQ(timings.size(), 3);
+    EXPECT_EQ(timings[0].name, "fold");
+    EXPECT_EQ(timings[0].runs, 1);
+    EXPECT_EQ(timings[0].changes, 1);
+    EXPECT_EQ(timings[1].name, "cse");
+    EXPECT_EQ(timings[2].name, "dce");
+    EXPECT_GE(timings[2].seconds, 0.0);
+
+    std::ostringstream table;
+    manager.PrintTimings(table);
+    EXPECT_NE(table.str().find("fold"), std::string::npos);
+}
@@ -0,0 +1,105 @@
+#include <intermediate.hpp>
+#include <gtest\gtest.h>
+#include <memory>
+#include <cstring>
+
+using namespace vf;
+
+/*****************************************************************************/
+/*                                      Utility                              */
+/*****************************************************************************/
+
+static std::shared_ptr<vf::ByteCode> Compile(const char * pSource)
+{
+    std::shared_ptr<vf::Program>    pProgram;
+    EXPECT_NO_THROW(pProgram = std::make_shared<vf::Program>(pSource));
+    return pProgram->Compile();
+}
+
+static const size_t NumElements = 1001;   /**< several blocks, and a partial one */
+
+/**
+ * c and d are only written, so they are stored with non-temporal stores. b is read and
+ * written, and is always stored through the cache.
+ */
+static const char * pSource =
+    "in vec4        a;"
+    "inout vec4     b;"
+    "out vec4       c;"
+    "out vec4       d;"
+    "uniform float  k;"
+    "void main()"
+    "{"
+    "   c = a * k + b;"
+    "   d = normalize(a - b);"
+    "   b = b * 0.5;"
+    "}";
+
+/**
+ * Executes the program with the streams placed offset floats into their buffers, and returns
+ * the streams b, c and d after each other.
+ */
+static std::vector<float> Execute(std::shared_ptr<vf::ByteCode> bc, vf::Engine_t engine, size_t offset, bool nonTemporal)
+{
+    std::vector<float> a(NumElements * 4 + 4), b(NumElements * 4 + 4), c(NumElements * 4 + 4, 7.0f), d(c);
+    for(size_t i = 0; i < NumElements * 4; ++i) {
+        a[offset + i] = float(i % 17) * 0.25f - 2.0f;
+        b[offset + i] = float(i % 5) + 0.5f;
+    }
+
+    std::vector<uint8_t> mem(64 * 1024);
+    vf::ByteCode_Execution be(bc, &mem[0], mem.size(), vf::Layout_AoS, engine);
+    be.SetRegisterPointer(bc->StreamLocation("a"), &a[offset]);
+    be.SetRegisterPointer(bc->StreamLocation("b"), &b[offset]);
+    be.SetRegisterPointer(bc->StreamLocation("c"), &c[offset]);
+    be.SetRegisterPointer(bc->StreamLocation("d"), &d[offset]);
+    be.SetUniform(bc->UniformLocation("k"), 1.5f);
+    if (!nonTemporal) {
+        EXPECT_EQ(be.SetNonTemporal(bc->StreamLocation("c"), false), vf::Err_Success);
+        EXPECT_EQ(be.SetNonTemporal(bc->StreamLocation("d"), false), vf::Err_Success);
+    }
+    EXPECT_EQ(be.Execute(0, NumElements), vf::Err_Success);
+
+    std::vector<float> result(b.begin() + offset, b.begin() + offset + NumElements * 4);
+    result.insert(result.end(), c.begin() + offset, c.begin() + offset + NumElements * 4);
+    result.insert(result.end(), d.begin() + offset, d.begin() + offset + NumElements * 4);
+    return result;
+}
+
+/*****************************************************************************/
+/*                                      Streaming                            */
+/*****************************************************************************/
+
+/**
+ * The streams that are only written has the same content whether they are stored with
+ * non-temporal stores or not, for aligned and misaligned streams.
+ */
+TEST(Streaming, SameResult)
+{
+    std::shared_ptr<vf::ByteCode> bc = Compile(pSource);
+    ASSERT_NE(bc, nullptr);
+
+    for(size_t engine = 0; engine < 2; ++engine) {
+        for(size_t offset = 0; offset < 2; ++offset) {
+            std::vector<float> cached = Execute(bc, vf::Engine_t(engine), offset, false);
+            std::vector<float> streamed = Execute(bc, vf::Engine_t(engine), offset, true);
+            EXPECT_EQ(memcmp(&cached[0], &streamed[0], cached.size() * sizeof(float)), 0)
+                << "engine " << engine << " offset " << offset;
+        }
+    }
+}
+
+TEST(Streaming, InvalidStream)
+{
+    std::shared_ptr<vf::ByteCode> bc = Compile(pSource);
+    ASSERT_NE(bc, nullptr);
+
+    std::vector<uint8_t> mem(1024);
+    vf::ByteCode_Execution be(bc, &mem[0], mem.size());
+    EXPECT_EQ(be.SetNonTemporal(100, false), vf::Err_InvalidRegister);
+
+    vf::ByteCode_Program program(bc);
+    std::shared_ptr<vf::ByteCode_Context> context = program.CreateContext();
+    EXPECT_EQ(context->SetNonTemporal(bc->StreamLocation("c"), false), vf::Err_Success);
+    EXPECT_EQ(context->SetNonTemporal(100, false), vf::Err_InvalidRegister);
+}
@@ -0,0 +1,179 @@
+#include <intermediate.hpp>
+#include <gtest\gtest.h>
+#include <memory>
+#include <cstring>
+
+using namespace vf;
+
+/*****************************************************************************/
+/*                                      Utility                              */
+/*****************************************************************************/
+
+static std::shared_ptr<vf::ByteCode> Compile(const char * pSource)
+{
+    std::shared_ptr<vf::Program>    pProgram;
+    EXPECT_NO_THROW(pProgram = std::make_shared<vf::Program>(pSource));
+    return pProgram->Compile();
+}
+
+static const size_t NumElements = 10007;   /**< several batches, and a partial one */
+
+static const char * pSource =
+    "inout vec3     pos;"
+    "inout float    age;"
+    "in vec3        vel;"
+    "inout vec2     uv;"
+    "uniform float  dt;"
+    "void main()"
+    "{"
+    "   pos = pos + vel * dt;"
+    "   age = age + dt;"
+    "   uv = uv * age;"
+    "}";
+
+/** A structure whose members are bound as streams, mass is never bound */
+struct Particle
+{
+    float pos[3];
+    float age;
+    float vel[3];
+    float mass;
+    float uv[2];
+};
+
+static std::vector<Particle> Particles()
+{
+    std::vector<Particle> particles(NumElements);
+    for(size_t i = 0; i < NumElements; ++i) {
+        Particle & p = particles[i];
+        for(size_t c = 0; c < 3; ++c) {
+            p.pos[c] = float((i * 7 + c) % 19) - 9.0f;
+            p.vel[c] = float((i * 3 + c) % 5) * 0.5f;
+        }
+        p.age   = float(i % 11);
+        p.mass  = float(i) + 0.5f;
+        p.uv[0] = float(i % 4) * 0.25f;
+        p.uv[1] = 1.0f - p.uv[0];
+    }
+    return particles;
+}
+
+/** Executes the program with the members of the particles copied to packed streams */
+static std::vector<Particle> Execute_Packed(std::shared_ptr<vf::ByteCode> bc, vf::Engine_t engine)
+{
+    std::vector<Particle> particles = Particles();
+    std::vector<vf::Vector4> pos(NumElements), age(NumElements), vel(NumElements), uv(NumElements);
+    for(size_t i = 0; i < NumElements; ++i) {
+        memcpy(&pos[i], particles[i].pos, sizeof(particles[i].pos));
+        memcpy(&vel[i], particles[i].vel, sizeof(particles[i].vel));
+        memcpy(&uv[i], particles[i].uv, sizeof(particles[i].uv));
+        age[i].x = particles[i].age;
+    }
+
+    std::vector<uint8_t> mem(64 * 1024);
+    vf::ByteCode_Execution be(bc, &mem[0], mem.size(), vf::Layout_AoS, engine);
+    be.SetRegisterPointer(bc->StreamLocation("pos"), &pos[0]);
+    be.SetRegisterPointer(bc->StreamLocation("age"), &age[0]);
+    be.SetRegisterPointer(bc->StreamLocation("vel"), &vel[0]);
+    be.SetRegisterPointer(bc->StreamLocation("uv"), &uv[0]);
+    be.SetUniform(bc->UniformLocation("dt"), 0.25f);
+    EXPECT_EQ(be.Execute(0, NumElements), vf::Err_Success);
+
+    for(size_t i = 0; i < NumElements; ++i) {
+        memcpy(particles[i].pos, &pos[i], sizeof(particles[i].pos));
+        memcpy(particles[i].uv, &uv[i], sizeof(particles[i].uv));
+        particles[i].age = age[i].x;
+    }
+    return particles;
+}
+
+/** Executes the program with the members of the particles bound as strided streams */
+static std::vector<Particle> Execute_Strided(std::shared_ptr<vf::ByteCode> bc, vf::Engine_t engine)
+{
+    std::vector<Particle> particles = Particles();
+    std::vector<uint8_t> mem(64 * 1024);
+    vf::ByteCode_Execution be(bc, &mem[0], mem.size(), vf::Layout_AoS, engine);
+    EXPECT_EQ(be.SetRegisterPointer(bc->StreamLocation("pos"), particles[0].pos, sizeof(Particle), 3), vf::Err_Success);
+    EXPECT_EQ(be.SetRegisterPointer(bc->StreamLocation("age"), &particles[0].age, sizeof(Particle), 1), vf::Err_Success);
+    EXPECT_EQ(be.SetRegisterPointer(bc->StreamLocation("vel"), particles[0].vel, sizeof(Particle), 3), vf::Err_Success);
+    EXPECT_EQ(be.SetRegisterPointer(bc->StreamLocation("uv"), particles[0].uv, sizeof(Particle), 2), vf::Err_Success);
+    be.SetUniform(bc->UniformLocation("dt"), 0.25f);
+    EXPECT_EQ(be.Execute(0, NumElements), vf::Err_Success);
+    return particles;
+}
+
+/*****************************************************************************/
+/*                                      Strided                              */
+/*****************************************************************************/
+
+/**
+ * Members of a structure bound as strided streams gets the same result as packed streams, and
+ * the members that aren't bound are left as they are.
+ */
+TEST(Strided, SameResult)
+{
+    std::shared_ptr<vf::ByteCode> bc = Compile(pSource);
+    ASSERT_NE(bc, nullptr);
+
+    for(size_t engine = 0; engine < 2; ++engine) {
+        std::vector<Particle> expected = Execute_Packed(bc, vf::Engine_t(engine));
+        std::vector<Particle> result = Execute_Strided(bc, vf::Engine_t(engine));
+        EXPECT_EQ(memcmp(&expected[0], &result[0], NumElements * sizeof(Particle)), 0) << "engine " << engine;
+    }
+}
+
+/**
+ * Ranges executed with scratch memory of their own, which holds the packed elements of the
+ * strided streams as well as the temporaries.
+ */
+TEST(Strided, Ranges)
+{
+    std::shared_ptr<vf::ByteCode> bc = Compile(pSource);
+    ASSERT_NE(bc, nullptr);
+
+    std::vector<Particle> expected = Execute_Packed(bc, vf::Engine_Interpreter);
+    std::vector<Particle> particles = Particles();
+    std::vector<uint8_t> mem(64 * 1024);
+    vf::ByteCode_Execution be(bc, &mem[0], mem.size());
+    size_t packed = be.GetScratchSize(100);
+    be.SetRegisterPointer(bc->StreamLocation("pos"), particles[0].pos, sizeof(Particle), 3);
+    be.SetRegisterPointer(bc->StreamLocation("age"), &particles[0].age, sizeof(Particle), 1);
+    be.SetRegisterPointer(bc->StreamLocation("vel"), particles[0].vel, sizeof(Particle), 3);
+    be.SetRegisterPointer(bc->StreamLocation("uv"), particles[0].uv, sizeof(Particle), 2);
+    be.SetUniform(bc->UniformLocation("dt"), 0.25f);
+    EXPECT_EQ(be.GetScratchSize(100), packed + (100 * 4 * sizeof(vf::Vector4)));
+
+    const size_t NumRanges = 4;
+    std::vector<uint8_t> scratch(be.GetScratchSize(100));
+    for(size_t i = 0; i < NumRanges; ++i) {
+        size_t begin = (NumElements * i) / NumRanges, end = (NumElements * (i + 1)) / NumRanges;
+        EXPECT_EQ(be.Execute(0, begin, end - begin, &scratch[0], scratch.size()), vf::Err_Success);
+    }
+    EXPECT_EQ(memcmp(&expected[0], &particles[0], NumElements * sizeof(Particle)), 0);
+}
+
+TEST(Strided, InvalidStride)
+{
+    std::shared_ptr<vf::ByteCode> bc = Compile(pSource);
+    ASSERT_NE(bc, nullptr);
+
+    Particle particle;
+    std::vector<uint8_t> mem(1024);
+    vf::ByteCode_Execution be(bc, &mem[0], mem.size());
+    int pos = bc->StreamLocation("pos");
+    EXPECT_EQ(be.SetRegisterPointer(pos, particle.pos, 8, 3), vf::Err_InvalidParameter);
+    EXPECT_EQ(be.SetRegisterPointer(pos, particle.pos, 14, 3), vf::Err_InvalidParameter);
+    EXPECT_EQ(be.SetRegisterPointer(pos, particle.pos, sizeof(Particle), 0), vf::Err_InvalidParameter);
+    EXPECT_EQ(be.SetRegisterPointer(pos, particle.pos, sizeof(Particle), 5), vf::Err_InvalidParameter);
+    EXPECT_EQ(be.SetRegisterPointer(100, particle.pos, sizeof(Particle), 3), vf::Err_InvalidRegister);
+    EXPECT_EQ(be.SetRegisterPointer(bc->GetNumRegisters(), particle.pos, sizeof(Particle), 3), vf::Err_InvalidRegister);
+    EXPECT_EQ(be.SetRegisterPointer(pos, particle.pos, 12, 3), vf::Err_Success);
+
+    vf::ByteCode_Execution soa(bc, &mem[0], mem.size(), vf::Layout_SoA);
+    EXPECT_EQ(soa.SetRegisterPointer(pos, particle.pos, sizeof(Particle), 3), vf::Err_InvalidParameter);
+
+    vf::ByteCode_Program program(bc);
+    std::shared_ptr<vf::ByteCode_Context> context = program.CreateContext();
+    EXPECT_EQ(context->SetRegisterPointer(pos, particle.pos, sizeof(Particle), 3), vf::Err_Success);
+    EXPECT_EQ(context->SetRegisterPointer(pos, particle.pos, 8, 3), vf::Err_InvalidParameter);
+}
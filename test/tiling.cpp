@@ -0,0 +1,105 @@
+#include <intermediate.hpp>
+#include <gtest\gtest.h>
+#include <memory>
+
+using namespace vf;
+
+/*****************************************************************************/
+/*                                      Utility                              */
+/*****************************************************************************/
+
+static std::shared_ptr<vf::ByteCode> Compile(const char * pSource)
+{
+    std::shared_ptr<vf::Program>    pProgram;
+    EXPECT_NO_THROW(pProgram = std::make_shared<vf::Program>(pSource));
+    return pProgram->Compile();
+}
+
+static const size_t NumElements = 20000;
+
+static const char * pSource =
+    "in vec4    a;"
+    "out vec4   c;"
+    "void main()"
+    "{"
+    "   vec4 t = a * 0.5 + normalize(a);"
+    "   c = t * dot(t, a) - a;"
+    "}";
+
+/**
+ * Executes the program a number of times with the specified tiling, and returns the output stream.
+ */
+static std::vector<vf::Vector4> Execute(std::shared_ptr<vf::ByteCode> bc, vf::Layout_t layout, vf::Tiling_t tiling)
+{
+    std::vector<vf::Vector4> a(NumElements), c(NumElements);
+    for(size_t i = 0; i < NumElements; ++i) {
+        a[i].x = float(i % 17) - 8.0f;
+        a[i].y = float(i % 5) + 0.25f;
+        a[i].z = -float(i % 3) - 1.0f;
+        a[i].w = 2.0f;
+    }
+
+    std::vector<uint8_t> mem(1024 * 1024);
+    vf::ByteCode_Execution be(bc, &mem[0], mem.size(), layout);
+    EXPECT_EQ(be.SetTiling(tiling), vf::Err_Success);
+    if (layout == vf::Layout_AoS) {
+        be.SetRegisterPointer(bc->StreamLocation("a"), (float *) &a[0]);
+        be.SetRegisterPointer(bc->StreamLocation("c"), (float *) &c[0]);
+    } else {
+        std::vector<float> planes(NumElements * 8);
+        const float * pSrc = (const float *) &a[0];
+        for(size_t i = 0; i < NumElements; ++i) {
+            for(size_t k = 0; k < 4; ++k) {
+                planes[k * NumElements + i] = pSrc[i * 4 + k];
+            }
+        }
+        float * pa = &planes[0], * pc = &planes[4 * NumElements];
+        be.SetComponentPointers(bc->StreamLocation("a"), pa, pa + NumElements, pa + 2 * NumElements, pa + 3 * NumElements);
+        be.SetComponentPointers(bc->StreamLocation("c"), pc, pc + NumElements, pc + 2 * NumElements, pc + 3 * NumElements);
+        EXPECT_EQ(be.Execute(0, NumElements), vf::Err_Success);
+        float * pDst = (float *) &c[0];
+        for(size_t i = 0; i < NumElements; ++i) {
+            for(size_t k = 0; k < 4; ++k) {
+                pDst[i * 4 + k] = pc[k * NumElements + i];
+            }
+        }
+        return c;
+    }
+    for(size_t i = 0; i < 20; ++i) {
+        EXPECT_EQ(be.Execute(0, NumElements), vf::Err_Success);
+    }
+    return c;
+}
+
+static void ExpectNear(const std::vector<vf::Vector4> & expected, const std::vector<vf::Vector4> & actual)
+{
+    const float * pExpected = (const float *) &expected[0], * pActual = (const float *) &actual[0];
+    for(size_t i = 0; i < NumElements * 4; ++i) {
+        EXPECT_FLOAT_EQ(pExpected[i], pActual[i]) << "element " << (i / 4);
+    }
+}
+
+/*****************************************************************************/
+/*                                      Tiling                               */
+/*****************************************************************************/
+
+TEST(Tiling, SameResult)
+{
+    std::shared_ptr<vf::ByteCode> bc = Compile(pSource);
+    ASSERT_NE(bc, nullptr);
+
+    std::vector<vf::Vector4> expected = Execute(bc, vf::Layout_AoS, vf::Tiling_Memory);
+    ExpectNear(expected, Execute(bc, vf::Layout_AoS, vf::Tiling_Cache));
+    ExpectNear(expected, Execute(bc, vf::Layout_AoS, vf::Tiling_Autotune));
+    ExpectNear(expected, Execute(bc, vf::Layout_SoA, vf::Tiling_Cache));
+}
+
+TEST(Tiling, InvalidTiling)
+{
+    std::shared_ptr<vf::ByteCode> bc = Compile(pSource);
+    ASSERT_NE(bc, nullptr);
+
+    uint8_t mem[1024];
+    vf::ByteCode_Execution be(bc, mem, sizeof(mem));
+    EXPECT_EQ(be.SetTiling(static_cast<vf::Tiling_t>(17)), vf::Err_InvalidParameter);
+}
@@ -0,0 +1,131 @@
+#include <intermediate.hpp>
+#include <gtest\gtest.h>
+#include <memory>
+
+using namespace vf;
+
+/*****************************************************************************/
+/*                                      Utility                              */
+/*****************************************************************************/
+
+static std::shared_ptr<vf::ByteCode> Compile(const char * pSource)
+{
+    std::shared_ptr<vf::Program>    pProgram;
+    EXPECT_NO_THROW(pProgram = std::make_shared<vf::Program>(pSource));
+    return pProgram->Compile();
+}
+
+/**
+ * Creates bytecode with a single method, the streams a (register 0) and c (register 1), and
+ * no uniforms or samplers.
+ */
+static std::shared_ptr<vf::ByteCode> Make_ByteCode(const std::vector<uint32_t> & code)
+{
+    std::map<std::string, vf::Variable> io, uniforms, samplers;
+    vf::Variable stream = vf::Variable();
+    stream.m_Type       = vf::Type_Vec4;
+    stream.m_Register   = 0;
+    io["a"] = stream;
+    stream.m_Register   = 1;
+    io["c"] = stream;
+
+    std::vector<std::shared_ptr<vf::ByteCode_Method> > methods;
+    methods.push_back(std::make_shared<vf::ByteCode_Method>("main"));
+    for(size_t i = 0; i < code.size(); ++i) {
+        methods[0]->emit(code[i]);
+    }
+    return std::make_shared<vf::ByteCode>(2, io, uniforms, samplers, methods);
+}
+
+/** Executes bytecode with both streams bound in a layout, and returns the status */
+static vf::Status_t Execute(std::shared_ptr<vf::ByteCode> bc, vf::Layout_t layout)
+{
+    std::vector<vf::Vector4> a(16), c(16);
+    uint8_t mem[1024];
+    vf::ByteCode_Execution be(bc, mem, sizeof(mem), layout);
+    if (layout == vf::Layout_AoS) {
+        be.SetRegisterPointer(0, &a[0]);
+        be.SetRegisterPointer(1, &c[0]);
+    } else {
+        be.SetComponentPointers(0, &a[0].x, &a[4].x, &a[8].x, &a[12].x);
+        be.SetComponentPointers(1, &c[0].x, &c[4].x, &c[8].x, &c[12].x);
+    }
+    return be.Execute(0, 4);
+}
+
+static const vf::Layout_t Layouts[] = { vf::Layout_AoS, vf::Layout_SoA };
+
+/*****************************************************************************/
+/*                                      Verify                               */
+/*****************************************************************************/
+
+TEST(Verify, ValidBytecode)
+{
+    std::vector<uint32_t> code;
+    code.push_back(Make_Opcode(OP_VECTOR4_ADD_RR)|Make_Destination(Make_Register(1,0))|Make_FirstOperand(Make_Register(0,0)) |
+        Make_SecondOperand(Make_Register(0,0)));
+    for(size_t i = 0; i < 2; ++i) {
+        EXPECT_EQ(Execute(Make_ByteCode(code), Layouts[i]), vf::Err_Success);
+    }
+}
+
+TEST(Verify, InvalidRegister)
+{
+    std::vector<uint32_t> code;
+    code.push_back(Make_Opcode(OP_VECTOR4_ADD_RR)|Make_Destination(Make_Register(5,0))|Make_FirstOperand(Make_Register(0,0)) |
+        Make_SecondOperand(Make_Register(0,0)));
+    for(size_t i = 0; i < 2; ++i) {
+        EXPECT_EQ(Execute(Make_ByteCode(code), Layouts[i]), vf::Err_InvalidBytecode);
+    }
+}
+
+TEST(Verify, InvalidUniform)
+{
+    std::vector<uint32_t> code;
+    code.push_back(Make_Opcode(OP_VECTOR4_ADD_RC)|Make_Destination(Make_Register(1,0))|Make_FirstOperand(Make_Register(0,0)) |
+        Make_SecondOperand(Make_Register(0,0)));
+    for(size_t i = 0; i < 2; ++i) {
+        EXPECT_EQ(Execute(Make_ByteCode(code), Layouts[i]), vf::Err_InvalidBytecode);
+    }
+}
+
+TEST(Verify, TruncatedConstant)
+{
+    std::vector<uint32_t> code;
+    float value = 1.0f;
+    code.push_back(Make_Opcode(OP_VECTOR4_ADD_RC)|Make_Destination(Make_Register(1,0))|Make_FirstOperand(Make_Register(0,0)) |
+        Make_SecondOperand(0xff));
+    code.push_back(*((uint32_t *)&value));
+    code.push_back(*((uint32_t *)&value));
+    for(size_t i = 0; i < 2; ++i) {
+        EXPECT_EQ(Execute(Make_ByteCode(code), Layouts[i]), vf::Err_InvalidBytecode);
+    }
+}
+
+TEST(Verify, UnboundStream)
+{
+    std::shared_ptr<vf::ByteCode> bc = Compile(
+        "in vec4    a;"
+        "out vec4   c;"
+        "void main()"
+        "{"
+        "   c = a * 2.0;"
+        "}");
+    ASSERT_NE(bc, nullptr);
+
+    std::vector<vf::Vector4> a(16), c(16);
+    uint8_t mem[1024];
+    vf::ByteCode_Execution aos(bc, mem, sizeof(mem), vf::Layout_AoS);
+    aos.SetRegisterPointer(bc->StreamLocation("a"), &a[0]);
+    EXPECT_EQ(aos.Execute(0, 16), vf::Err_UnassignedRegisterPointer);
+    aos.SetRegisterPointer(bc->StreamLocation("c"), &c[0]);
+    EXPECT_EQ(aos.Execute(0, 16), vf::Err_Success);
+
+    // Only the components that are referenced has to be bound.
+    vf::ByteCode_Execution soa(bc, mem, sizeof(mem), vf::Layout_SoA);
+    soa.SetComponentPointers(bc->StreamLocation("a"), &a[0].x, &a[4].x, &a[8].x, &a[12].x);
+    soa.SetComponentPointers(bc->StreamLocation("c"), &c[0].x, &c[4].x, &c[8].x);
+    EXPECT_EQ(soa.Execute(0, 4), vf::Err_UnassignedRegisterPointer);
+    soa.SetComponentPointers(bc->StreamLocation("c"), &c[0].x, &c[4].x, &c[8].x, &c[12].x);
+    EXPECT_EQ(soa.Execute(0, 4), vf::Err_Success);
+}